@@ -94,6 +94,7 @@ AppConfig load_app_config(const std::string& path){
   // Prefilter configuration
   if (auto p = y["prefilter"]) {
     if (p["enabled"]) cfg.prefilter.enabled = p["enabled"].as<bool>(cfg.prefilter.enabled);
+    if (p["scan_stage"]) cfg.prefilter.scan_stage = p["scan_stage"].as<bool>(cfg.prefilter.scan_stage);
     
     // Neighborhood filter
     if (auto n = p["neighborhood"]) {
@@ -131,6 +132,18 @@ AppConfig load_app_config(const std::string& path){
       if (iso["min_cluster_size"]) cfg.prefilter.isolation_removal.min_cluster_size = std::max(1, iso["min_cluster_size"].as<int>(cfg.prefilter.isolation_removal.min_cluster_size));
       if (iso["isolation_radius"]) cfg.prefilter.isolation_removal.isolation_radius = std::max(0.001f, iso["isolation_radius"].as<float>(cfg.prefilter.isolation_removal.isolation_radius));
     }
+    
+    // Temporal persistence filter
+    if (auto tp = p["temporal_persistence"]) {
+      auto& t = cfg.prefilter.temporal_persistence;
+      if (tp["enabled"])        t.enabled        = tp["enabled"].as<bool>(t.enabled);
+      if (tp["history_frames"]) t.history_frames = std::clamp(tp["history_frames"].as<int>(t.history_frames), 1, 64);
+      if (tp["min_hits"])       t.min_hits       = std::max(1, tp["min_hits"].as<int>(t.min_hits));
+      if (tp["cell_size"])      t.cell_size      = std::max(0.01f, tp["cell_size"].as<float>(t.cell_size));
+      if (tp["extent"])         t.extent         = std::max(0.1f, tp["extent"].as<float>(t.extent));
+      if (tp["dilate"])         t.dilate         = tp["dilate"].as<bool>(t.dilate);
+      t.min_hits = std::min(t.min_hits, t.history_frames);
+    }
   }
 
   // Postfilter configuration
@@ -146,6 +159,43 @@ AppConfig load_app_config(const std::string& path){
     }
   }
 
+  // Voxel downsampling
+  if (auto v = y["voxel"]) {
+    if (v["enabled"])            cfg.voxel.enabled            = v["enabled"].as<bool>(cfg.voxel.enabled);
+    if (v["resolution"])         cfg.voxel.resolution         = std::max(0.001f, v["resolution"].as<float>(cfg.voxel.resolution));
+    if (v["publish_resolution"]) cfg.voxel.publish_resolution = std::max(0.0f, v["publish_resolution"].as<float>(cfg.voxel.publish_resolution));
+  }
+
+  // Frame budget
+  if (auto fb = y["frame_budget"]) {
+    auto& b = cfg.frame_budget;
+    if (fb["enabled"])          b.enabled          = fb["enabled"].as<bool>(b.enabled);
+    if (fb["budget_ms"])        b.budget_ms        = std::max(1.0f, fb["budget_ms"].as<float>(b.budget_ms));
+    if (fb["recover_ratio"])    b.recover_ratio    = std::clamp(fb["recover_ratio"].as<float>(b.recover_ratio), 0.1f, 1.0f);
+    if (fb["recover_frames"])   b.recover_frames   = std::max(1, fb["recover_frames"].as<int>(b.recover_frames));
+    if (fb["order"] && fb["order"].IsSequence()) b.order = fb["order"].as<std::vector<std::string>>();
+    if (fb["voxel_resolution"]) b.voxel_resolution = std::max(0.001f, fb["voxel_resolution"].as<float>(b.voxel_resolution));
+    if (fb["raw_sink_divisor"]) b.raw_sink_divisor = std::max(1, fb["raw_sink_divisor"].as<int>(b.raw_sink_divisor));
+  }
+
+  // Real-time scheduling profile
+  if (auto rt = y["realtime"]) {
+    auto loadProfile = [](const YAML::Node& n, ThreadProfileConfig& p) {
+      if (!n) return;
+      if (n["cpus"] && n["cpus"].IsSequence()) p.cpus = n["cpus"].as<std::vector<int>>();
+      if (n["priority"]) p.priority = std::clamp(n["priority"].as<int>(p.priority), 0, 99);
+    };
+    if (rt["enabled"])           cfg.realtime.enabled           = rt["enabled"].as<bool>(cfg.realtime.enabled);
+    if (rt["lock_memory"])       cfg.realtime.lock_memory       = rt["lock_memory"].as<bool>(cfg.realtime.lock_memory);
+    if (rt["prefault_heap_mb"])  cfg.realtime.prefault_heap_mb  = std::max(0, rt["prefault_heap_mb"].as<int>(cfg.realtime.prefault_heap_mb));
+    if (rt["jitter_report_sec"]) cfg.realtime.jitter_report_sec = std::max(0, rt["jitter_report_sec"].as<int>(cfg.realtime.jitter_report_sec));
+    loadProfile(rt["fusion"], cfg.realtime.fusion);
+    loadProfile(rt["sensor_rx"], cfg.realtime.sensor_rx);
+    loadProfile(rt["workers"], cfg.realtime.workers);
+    loadProfile(rt["io"], cfg.realtime.io);
+    loadProfile(rt["shadow"], cfg.realtime.shadow);
+  }
+
   if (auto u = y["ui"]) {
     if (u["listen"])   cfg.ui.listen   = u["listen"].as<std::string>(cfg.ui.listen);
   }
@@ -159,6 +209,8 @@ AppConfig load_app_config(const std::string& path){
 
   // World mask configuration
   if (auto wm = y["world_mask"]) {
+    if (wm["resolution"]) cfg.world_mask.resolution = wm["resolution"].as<double>(cfg.world_mask.resolution);
+    if (wm["apply_at_ingest"]) cfg.world_mask.apply_at_ingest = wm["apply_at_ingest"].as<bool>(cfg.world_mask.apply_at_ingest);
     if (auto inc = wm["include"]) {
       for (const auto& polyNode : inc) {
         core::Polygon poly;
@@ -187,6 +239,7 @@ AppConfig load_app_config(const std::string& path){
       if (sn["cluster_topic"]) sc.cluster_topic = sn["cluster_topic"].as<std::string>(sc.cluster_topic);
       if (sn["raw_topic"])     sc.raw_topic     = sn["raw_topic"].as<std::string>(sc.raw_topic);
       if (sn["rate_limit"])    sc.rate_limit    = sn["rate_limit"].as<int>(0);
+      if (sn["queue_depth"])   sc.queue_depth   = std::max(1, sn["queue_depth"].as<int>(sc.queue_depth));
       if (sn["send_clusters"]) sc.send_clusters = sn["send_clusters"].as<bool>(sc.send_clusters);
       if (sn["send_raw"])      sc.send_raw      = sn["send_raw"].as<bool>(sc.send_raw);
 
@@ -201,6 +254,14 @@ AppConfig load_app_config(const std::string& path){
         if (sn["in_bundle"]) sc.osc().in_bundle = sn["in_bundle"].as<bool>(false);
         if (sn["bundle_fragment_size"]) sc.osc().bundle_fragment_size = sn["bundle_fragment_size"].as<int>(0);
       }
+      if(type == "shm") {
+        sc.cfg = ShmConfig{};
+        if (sn["url"])          sc.shm().url          = sn["url"].as<std::string>(sc.shm().url);
+        if (sn["slots"])        sc.shm().slots        = static_cast<uint32_t>(std::max(2, sn["slots"].as<int>(8)));
+        if (sn["max_clusters"]) sc.shm().max_clusters = static_cast<uint32_t>(std::max(1, sn["max_clusters"].as<int>(1024)));
+        if (sn["max_points"])   sc.shm().max_points   = static_cast<uint32_t>(std::max(1, sn["max_points"].as<int>(16384)));
+        if (sn["force"])        sc.shm().force        = sn["force"].as<bool>(false);
+      }
 
       cfg.sinks.push_back(std::move(sc));
     }
@@ -262,6 +323,7 @@ std::string dump_app_config(const AppConfig& cfg) {
   // Prefilter
   out << YAML::Key << "prefilter" << YAML::Value << YAML::BeginMap;
   out << YAML::Key << "enabled" << YAML::Value << cfg.prefilter.enabled;
+  out << YAML::Key << "scan_stage" << YAML::Value << cfg.prefilter.scan_stage;
   
   out << YAML::Key << "neighborhood" << YAML::Value << YAML::BeginMap;
   out << YAML::Key << "enabled" << YAML::Value << cfg.prefilter.neighborhood.enabled;
@@ -295,6 +357,15 @@ std::string dump_app_config(const AppConfig& cfg) {
   out << YAML::Key << "isolation_radius" << YAML::Value << cfg.prefilter.isolation_removal.isolation_radius;
   out << YAML::EndMap;
   
+  out << YAML::Key << "temporal_persistence" << YAML::Value << YAML::BeginMap;
+  out << YAML::Key << "enabled" << YAML::Value << cfg.prefilter.temporal_persistence.enabled;
+  out << YAML::Key << "history_frames" << YAML::Value << cfg.prefilter.temporal_persistence.history_frames;
+  out << YAML::Key << "min_hits" << YAML::Value << cfg.prefilter.temporal_persistence.min_hits;
+  out << YAML::Key << "cell_size" << YAML::Value << cfg.prefilter.temporal_persistence.cell_size;
+  out << YAML::Key << "extent" << YAML::Value << cfg.prefilter.temporal_persistence.extent;
+  out << YAML::Key << "dilate" << YAML::Value << cfg.prefilter.temporal_persistence.dilate;
+  out << YAML::EndMap;
+  
   out << YAML::EndMap;
 
   // Postfilter
@@ -310,6 +381,43 @@ std::string dump_app_config(const AppConfig& cfg) {
   
   out << YAML::EndMap;
 
+  // Voxel downsampling
+  out << YAML::Key << "voxel" << YAML::Value << YAML::BeginMap;
+  out << YAML::Key << "enabled" << YAML::Value << cfg.voxel.enabled;
+  out << YAML::Key << "resolution" << YAML::Value << cfg.voxel.resolution;
+  out << YAML::Key << "publish_resolution" << YAML::Value << cfg.voxel.publish_resolution;
+  out << YAML::EndMap;
+
+  // Frame budget
+  out << YAML::Key << "frame_budget" << YAML::Value << YAML::BeginMap;
+  out << YAML::Key << "enabled" << YAML::Value << cfg.frame_budget.enabled;
+  out << YAML::Key << "budget_ms" << YAML::Value << cfg.frame_budget.budget_ms;
+  out << YAML::Key << "recover_ratio" << YAML::Value << cfg.frame_budget.recover_ratio;
+  out << YAML::Key << "recover_frames" << YAML::Value << cfg.frame_budget.recover_frames;
+  out << YAML::Key << "order" << YAML::Value << YAML::Flow << cfg.frame_budget.order;
+  out << YAML::Key << "voxel_resolution" << YAML::Value << cfg.frame_budget.voxel_resolution;
+  out << YAML::Key << "raw_sink_divisor" << YAML::Value << cfg.frame_budget.raw_sink_divisor;
+  out << YAML::EndMap;
+
+  // Real-time scheduling profile
+  auto dumpProfile = [&out](const char* key, const ThreadProfileConfig& p) {
+    out << YAML::Key << key << YAML::Value << YAML::BeginMap;
+    out << YAML::Key << "cpus" << YAML::Value << YAML::Flow << p.cpus;
+    out << YAML::Key << "priority" << YAML::Value << p.priority;
+    out << YAML::EndMap;
+  };
+  out << YAML::Key << "realtime" << YAML::Value << YAML::BeginMap;
+  out << YAML::Key << "enabled" << YAML::Value << cfg.realtime.enabled;
+  out << YAML::Key << "lock_memory" << YAML::Value << cfg.realtime.lock_memory;
+  out << YAML::Key << "prefault_heap_mb" << YAML::Value << cfg.realtime.prefault_heap_mb;
+  out << YAML::Key << "jitter_report_sec" << YAML::Value << cfg.realtime.jitter_report_sec;
+  dumpProfile("fusion", cfg.realtime.fusion);
+  dumpProfile("sensor_rx", cfg.realtime.sensor_rx);
+  dumpProfile("workers", cfg.realtime.workers);
+  dumpProfile("io", cfg.realtime.io);
+  dumpProfile("shadow", cfg.realtime.shadow);
+  out << YAML::EndMap;
+
   // UI
   out << YAML::Key << "ui" << YAML::Value << YAML::BeginMap;
   out << YAML::Key << "listen" << YAML::Value << cfg.ui.listen;
@@ -322,6 +430,8 @@ std::string dump_app_config(const AppConfig& cfg) {
 
   // World mask
   out << YAML::Key << "world_mask" << YAML::Value << YAML::BeginMap;
+  out << YAML::Key << "resolution" << YAML::Value << cfg.world_mask.resolution;
+  out << YAML::Key << "apply_at_ingest" << YAML::Value << cfg.world_mask.apply_at_ingest;
   
   auto emitPolygons = [&](const char* key, const std::vector<core::Polygon>& polys) {
     out << YAML::Key << key << YAML::Value << YAML::BeginSeq;
@@ -355,10 +465,19 @@ std::string dump_app_config(const AppConfig& cfg) {
       out << YAML::Key << "type" << YAML::Value << "nng";
       out << YAML::Key << "url" << YAML::Value << cfg.url;
       out << YAML::Key << "encoding" << YAML::Value << cfg.encoding;
+    } else if (sink.isShm()) {
+      const auto& scfg = sink.shm();
+      out << YAML::Key << "type" << YAML::Value << "shm";
+      out << YAML::Key << "url" << YAML::Value << scfg.url;
+      out << YAML::Key << "slots" << YAML::Value << scfg.slots;
+      out << YAML::Key << "max_clusters" << YAML::Value << scfg.max_clusters;
+      out << YAML::Key << "max_points" << YAML::Value << scfg.max_points;
+      out << YAML::Key << "force" << YAML::Value << scfg.force;
     }
     out << YAML::Key << "cluster_topic" << YAML::Value << sink.cluster_topic;
     out << YAML::Key << "raw_topic" << YAML::Value << sink.raw_topic;
     out << YAML::Key << "rate_limit" << YAML::Value << sink.rate_limit;
+    out << YAML::Key << "queue_depth" << YAML::Value << sink.queue_depth;
     out << YAML::Key << "send_clusters" << YAML::Value << sink.send_clusters;
     out << YAML::Key << "send_raw" << YAML::Value << sink.send_raw;
     out << YAML::EndMap;
@@ -59,21 +59,33 @@ struct OscConfig {
   uint64_t bundle_fragment_size{1200}; // Fragment size for OSC bundle (default: safe for typical MTU)
 };
 
+struct ShmConfig {
+  std::string url{"shm://hokuyohub"};   // POSIX shm object name ("/hokuyohub")
+  uint32_t slots{8};                    // ring depth per channel
+  uint32_t max_clusters{1024};          // per-slot capacity (clusters)
+  uint32_t max_points{16384};           // per-slot capacity (raw points)
+  bool     force{false};                // unlink an existing segment of the same name on start
+};
+
 struct SinkConfig {
   std::string cluster_topic{"/hokuyohub/cluster"};
   std::string raw_topic{"/hokuyohub/raw"};
   int         rate_limit{0};
+  int         queue_depth{2};   // per-sink worker queue (latest-wins, oldest frame dropped)
   bool send_clusters{true};
   bool send_raw{false};
 
-  std::variant<OscConfig, NngConfig> cfg{OscConfig{}};
+  std::variant<OscConfig, NngConfig, ShmConfig> cfg{OscConfig{}};
 
   bool isOsc() const { return std::holds_alternative<OscConfig>(cfg); }
   bool isNng() const { return std::holds_alternative<NngConfig>(cfg); }
+  bool isShm() const { return std::holds_alternative<ShmConfig>(cfg); }
   OscConfig& osc() { return std::get<OscConfig>(cfg); }
   NngConfig& nng() { return std::get<NngConfig>(cfg); }
+  ShmConfig& shm() { return std::get<ShmConfig>(cfg); }
   const OscConfig& osc() const { return std::get<OscConfig>(cfg); }
   const NngConfig& nng() const { return std::get<NngConfig>(cfg); }
+  const ShmConfig& shm() const { return std::get<ShmConfig>(cfg); }
 };
 
 struct DbscanConfig {
@@ -91,6 +103,7 @@ struct DbscanConfig {
 
 struct PrefilterConfig {
     bool enabled{true};
+    bool scan_stage{false};          // spike/outlier/intensity をセンサー取り込み時にステップ順で適用
     
     // Strategy 1: Neighborhood count filter
     struct {
@@ -128,6 +141,16 @@ struct PrefilterConfig {
         int min_cluster_size{3};     // Minimum points to keep a cluster
         float isolation_radius{0.1f}; // Radius to check for isolation
     } isolation_removal;
+
+    // Strategy 6: Multi-frame temporal persistence (occupancy history on a fixed world grid)
+    struct {
+        bool enabled{false};
+        int history_frames{5};       // K: frames of occupancy history (1-64)
+        int min_hits{3};             // M: frames (incl. the current one) a cell must be occupied in
+        float cell_size{0.1f};       // Grid cell size [m]
+        float extent{20.0f};         // Grid half-width around the world origin [m]; points outside pass
+        bool dilate{true};           // Count a hit if any cell of the 3x3 neighborhood was occupied
+    } temporal_persistence;
 };
 
 struct PostfilterConfig {
@@ -148,6 +171,43 @@ struct PostfilterConfig {
     // } future_strategy;
 };
 
+// Voxel-grid downsampling between the world mask and DBSCAN
+struct VoxelConfig {
+    bool enabled{false};
+    float resolution{0.02f};          // Voxel size for detection [m]
+    float publish_resolution{0.0f};   // Voxel size for raw points sent to sinks/UI [m] (0 = as-is)
+};
+
+// Frame budget: degrade the detection pipeline in order when a frame is projected to overrun
+struct FrameBudgetConfig {
+    bool enabled{false};
+    float budget_ms{25.0f};           // Target processing time per frame [ms] (fusion period is 33.3 ms)
+    float recover_ratio{0.7f};        // Lift a degradation when the lighter level projects below ratio * budget
+    int recover_frames{30};           // ...for this many consecutive frames
+    std::vector<std::string> order{"ui_points", "prefilter", "voxel", "raw_sink_rate"};
+    float voxel_resolution{0.05f};    // Voxel size used by the "voxel" degradation [m]
+    int raw_sink_divisor{3};          // "raw_sink_rate": raw points go to sinks every N-th frame
+};
+
+// Real-time scheduling profile for one thread role
+struct ThreadProfileConfig {
+    std::vector<int> cpus;            // CPU cores to pin to (empty = no pinning)
+    int priority{0};                  // 1-99: SCHED_FIFO priority, 0 = default scheduler
+};
+
+// Real-time scheduling profile (Linux; ignored elsewhere). Missing privileges only log a warning.
+struct RealtimeConfig {
+    bool enabled{false};
+    bool lock_memory{false};          // mlockall(MCL_CURRENT | MCL_FUTURE)
+    int prefault_heap_mb{0};          // Heap pre-faulted and kept resident when lock_memory is set [MiB]
+    int jitter_report_sec{10};        // Interval of the fusion tick-jitter log [s] (0 = off)
+    ThreadProfileConfig fusion;       // Fusion + detection thread
+    ThreadProfileConfig sensor_rx;    // Sensor receive threads (urg_c driver / SCIP reactor)
+    ThreadProfileConfig workers;      // Fusion worker pool
+    ThreadProfileConfig io;           // Crow HTTP/WebSocket threads
+    ThreadProfileConfig shadow;       // Shadow (A/B) detection pipeline (always runs at nice +10)
+};
+
 struct SecurityConfig {
   std::string api_token; // empty => auth disabled
 };
@@ -162,6 +222,9 @@ struct AppConfig {
   DbscanConfig dbscan{};
   PrefilterConfig prefilter{};
   PostfilterConfig postfilter{};
+  VoxelConfig voxel{};
+  FrameBudgetConfig frame_budget{};
+  RealtimeConfig realtime{};
   UiConfig ui{};
   std::vector<SinkConfig> sinks;
   SecurityConfig security{};
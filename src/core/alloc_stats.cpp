@@ -0,0 +1,177 @@
+#include "alloc_stats.h"
+
+#ifdef HOKUYO_ALLOC_STATS
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#endif
+
+namespace alloc_stats {
+
+namespace {
+  constexpr size_t kStages = static_cast<size_t>(Stage::kCount);
+
+  const char* stageName(Stage s) {
+    switch (s) {
+      case Stage::Other:      return "other";
+      case Stage::Ingest:     return "ingest";
+      case Stage::Ui:         return "ui";
+      case Stage::Prefilter:  return "prefilter";
+      case Stage::Voxel:      return "voxel";
+      case Stage::Dbscan:     return "dbscan";
+      case Stage::Postfilter: return "postfilter";
+      case Stage::Publish:    return "publish";
+      case Stage::Sinks:      return "sinks";
+      case Stage::kCount:     break;
+    }
+    return "?";
+  }
+
+#ifdef HOKUYO_ALLOC_STATS
+  constexpr size_t kLargeCopyBytes = 4096;   // noteCopy() 以上のサイズを "large" として別に数える
+
+  struct Counters {
+    uint64_t allocs{0}, bytes{0}, copies{0}, copy_bytes{0}, large_copies{0};
+
+    Counters& operator+=(const Counters& o) {
+      allocs += o.allocs; bytes += o.bytes; copies += o.copies;
+      copy_bytes += o.copy_bytes; large_copies += o.large_copies;
+      return *this;
+    }
+    Counters operator-(const Counters& o) const {
+      return {allocs - o.allocs, bytes - o.bytes, copies - o.copies,
+              copy_bytes - o.copy_bytes, large_copies - o.large_copies};
+    }
+  };
+
+  // operator new から触るので atomics のみ（ロック・確保をしない）
+  struct AtomicCounters {
+    std::atomic<uint64_t> allocs{0}, bytes{0}, copies{0}, copy_bytes{0}, large_copies{0};
+    Counters load() const {
+      return {allocs.load(std::memory_order_relaxed), bytes.load(std::memory_order_relaxed),
+              copies.load(std::memory_order_relaxed), copy_bytes.load(std::memory_order_relaxed),
+              large_copies.load(std::memory_order_relaxed)};
+    }
+  };
+
+  AtomicCounters g_counters[kStages];
+  thread_local Stage t_stage = Stage::Other;
+
+  // フレーム集計（endFrame / toJson）
+  std::mutex g_frame_mu;
+  bool g_have_baseline = false;
+  uint64_t g_frames = 0;
+  std::array<Counters, kStages> g_prev{};   // 直前の endFrame 時点の累計
+  std::array<Counters, kStages> g_last{};   // 直近フレームの差分
+  std::array<Counters, kStages> g_sum{};    // 最初の endFrame 以降の合計（起動時の確保は含めない）
+  Counters g_max{};                         // 1フレームの最大（全ステージ合計）
+
+  Json::Value countersJson(const Counters& c, double div) {
+    Json::Value out(Json::objectValue);
+    out["allocs"] = static_cast<double>(c.allocs) / div;
+    out["bytes"] = static_cast<double>(c.bytes) / div;
+    out["copies"] = static_cast<double>(c.copies) / div;
+    out["copy_bytes"] = static_cast<double>(c.copy_bytes) / div;
+    out["large_copies"] = static_cast<double>(c.large_copies) / div;
+    return out;
+  }
+
+  inline void countAlloc(size_t n) {
+    auto& c = g_counters[static_cast<size_t>(t_stage)];
+    c.allocs.fetch_add(1, std::memory_order_relaxed);
+    c.bytes.fetch_add(n, std::memory_order_relaxed);
+  }
+#endif
+}
+
+#ifdef HOKUYO_ALLOC_STATS
+Stage stage() { return t_stage; }
+
+void setStage(Stage s) { t_stage = s; }
+
+void noteCopy(size_t bytes) {
+  if (bytes == 0) return;
+  auto& c = g_counters[static_cast<size_t>(t_stage)];
+  c.copies.fetch_add(1, std::memory_order_relaxed);
+  c.copy_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  if (bytes >= kLargeCopyBytes) c.large_copies.fetch_add(1, std::memory_order_relaxed);
+}
+
+void endFrame() {
+  std::array<Counters, kStages> now;
+  for (size_t i = 0; i < kStages; ++i) now[i] = g_counters[i].load();
+
+  std::lock_guard<std::mutex> lk(g_frame_mu);
+  if (!g_have_baseline) {
+    g_prev = now;
+    g_have_baseline = true;
+    return;
+  }
+  Counters total{};
+  for (size_t i = 0; i < kStages; ++i) {
+    g_last[i] = now[i] - g_prev[i];
+    g_sum[i] += g_last[i];
+    total += g_last[i];
+  }
+  g_prev = now;
+  ++g_frames;
+  g_max.allocs = std::max(g_max.allocs, total.allocs);
+  g_max.bytes = std::max(g_max.bytes, total.bytes);
+  g_max.copies = std::max(g_max.copies, total.copies);
+  g_max.copy_bytes = std::max(g_max.copy_bytes, total.copy_bytes);
+  g_max.large_copies = std::max(g_max.large_copies, total.large_copies);
+}
+#endif
+
+Json::Value toJson() {
+  Json::Value out(Json::objectValue);
+  out["enabled"] = kEnabled;
+#ifdef HOKUYO_ALLOC_STATS
+  std::lock_guard<std::mutex> lk(g_frame_mu);
+  const double div = g_frames > 0 ? static_cast<double>(g_frames) : 1.0;
+  Counters sum{}, last{};
+  Json::Value stages(Json::objectValue);
+  for (size_t i = 0; i < kStages; ++i) {
+    sum += g_sum[i];
+    last += g_last[i];
+    stages[stageName(static_cast<Stage>(i))] = countersJson(g_sum[i], div);
+  }
+  out["frames"] = static_cast<Json::UInt64>(g_frames);
+  out["large_copy_bytes"] = static_cast<Json::UInt64>(kLargeCopyBytes);
+  out["per_frame"] = countersJson(sum, div);      // 平均
+  out["last_frame"] = countersJson(last, 1.0);
+  out["max_frame"] = countersJson(g_max, 1.0);
+  out["stages"] = stages;                         // ステージ別の平均
+#else
+  (void)stageName;
+#endif
+  return out;
+}
+
+} // namespace alloc_stats
+
+#ifdef HOKUYO_ALLOC_STATS
+// ---- global allocation hook ----
+// aligned new/delete は置き換えない（libstdc++/libc++ では aligned_alloc + free の組で閉じている）
+void* operator new(std::size_t n) {
+  alloc_stats::countAlloc(n);
+  if (void* p = std::malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+void* operator new[](std::size_t n) { return ::operator new(n); }
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept {
+  alloc_stats::countAlloc(n);
+  return std::malloc(n ? n : 1);
+}
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept { return ::operator new(n, std::nothrow); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <json/json.h>
+
+// Opt-in allocation / copy accounting for the frame pipeline (CMake: -DHOKUYO_ALLOC_STATS=ON).
+// The instrumentation build replaces the global operator new/delete and charges every
+// allocation to the calling thread's current stage. Known bulk copies (scan snapshots,
+// sink snapshots, per-client WS payloads) are reported with noteCopy().
+// endFrame() closes one fused frame; toJson() reports per-frame figures for /api/v1/metrics.
+// In a normal build everything below is an inline no-op.
+namespace alloc_stats {
+
+enum class Stage : uint8_t {
+  Other,        // threads / code outside the frame pipeline
+  Ingest,       // fusion thread: scan copies and conversion
+  Ui,           // WebUI point / cluster streams
+  Prefilter,    // spatial index, prefilter, ROI
+  Voxel,
+  Dbscan,
+  Postfilter,
+  Publish,      // publish downsampling and sink snapshots
+  Sinks,        // sink worker threads (encode / send)
+  kCount
+};
+
+#ifdef HOKUYO_ALLOC_STATS
+constexpr bool kEnabled = true;
+
+Stage stage();
+void setStage(Stage s);                 // calling thread only
+void noteCopy(size_t bytes);            // charged to the calling thread's stage
+void endFrame();
+
+// Switches the calling thread's stage for a scope
+class ScopedStage {
+public:
+  explicit ScopedStage(Stage s) : prev_(stage()) { setStage(s); }
+  ~ScopedStage() { setStage(prev_); }
+  ScopedStage(const ScopedStage&) = delete;
+  ScopedStage& operator=(const ScopedStage&) = delete;
+private:
+  Stage prev_;
+};
+#else
+constexpr bool kEnabled = false;
+
+inline Stage stage() { return Stage::Other; }
+inline void setStage(Stage) {}
+inline void noteCopy(size_t) {}
+inline void endFrame() {}
+
+class ScopedStage {
+public:
+  explicit ScopedStage(Stage) {}
+};
+#endif
+
+// {"enabled": false} unless built with HOKUYO_ALLOC_STATS
+Json::Value toJson();
+
+} // namespace alloc_stats
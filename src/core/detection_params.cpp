@@ -0,0 +1,51 @@
+#include "detection_params.h"
+#include <iostream>
+
+namespace {
+
+DbscanConfig effectiveDbscan(const DbscanConfig& in) {
+    // 旧設定 (eps) との互換: eps_norm が既定値のままなら eps を採用する
+    DbscanConfig out = in;
+    out.eps_norm = (in.eps_norm != 2.5f) ? in.eps_norm : in.eps;
+    return out;
+}
+
+std::shared_ptr<const core::CompiledWorldMask> compileWorldMask(const core::WorldMask& mask) {
+    auto compiled = std::make_shared<const core::CompiledWorldMask>(mask, mask.resolution);
+    if (!mask.empty()) {
+        std::cout << "[DetectionParams] Compiled world mask: " << compiled->cellCount() << " cells ("
+                  << compiled->boundaryCellCount() << " boundary) at " << compiled->resolution() << " m" << std::endl;
+    }
+    return compiled;
+}
+
+} // namespace
+
+DetectionParamsStore::DetectionParamsStore(const AppConfig& cfg) {
+    auto initial = std::make_shared<DetectionParams>();
+    initial->version = ++last_version_;
+    initial->dbscan = effectiveDbscan(cfg.dbscan);
+    initial->prefilter = cfg.prefilter;
+    initial->postfilter = cfg.postfilter;
+    initial->voxel = cfg.voxel;
+    initial->world_mask = compileWorldMask(cfg.world_mask);
+    publish(std::move(initial));
+}
+
+uint64_t DetectionParamsStore::publishFrom(const AppConfig& cfg) {
+    auto mask = compileWorldMask(cfg.world_mask);
+    const uint64_t v = update([&](DetectionParams& p) {
+        p.dbscan = effectiveDbscan(cfg.dbscan);  // same legacy eps fallback as at startup
+        p.prefilter = cfg.prefilter;
+        p.postfilter = cfg.postfilter;
+        p.voxel = cfg.voxel;
+        p.world_mask = std::move(mask);
+    });
+    std::cout << "[DetectionParams] Published version " << v << " from AppConfig" << std::endl;
+    return v;
+}
+
+uint64_t DetectionParamsStore::publishWorldMask(const core::WorldMask& mask) {
+    auto compiled = compileWorldMask(mask);
+    return update([&](DetectionParams& p) { p.world_mask = std::move(compiled); });
+}
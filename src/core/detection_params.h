@@ -0,0 +1,65 @@
+#pragma once
+
+#include "config/config.h"
+#include "core/mask.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// Detection parameters as one immutable, versioned snapshot.
+// Writers (WS/REST/config load) copy the current snapshot, modify the copy and
+// publish it with a pointer swap. The detection thread loads the
+// pointer once per frame and reconfigures DBSCAN/filters only when the
+// version changes, so tuning never blocks or tears a running frame.
+struct DetectionParams {
+    uint64_t version{0};
+    DbscanConfig dbscan;
+    PrefilterConfig prefilter;
+    PostfilterConfig postfilter;
+    VoxelConfig voxel;
+    // ROI: compiled raster of AppConfig::world_mask (never null)
+    std::shared_ptr<const core::CompiledWorldMask> world_mask;
+};
+
+class DetectionParamsStore {
+public:
+    explicit DetectionParamsStore(const AppConfig& cfg);
+
+    // Reader side (safe from any thread; only the pointer copy is under the lock)
+    std::shared_ptr<const DetectionParams> load() const {
+        std::lock_guard<std::mutex> lk(current_mutex_);
+        return current_;
+    }
+    uint64_t version() const { return load()->version; }
+
+    // Writer side: copy-modify-publish. Returns the new version.
+    template <typename Fn>
+    uint64_t update(Fn&& mutate) {
+        std::lock_guard<std::mutex> lk(write_mutex_);
+        auto next = std::make_shared<DetectionParams>(*load());
+        mutate(*next);
+        next->version = ++last_version_;
+        publish(std::move(next));
+        return last_version_;
+    }
+
+    // Replace dbscan/prefilter/postfilter/world_mask from AppConfig (Load/Import operations)
+    uint64_t publishFrom(const AppConfig& cfg);
+
+    // Recompile and publish the ROI mask (world.update). Compilation runs outside the writer lock.
+    uint64_t publishWorldMask(const core::WorldMask& mask);
+
+private:
+    void publish(std::shared_ptr<const DetectionParams> next) {
+        std::lock_guard<std::mutex> lk(current_mutex_);
+        current_.swap(next);
+        // the old snapshot (now in next) is released after the lock
+    }
+
+    // std::atomic<std::shared_ptr> is not available in libc++ (macOS), so the pointer
+    // is swapped under a small mutex held only for the shared_ptr copy
+    mutable std::mutex current_mutex_;
+    std::shared_ptr<const DetectionParams> current_;
+    std::mutex write_mutex_;   // serializes writers only
+    uint64_t last_version_{0};
+};
@@ -0,0 +1,152 @@
+#include "detection_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "core/alloc_stats.h"
+#include "core/frame_budget.h"
+#include "core/trace.h"
+
+DetectionPipeline::DetectionPipeline(const DetectionParams& initial)
+    : dbscan_(initial.dbscan.eps_norm, initial.dbscan.minPts),
+      prefilter_(initial.prefilter),
+      postfilter_(initial.postfilter),
+      applied_version_(initial.version) {
+  // (DBSCAN eps falls back to legacy eps for compatibility, see DetectionParamsStore)
+  dbscan_.setAngularScale(initial.dbscan.k_scale);
+  dbscan_.setPerformanceParams(initial.dbscan.h_min, initial.dbscan.h_max, initial.dbscan.R_max, initial.dbscan.M_max);
+}
+
+void DetectionPipeline::applyParams(const DetectionParams& params, bool cheap_prefilter) {
+  if (params.version != applied_version_) {
+    const auto& d = params.dbscan;
+    dbscan_.setParams(d.eps_norm, d.minPts);
+    dbscan_.setAngularScale(d.k_scale);
+    dbscan_.setPerformanceParams(d.h_min, d.h_max, d.R_max, d.M_max);
+    prefilter_.setConfig(cheap_prefilter ? degradedPrefilterConfig(params.prefilter) : params.prefilter);
+    prefilter_degraded_ = cheap_prefilter;
+    postfilter_.setConfig(params.postfilter);
+    applied_version_ = params.version;
+  }
+  if (cheap_prefilter != prefilter_degraded_) {
+    prefilter_.setConfig(cheap_prefilter ? degradedPrefilterConfig(params.prefilter) : params.prefilter);
+    prefilter_degraded_ = cheap_prefilter;
+  }
+}
+
+void DetectionPipeline::run(const ScanFrame& f, const DetectionParams& params, const Options& opt) {
+  using clock = std::chrono::steady_clock;
+  using ms = std::chrono::duration<double, std::milli>;
+
+  applyParams(params, opt.cheap_prefilter);
+  // Per-sid models derived by SensorManager from each sensor's angle_res/type
+  if (f.sensor_models && f.sensor_models != applied_models_) {
+    dbscan_.setSensorModels(*f.sensor_models);
+    applied_models_ = f.sensor_models;
+  }
+
+  const alloc_stats::Stage caller_stage = alloc_stats::stage();
+  auto enter = [&](alloc_stats::Stage s) {
+    if (opt.alloc_stages) alloc_stats::setStage(s);
+  };
+  auto lap = clock::now();
+  auto done = [&](double& out_ms, auto stage) {
+    const auto now = clock::now();
+    out_ms = ms(now - lap).count();
+    lap = now;
+    if (opt.budget) opt.budget->mark(stage);
+  };
+
+  // Apply prefilter
+  // Use pointers to avoid copies — point at original data by default
+  enter(alloc_stats::Stage::Prefilter);
+  const std::vector<float>* p_xy = &f.xy;
+  const std::vector<uint8_t>* p_sid = &f.sid;
+  const std::vector<float>* p_dist = &f.dist;
+
+  // 基本セルは DBSCAN の最小セル幅。各ステージはその整数倍のレベルを使う
+  {
+    trace::Scope span("spatial_index.build");
+    spatial_index_.build(f.xy.data(), f.xy.size() / 2, std::max(params.dbscan.h_min, 0.005f));
+  }
+
+  if (params.prefilter.enabled) {
+    try {
+      prefilter_.apply(f.xy, f.sid, f.dist, filter_work_, {}, &spatial_index_);
+      p_xy = &filter_work_.xy;
+      p_sid = &filter_work_.sid;
+      p_dist = &filter_work_.dist;
+    } catch (const std::exception& e) {
+      std::cerr << "[Prefilter] Error in frame seq=" << f.seq << ": " << e.what() << std::endl;
+      spatial_index_.build(f.xy.data(), f.xy.size() / 2, std::max(params.dbscan.h_min, 0.005f));
+    }
+  }
+
+  // Apply ROI world_mask filtering after prefilter and before DBSCAN
+  // (compiled raster from the params snapshot; compacts the arrays in place)
+  const auto& world_mask = params.world_mask;
+  if (world_mask && !world_mask->empty() && !f.roi_applied) {
+    trace::Scope span("roi.world_mask");
+    if (p_xy != &filter_work_.xy) {
+      filter_work_.xy.assign(p_xy->begin(), p_xy->end());
+      filter_work_.sid.assign(p_sid->begin(), p_sid->end());
+      filter_work_.dist.assign(p_dist->begin(), p_dist->end());
+      alloc_stats::noteCopy(p_xy->size() * sizeof(float) + p_sid->size() + p_dist->size() * sizeof(float));
+    }
+    world_mask->filterInPlace(filter_work_.xy, filter_work_.sid, filter_work_.dist, &roi_kept_);
+    spatial_index_.compact(roi_kept_.data(), roi_kept_.size(), filter_work_.xy.data());
+
+    p_xy = &filter_work_.xy;
+    p_sid = &filter_work_.sid;
+    p_dist = &filter_work_.dist;
+  }
+  done(times_.prefilter_ms, FrameBudget::Stage::Prefilter);
+
+  // Voxel downsampling: merge near-duplicate points of overlapping sensors before DBSCAN.
+  // Clusters then index voxels; the index is rebuilt over the (much smaller) voxel set.
+  // Under the frame budget's "voxel" degradation the stage is forced on (at least its resolution).
+  enter(alloc_stats::Stage::Voxel);
+  const bool voxelized = params.voxel.enabled || opt.force_voxel > 0.0f;
+  if (voxelized) {
+    trace::Scope span("voxel");
+    const float resolution = opt.force_voxel > 0.0f
+        ? std::max(params.voxel.enabled ? params.voxel.resolution : 0.0f, opt.force_voxel)
+        : params.voxel.resolution;
+    voxel_downsampler_.apply(*p_xy, *p_sid, *p_dist, resolution, voxel_frame_);
+    spatial_index_.build(voxel_frame_.xy.data(), voxel_frame_.size(), std::max(params.dbscan.h_min, 0.005f));
+    p_xy = &voxel_frame_.xy;
+    p_sid = &voxel_frame_.sid;
+    p_dist = &voxel_frame_.dist;
+  }
+  done(times_.voxel_ms, FrameBudget::Stage::Voxel);
+
+  // DBSCAN clustering on filtered frame
+  enter(alloc_stats::Stage::Dbscan);
+  try {
+    dbscan_.run(*p_xy, *p_sid, *p_dist, f.t_ns, f.seq, cluster_set_, &spatial_index_);
+  } catch (const std::exception& e) {
+    std::cerr << "[DBSCAN] Error in frame seq=" << f.seq << ": " << e.what() << std::endl;
+    cluster_set_.clear();
+  }
+  done(times_.dbscan_ms, FrameBudget::Stage::Dbscan);
+
+  // Apply postfilter to clusters (compacts the set in place)
+  enter(alloc_stats::Stage::Postfilter);
+  if (params.postfilter.enabled) {
+    try {
+      postfilter_.applyInPlace(cluster_set_, *p_xy, *p_sid, &spatial_index_);
+    } catch (const std::exception& e) {
+      std::cerr << "[Postfilter] Error in frame seq=" << f.seq << ": " << e.what() << std::endl;
+      // Continue with the clusters as they are
+    }
+  }
+  if (voxelized) {
+    // メンバは voxel なので、点数・センサー別点数・sensor_mask を統合前の入力点で数え直す
+    cluster_set_.updateSensorStats(voxel_frame_.sensor_offsets, voxel_frame_.sensor_counts);
+  }
+  done(times_.postfilter_ms, FrameBudget::Stage::Postfilter);
+
+  p_xy_ = p_xy;
+  p_sid_ = p_sid;
+  if (opt.alloc_stages) alloc_stats::setStage(caller_stage);
+}
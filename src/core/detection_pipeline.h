@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "core/detection_params.h"
+#include "core/sensor_manager.h"
+#include "detect/dbscan.h"
+#include "detect/prefilter.h"
+#include "detect/postfilter.h"
+#include "detect/spatial_index.h"
+#include "detect/voxel_grid.h"
+
+class FrameBudget;
+
+// Prefilter -> ROI -> voxel -> DBSCAN -> postfilter on one fused frame.
+// Owns the stage objects and their buffers (reused across frames) and reconfigures
+// them from the params snapshot only when its version changes.
+// Not thread-safe: the live detection thread and the shadow pipeline each own one.
+class DetectionPipeline {
+public:
+  struct Options {
+    bool cheap_prefilter{false};   // frame budget "prefilter": expensive strategies off
+    float force_voxel{0.0f};       // > 0: voxel stage on with at least this resolution [m]
+    FrameBudget* budget{nullptr};  // stage marks (live pipeline)
+    bool alloc_stages{false};      // charge allocations to the pipeline stages (live pipeline)
+  };
+
+  // Wall time of the last run() per stage [ms]
+  struct StageTimes {
+    double prefilter_ms{0.0};      // spatial index + prefilter + ROI
+    double voxel_ms{0.0};
+    double dbscan_ms{0.0};
+    double postfilter_ms{0.0};
+    double total_ms() const { return prefilter_ms + voxel_ms + dbscan_ms + postfilter_ms; }
+  };
+
+  explicit DetectionPipeline(const DetectionParams& initial);
+
+  void run(const ScanFrame& f, const DetectionParams& params, const Options& opt);
+
+  // Results of the last run(), valid until the next one (xy/sid may point into the frame)
+  const ClusterSet& clusters() const { return cluster_set_; }
+  // Points the clusters index into (filtered points, or voxel centroids when voxelized)
+  const std::vector<float>& xy() const { return *p_xy_; }
+  const std::vector<uint8_t>& sid() const { return *p_sid_; }
+  const StageTimes& times() const { return times_; }
+
+private:
+  void applyParams(const DetectionParams& params, bool cheap_prefilter);
+
+  DBSCAN2D dbscan_;
+  Prefilter prefilter_;
+  Postfilter postfilter_;
+  uint64_t applied_version_;
+  bool prefilter_degraded_{false};
+  std::shared_ptr<const SensorModelTable> applied_models_;
+  // Filtered-point buffers
+  Prefilter::FilterResult filter_work_;
+  // Spatial index shared by prefilter, DBSCAN and postfilter: built once per frame,
+  // compacted (not rebuilt) when the prefilter / ROI drop points
+  FrameSpatialIndex spatial_index_;
+  std::vector<uint32_t> roi_kept_;
+  VoxelDownsampler voxel_downsampler_;
+  VoxelFrame voxel_frame_;
+  // Cluster result (stats + CSR membership)
+  ClusterSet cluster_set_;
+  const std::vector<float>* p_xy_{&filter_work_.xy};
+  const std::vector<uint8_t>* p_sid_{&filter_work_.sid};
+  StageTimes times_;
+};
@@ -1,12 +1,12 @@
 #include "filter_manager.h"
+#include <algorithm>
 #include <iostream>
 #include <mutex>
 #include <shared_mutex>
 
-FilterManager::FilterManager(PrefilterConfig& prefilter_config, PostfilterConfig& postfilter_config)
-    : prefilter_config_(prefilter_config), postfilter_config_(postfilter_config) {
-    recreatePrefilter();
-    recreatePostfilter();
+FilterManager::FilterManager(PrefilterConfig& prefilter_config, PostfilterConfig& postfilter_config,
+                             DetectionParamsStore& params)
+    : prefilter_config_(prefilter_config), postfilter_config_(postfilter_config), params_(params) {
 }
 
 bool FilterManager::updatePrefilterConfig(const Json::Value& config) {
@@ -15,7 +15,7 @@ bool FilterManager::updatePrefilterConfig(const Json::Value& config) {
         PrefilterConfig new_config = jsonToPrefilterConfig(config);
         prefilter_config_ = new_config;
         
-        recreatePrefilter();
+        publishLocked();
         std::cout << "[FilterManager] Prefilter configuration updated" << std::endl;
         return true;
     } catch (const std::exception& e) {
@@ -30,7 +30,7 @@ bool FilterManager::updatePostfilterConfig(const Json::Value& config) {
         PostfilterConfig new_config = jsonToPostfilterConfig(config);
         postfilter_config_ = new_config;
         
-        recreatePostfilter();
+        publishLocked();
         std::cout << "[FilterManager] Postfilter configuration updated" << std::endl;
         return true;
     } catch (const std::exception& e) {
@@ -47,17 +47,15 @@ bool FilterManager::updateFilterConfig(const Json::Value& config) {
         if (config.isMember("prefilter")) {
             PrefilterConfig new_prefilter_config = jsonToPrefilterConfig(config["prefilter"]);
             prefilter_config_ = new_prefilter_config;
-            
-            recreatePrefilter();
         }
         
         if (config.isMember("postfilter")) {
             PostfilterConfig new_postfilter_config = jsonToPostfilterConfig(config["postfilter"]);
             postfilter_config_ = new_postfilter_config;
-            
-            recreatePostfilter();
         }
         
+        publishLocked();
+        
         std::cout << "[FilterManager] Filter configuration updated" << std::endl;
         return success;
     } catch (const std::exception& e) {
@@ -69,9 +67,8 @@ bool FilterManager::updateFilterConfig(const Json::Value& config) {
 void FilterManager::reloadFromAppConfig() {
     std::unique_lock lock(mutex_);
     try {
-        // Recreate filters with new configurations
-        recreatePrefilter();
-        recreatePostfilter();
+        // Publish the (already replaced) AppConfig filter sections
+        publishLocked();
         
         std::cout << "[FilterManager] Configuration reloaded from AppConfig" << std::endl;
     } catch (const std::exception& e) {
@@ -97,50 +94,54 @@ Json::Value FilterManager::getFilterConfigAsJson() const {
     return result;
 }
 
-Prefilter::FilterResult FilterManager::applyPrefilter(const std::vector<float>& xy, const std::vector<uint8_t>& sid, const std::vector<float>& dist) {
+PrefilterConfig FilterManager::prefilterConfig() const {
     std::shared_lock lock(mutex_);
-    if (prefilter_ && prefilter_config_.enabled) {
-        return prefilter_->apply(xy, sid, dist);
-    } else {
-        // Return unfiltered data
-        Prefilter::FilterResult result;
-        result.xy = xy;
-        result.sid = sid;
-        result.dist = dist;
-        result.stats.input_points = xy.size() / 2;
-        result.stats.output_points = xy.size() / 2;
-        return result;
-    }
+    return prefilter_config_;
 }
 
-Postfilter::FilterResult FilterManager::applyPostfilter(const std::vector<Cluster>& clusters,
-                                                       const std::vector<float>& xy,
-                                                       const std::vector<uint8_t>& sid) {
+PrefilterConfig FilterManager::parsePrefilterConfig(const Json::Value& config) const {
     std::shared_lock lock(mutex_);
-    if (postfilter_ && postfilter_config_.enabled) {
-        return postfilter_->apply(clusters, xy, sid);
-    } else {
-        // Return unfiltered clusters
-        Postfilter::FilterResult result;
-        result.clusters = clusters;
-        result.stats.input_clusters = clusters.size();
-        result.stats.output_clusters = clusters.size();
-        return result;
-    }
+    return jsonToPrefilterConfig(config);
 }
 
-void FilterManager::recreatePrefilter() {
-    prefilter_ = std::make_unique<Prefilter>(prefilter_config_);
+Json::Value FilterManager::prefilterConfigAsJson(const PrefilterConfig& config) const {
+    return prefilterConfigToJson(config);
+}
+
+bool FilterManager::applyDetectionConfig(const PrefilterConfig& prefilter, const DbscanConfig& dbscan) {
+    std::unique_lock lock(mutex_);
+    try {
+        prefilter_config_ = prefilter;
+        const PostfilterConfig post = postfilter_config_;
+        // The detection thread must never see the new prefilter with the old DBSCAN (or vice versa)
+        params_.update([&](DetectionParams& p) {
+            p.prefilter = prefilter;
+            p.postfilter = post;
+            p.dbscan = dbscan;
+        });
+        std::cout << "[FilterManager] Prefilter and DBSCAN configuration applied" << std::endl;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "[FilterManager] Failed to apply detection config: " << e.what() << std::endl;
+        return false;
+    }
 }
 
-void FilterManager::recreatePostfilter() {
-    postfilter_ = std::make_unique<Postfilter>(postfilter_config_);
+void FilterManager::publishLocked() {
+    const PrefilterConfig pre = prefilter_config_;
+    const PostfilterConfig post = postfilter_config_;
+    params_.update([&](DetectionParams& p) {
+        p.prefilter = pre;
+        p.postfilter = post;
+    });
 }
 
 PrefilterConfig FilterManager::jsonToPrefilterConfig(const Json::Value& json) const {
     PrefilterConfig config;
     
     config.enabled = json.get("enabled", true).asBool();
+    // Not exposed in the filter panel; keep the current value when omitted
+    config.scan_stage = json.get("scan_stage", prefilter_config_.scan_stage).asBool();
     
     if (json.isMember("neighborhood")) {
         const auto& nb = json["neighborhood"];
@@ -178,6 +179,19 @@ PrefilterConfig FilterManager::jsonToPrefilterConfig(const Json::Value& json) co
         config.isolation_removal.isolation_radius = ir.get("isolation_radius", 0.1f).asFloat();
     }
     
+    // Not exposed in the filter panel; keep the current settings when omitted
+    config.temporal_persistence = prefilter_config_.temporal_persistence;
+    if (json.isMember("temporal_persistence")) {
+        const auto& tp = json["temporal_persistence"];
+        auto& t = config.temporal_persistence;
+        t.enabled = tp.get("enabled", t.enabled).asBool();
+        t.history_frames = std::clamp(tp.get("history_frames", t.history_frames).asInt(), 1, 64);
+        t.min_hits = std::clamp(tp.get("min_hits", t.min_hits).asInt(), 1, t.history_frames);
+        t.cell_size = std::max(0.01f, tp.get("cell_size", t.cell_size).asFloat());
+        t.extent = std::max(0.1f, tp.get("extent", t.extent).asFloat());
+        t.dilate = tp.get("dilate", t.dilate).asBool();
+    }
+    
     return config;
 }
 
@@ -201,6 +215,7 @@ Json::Value FilterManager::prefilterConfigToJson(const PrefilterConfig& config)
     Json::Value json;
     
     json["enabled"] = config.enabled;
+    json["scan_stage"] = config.scan_stage;
     
     json["neighborhood"]["enabled"] = config.neighborhood.enabled;
     json["neighborhood"]["k"] = config.neighborhood.k;
@@ -223,6 +238,13 @@ Json::Value FilterManager::prefilterConfigToJson(const PrefilterConfig& config)
     json["isolation_removal"]["min_cluster_size"] = config.isolation_removal.min_cluster_size;
     json["isolation_removal"]["isolation_radius"] = config.isolation_removal.isolation_radius;
     
+    json["temporal_persistence"]["enabled"] = config.temporal_persistence.enabled;
+    json["temporal_persistence"]["history_frames"] = config.temporal_persistence.history_frames;
+    json["temporal_persistence"]["min_hits"] = config.temporal_persistence.min_hits;
+    json["temporal_persistence"]["cell_size"] = config.temporal_persistence.cell_size;
+    json["temporal_persistence"]["extent"] = config.temporal_persistence.extent;
+    json["temporal_persistence"]["dilate"] = config.temporal_persistence.dilate;
+    
     return json;
 }
 
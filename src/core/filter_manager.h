@@ -3,13 +3,18 @@
 #include "detect/prefilter.h"
 #include "detect/postfilter.h"
 #include "config/config.h"
+#include "core/detection_params.h"
 #include <json/json.h>
 #include <memory>
 #include <shared_mutex>
 
+// Owns the JSON <-> PrefilterConfig/PostfilterConfig conversion and keeps
+// AppConfig in sync. Every successful update is published to the
+// DetectionParamsStore; the detection thread never touches this class.
 class FilterManager {
 public:
-    FilterManager(PrefilterConfig& prefilter_config, PostfilterConfig& postfilter_config);
+    FilterManager(PrefilterConfig& prefilter_config, PostfilterConfig& postfilter_config,
+                  DetectionParamsStore& params);
     
     // Update filter configurations from JSON
     bool updatePrefilterConfig(const Json::Value& config);
@@ -21,19 +26,13 @@ public:
     Json::Value getPostfilterConfigAsJson() const;
     Json::Value getFilterConfigAsJson() const;
     
-    void recreatePrefilter();
-    void recreatePostfilter();
-
-    // Apply filters (thread-safe)
-    // sid: 点群処理用の数値センサーID (0-255)
-    Prefilter::FilterResult applyPrefilter(const std::vector<float>& xy, const std::vector<uint8_t>& sid, const std::vector<float>& dist);
-    Postfilter::FilterResult applyPostfilter(const std::vector<Cluster>& clusters,
-                                            const std::vector<float>& xy,
-                                            const std::vector<uint8_t>& sid);
+    // Conversion without applying (shadow pipeline candidates)
+    PrefilterConfig prefilterConfig() const;
+    PrefilterConfig parsePrefilterConfig(const Json::Value& config) const;
+    Json::Value prefilterConfigAsJson(const PrefilterConfig& config) const;
     
-    // Check if filters are enabled
-    bool isPrefilterEnabled() const { return prefilter_config_.enabled; }
-    bool isPostfilterEnabled() const { return postfilter_config_.enabled; }
+    // Apply a prefilter together with a DBSCAN config as one params version (shadow promotion)
+    bool applyDetectionConfig(const PrefilterConfig& prefilter, const DbscanConfig& dbscan);
     
     // Reload configuration from AppConfig (for Load/Import operations)
     void reloadFromAppConfig();
@@ -42,8 +41,10 @@ private:
     mutable std::shared_mutex mutex_;
     PrefilterConfig& prefilter_config_;
     PostfilterConfig& postfilter_config_;
-    std::unique_ptr<Prefilter> prefilter_;
-    std::unique_ptr<Postfilter> postfilter_;
+    DetectionParamsStore& params_;
+
+    // Publish the current configs as a new params snapshot (caller holds mutex_)
+    void publishLocked();
     
     // Helper methods to convert JSON to config structs
     PrefilterConfig jsonToPrefilterConfig(const Json::Value& json) const;
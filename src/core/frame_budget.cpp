@@ -0,0 +1,154 @@
+#include "frame_budget.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+  constexpr double kEwma = 0.2;           // weight of the newest frame
+  constexpr int kSettleFrames = 2;        // frames measured after a level change before re-evaluating
+}
+
+const char* FrameBudget::name(Degradation d) {
+  switch (d) {
+    case Degradation::UiPoints:    return "ui_points";
+    case Degradation::Prefilter:   return "prefilter";
+    case Degradation::Voxel:       return "voxel";
+    case Degradation::RawSinkRate: return "raw_sink_rate";
+  }
+  return "?";
+}
+
+const char* FrameBudget::name(Stage s) {
+  switch (s) {
+    case Stage::Ui:         return "ui";
+    case Stage::Prefilter:  return "prefilter";
+    case Stage::Voxel:      return "voxel";
+    case Stage::Dbscan:     return "dbscan";
+    case Stage::Postfilter: return "postfilter";
+    case Stage::Publish:    return "publish";
+    case Stage::kCount:     break;
+  }
+  return "?";
+}
+
+void FrameBudget::configure(const FrameBudgetConfig& cfg) {
+  cfg_ = cfg;
+  order_.clear();
+  for (const auto& n : cfg.order) {
+    bool found = false;
+    for (auto d : {Degradation::UiPoints, Degradation::Prefilter, Degradation::Voxel, Degradation::RawSinkRate}) {
+      if (n == name(d)) {
+        if (std::find(order_.begin(), order_.end(), d) == order_.end()) order_.push_back(d);
+        found = true;
+      }
+    }
+    if (!found) std::cerr << "[FrameBudget] unknown degradation '" << n << "' ignored" << std::endl;
+  }
+  level_cost_.assign(order_.size() + 1, 0.0);
+  setLevel(0);
+  have_estimate_ = false;
+  std::cout << "[FrameBudget] " << (cfg_.enabled ? "enabled" : "disabled") << " budget=" << cfg_.budget_ms
+            << "ms degradations=" << order_.size() << std::endl;
+}
+
+void FrameBudget::setLevel(size_t level) {
+  level_ = std::min(level, order_.size());
+  active_mask_ = 0;
+  for (size_t i = 0; i < level_; ++i) active_mask_ |= 1u << static_cast<unsigned>(order_[i]);
+  settle_frames_ = kSettleFrames;
+  recover_count_ = 0;
+}
+
+void FrameBudget::beginFrame(size_t points) {
+  frame_start_ = last_mark_ = clock::now();
+  points_ = points;
+  stage_ms_.fill(0.0);
+  const double n = static_cast<double>(std::max<size_t>(points, 1));
+  projected_ms_ = have_estimate_ ? per_point_ms_ * n : 0.0;
+
+  if (!cfg_.enabled || !have_estimate_ || order_.empty()) return;
+  if (settle_frames_ > 0) return;
+
+  if (projected_ms_ > cfg_.budget_ms && level_ < order_.size()) {
+    // 予算超過の見込み: 次の劣化を有効化（現在レベルのコストを回復判定用に覚えておく）
+    level_cost_[level_] = per_point_ms_;
+    setLevel(level_ + 1);
+    have_estimate_ = false; // 新しいレベルのコストを測り直す
+    std::cout << "[FrameBudget] projected " << projected_ms_ << "ms > " << cfg_.budget_ms
+              << "ms: degrade " << name(order_[level_ - 1]) << " (level " << level_ << ")" << std::endl;
+    std::lock_guard<std::mutex> lk(stats_mu_);
+    ++escalations_;
+    return;
+  }
+
+  if (level_ > 0) {
+    // 一段軽いレベルのコストで見積もっても十分余裕があれば戻す
+    const double lighter_ms = level_cost_[level_ - 1] * n;
+    if (lighter_ms < cfg_.recover_ratio * cfg_.budget_ms) {
+      if (++recover_count_ >= cfg_.recover_frames) {
+        const Degradation lifted = order_[level_ - 1];
+        setLevel(level_ - 1);
+        have_estimate_ = false;
+        std::cout << "[FrameBudget] projected " << lighter_ms << "ms: recover " << name(lifted)
+                  << " (level " << level_ << ")" << std::endl;
+        std::lock_guard<std::mutex> lk(stats_mu_);
+        ++recoveries_;
+      }
+    } else {
+      recover_count_ = 0;
+    }
+  }
+}
+
+void FrameBudget::mark(Stage stage) {
+  const auto now = clock::now();
+  stage_ms_[static_cast<size_t>(stage)] += std::chrono::duration<double, std::milli>(now - last_mark_).count();
+  last_mark_ = now;
+}
+
+void FrameBudget::endFrame() {
+  const double frame_ms = std::chrono::duration<double, std::milli>(clock::now() - frame_start_).count();
+  const double per_point = frame_ms / static_cast<double>(std::max<size_t>(points_, 1));
+  per_point_ms_ = have_estimate_ ? per_point_ms_ + kEwma * (per_point - per_point_ms_) : per_point;
+  have_estimate_ = true;
+  if (settle_frames_ > 0) --settle_frames_;
+
+  std::lock_guard<std::mutex> lk(stats_mu_);
+  const bool first = frames_ == 0;
+  ++frames_;
+  if (cfg_.enabled && frame_ms > cfg_.budget_ms) ++overruns_;
+  frame_ewma_ms_ = first ? frame_ms : frame_ewma_ms_ + kEwma * (frame_ms - frame_ewma_ms_);
+  for (size_t i = 0; i < kStages; ++i) {
+    stage_ewma_ms_[i] = first ? stage_ms_[i] : stage_ewma_ms_[i] + kEwma * (stage_ms_[i] - stage_ewma_ms_[i]);
+  }
+  last_projected_ms_ = projected_ms_;
+  stats_level_ = level_;
+}
+
+Json::Value FrameBudget::toJson() const {
+  Json::Value out(Json::objectValue);
+  std::lock_guard<std::mutex> lk(stats_mu_);
+  out["enabled"] = cfg_.enabled;
+  out["budget_ms"] = cfg_.budget_ms;
+  out["frame_ms"] = frame_ewma_ms_;
+  out["projected_ms"] = last_projected_ms_;
+  out["level"] = static_cast<Json::UInt>(stats_level_);
+  Json::Value active(Json::arrayValue);
+  for (size_t i = 0; i < stats_level_ && i < order_.size(); ++i) active.append(name(order_[i]));
+  out["active"] = active;
+  Json::Value stages(Json::objectValue);
+  for (size_t i = 0; i < kStages; ++i) stages[name(static_cast<Stage>(i))] = stage_ewma_ms_[i];
+  out["stages_ms"] = stages;
+  out["frames"] = static_cast<Json::UInt64>(frames_);
+  out["overruns"] = static_cast<Json::UInt64>(overruns_);
+  out["escalations"] = static_cast<Json::UInt64>(escalations_);
+  out["recoveries"] = static_cast<Json::UInt64>(recoveries_);
+  return out;
+}
+
+PrefilterConfig degradedPrefilterConfig(const PrefilterConfig& cfg) {
+  PrefilterConfig out = cfg;
+  out.neighborhood.enabled = false;
+  out.outlier_removal.enabled = false;
+  return out;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <json/json.h>
+#include "config/config.h"
+
+// Per-frame processing budget for the detection pipeline.
+// The detection thread times each stage, projects the next frame's cost from the
+// per-point cost and the incoming point count, and when the projection exceeds the
+// budget enables degradations one at a time in the configured order. A degradation is
+// lifted again once the lighter level is projected to fit with margin for a while.
+// Detection thread: beginFrame / mark / endFrame / active. Any thread: toJson.
+class FrameBudget {
+public:
+  enum class Degradation : uint8_t {
+    UiPoints,      // skip raw/filtered point streams to the WebUI
+    Prefilter,     // disable the expensive prefilter strategies (neighborhood / outlier)
+    Voxel,         // voxel-downsample before DBSCAN
+    RawSinkRate,   // send raw points to sinks only every N-th frame
+  };
+  enum class Stage : uint8_t { Ui, Prefilter, Voxel, Dbscan, Postfilter, Publish, kCount };
+
+  static const char* name(Degradation d);
+  static const char* name(Stage s);
+
+  void configure(const FrameBudgetConfig& cfg);
+  const FrameBudgetConfig& config() const { return cfg_; }
+
+  // Decide the degradation level for this frame from the incoming point count
+  void beginFrame(size_t points);
+  // Attribute the time since the previous mark (or beginFrame) to `stage`
+  void mark(Stage stage);
+  void endFrame();
+
+  bool active(Degradation d) const { return (active_mask_ >> static_cast<unsigned>(d)) & 1u; }
+
+  Json::Value toJson() const;
+
+private:
+  using clock = std::chrono::steady_clock;
+  static constexpr size_t kStages = static_cast<size_t>(Stage::kCount);
+
+  void setLevel(size_t level);
+
+  FrameBudgetConfig cfg_{};
+  std::vector<Degradation> order_;
+  size_t level_{0};                       // number of degradations active (prefix of order_)
+  uint32_t active_mask_{0};
+
+  // Detection thread state
+  clock::time_point frame_start_{};
+  clock::time_point last_mark_{};
+  size_t points_{0};
+  std::array<double, kStages> stage_ms_{};
+  double per_point_ms_{0.0};              // EWMA of frame cost per input point at the current level
+  bool have_estimate_{false};
+  int settle_frames_{0};                  // frames to measure after a level change before acting again
+  int recover_count_{0};
+  std::vector<double> level_cost_;        // per-point cost measured at level k (before escalating past it)
+  double projected_ms_{0.0};
+
+  // Published statistics
+  mutable std::mutex stats_mu_;
+  std::array<double, kStages> stage_ewma_ms_{};
+  double frame_ewma_ms_{0.0};
+  double last_projected_ms_{0.0};
+  size_t stats_level_{0};
+  uint64_t frames_{0};
+  uint64_t overruns_{0};
+  uint64_t escalations_{0};
+  uint64_t recoveries_{0};
+};
+
+// PrefilterConfig with the expensive strategies (neighborhood count, moving median) switched off
+PrefilterConfig degradedPrefilterConfig(const PrefilterConfig& cfg);
@@ -1,5 +1,7 @@
 #include "mask.h"
+#include <algorithm>
 #include <cmath>
+#include <limits>
 
 namespace core {
 
@@ -49,4 +51,254 @@ bool WorldMask::allows(const Point2D& p) const {
   return true;
 }
 
-} // namespace core
\ No newline at end of file
+// ===== CompiledWorldMask =====
+
+namespace {
+
+constexpr size_t kMaxCells = size_t{1} << 24;  // 16M cells (16 MB) upper bound
+
+struct Bounds {
+  double minx{std::numeric_limits<double>::infinity()};
+  double miny{std::numeric_limits<double>::infinity()};
+  double maxx{-std::numeric_limits<double>::infinity()};
+  double maxy{-std::numeric_limits<double>::infinity()};
+
+  void add(const Polygon& poly) {
+    if (poly.empty()) return;
+    for (const auto& pt : poly.points) {
+      minx = std::min(minx, pt.x); maxx = std::max(maxx, pt.x);
+      miny = std::min(miny, pt.y); maxy = std::max(maxy, pt.y);
+    }
+  }
+  bool valid() const { return std::isfinite(minx) && std::isfinite(maxx) && std::isfinite(miny) && std::isfinite(maxy); }
+};
+
+} // namespace
+
+CompiledWorldMask::CompiledWorldMask(const WorldMask& mask, double resolution)
+  : source_(mask) {
+  // include が空なら既定で許可、あれば include の外はすべて拒否
+  outside_allows_ = mask.include.empty();
+
+  // ラスタ範囲: include があればその外接矩形、なければ exclude の外接矩形
+  Bounds b;
+  for (const auto& poly : (mask.include.empty() ? mask.exclude : mask.include)) b.add(poly);
+  if (!b.valid()) return;  // 有効な多角形なし → 範囲外判定のみ
+
+  res_ = (resolution > 0.0 && std::isfinite(resolution)) ? resolution : 0.05;
+  // 外周を 1 セル広げて境界上の辺を確実にラスタ内に収める
+  double w = (b.maxx - b.minx) + 2.0 * res_;
+  double h = (b.maxy - b.miny) + 2.0 * res_;
+  const double cells = std::ceil(w / res_) * std::ceil(h / res_);
+  if (cells > static_cast<double>(kMaxCells)) {
+    res_ *= std::sqrt(cells / static_cast<double>(kMaxCells)) * 1.01;
+    w = (b.maxx - b.minx) + 2.0 * res_;
+    h = (b.maxy - b.miny) + 2.0 * res_;
+  }
+  inv_res_ = 1.0 / res_;
+  origin_x_ = b.minx - res_;
+  origin_y_ = b.miny - res_;
+  nx_ = std::max(1, static_cast<int>(std::ceil(w * inv_res_)));
+  ny_ = std::max(1, static_cast<int>(std::ceil(h * inv_res_)));
+  cells_.assign(static_cast<size_t>(nx_) * ny_, kReject);
+
+  // 1) 辺が通過するセルを boundary にする。
+  //    半セル以下の間隔でサンプルし 3x3 近傍を塗るので、角をかすめるセルも漏れない。
+  auto markEdges = [&](const Polygon& poly) {
+    if (poly.empty()) return;
+    const size_t n = poly.points.size();
+    for (size_t i = 0, j = n - 1; i < n; j = i++) {
+      const auto& a = poly.points[j];
+      const auto& c = poly.points[i];
+      const double len = std::hypot(c.x - a.x, c.y - a.y);
+      const int steps = std::max(1, static_cast<int>(std::ceil(len * inv_res_ * 2.0)));
+      for (int s = 0; s <= steps; ++s) {
+        const double t = static_cast<double>(s) / steps;
+        const int cx = static_cast<int>(std::floor((a.x + (c.x - a.x) * t - origin_x_) * inv_res_));
+        const int cy = static_cast<int>(std::floor((a.y + (c.y - a.y) * t - origin_y_) * inv_res_));
+        for (int dy = -1; dy <= 1; ++dy) {
+          const int yy = cy + dy;
+          if (yy < 0 || yy >= ny_) continue;
+          for (int dx = -1; dx <= 1; ++dx) {
+            const int xx = cx + dx;
+            if (xx < 0 || xx >= nx_) continue;
+            cells_[static_cast<size_t>(yy) * nx_ + xx] = kBoundary;
+          }
+        }
+      }
+    }
+  };
+  for (const auto& poly : mask.include) markEdges(poly);
+  for (const auto& poly : mask.exclude) markEdges(poly);
+
+  // 2) 残りのセルは辺を含まないので中心点の判定がセル全体に当てはまる。
+  //    行ごとに各多角形の交差 x 座標を求め（contains と同じ式）、左から走査する。
+  struct Crossings { std::vector<double> xs; size_t k{0}; bool include{false}; };
+  std::vector<Crossings> rows;
+  for (const auto& poly : mask.include) if (!poly.empty()) rows.push_back({{}, 0, true});
+  for (const auto& poly : mask.exclude) if (!poly.empty()) rows.push_back({{}, 0, false});
+
+  for (int iy = 0; iy < ny_; ++iy) {
+    const double yc = origin_y_ + (iy + 0.5) * res_;
+    size_t r = 0;
+    auto collect = [&](const Polygon& poly) {
+      if (poly.empty()) return;
+      auto& row = rows[r++];
+      row.xs.clear();
+      row.k = 0;
+      const size_t n = poly.points.size();
+      for (size_t i = 0, j = n - 1; i < n; j = i++) {
+        const auto& pi = poly.points[i];
+        const auto& pj = poly.points[j];
+        if ((pi.y > yc) != (pj.y > yc)) {
+          row.xs.push_back((pj.x - pi.x) * (yc - pi.y) / (pj.y - pi.y) + pi.x);
+        }
+      }
+      std::sort(row.xs.begin(), row.xs.end());
+    };
+    for (const auto& poly : mask.include) collect(poly);
+    for (const auto& poly : mask.exclude) collect(poly);
+
+    uint8_t* line = &cells_[static_cast<size_t>(iy) * nx_];
+    for (int ix = 0; ix < nx_; ++ix) {
+      const double xc = origin_x_ + (ix + 0.5) * res_;
+      bool included = mask.include.empty();
+      bool excluded = false;
+      for (auto& row : rows) {
+        while (row.k < row.xs.size() && row.xs[row.k] <= xc) ++row.k;
+        // xc より右にある交差の数が奇数なら内側
+        if (((row.xs.size() - row.k) & 1) != 0) {
+          if (row.include) included = true; else excluded = true;
+        }
+      }
+      if (line[ix] == kBoundary) { ++boundary_cells_; continue; }
+      line[ix] = (included && !excluded) ? kAllow : kReject;
+    }
+  }
+
+  // 3) タイル要約: 一様なタイルはセル参照を省略できる
+  tiles_x_ = (nx_ + (1 << kTileShift) - 1) >> kTileShift;
+  const int tiles_y = (ny_ + (1 << kTileShift) - 1) >> kTileShift;
+  tiles_.assign(static_cast<size_t>(tiles_x_) * tiles_y, kBoundary);
+  for (int ty = 0; ty < tiles_y; ++ty) {
+    for (int tx = 0; tx < tiles_x_; ++tx) {
+      const int x0 = tx << kTileShift, x1 = std::min(nx_, x0 + (1 << kTileShift));
+      const int y0 = ty << kTileShift, y1 = std::min(ny_, y0 + (1 << kTileShift));
+      const uint8_t first = cells_[static_cast<size_t>(y0) * nx_ + x0];
+      bool uniform = (first != kBoundary);
+      for (int y = y0; y < y1 && uniform; ++y) {
+        for (int x = x0; x < x1; ++x) {
+          if (cells_[static_cast<size_t>(y) * nx_ + x] != first) { uniform = false; break; }
+        }
+      }
+      if (uniform) tiles_[static_cast<size_t>(ty) * tiles_x_ + tx] = first;
+    }
+  }
+}
+
+bool CompiledWorldMask::allows(float x, float y) const {
+  const double fx = (static_cast<double>(x) - origin_x_) * inv_res_;
+  const double fy = (static_cast<double>(y) - origin_y_) * inv_res_;
+  // NaN もここで範囲外扱い（WorldMask::allows と同じ結果になる）
+  if (!(fx >= 0.0 && fy >= 0.0 && fx < nx_ && fy < ny_)) return outside_allows_;
+
+  const int ix = static_cast<int>(fx);
+  const int iy = static_cast<int>(fy);
+  const uint8_t tile = tiles_[static_cast<size_t>(iy >> kTileShift) * tiles_x_ + (ix >> kTileShift)];
+  if (tile != kBoundary) return tile == kAllow;
+
+  const uint8_t cell = cells_[static_cast<size_t>(iy) * nx_ + ix];
+  if (cell != kBoundary) return cell == kAllow;
+
+  // 境界セルのみ厳密判定
+  return source_.allows(Point2D(x, y));
+}
+
+size_t CompiledWorldMask::filterInPlace(std::vector<float>& xy, std::vector<uint8_t>& sid, std::vector<float>& dist,
+                                        std::vector<uint32_t>* kept) const {
+  const size_t n = std::min(xy.size() / 2, sid.size());
+  const bool has_dist = dist.size() >= n;
+  if (kept) kept->clear();
+
+  size_t out = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const float x = xy[2 * i];
+    const float y = xy[2 * i + 1];
+    if (!allows(x, y)) continue;
+    if (kept) kept->push_back(static_cast<uint32_t>(i));
+    if (out != i) {
+      xy[2 * out] = x;
+      xy[2 * out + 1] = y;
+      sid[out] = sid[i];
+      if (has_dist) dist[out] = dist[i];
+    }
+    ++out;
+  }
+
+  xy.resize(2 * out);
+  sid.resize(out);
+  if (has_dist) dist.resize(out);
+  return out;
+}
+
+void projectWorldMaskToRays(const CompiledWorldMask& mask, double ox, double oy,
+                            double start_rad, double step_rad, size_t n, RayRangeIntervals& out) {
+  out.offsets.assign(1, 0);
+  out.offsets.reserve(n + 1);
+  out.ranges.clear();
+
+  const WorldMask& wm = mask.source();
+  std::vector<double> ts;
+  for (size_t i = 0; i < n; ++i) {
+    const double a = start_rad + static_cast<double>(i) * step_rad;
+    const double dx = std::cos(a);
+    const double dy = std::sin(a);
+
+    // 放射線と全ての辺の交点距離を集める
+    ts.clear();
+    ts.push_back(0.0);
+    auto intersect = [&](const Polygon& poly) {
+      if (poly.empty()) return;
+      const size_t m = poly.points.size();
+      for (size_t k = 0, j = m - 1; k < m; j = k++) {
+        const double ex = poly.points[k].x - poly.points[j].x;
+        const double ey = poly.points[k].y - poly.points[j].y;
+        const double denom = dx * ey - dy * ex;
+        if (denom == 0.0) continue;  // 平行
+        const double wx = poly.points[j].x - ox;
+        const double wy = poly.points[j].y - oy;
+        const double t = (wx * ey - wy * ex) / denom;
+        const double s = (wx * dy - wy * dx) / denom;
+        if (t > 0.0 && s >= 0.0 && s <= 1.0) ts.push_back(t);
+      }
+    };
+    for (const auto& poly : wm.include) intersect(poly);
+    for (const auto& poly : wm.exclude) intersect(poly);
+    std::sort(ts.begin(), ts.end());
+
+    // 交点間の区間は判定が一定なので中点で評価し、隣接する許可区間は結合する
+    auto pushRange = [&](double near_m, double far_m) {
+      const size_t begin = out.offsets.back();
+      if (out.ranges.size() > begin && out.ranges.back() >= static_cast<float>(near_m)) {
+        out.ranges.back() = static_cast<float>(far_m);
+      } else {
+        out.ranges.push_back(static_cast<float>(near_m));
+        out.ranges.push_back(static_cast<float>(far_m));
+      }
+    };
+    for (size_t k = 0; k + 1 < ts.size(); ++k) {
+      if (ts[k + 1] - ts[k] <= 0.0) continue;
+      const double tm = 0.5 * (ts[k] + ts[k + 1]);
+      if (mask.allows(static_cast<float>(ox + tm * dx), static_cast<float>(oy + tm * dy))) {
+        pushRange(ts[k], ts[k + 1]);
+      }
+    }
+    // 最後の交点より先は全多角形の外側
+    if (mask.allows(static_cast<float>(ox + (ts.back() + 1.0) * dx), static_cast<float>(oy + (ts.back() + 1.0) * dy))) {
+      pushRange(ts.back(), std::numeric_limits<float>::infinity());
+    }
+    out.offsets.push_back(static_cast<uint32_t>(out.ranges.size()));
+  }
+}
+
+} // namespace core
@@ -1,4 +1,6 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 namespace core {
@@ -21,9 +23,74 @@ struct Polygon {
 struct WorldMask {
   std::vector<Polygon> include;
   std::vector<Polygon> exclude;
+  double resolution{0.05};  // [m] cell size of the compiled raster
+  bool apply_at_ingest{false}; // true: ROI をセンサー取り込み時（極座標のステップ区間）で適用
 
   bool empty() const { return include.empty() && exclude.empty(); }
   bool allows(const Point2D& p) const;
 };
 
+// WorldMask をラスタ化した検索用構造（検出スレッドのホットパス用）
+// 2 階層: 16x16 セルのタイルが一様なら 1 回の参照で判定し、
+// 混在タイルではセル単位で allow / reject / boundary を引く。
+// 多角形の辺が通過する boundary セルだけ元の WorldMask で厳密判定するので、
+// 結果は WorldMask::allows と一致する。
+class CompiledWorldMask {
+public:
+  CompiledWorldMask() = default;
+  CompiledWorldMask(const WorldMask& mask, double resolution);
+
+  bool empty() const { return source_.empty(); }
+  bool allows(float x, float y) const;
+
+  // xy (interleaved), sid, dist を許可された点だけに詰め直す。残った点数を返す。
+  // kept を渡すと残った点の元インデックス（昇順）を書き出す（空間索引の詰め直し用）。
+  size_t filterInPlace(std::vector<float>& xy, std::vector<uint8_t>& sid, std::vector<float>& dist,
+                       std::vector<uint32_t>* kept = nullptr) const;
+
+  const WorldMask& source() const { return source_; }
+  bool applyAtIngest() const { return source_.apply_at_ingest; }
+  double resolution() const { return res_; }
+  size_t cellCount() const { return cells_.size(); }
+  size_t boundaryCellCount() const { return boundary_cells_; }
+
+private:
+  enum : uint8_t { kReject = 0, kAllow = 1, kBoundary = 2 };  // kBoundary doubles as "mixed" for tiles
+  static constexpr int kTileShift = 4;
+
+  WorldMask source_;
+  double res_{0.05};
+  double inv_res_{20.0};
+  double origin_x_{0.0};
+  double origin_y_{0.0};
+  int nx_{0};
+  int ny_{0};
+  int tiles_x_{0};
+  bool outside_allows_{true};  // points outside the raster bounds
+  size_t boundary_cells_{0};
+  std::vector<uint8_t> cells_;
+  std::vector<uint8_t> tiles_;
+};
+
+// センサー原点からの放射線（ステップ）ごとの許可距離区間。
+// 姿勢が変わらない限り WorldMask を極座標に射影したものとして再利用でき、
+// 取り込み時に r が区間に入るかだけで ROI 判定できる。
+struct RayRangeIntervals {
+  std::vector<uint32_t> offsets;  // ray i の区間は ranges[offsets[i] .. offsets[i+1])（near, far の組）
+  std::vector<float> ranges;
+
+  size_t rays() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+  bool allows(size_t ray, float r) const {
+    for (uint32_t k = offsets[ray]; k < offsets[ray + 1]; k += 2) {
+      if (r >= ranges[k] && r < ranges[k + 1]) return true;
+    }
+    return false;
+  }
+};
+
+// 原点 (ox, oy) から角度 start_rad + i * step_rad (i = 0..n-1) の各放射線について
+// mask が許可する距離区間を求める。
+void projectWorldMaskToRays(const CompiledWorldMask& mask, double ox, double oy,
+                            double start_rad, double step_rad, size_t n, RayRangeIntervals& out);
+
 } // namespace core
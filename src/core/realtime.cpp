@@ -0,0 +1,312 @@
+#include "realtime.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#ifdef __linux__
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace realtime {
+
+namespace {
+  std::mutex g_mu;
+  RealtimeConfig g_cfg;
+  std::atomic<bool> g_memory_locked{false};
+  std::atomic<uint32_t> g_applied{0};
+  std::atomic<uint32_t> g_degraded{0};
+
+  const char* roleName(ThreadRole role) {
+    switch (role) {
+      case ThreadRole::Fusion:   return "fusion";
+      case ThreadRole::SensorRx: return "sensor_rx";
+      case ThreadRole::Worker:   return "workers";
+      case ThreadRole::Io:       return "io";
+      case ThreadRole::Shadow:   return "shadow";
+      case ThreadRole::Background: return "bg";
+    }
+    return "?";
+  }
+
+  const ThreadProfileConfig& profileFor(const RealtimeConfig& cfg, ThreadRole role) {
+    static const ThreadProfileConfig kDefaultProfile{};
+    switch (role) {
+      case ThreadRole::Fusion:   return cfg.fusion;
+      case ThreadRole::SensorRx: return cfg.sensor_rx;
+      case ThreadRole::Worker:   return cfg.workers;
+      case ThreadRole::Shadow:   return cfg.shadow;
+      case ThreadRole::Background: return kDefaultProfile;
+      case ThreadRole::Io:       break;
+    }
+    return cfg.io;
+  }
+
+#ifdef __linux__
+  // 起動時（どのスレッドもピン留めする前）のプロセスの CPU マスク。
+  // cpus が空のロールはこれに戻す（生成元スレッドのピン留めを継承しないように）
+  cpu_set_t g_process_cpus;
+  bool g_process_cpus_valid = false;   // g_mu
+
+  // スタックを先に触っておき、ロック後のページフォルトを避ける
+  void prefaultStack() {
+    constexpr size_t kStackPrefault = 256 * 1024;
+    char buf[kStackPrefault];
+    std::memset(buf, 0, sizeof(buf));
+    asm volatile("" : : "r"(buf) : "memory"); // 最適化で消されないように
+  }
+#endif
+}
+
+void configure(const RealtimeConfig& cfg) {
+  {
+    std::lock_guard<std::mutex> lk(g_mu);
+    g_cfg = cfg;
+  }
+  if (!cfg.enabled) return;
+
+#ifdef __linux__
+  {
+    std::lock_guard<std::mutex> lk(g_mu);
+    if (!g_process_cpus_valid) {
+      CPU_ZERO(&g_process_cpus);
+      g_process_cpus_valid = sched_getaffinity(0, sizeof(g_process_cpus), &g_process_cpus) == 0;
+    }
+  }
+  if (cfg.lock_memory && !g_memory_locked.load()) {
+    if (cfg.prefault_heap_mb > 0) {
+      // 解放したヒープを OS に返さず、大きな確保も mmap にしない（ロック済みページを再利用する）
+      mallopt(M_TRIM_THRESHOLD, -1);
+      mallopt(M_MMAP_MAX, 0);
+    }
+    // MCL_FUTURE は以後のスレッドスタックや確保もロックするため、上限が有限だと
+    // 後から pthread_create / malloc が EAGAIN で失敗する。その場合はロックしない
+    rlimit lim{};
+    const bool limited = getrlimit(RLIMIT_MEMLOCK, &lim) == 0 && lim.rlim_cur != RLIM_INFINITY && geteuid() != 0;
+    if (limited) {
+      std::cerr << "[Realtime] RLIMIT_MEMLOCK is " << (lim.rlim_cur >> 10)
+                << " KiB (needs unlimited, e.g. LimitMEMLOCK=infinity) - continuing without memory locking" << std::endl;
+    } else if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      std::cerr << "[Realtime] mlockall failed: " << std::strerror(errno)
+                << " (needs CAP_IPC_LOCK or a larger RLIMIT_MEMLOCK) - continuing without memory locking" << std::endl;
+    } else {
+      g_memory_locked = true;
+      if (cfg.prefault_heap_mb > 0) {
+        const size_t bytes = static_cast<size_t>(cfg.prefault_heap_mb) << 20;
+        const long page = sysconf(_SC_PAGESIZE);
+        if (auto* p = static_cast<volatile char*>(std::malloc(bytes))) {
+          for (size_t i = 0; i < bytes; i += static_cast<size_t>(page)) p[i] = 0;
+          std::free(const_cast<char*>(p));
+        }
+      }
+      std::cout << "[Realtime] memory locked (prefault_heap_mb=" << cfg.prefault_heap_mb << ")" << std::endl;
+    }
+  }
+#else
+  std::cerr << "[Realtime] real-time profile is only supported on Linux - ignored" << std::endl;
+#endif
+}
+
+bool applyThreadProfile(ThreadRole role) {
+  ThreadProfileConfig profile;
+  bool lock_memory = false;
+#ifdef __linux__
+  cpu_set_t process_cpus;
+  bool process_cpus_valid = false;
+#endif
+  {
+    std::lock_guard<std::mutex> lk(g_mu);
+    if (!g_cfg.enabled) return true;
+    profile = profileFor(g_cfg, role);
+    lock_memory = g_cfg.lock_memory;
+#ifdef __linux__
+    process_cpus = g_process_cpus;
+    process_cpus_valid = g_process_cpus_valid;
+#endif
+  }
+
+#ifdef __linux__
+  // Linux のスレッドは生成元の CPU マスクとスケジューリング方針を継承する。
+  // 空の cpus / priority 0 は「既定」なので、明示的に既定へ戻す
+  // （例: fusion スレッド内で作られるワーカーが SCHED_FIFO・fusion コアのままになるのを防ぐ）
+  bool ok = true;
+  char name[16];
+  std::snprintf(name, sizeof(name), "hh-%s", roleName(role));
+  pthread_setname_np(pthread_self(), name);
+
+  if (!profile.cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : profile.cpus) {
+      if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    const int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+      std::cerr << "[Realtime] " << roleName(role) << ": CPU pinning failed: " << std::strerror(rc) << std::endl;
+      ok = false;
+    }
+  } else if (process_cpus_valid) {
+    const int rc = pthread_setaffinity_np(pthread_self(), sizeof(process_cpus), &process_cpus);
+    if (rc != 0) {
+      std::cerr << "[Realtime] " << roleName(role) << ": restoring the process CPU mask failed: " << std::strerror(rc) << std::endl;
+      ok = false;
+    }
+  }
+
+  if (profile.priority > 0) {
+    sched_param sp{};
+    sp.sched_priority = std::clamp(profile.priority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+    const int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+    if (rc != 0) {
+      std::cerr << "[Realtime] " << roleName(role) << ": SCHED_FIFO " << sp.sched_priority << " failed: " << std::strerror(rc)
+                << " (needs CAP_SYS_NICE or an rtprio limit) - staying on the default scheduler" << std::endl;
+      ok = false;
+    }
+  } else {
+    int policy = SCHED_OTHER;
+    sched_param current{};
+    if (pthread_getschedparam(pthread_self(), &policy, &current) == 0 && policy != SCHED_OTHER) {
+      // 実時間方針から通常方針へ下げるのに特権は要らない
+      sched_param sp{};
+      const int rc = pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+      if (rc != 0) {
+        std::cerr << "[Realtime] " << roleName(role) << ": resetting to SCHED_OTHER failed: " << std::strerror(rc) << std::endl;
+        ok = false;
+      }
+    }
+  }
+
+  if (lock_memory && g_memory_locked.load()) prefaultStack();
+
+  (ok ? g_applied : g_degraded).fetch_add(1);
+  std::cout << "[Realtime] " << roleName(role) << " thread profile: cpus=" << profile.cpus.size()
+            << " priority=" << profile.priority << (ok ? "" : " (degraded)") << std::endl;
+  return ok;
+#else
+  (void)role;
+  (void)lock_memory;
+  return true;
+#endif
+}
+
+bool lowerThreadPriority(int nice_delta) {
+#ifdef __linux__
+  // SCHED_FIFO のスレッドから生成されると方針を継承するので、先に通常スケジューラへ戻す
+  sched_param sp{};
+  pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+  const pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+  errno = 0;
+  const int current = getpriority(PRIO_PROCESS, static_cast<id_t>(tid));
+  if (errno == 0 && setpriority(PRIO_PROCESS, static_cast<id_t>(tid), std::min(current + nice_delta, 19)) == 0) {
+    return true;
+  }
+  std::cerr << "[Realtime] lowering thread priority failed: " << std::strerror(errno) << std::endl;
+  return false;
+#else
+  (void)nice_delta;
+  return true;
+#endif
+}
+
+Status status() {
+  Status s;
+  {
+    std::lock_guard<std::mutex> lk(g_mu);
+    s.enabled = g_cfg.enabled;
+  }
+  s.memory_locked = g_memory_locked.load();
+  s.threads_applied = g_applied.load();
+  s.threads_degraded = g_degraded.load();
+  return s;
+}
+
+// ---- tick jitter ----
+
+void TickJitter::Window::add(int64_t lateness_ns, bool missed_tick) {
+  if (hist.empty()) hist.assign(kBuckets, 0);
+  const int64_t v = std::max<int64_t>(0, lateness_ns);
+  ++ticks;
+  if (missed_tick) ++missed;
+  sum_ns += static_cast<double>(v);
+  max_ns = std::max(max_ns, v);
+  ++hist[std::min<size_t>(static_cast<size_t>(v / kBucketNs), kBuckets - 1)];
+}
+
+void TickJitter::Window::reset() {
+  ticks = missed = 0;
+  sum_ns = 0.0;
+  max_ns = 0;
+  std::fill(hist.begin(), hist.end(), 0u);
+}
+
+TickJitterStats TickJitter::Window::stats() const {
+  TickJitterStats s;
+  s.ticks = ticks;
+  s.missed = missed;
+  if (ticks == 0) return s;
+  s.mean_us = sum_ns / static_cast<double>(ticks) / 1000.0;
+  s.max_us = static_cast<double>(max_ns) / 1000.0;
+  // p99: 上側バケット境界で近似
+  const uint64_t target = ticks - ticks / 100;
+  uint64_t acc = 0;
+  for (size_t i = 0; i < hist.size(); ++i) {
+    acc += hist[i];
+    if (acc >= target) {
+      s.p99_us = std::min(static_cast<double>((i + 1) * kBucketNs) / 1000.0, s.max_us);
+      break;
+    }
+  }
+  return s;
+}
+
+void TickJitter::record(int64_t lateness_ns, int64_t period_ns) {
+  int report_sec = 0;
+  {
+    std::lock_guard<std::mutex> lk(g_mu);
+    // 統計は常に取る（/api/v1/metrics で有効化前後を比較できる）。ログは有効時のみ
+    report_sec = g_cfg.enabled ? g_cfg.jitter_report_sec : 0;
+  }
+  const bool missed_tick = lateness_ns > period_ns;
+
+  TickJitterStats report;
+  bool do_report = false;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    total_.add(lateness_ns, missed_tick);
+    window_.add(lateness_ns, missed_tick);
+    window_ns_ += period_ns;
+    if (report_sec > 0 && window_ns_ >= static_cast<int64_t>(report_sec) * 1'000'000'000) {
+      report = window_.stats();
+      do_report = true;
+      window_.reset();
+      window_ns_ = 0;
+    }
+  }
+  if (do_report) {
+    std::cout << "[Realtime] tick jitter: ticks=" << report.ticks << " mean=" << report.mean_us
+              << "us p99=" << report.p99_us << "us max=" << report.max_us
+              << "us missed=" << report.missed << std::endl;
+  }
+}
+
+TickJitterStats TickJitter::total() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return total_.stats();
+}
+
+TickJitter& fusionTickJitter() {
+  static TickJitter jitter;
+  return jitter;
+}
+
+} // namespace realtime
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "config/config.h"
+
+// Real-time scheduling profile (CPU pinning / SCHED_FIFO / mlockall) and fusion tick jitter.
+// configure() is called once at startup; each long-lived thread calls applyThreadProfile()
+// for its role when it starts. Everything degrades to a warning when privileges are missing
+// (CAP_SYS_NICE / CAP_IPC_LOCK / rtprio / memlock limits) or on non-Linux builds.
+namespace realtime {
+
+// Background has no profile of its own (sink workers, sensor lifecycle threads): with the
+// profile enabled it always resets to the process CPU mask and SCHED_OTHER.
+enum class ThreadRole { Fusion, SensorRx, Worker, Io, Shadow, Background };
+
+// Store the profile and lock memory (process-wide, once).
+void configure(const RealtimeConfig& cfg);
+
+// Apply the profile of `role` to the calling thread. Returns true if everything requested
+// was applied (also true when the profile is disabled or empty).
+// With the profile enabled, empty cpus / priority 0 reset the thread to the process CPU mask
+// and SCHED_OTHER instead of keeping what it inherited from its creator (e.g. the fusion thread).
+bool applyThreadProfile(ThreadRole role);
+
+// Put the calling thread on the normal scheduler at a lower priority (nice).
+// Independent of the profile; used for background work that must not compete with the pipeline.
+bool lowerThreadPriority(int nice_delta);
+
+struct Status {
+  bool enabled{false};
+  bool memory_locked{false};
+  uint32_t threads_applied{0};
+  uint32_t threads_degraded{0};   // threads where pinning or priority could not be applied
+};
+Status status();
+
+// Lateness of the fusion thread's wake-ups relative to its tick schedule.
+struct TickJitterStats {
+  uint64_t ticks{0};
+  uint64_t missed{0};             // wake-ups later than one full period
+  double mean_us{0.0};
+  double p99_us{0.0};
+  double max_us{0.0};
+};
+
+class TickJitter {
+public:
+  // Record one wake-up. Logs the window statistics every report interval.
+  void record(int64_t lateness_ns, int64_t period_ns);
+  TickJitterStats total() const;
+
+private:
+  static constexpr int64_t kBucketNs = 50'000;  // 50us histogram buckets
+  static constexpr size_t kBuckets = 1000;      // up to 50ms, last bucket is open-ended
+
+  struct Window {
+    uint64_t ticks{0}, missed{0};
+    double sum_ns{0.0};
+    int64_t max_ns{0};
+    std::vector<uint32_t> hist;
+    void add(int64_t lateness_ns, bool missed_tick);
+    void reset();
+    TickJitterStats stats() const;
+  };
+
+  mutable std::mutex mu_;
+  Window total_;
+  Window window_;
+  int64_t window_ns_{0};
+};
+
+TickJitter& fusionTickJitter();
+
+} // namespace realtime
@@ -4,21 +4,31 @@
 #include "sensors/ISensor.h"
 #include "sensors/SensorFactory.h"
 #include "mask.h"
+#include "detection_params.h"
+#include "detect/scan_filter.h"
+#include "detect/dbscan.h"
 
 #include "transform.h"
+#include "worker_pool.h"
+#include "realtime.h"
+#include "alloc_stats.h"
+#include "trace.h"
 
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
 #ifdef _WIN32
 #define _USE_MATH_DEFINES
 #endif
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <mutex>
 #include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include <algorithm>
 
@@ -42,25 +52,318 @@ namespace {
     return static_cast<float>(ddeg);
   }
 
+// world_mask をこのセンサーのステップ区間へ射影したキャッシュ。
+// 姿勢・スキャン形状・マスクのいずれかが変わったときだけ作り直す。
+struct IngestRoi {
+  std::shared_ptr<const core::CompiledWorldMask> mask;
+  float tx{0.0f}, ty{0.0f}, theta_deg{0.0f};
+  double start_angle{0.0};
+  double angle_res{0.0};
+  size_t steps{0};
+  core::RayRangeIntervals intervals;
+
+  bool matches(const std::shared_ptr<const core::CompiledWorldMask>& m, const PoseDeg& pose, const RawScan& rs) const {
+    return mask == m && tx == pose.tx && ty == pose.ty && theta_deg == pose.theta_deg &&
+           start_angle == rs.start_angle && angle_res == rs.angle_res && steps == rs.ranges_mm.size();
+  }
+};
+
+// センサーの実行状態（ライフサイクルスレッドが更新し、集約スレッド・API が読む）
+enum class RunState : uint8_t { Stopped, Connecting, Running, Failed };
+
+inline const char* runStateName(RunState s) {
+  switch (s) {
+    case RunState::Connecting: return "connecting";
+    case RunState::Running:    return "running";
+    case RunState::Failed:     return "failed";
+    default:                   return "stopped";
+  }
+}
+
 struct Slot {
   SensorConfig cfg;                    // pose/mask/connection 等を保持（動的更新もここ）
-  std::unique_ptr<ISensor> dev;        // 実デバイス（抽象）
+  std::unique_ptr<ISensor> dev;        // 実デバイス（抽象）。start/stop/差し替えはライフサイクルスレッドのみ
   RawScan latest;                      // 最新Raw（push購読で差し替え）
   std::mutex mu;                       // latest保護
   uint8_t sid{0};                      // 出力時のセンサーID（0..255）
-  bool started{false};
   std::atomic<bool> need_restart{false};
+  // ライフサイクル: start/stop/再起動はスロットごとの専用スレッドで非同期に行う。
+  // 接続待ち（ブロッキング connect）の間も slots_mu や呼び出し元を止めない。
+  std::atomic<RunState> run_state{RunState::Stopped};
+  std::mutex life_mu;
+  std::condition_variable life_cv;
+  bool want_running{false};                 // life_mu: 要求された状態（enabled）
+  uint64_t restart_gen{0};                  // life_mu: 再起動要求ごとに +1
+  std::unique_ptr<ISensor> pending_dev;     // life_mu: 差し替え待ちのドライバ
+  SensorConfig start_cfg;                   // life_mu: 次の start() に渡す設定
+  bool quit{false};                         // life_mu
+  std::thread life_th;
+  IngestRoi roi;                       // 集約スレッド専用
+  // prefilter.scan_stage（集約スレッド専用）
+  ScanFilter scan_filter;
+  uint64_t scan_filter_version{0};
+  std::vector<float> scan_range, scan_angle, scan_intensity;
+  RawScan scan;                        // latest のコピー先（集約スレッド専用、容量を再利用）
+  size_t out_offset{0};                // 融合配列内の割り当て先頭（集約スレッド専用）
+  size_t out_count{0};                 // convertScan が書いた点数
+  // センサーモデル導出に使った値（集約スレッド専用、変化したらテーブルを作り直す）
+  uint8_t model_sid{0};
+  double model_angle_res{0.0};
+  std::string model_type;
+
+  ~Slot() {
+    if (life_th.joinable()) {
+      {
+        std::lock_guard<std::mutex> lk(life_mu);
+        quit = true;
+      }
+      life_cv.notify_one();
+      life_th.join();
+    }
+  }
 };
 
+inline RunState runStateOf(SensorLinkState s) {
+  switch (s) {
+    case SensorLinkState::Streaming: return RunState::Running;
+    case SensorLinkState::Failed:    return RunState::Failed;
+    default:                         return RunState::Connecting;
+  }
+}
+
+// 要求（want_running / restart_gen / pending_dev）と実デバイスの状態を突き合わせる。
+// 失敗した起動は自動では再試行しない（再度 enable / restart されたときに試す）。
+void lifecycleLoop(Slot& sl) {
+  // 生成元（fusion / Crow スレッド）の CPU マスク・SCHED_FIFO を継承しないよう既定に戻す
+  realtime::applyThreadProfile(realtime::ThreadRole::Background);
+  bool running = false;        // dev->start() が成功している
+  bool applied_want = false;
+  uint64_t applied_gen = 0;
+  std::unique_lock<std::mutex> lk(sl.life_mu);
+  for (;;) {
+    sl.life_cv.wait(lk, [&] {
+      return sl.quit || sl.pending_dev || sl.want_running != applied_want || sl.restart_gen != applied_gen;
+    });
+    if (sl.quit) break;
+    const bool want = sl.want_running;
+    const uint64_t gen = sl.restart_gen;
+    std::unique_ptr<ISensor> next = std::move(sl.pending_dev);
+    const SensorConfig cfg = sl.start_cfg;
+    lk.unlock();
+
+    // 停止（無効化・再起動・ドライバ差し替え）
+    if (running && (!want || gen != applied_gen || next)) {
+      sl.run_state.store(RunState::Stopped);
+      sl.dev->stop();
+      // stop() までに届いた状態通知を上書きする（以降は通知されない）
+      sl.run_state.store(RunState::Stopped);
+      running = false;
+      std::cout << "[SensorManager] stopped sensor id=" << cfg.id << std::endl;
+    }
+    if (!running) {
+      // 古いスキャンが再開後に混ざらないよう捨てる
+      std::lock_guard<std::mutex> lk2(sl.mu);
+      sl.latest.ranges_mm.clear();
+    }
+    if (next) {
+      std::unique_ptr<ISensor> old;
+      {
+        std::lock_guard<std::mutex> lk2(sl.life_mu);
+        old = std::exchange(sl.dev, std::move(next));
+      }
+    }
+
+    if (want && !running && sl.dev) {
+      sl.run_state.store(RunState::Connecting);
+      // 非同期に接続するドライバ（hokuyo_urg_eth_epoll 等）は start() が登録だけで戻るので、
+      // 接続中 / 受信中 / 失敗（バックオフ中）はドライバの通知で更新する
+      const bool reports = sl.dev->reportsLinkState();
+      if (reports) {
+        sl.dev->setStateCallback([&sl](SensorLinkState s) { sl.run_state.store(runStateOf(s)); });
+      }
+      const auto t0 = clock_mono::now();
+      running = sl.dev->start(cfg);
+      if (!running) {
+        sl.run_state.store(RunState::Failed);
+      } else if (!reports) {
+        sl.run_state.store(RunState::Running);
+      }
+      const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(clock_mono::now() - t0).count();
+      if (running && reports) {
+        std::cout << "[SensorManager] registered sensor id=" << cfg.id << " (connecting asynchronously)" << std::endl;
+      } else if (running) {
+        std::cout << "[SensorManager] started sensor id=" << cfg.id << " (" << ms << "ms)" << std::endl;
+      } else {
+        std::cerr << "[SensorManager] FAILED to start sensor id=" << cfg.id << " (" << ms << "ms)" << std::endl;
+      }
+    } else if (!want) {
+      sl.run_state.store(RunState::Stopped);
+    }
+
+    applied_want = want;
+    applied_gen = gen;
+    lk.lock();
+  }
+  lk.unlock();
+  if (running) {
+    sl.run_state.store(RunState::Stopped);
+    sl.dev->stop();
+    sl.run_state.store(RunState::Stopped);
+  }
+}
+
+// 要求を書き換えてライフサイクルスレッドを起こす（I/O はしないので即座に戻る）
+template <class F>
+void requestLifecycle(Slot& sl, F&& update) {
+  {
+    std::lock_guard<std::mutex> lk(sl.life_mu);
+    update();
+  }
+  sl.life_cv.notify_one();
+}
+
+bool wantsRunning(Slot& sl) {
+  std::lock_guard<std::mutex> lk(sl.life_mu);
+  return sl.want_running;
+}
+
+// ドライバを生成して最新スキャンの購読をつなぐ（接続はしない）
+std::unique_ptr<ISensor> makeDevice(Slot& sl, const SensorConfig& cfg) {
+  auto dev = create_sensor(cfg);
+  if (!dev) {
+    std::cerr << "[SensorManager] no driver for type: " << cfg.type << " (id=" << cfg.id << ")\n";
+    return nullptr;
+  }
+  dev->subscribe([raw = &sl](const RawScan& rs){
+    alloc_stats::ScopedStage alloc_scope(alloc_stats::Stage::Ingest);
+    std::lock_guard<std::mutex> lk(raw->mu);
+    raw->latest = rs;
+    alloc_stats::noteCopy((rs.ranges_mm.size() + rs.intensities.size()) * sizeof(uint16_t));
+  });
+  return dev;
+}
+
 struct State {
   std::vector<std::unique_ptr<Slot>> slots;
   std::unordered_map<std::string, uint8_t> id2sid;
   std::atomic<bool> running{false};
   std::thread th;
   std::atomic<uint32_t> seq{0};
+  std::atomic<DetectionParamsStore*> params{nullptr};
+  std::shared_ptr<const SensorModelTable> sensor_models; // 集約スレッド専用
   std::mutex slots_mu;  // slots/id2sid コンテナ自体の保護（集約スレッドと configure() 等の競合回避）
 };
 
+// 1フレーム分の取り込み条件（全センサー共通）
+struct IngestContext {
+  const DetectionParams* snapshot{nullptr};
+  std::shared_ptr<const core::CompiledWorldMask> ingest_mask;
+  bool scan_stage{false};
+};
+
+// 1センサー分のスキャンをワールド座標へ変換し、割り当て済みの出力範囲へ書く。
+// 書き込み先は最大 sl.scan.ranges_mm.size() 点。戻り値は書いた点数。
+// スロット固有の状態（roi / scan_filter / scan_*）しか触らないので、センサー間で並列に呼べる。
+size_t convertScan(Slot& sl, const IngestContext& ctx, float* xy, uint8_t* sid, float* dist) {
+  const RawScan& rs = sl.scan;
+  const auto& ingest_mask = ctx.ingest_mask;
+  const bool scan_stage = ctx.scan_stage;
+  size_t n = 0;
+
+  const auto& pose = sl.cfg.pose;
+  const auto& m    = sl.cfg.mask;
+
+  // Pre-compute pose rotation (constant per sensor)
+  const float pose_th = pose.theta_deg * static_cast<float>(M_PI / 180.0);
+  const float pose_cos = std::cos(pose_th);
+  const float pose_sin = std::sin(pose_th);
+
+  // world_mask をステップ区間へ射影（変更時のみ再計算）
+  const core::RayRangeIntervals* roi = nullptr;
+  if (ingest_mask && !ingest_mask->empty()) {
+    if (!sl.roi.matches(ingest_mask, pose, rs)) {
+      sl.roi.mask = ingest_mask;
+      sl.roi.tx = pose.tx; sl.roi.ty = pose.ty; sl.roi.theta_deg = pose.theta_deg;
+      sl.roi.start_angle = rs.start_angle;
+      sl.roi.angle_res = rs.angle_res;
+      sl.roi.steps = rs.ranges_mm.size();
+      core::projectWorldMaskToRays(*ingest_mask, pose.tx, pose.ty,
+                                   (static_cast<double>(pose.theta_deg) + rs.start_angle) * (M_PI / 180.0),
+                                   rs.angle_res * (M_PI / 180.0), rs.ranges_mm.size(), sl.roi.intervals);
+    }
+    roi = &sl.roi.intervals;
+  }
+
+  auto emit = [&](float r_m, double angle_rad) {
+    float x = r_m * std::cos(angle_rad);
+    float y = r_m * std::sin(angle_rad);
+
+    // Inline apply_pose with pre-computed cos/sin
+    const float nx = pose_cos * x - pose_sin * y + pose.tx;
+    const float ny = pose_sin * x + pose_cos * y + pose.ty;
+    x = nx; y = ny;
+
+    xy[2 * n] = x;
+    xy[2 * n + 1] = y;
+    sid[n] = sl.sid;
+    dist[n] = r_m;
+    ++n;
+  };
+
+  // prefilter.scan_stage: 候補をステップ順に集め、センサー単位で spike/outlier/intensity を判定
+  const bool has_intensity = rs.intensities.size() == rs.ranges_mm.size();
+  if (scan_stage) {
+    if (sl.scan_filter_version != ctx.snapshot->version) {
+      sl.scan_filter.setConfig(ctx.snapshot->prefilter);
+      sl.scan_filter_version = ctx.snapshot->version;
+    }
+    sl.scan_range.clear();
+    sl.scan_angle.clear();
+    sl.scan_intensity.clear();
+  }
+
+  double ang = rs.start_angle;
+  const int N = static_cast<int>(rs.ranges_mm.size());
+  for (int i = 0; i < N; ++i, ang += rs.angle_res) {
+    const uint16_t d_mm = rs.ranges_mm[i];
+    if (d_mm == 0) continue; // 欠測
+    const float r_m = static_cast<float>(d_mm) * 0.001f;
+
+    // Inline local mask check
+    if (ang < m.angle.min_deg || ang > m.angle.max_deg ||
+        r_m < m.range.near_m  || r_m > m.range.far_m) continue;
+
+    // World ROI (step-domain) — rejected points are never converted
+    if (roi && !roi->allows(static_cast<size_t>(i), r_m)) continue;
+
+    const float angle_rad = deg2rad(static_cast<float>(ang));
+    if (scan_stage) {
+      sl.scan_range.push_back(r_m);
+      sl.scan_angle.push_back(angle_rad);
+      if (has_intensity) sl.scan_intensity.push_back(static_cast<float>(rs.intensities[i]));
+      continue;
+    }
+    emit(r_m, angle_rad);
+  }
+
+  if (scan_stage && !sl.scan_range.empty()) {
+    const auto& keep = sl.scan_filter.apply(sl.scan_angle.data(), sl.scan_range.data(),
+                                            has_intensity ? sl.scan_intensity.data() : nullptr,
+                                            sl.scan_range.size());
+    for (size_t k = 0; k < sl.scan_range.size(); ++k) {
+      if (keep.test(k)) emit(sl.scan_range[k], sl.scan_angle[k]);
+    }
+  }
+
+  return n;
+}
+
+// 呼び出し側スレッドも処理に加わるので、ワーカーは論理コア数の半分まで（最大3）
+size_t fusionWorkerCount() {
+  const unsigned hw = std::thread::hardware_concurrency();
+  return std::min<size_t>(3, hw > 1 ? hw / 2 : 0);
+}
+
 State& S() {
   static State s;
   return s;
@@ -112,6 +415,9 @@ void SensorManager::configure(const std::vector<SensorConfig>& cfgs) {
   uint8_t next_sid = 0;
   
   // Process each new configuration
+  // デバイスの start/stop はここでは行わず、各スロットのライフサイクルスレッドへ要求するだけ。
+  // （接続待ちで slots_mu を握り続けると集約スレッドが止まるため）
+  std::vector<std::unique_ptr<Slot>> retired;
   for (const auto& new_cfg : cfgs) {
     auto current_it = current_sensors.find(new_cfg.id);
     std::unique_ptr<Slot> slot;
@@ -119,6 +425,7 @@ void SensorManager::configure(const std::vector<SensorConfig>& cfgs) {
     if (current_it != current_sensors.end()) {
       // Sensor exists in current configuration
       slot = std::move(current_it->second);
+      current_sensors.erase(current_it);
       
       // Update configuration (but preserve device and state)
       bool config_changed = (slot->cfg.host != new_cfg.host ||
@@ -131,76 +438,34 @@ void SensorManager::configure(const std::vector<SensorConfig>& cfgs) {
       slot->cfg = new_cfg;
       
       // If critical config changed, need to recreate device
+      std::unique_ptr<ISensor> dev;
       if (config_changed) {
-        if (slot->started) {
-          slot->dev->stop();
-          slot->started = false;
-        }
-        slot->dev = create_sensor(new_cfg);
-        if (!slot->dev) {
-          std::cerr << "[SensorManager] no driver for type: " << new_cfg.type << " (id=" << new_cfg.id << ")\n";
+        dev = makeDevice(*slot, new_cfg);
+        if (!dev) {
+          retired.emplace_back(std::move(slot));
           continue;
         }
-        // Re-setup subscription
-        slot->dev->subscribe([raw = slot.get()](const RawScan& rs){
-          std::lock_guard<std::mutex> lk(raw->mu);
-          raw->latest = rs;
-        });
-      }
-      
-      // Handle enabled state based on new configuration
-      if (new_cfg.enabled) {
-        // Should be running
-        if (!slot->started) {
-          // Currently not running + should run → start
-          if (slot->dev && slot->dev->start(slot->cfg)) {
-            slot->started = true;
-            std::cout << "[SensorManager] started existing sensor id=" << slot->cfg.id << std::endl;
-          } else {
-            std::cerr << "[SensorManager] FAILED to start existing sensor id=" << slot->cfg.id << std::endl;
-          }
-        }
-        // Currently running + should run → do nothing (already handled above)
-      } else {
-        // Should not be running
-        if (slot->started) {
-          // Currently running + should not run → stop
-          slot->dev->stop();
-          slot->started = false;
-          std::cout << "[SensorManager] stopped sensor id=" << slot->cfg.id << std::endl;
-        }
-        // Currently not running + should not run → do nothing
       }
-      
-      current_sensors.erase(current_it);
+      requestLifecycle(*slot, [&] {
+        if (dev) slot->pending_dev = std::move(dev);
+        slot->start_cfg = new_cfg;
+        slot->want_running = new_cfg.enabled;
+      });
+      std::cout << "[SensorManager] updated sensor id=" << new_cfg.id
+                << (config_changed ? " (device recreated)" : "")
+                << (new_cfg.enabled ? "" : " (disabled)") << std::endl;
     } else {
       // New sensor not in current configuration
       slot = std::make_unique<Slot>();
       slot->cfg = new_cfg;
-      slot->dev = create_sensor(new_cfg);
-      if (!slot->dev) {
-        std::cerr << "[SensorManager] no driver for type: " << new_cfg.type << " (id=" << new_cfg.id << ")\n";
-        continue;
-      }
-      
-      // Setup subscription
-      slot->dev->subscribe([raw = slot.get()](const RawScan& rs){
-        std::lock_guard<std::mutex> lk(raw->mu);
-        raw->latest = rs;
-      });
-      
-      if (new_cfg.enabled) {
-        // Not in current + should run → add and start
-        if (slot->dev->start(slot->cfg)) {
-          slot->started = true;
-          std::cout << "[SensorManager] added and started new sensor id=" << slot->cfg.id << std::endl;
-        } else {
-          std::cerr << "[SensorManager] FAILED to start new sensor id=" << slot->cfg.id << std::endl;
-        }
-      } else {
-        // Not in current + should not run → add but don't start
-        std::cout << "[SensorManager] added new sensor id=" << slot->cfg.id << " (not started)" << std::endl;
-      }
+      slot->dev = makeDevice(*slot, new_cfg);
+      if (!slot->dev) continue;
+      slot->start_cfg = new_cfg;
+      slot->want_running = new_cfg.enabled;
+      Slot* raw = slot.get();
+      slot->life_th = std::thread([raw] { lifecycleLoop(*raw); });
+      std::cout << "[SensorManager] added new sensor id=" << new_cfg.id
+                << (new_cfg.enabled ? "" : " (not started)") << std::endl;
     }
     
     // Assign sensor ID and add to slots
@@ -210,19 +475,24 @@ void SensorManager::configure(const std::vector<SensorConfig>& cfgs) {
   }
   
   // Handle sensors that exist in current but not in new configuration
-  // → stop and remove (they're already removed from st.slots, just need to stop)
+  // → stop and remove (they're already removed from st.slots)
   for (auto& [id, slot] : current_sensors) {
-    if (slot->started) {
-      slot->dev->stop();
-      slot->started = false;
-      std::cout << "[SensorManager] stopped and removed sensor id=" << id << std::endl;
-    }
-    // slot will be automatically destroyed when current_sensors goes out of scope
+    std::cout << "[SensorManager] removed sensor id=" << id << std::endl;
+    retired.emplace_back(std::move(slot));
+  }
+  if (!retired.empty()) {
+    // 接続中のセンサーは停止完了まで時間がかかることがあるため、破棄（ライフサイクル
+    // スレッドの join とデバイス停止）は別スレッドで行う
+    std::thread([r = std::move(retired)]() mutable { r.clear(); }).detach();
   }
 
   std::cout << "[SensorManager] configured sensors=" << st.slots.size() << std::endl;
 }
 
+void SensorManager::setDetectionParams(DetectionParamsStore* params) {
+  S().params.store(params);
+}
+
 void SensorManager::setSensorPower(std::string /*sensor_id*/, bool /*on*/) {
   // 現状、Hokuyoは電源制御API無し。必要なら将来 ISensor に拡張。
 }
@@ -261,17 +531,16 @@ bool SensorManager::restartSensor(std::string sensor_id) {
   int slot_index = -1;
   if (!getSlotIndexById(sensor_id, slot_index)) return false;
   auto& sl = *(S().slots[slot_index]);
-  if (!sl.dev) return false;
 
-  if (sl.started) {
-    sl.dev->stop();
-    sl.started = false;
-  }
-  const bool ok = sl.dev->start(sl.cfg);
-  sl.started = ok;
+  // 停止→起動はライフサイクルスレッドで非同期に行う（結果は state で確認）
+  requestLifecycle(sl, [&] {
+    sl.start_cfg = sl.cfg;
+    sl.want_running = true;
+    ++sl.restart_gen;
+  });
   sl.need_restart.store(false);
-  std::cout << "[SensorManager] restart slot=" << slot_index << " -> " << (ok?"OK":"NG") << std::endl;
-  return ok;
+  std::cout << "[SensorManager] restart requested slot=" << slot_index << std::endl;
+  return true;
 }
 
 bool SensorManager::applyPatch(std::string sensor_id, const Json::Value& patch, Json::Value& applied, std::string& err){
@@ -358,7 +627,10 @@ bool SensorManager::applyPatch(std::string sensor_id, const Json::Value& patch,
       app_config_.sensors[slot_index].mode = m;
     }
     
-    if (!sl.dev || !sl.dev->applyMode(m)) need_restart = true;
+    {
+      std::lock_guard<std::mutex> lk(sl.life_mu);
+      if (!sl.dev || !sl.dev->applyMode(m)) need_restart = true;
+    }
   }
 
   // skip_step
@@ -373,7 +645,10 @@ bool SensorManager::applyPatch(std::string sensor_id, const Json::Value& patch,
       app_config_.sensors[slot_index].skip_step = v;
     }
     
-    if (!sl.dev || !sl.dev->applySkipStep(v)) need_restart = true;
+    {
+      std::lock_guard<std::mutex> lk(sl.life_mu);
+      if (!sl.dev || !sl.dev->applySkipStep(v)) need_restart = true;
+    }
   }
   if (patch.isMember("ignore_checksum_error")){
     const int v = patch["ignore_checksum_error"].asInt();
@@ -389,7 +664,7 @@ bool SensorManager::applyPatch(std::string sensor_id, const Json::Value& patch,
     need_restart = true;
   }
 
-  if (need_restart && sl.started) {
+  if (need_restart && wantsRunning(sl)) {
     sl.need_restart.store(true);
     restartSensor(sensor_id);
   }
@@ -403,22 +678,22 @@ void SensorManager::start(FrameCallback cb) {
     return;
   }
 
-  // 各センサーを起動
-  for (auto& up : st.slots) {
-    auto& sl = *up;
-    if (!sl.dev) continue;
-    if (sl.dev->start(sl.cfg)) {
-      sl.started = true;
-      std::cout << "[SensorManager] started sensor id=" << sl.cfg.id
-                << " (sid=" << int(sl.sid) << ")\n";
-    } else {
-      std::cerr << "[SensorManager] FAILED to start sensor id=" << sl.cfg.id << "\n";
+  // 各センサーの起動は configure() でライフサイクルスレッドへ要求済み（並列に接続中）。
+  // 集約スレッドは接続を待たずに始め、Running になったセンサーから取り込む。
+  {
+    std::lock_guard<std::mutex> slk(st.slots_mu);
+    for (auto& up : st.slots) {
+      std::cout << "[SensorManager] sensor id=" << up->cfg.id << " (sid=" << int(up->sid) << ") state="
+                << runStateName(up->run_state.load()) << std::endl;
     }
   }
 
   // 集約スレッド：直近Rawを統合してScanFrameに
   st.th = std::thread([cb]{
     auto& st2 = S();
+    realtime::applyThreadProfile(realtime::ThreadRole::Fusion);
+    alloc_stats::setStage(alloc_stats::Stage::Ingest);
+    trace::setThreadName("fusion");
     // TODO: アプリ設定によって可変にする
     const double target_fps = 30.0;
 
@@ -426,85 +701,148 @@ void SensorManager::start(FrameCallback cb) {
                           std::chrono::duration<double>(1.0 / target_fps));
     auto next_tick = clock_mono::now();
 
+    // フレームバッファは2面を交互に使う（move で手放さないので容量が残り、
+    // 定常状態ではフレームごとの確保が発生しない。下流が1フレーム遅れて読んでも安全）
     // TODO: センサー数やセンサーの種類によって配列サイズは変えるべき
-    std::vector<float> xy;  xy.reserve(16384);
-    std::vector<uint8_t> sid; sid.reserve(8192);
-    std::vector<float> dist; dist.reserve(8192);
+    ScanFrame frames[2];
+    for (auto& fr : frames) {
+      fr.xy.reserve(16384);
+      fr.sid.reserve(8192);
+      fr.dist.reserve(8192);
+    }
+    size_t frame_slot = 0;
+
+    // センサーごとの変換（マスク・極座標変換・姿勢）は固定サイズのプールで並列に行う
+    WorkerPool pool(fusionWorkerCount());
+    std::vector<Slot*> active;
+    active.reserve(16);
 
     while (st2.running.load()) {
+      trace::Scope ingest_span("fusion.ingest");
+      ScanFrame& f = frames[frame_slot];
+      frame_slot ^= 1;
+      auto& xy = f.xy;
+      auto& sid = f.sid;
+      auto& dist = f.dist;
       xy.clear();
       sid.clear();
       dist.clear();
 
+      // パラメータはフレーム単位で固定（下流にも同じスナップショットを渡す）
+      std::shared_ptr<const DetectionParams> snapshot;
+      if (auto* params = st2.params.load()) snapshot = params->load();
+
+      // ROI を取り込み時に適用するか
+      std::shared_ptr<const core::CompiledWorldMask> ingest_mask;
+      if (snapshot && snapshot->world_mask && snapshot->world_mask->applyAtIngest()) {
+        ingest_mask = snapshot->world_mask;
+      }
+      const bool scan_stage = snapshot && snapshot->prefilter.enabled && snapshot->prefilter.scan_stage;
+
       // slots の差し替え（configure()）と競合しないよう走査中だけロック。
       // 重い下流処理 cb(f) はロック外で呼ぶため、明示ブロックでスコープを限定する。
+      bool models_dirty = !st2.sensor_models;
+      IngestContext ctx;
+      ctx.snapshot = snapshot.get();
+      ctx.ingest_mask = ingest_mask;
+      ctx.scan_stage = scan_stage;
+      active.clear();
+      size_t total = 0;
       {
       std::lock_guard<std::mutex> slk(st2.slots_mu);
       for (auto& up : st2.slots) {
         auto& sl = *up;
-        if (!sl.started) continue;
+        if (sl.run_state.load(std::memory_order_acquire) != RunState::Running) continue;
 
-        RawScan rs;
+        RawScan& rs = sl.scan;
         {
           std::lock_guard<std::mutex> lk(sl.mu);
-          rs = sl.latest; // 無い場合は空
+          rs = sl.latest; // 無い場合は空（コピー代入なので既存の容量を再利用）
         }
+        alloc_stats::noteCopy((rs.ranges_mm.size() + rs.intensities.size()) * sizeof(uint16_t));
         if (rs.ranges_mm.empty()) continue;
 
-        const auto& pose = sl.cfg.pose;
-        const auto& m    = sl.cfg.mask;
-
-        // Pre-compute pose rotation (constant per sensor)
-        const float pose_th = pose.theta_deg * static_cast<float>(M_PI / 180.0);
-        const float pose_cos = std::cos(pose_th);
-        const float pose_sin = std::sin(pose_th);
-
-        double ang = rs.start_angle;
-        const int N = static_cast<int>(rs.ranges_mm.size());
-        for (int i = 0; i < N; ++i, ang += rs.angle_res) {
-          const uint16_t d_mm = rs.ranges_mm[i];
-          if (d_mm == 0) continue; // 欠測
-          const float r_m = static_cast<float>(d_mm) * 0.001f;
-
-          // Inline local mask check
-          if (ang < m.angle.min_deg || ang > m.angle.max_deg ||
-              r_m < m.range.near_m  || r_m > m.range.far_m) continue;
-
-          const double angle_rad = deg2rad(static_cast<float>(ang));
-          float x = r_m * std::cos(angle_rad);
-          float y = r_m * std::sin(angle_rad);
-
-          // Inline apply_pose with pre-computed cos/sin
-          const float nx = pose_cos * x - pose_sin * y + pose.tx;
-          const float ny = pose_sin * x + pose_cos * y + pose.ty;
-          x = nx; y = ny;
-
-          xy.push_back(x);
-          xy.push_back(y);
-          sid.push_back(sl.sid);
-          dist.push_back(r_m);
+        // DBSCAN のセンサーモデルは実際の角度分解能と種別から導出する
+        if (sl.model_angle_res != rs.angle_res || sl.model_sid != sl.sid || sl.model_type != sl.cfg.type) {
+          sl.model_angle_res = rs.angle_res;
+          sl.model_sid = sl.sid;
+          sl.model_type = sl.cfg.type;
+          models_dirty = true;
+        }
+
+        // 出力範囲を先に割り当てる（上限はステップ数）。変換順＝スロット順なので
+        // 並列に変換しても点の並びは逐次処理と同じになる
+        sl.out_offset = total;
+        total += rs.ranges_mm.size();
+        active.push_back(&sl);
+      }
+
+      xy.resize(2 * total);
+      sid.resize(total);
+      dist.resize(total);
+      pool.run(active.size(), [&](size_t k) {
+        Slot& sl = *active[k];
+        trace::Scope span("fusion.convert", sl.cfg.id);
+        const size_t off = sl.out_offset;
+        sl.out_count = convertScan(sl, ctx, xy.data() + 2 * off, sid.data() + off, dist.data() + off);
+      });
+
+      // 各範囲の未使用分を詰める（先頭から順に前方へ移すだけ）
+      size_t n = 0;
+      for (Slot* sl : active) {
+        if (sl->out_offset != n && sl->out_count > 0) {
+          std::memmove(xy.data() + 2 * n, xy.data() + 2 * sl->out_offset, 2 * sl->out_count * sizeof(float));
+          std::memmove(sid.data() + n, sid.data() + sl->out_offset, sl->out_count * sizeof(uint8_t));
+          std::memmove(dist.data() + n, dist.data() + sl->out_offset, sl->out_count * sizeof(float));
+        }
+        n += sl->out_count;
+      }
+      xy.resize(2 * n);
+      sid.resize(n);
+      dist.resize(n);
+
+      if (models_dirty) {
+        auto table = std::make_shared<SensorModelTable>();
+        for (auto& up : st2.slots) {
+          if (up->model_angle_res <= 0.0) continue; // まだスキャンを受け取っていない
+          (*table)[up->sid] = deriveSensorModel(up->model_type, up->model_angle_res);
+          std::cout << "[SensorManager] sensor model sid=" << int(up->sid) << " type=" << up->model_type
+                    << " angle_res=" << up->model_angle_res << "deg" << std::endl;
         }
+        st2.sensor_models = std::move(table);
       }
       } // slots_mu unlock（cb はロック外で実行）
 
-      ScanFrame f;
       f.seq  = st2.seq.fetch_add(1);
       f.t_ns = std::chrono::duration_cast<nanoseconds>(
                  clock_sys::now().time_since_epoch()).count();
-      f.xy   = std::move(xy);
-      f.sid  = std::move(sid);
-      f.dist = std::move(dist);
+      f.roi_applied = static_cast<bool>(ingest_mask);
+      f.params = std::move(snapshot);
+      f.sensor_models = st2.sensor_models;
+      ingest_span.end();
       cb(f);
 
       next_tick += period;                       // ★ 同一duration型で加算
+      const auto now_tick = clock_mono::now();
+      if (now_tick - next_tick >= period) {
+        // 1周期以上遅れた（処理が予算超過）: 取り戻そうと連続実行せず、今から周期を数え直す
+        realtime::fusionTickJitter().record(
+            std::chrono::duration_cast<nanoseconds>(now_tick - next_tick).count(),
+            std::chrono::duration_cast<nanoseconds>(period).count());
+        next_tick = now_tick;
+        continue;
+      }
       std::this_thread::sleep_until(next_tick);
+      // 起床の遅れ（tick jitter）を記録
+      realtime::fusionTickJitter().record(
+          std::chrono::duration_cast<nanoseconds>(clock_mono::now() - next_tick).count(),
+          std::chrono::duration_cast<nanoseconds>(period).count());
     }
 
     // 停止時
+    std::lock_guard<std::mutex> slk(st2.slots_mu);
     for (auto& up : st2.slots) {
-      auto& sl = *up;
-      if (sl.dev) sl.dev->stop();
-      sl.started = false;
+      requestLifecycle(*up, [&] { up->want_running = false; });
     }
   });
 
@@ -526,28 +864,19 @@ bool SensorManager::setEnabled(std::string sensor_id, bool on) {
   }
   if (slot_index < 0 || slot_index >= static_cast<int>(st.slots.size())) return false;
   auto& sl = *st.slots[static_cast<size_t>(slot_index)];
-  if (!sl.dev) return false;
-
-  if (on) {
-    if (!sl.started) {
-      if (sl.dev->start(sl.cfg)) {
-        sl.started = true;
-        std::cout << "[SensorManager] enabled sensor slot=" << slot_index
-                  << " (cfg.id=" << sl.cfg.id << ")\n";
-      } else {
-        std::cerr << "[SensorManager] FAILED to enable sensor slot=" << slot_index
-                  << " (cfg.id=" << sl.cfg.id << ")\n";
-        return false;
-      }
-    }
-  } else {
-    if (sl.started) {
-      sl.dev->stop();
-      sl.started = false;
-      std::cout << "[SensorManager] disabled sensor slot=" << slot_index
-                << " (cfg.id=" << sl.cfg.id << ")\n";
+
+  // 接続・切断はライフサイクルスレッドで行う。結果は getAsJson() の state に出る
+  requestLifecycle(sl, [&] {
+    if (on && sl.want_running) {
+      // 起動に失敗したままなら再試行する
+      if (sl.run_state.load() == RunState::Failed) ++sl.restart_gen;
+      return;
     }
-  }
+    if (on) sl.start_cfg = sl.cfg;
+    sl.want_running = on;
+  });
+  std::cout << "[SensorManager] " << (on ? "enable" : "disable") << " requested slot=" << slot_index
+            << " (cfg.id=" << sl.cfg.id << ")\n";
   return true;
 }
 
@@ -561,10 +890,11 @@ Json::Value SensorManager::getAsJson(std::string sensor_id) const {
       break;
     }
   }
-  const auto& sl = *st.slots[static_cast<size_t>(slot_index)];
+  auto& sl = *st.slots[static_cast<size_t>(slot_index)];
 
   s["id"] = slot_index;       // slot index (API操作用)
-  s["enabled"] = sl.started;  // 実行状態
+  s["enabled"] = wantsRunning(sl);                  // 要求された状態
+  s["state"] = runStateName(sl.run_state.load());   // 実行状態: stopped / connecting / running / failed
   s["id"] = sl.cfg.id;    // 設定上の文字列センサーID
   s["sid"] = sl.sid;          // 点群処理用の数値センサーID
 
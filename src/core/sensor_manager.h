@@ -4,8 +4,11 @@
 #include <vector>
 #include <cstdint>
 #include "config/config.h"
+#include "core/detection_params.h"
 #include <json/json.h>
 
+struct SensorModelTable;
+
 /**
  * センサーID管理の整理:
  *
@@ -32,6 +35,9 @@ struct ScanFrame {
   std::vector<float> xy;           // [x0,y0,x1,y1,...] ワールド座標
   std::vector<uint8_t> sid;        // 点群処理用の数値センサーID (0-255)
   std::vector<float> dist;         // センサーからの距離 [m]（sidと同サイズ）
+  bool roi_applied{false};         // world_mask を取り込み時に適用済み（apply_at_ingest）
+  std::shared_ptr<const DetectionParams> params; // 取り込みに使ったパラメータ（未設定なら null）
+  std::shared_ptr<const SensorModelTable> sensor_models; // sid ごとのセンサーモデル（変更時のみ差し替え）
 };
 
 class SensorManager {
@@ -42,6 +48,9 @@ public:
   SensorManager(AppConfig& app_config);
   
   void configure(const std::vector<SensorConfig>& cfgs);
+  // 集約スレッドがフレームごとにスナップショットを参照する
+  // （world_mask.apply_at_ingest / prefilter.scan_stage）
+  void setDetectionParams(DetectionParamsStore* params);
   void start(FrameCallback cb);
   void setSensorPower(std::string sensor_id, bool on);
   void setPose(std::string sensor_id, float tx, float ty, float theta_deg);
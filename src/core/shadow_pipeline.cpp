@@ -0,0 +1,256 @@
+#include "shadow_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <tuple>
+#include <utility>
+#include "core/alloc_stats.h"
+#include "core/realtime.h"
+#include "core/trace.h"
+
+namespace {
+  constexpr int kNiceDelta = 10;
+  constexpr auto kReportInterval = std::chrono::seconds(1);
+
+  // Cluster-level difference of one frame
+  struct FrameDiff {
+    size_t live{0};
+    size_t shadow{0};
+    size_t matched{0};
+    double error_sum_m{0.0};
+    double error_max_m{0.0};
+  };
+
+  // Greedy nearest-centroid matching within the gate (counts are small: O(L*S) pairs)
+  FrameDiff diffClusters(const std::vector<Cluster>& live, const std::vector<Cluster>& shadow,
+                         std::vector<std::tuple<float, uint32_t, uint32_t>>& pairs,
+                         std::vector<uint8_t>& used_live, std::vector<uint8_t>& used_shadow) {
+    FrameDiff d;
+    d.live = live.size();
+    d.shadow = shadow.size();
+    const float gate_sq = ShadowPipeline::kMatchGateM * ShadowPipeline::kMatchGateM;
+    pairs.clear();
+    for (uint32_t i = 0; i < live.size(); ++i) {
+      for (uint32_t j = 0; j < shadow.size(); ++j) {
+        const float dx = live[i].cx - shadow[j].cx;
+        const float dy = live[i].cy - shadow[j].cy;
+        const float dsq = dx * dx + dy * dy;
+        if (dsq <= gate_sq) pairs.emplace_back(dsq, i, j);
+      }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    used_live.assign(live.size(), 0);
+    used_shadow.assign(shadow.size(), 0);
+    for (const auto& [dsq, i, j] : pairs) {
+      if (used_live[i] || used_shadow[j]) continue;
+      used_live[i] = used_shadow[j] = 1;
+      const double e = std::sqrt(static_cast<double>(dsq));
+      ++d.matched;
+      d.error_sum_m += e;
+      d.error_max_m = std::max(d.error_max_m, e);
+    }
+    return d;
+  }
+
+  void addTimes(DetectionPipeline::StageTimes& sum, const DetectionPipeline::StageTimes& t) {
+    sum.prefilter_ms += t.prefilter_ms;
+    sum.voxel_ms += t.voxel_ms;
+    sum.dbscan_ms += t.dbscan_ms;
+    sum.postfilter_ms += t.postfilter_ms;
+  }
+
+  Json::Value timesJson(const DetectionPipeline::StageTimes& sum, double div) {
+    Json::Value out(Json::objectValue);
+    out["prefilter"] = sum.prefilter_ms / div;
+    out["voxel"] = sum.voxel_ms / div;
+    out["dbscan"] = sum.dbscan_ms / div;
+    out["postfilter"] = sum.postfilter_ms / div;
+    out["total"] = sum.total_ms() / div;
+    return out;
+  }
+}
+
+ShadowPipeline::~ShadowPipeline() {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    quit_ = true;
+  }
+  cv_.notify_one();
+  if (th_.joinable()) th_.join();
+}
+
+void ShadowPipeline::start(const Candidate& candidate) {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    candidate_ = candidate;
+    ++generation_;
+    has_pending_ = false;
+    stats_ = Stats{};
+    if (!th_.joinable()) th_ = std::thread([this] { loop(); });
+  }
+  active_.store(true, std::memory_order_relaxed);
+  std::cout << "[ShadowPipeline] candidate started (eps_norm=" << candidate.dbscan.eps_norm
+            << " minPts=" << candidate.dbscan.minPts << ")" << std::endl;
+}
+
+void ShadowPipeline::stop() {
+  if (!active_.exchange(false)) return;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    ++generation_;
+    has_pending_ = false;
+  }
+  std::cout << "[ShadowPipeline] stopped" << std::endl;
+}
+
+std::optional<ShadowPipeline::Candidate> ShadowPipeline::candidate() const {
+  if (!active()) return std::nullopt;
+  std::lock_guard<std::mutex> lk(mu_);
+  return candidate_;
+}
+
+void ShadowPipeline::setReporter(std::function<void(const Json::Value&)> reporter) {
+  std::lock_guard<std::mutex> lk(mu_);
+  reporter_ = std::move(reporter);
+}
+
+void ShadowPipeline::submit(const ScanFrame& f, const std::shared_ptr<const DetectionParams>& params,
+                            const DetectionPipeline& live, const DetectionPipeline::Options& live_opt) {
+  if (!active()) return;
+  std::lock_guard<std::mutex> lk(mu_);
+  if (has_pending_) {
+    // まだ前のフレームを処理中: ライブ側を待たせずに捨てる
+    ++stats_.skipped;
+    return;
+  }
+  // 容量は前回のジョブと入れ替えて再利用する
+  Job& job = pending_;
+  job.frame.t_ns = f.t_ns;
+  job.frame.seq = f.seq;
+  job.frame.xy.assign(f.xy.begin(), f.xy.end());
+  job.frame.sid.assign(f.sid.begin(), f.sid.end());
+  job.frame.dist.assign(f.dist.begin(), f.dist.end());
+  job.frame.roi_applied = f.roi_applied;
+  job.frame.params = f.params;
+  job.frame.sensor_models = f.sensor_models;
+  job.params = params;
+  job.live_clusters.assign(live.clusters().clusters.begin(), live.clusters().clusters.end());
+  job.live_times = live.times();
+  job.cheap_prefilter = live_opt.cheap_prefilter;
+  job.force_voxel = live_opt.force_voxel;
+  job.generation = generation_;
+  has_pending_ = true;
+  alloc_stats::noteCopy(f.xy.size() * sizeof(float) + f.sid.size() + f.dist.size() * sizeof(float));
+  cv_.notify_one();
+}
+
+void ShadowPipeline::loop() {
+  // 予備コア・低優先度で動かす（ライブのパイプラインと競合させない）
+  realtime::lowerThreadPriority(kNiceDelta);
+  realtime::applyThreadProfile(realtime::ThreadRole::Shadow);
+  trace::setThreadName("shadow");
+
+  std::unique_ptr<DetectionPipeline> pipeline;
+  DetectionParams cand_params;
+  uint64_t built_generation = 0;
+  uint64_t built_live_version = 0;
+  uint64_t local_version = 0;
+  Job job;
+  std::vector<std::tuple<float, uint32_t, uint32_t>> pairs;
+  std::vector<uint8_t> used_live, used_shadow;
+  auto last_report = std::chrono::steady_clock::now();
+
+  std::unique_lock<std::mutex> lk(mu_);
+  for (;;) {
+    cv_.wait(lk, [&] { return quit_ || has_pending_; });
+    if (quit_) break;
+    std::swap(job, pending_);
+    has_pending_ = false;
+    const uint64_t generation = job.generation;
+    const Candidate cand = candidate_;
+    lk.unlock();
+
+    // 候補は DBSCAN / prefilter のみ。ROI・voxel・postfilter はライブのスナップショットに従う
+    if (!pipeline || generation != built_generation || job.params->version != built_live_version) {
+      cand_params = *job.params;
+      cand_params.dbscan = cand.dbscan;
+      cand_params.prefilter = cand.prefilter;
+      // scan_stage の戦略は取り込み時にライブの設定で適用済み
+      cand_params.prefilter.scan_stage = job.params->prefilter.scan_stage;
+      cand_params.version = ++local_version;
+      built_generation = generation;
+      built_live_version = job.params->version;
+      if (!pipeline) pipeline = std::make_unique<DetectionPipeline>(cand_params);
+    }
+    // ライブと同じ縮退（frame budget）で走らせ、同じ条件で比較する
+    DetectionPipeline::Options opt;
+    opt.cheap_prefilter = job.cheap_prefilter;
+    opt.force_voxel = job.force_voxel;
+    const bool degraded = opt.cheap_prefilter || opt.force_voxel > 0.0f;
+    {
+      trace::Scope span("shadow.frame", "seq", job.frame.seq);
+      pipeline->run(job.frame, cand_params, opt);
+    }
+    const FrameDiff d = diffClusters(job.live_clusters, pipeline->clusters().clusters, pairs, used_live, used_shadow);
+
+    lk.lock();
+    if (generation != generation_) continue; // 候補が差し替えられた
+    ++stats_.frames;
+    stats_.live_clusters += d.live;
+    stats_.shadow_clusters += d.shadow;
+    stats_.matched += d.matched;
+    if (d.live != d.shadow) ++stats_.count_diff_frames;
+    if (degraded) ++stats_.degraded_frames;
+    stats_.error_sum_m += d.error_sum_m;
+    stats_.error_max_m = std::max(stats_.error_max_m, d.error_max_m);
+    addTimes(stats_.live_ms, job.live_times);
+    addTimes(stats_.shadow_ms, pipeline->times());
+
+    const auto now = std::chrono::steady_clock::now();
+    if (reporter_ && now - last_report >= kReportInterval) {
+      last_report = now;
+      Json::Value report = statsJsonLocked();
+      auto reporter = reporter_;
+      lk.unlock();
+      reporter(report);
+      lk.lock();
+    }
+  }
+}
+
+Json::Value ShadowPipeline::statsJsonLocked() const {
+  Json::Value out(Json::objectValue);
+  const double frames = static_cast<double>(std::max<uint64_t>(stats_.frames, 1));
+  out["active"] = active();
+  out["frames"] = static_cast<Json::UInt64>(stats_.frames);
+  out["skipped"] = static_cast<Json::UInt64>(stats_.skipped);
+  out["degraded_frames"] = static_cast<Json::UInt64>(stats_.degraded_frames);
+
+  Json::Value clusters(Json::objectValue);
+  clusters["live_mean"] = static_cast<double>(stats_.live_clusters) / frames;
+  clusters["shadow_mean"] = static_cast<double>(stats_.shadow_clusters) / frames;
+  clusters["matched_mean"] = static_cast<double>(stats_.matched) / frames;
+  clusters["unmatched_live_mean"] = static_cast<double>(stats_.live_clusters - stats_.matched) / frames;
+  clusters["unmatched_shadow_mean"] = static_cast<double>(stats_.shadow_clusters - stats_.matched) / frames;
+  clusters["count_diff_frames"] = static_cast<Json::UInt64>(stats_.count_diff_frames);
+  out["clusters"] = clusters;
+
+  Json::Value error(Json::objectValue);
+  error["mean"] = stats_.matched > 0 ? stats_.error_sum_m / static_cast<double>(stats_.matched) : 0.0;
+  error["max"] = stats_.error_max_m;
+  error["gate"] = kMatchGateM;
+  out["centroid_error_m"] = error;
+
+  Json::Value stages(Json::objectValue);
+  stages["live"] = timesJson(stats_.live_ms, frames);
+  stages["shadow"] = timesJson(stats_.shadow_ms, frames);
+  out["stages_ms"] = stages;
+  return out;
+}
+
+Json::Value ShadowPipeline::toJson() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return statsJsonLocked();
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <json/json.h>
+#include "config/config.h"
+#include "core/detection_pipeline.h"
+
+// Shadow pipeline for A/B testing detection parameters on live frames.
+// A candidate DBSCAN / prefilter configuration runs on copies of the fused frames in its
+// own thread (nice +10, realtime.shadow pinning) and its clusters are compared with the
+// live ones: counts, centroid matching (greedy nearest within kMatchGateM) and stage cost.
+// Frame-budget degradations of the live run (cheap prefilter, forced voxel) are mirrored so
+// both sides are compared at the same cost level.
+// The detection thread only copies into a one-deep mailbox and skips the frame when the
+// shadow is still busy, so the live pipeline never waits for it.
+class ShadowPipeline {
+public:
+  struct Candidate {
+    DbscanConfig dbscan;
+    PrefilterConfig prefilter;
+  };
+
+  static constexpr float kMatchGateM = 0.5f;
+
+  ShadowPipeline() = default;
+  ~ShadowPipeline();
+  ShadowPipeline(const ShadowPipeline&) = delete;
+  ShadowPipeline& operator=(const ShadowPipeline&) = delete;
+
+  // Start (or replace) the candidate; statistics restart
+  void start(const Candidate& candidate);
+  void stop();
+  bool active() const { return active_.load(std::memory_order_relaxed); }
+  std::optional<Candidate> candidate() const;
+
+  // Detection thread: offer this frame, the live result and the options it ran with
+  // (no-op when inactive)
+  void submit(const ScanFrame& f, const std::shared_ptr<const DetectionParams>& params,
+              const DetectionPipeline& live, const DetectionPipeline::Options& live_opt);
+
+  // Status and comparison statistics
+  Json::Value toJson() const;
+  // Called about once a second from the shadow thread with toJson() while active
+  void setReporter(std::function<void(const Json::Value&)> reporter);
+
+private:
+  struct Job {
+    ScanFrame frame{};
+    std::shared_ptr<const DetectionParams> params;
+    std::vector<Cluster> live_clusters;
+    DetectionPipeline::StageTimes live_times;
+    bool cheap_prefilter{false};     // live frame-budget degradations
+    float force_voxel{0.0f};
+    uint64_t generation{0};
+  };
+
+  struct Stats {
+    uint64_t frames{0};
+    uint64_t skipped{0};
+    uint64_t live_clusters{0};
+    uint64_t shadow_clusters{0};
+    uint64_t matched{0};
+    uint64_t count_diff_frames{0};   // frames whose cluster counts differ
+    uint64_t degraded_frames{0};     // frames run under frame-budget degradations (mirrored)
+    double error_sum_m{0.0};
+    double error_max_m{0.0};
+    DetectionPipeline::StageTimes live_ms;     // sums
+    DetectionPipeline::StageTimes shadow_ms;   // sums
+  };
+
+  void loop();
+  Json::Value statsJsonLocked() const;
+
+  std::atomic<bool> active_{false};
+
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  std::thread th_;
+  bool quit_{false};                     // mu_
+  Candidate candidate_{};                // mu_
+  uint64_t generation_{0};               // mu_: bumped by start()
+  Job pending_;                          // mu_
+  bool has_pending_{false};              // mu_
+  Stats stats_;                          // mu_
+  std::function<void(const Json::Value&)> reporter_;   // mu_
+};
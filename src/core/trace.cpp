@@ -0,0 +1,221 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace trace {
+
+namespace detail {
+  std::atomic<bool> g_enabled{false};
+}
+
+namespace {
+  using clock = std::chrono::steady_clock;
+  constexpr size_t kMaxEvents = 500'000;   // 全スレッド合計の上限（超えた分は dropped として数える）
+
+  struct Event {
+    const char* name;
+    const char* key;
+    int64_t value;
+    int64_t ts_ns;
+    int64_t dur_ns;
+    char detail[32];
+  };
+
+  struct ThreadBuffer {
+    std::mutex mu;
+    std::vector<Event> events;   // mu
+    std::string name;            // mu
+    uint32_t tid{0};
+    bool retired{false};         // mu: スレッド終了済み（イベントが空なら別スレッドが再利用する）
+  };
+
+  std::mutex g_reg_mu;
+  std::vector<std::unique_ptr<ThreadBuffer>> g_buffers;
+
+  struct TlsSlot {
+    ThreadBuffer* buf{nullptr};
+    ~TlsSlot() {
+      if (!buf) return;
+      std::lock_guard<std::mutex> lk(buf->mu);
+      buf->retired = true;
+    }
+  };
+  thread_local TlsSlot t_slot;
+
+  std::mutex g_state_mu;
+  std::condition_variable g_done_cv;
+  bool g_running = false;          // g_state_mu
+  uint32_t g_frames_left = 0;      // g_state_mu
+  uint32_t g_frames_captured = 0;  // g_state_mu
+  std::atomic<int64_t> g_origin_ns{0};
+  std::atomic<size_t> g_event_count{0};
+  std::atomic<uint64_t> g_dropped{0};
+
+  int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+  }
+
+  ThreadBuffer& threadBuffer() {
+    if (!t_slot.buf) {
+      std::lock_guard<std::mutex> lk(g_reg_mu);
+      for (auto& b : g_buffers) {
+        std::lock_guard<std::mutex> bl(b->mu);
+        if (b->retired && b->events.empty()) {
+          b->retired = false;
+          b->name.clear();
+          t_slot.buf = b.get();
+          break;
+        }
+      }
+      if (!t_slot.buf) {
+        g_buffers.push_back(std::make_unique<ThreadBuffer>());
+        g_buffers.back()->tid = static_cast<uint32_t>(g_buffers.size());
+        t_slot.buf = g_buffers.back().get();
+      }
+    }
+    return *t_slot.buf;
+  }
+
+  // g_state_mu held
+  void stopLocked() {
+    detail::g_enabled.store(false, std::memory_order_relaxed);
+    g_running = false;
+    g_done_cv.notify_all();
+  }
+}
+
+bool start(uint32_t frames) {
+  std::lock_guard<std::mutex> lk(g_state_mu);
+  if (g_running) return false;
+  {
+    // 前回のキャプチャを捨てる（メモリも返す）
+    std::lock_guard<std::mutex> rl(g_reg_mu);
+    for (auto& b : g_buffers) {
+      std::lock_guard<std::mutex> bl(b->mu);
+      std::vector<Event>().swap(b->events);
+    }
+  }
+  g_event_count.store(0);
+  g_dropped.store(0);
+  g_origin_ns.store(nowNs());
+  g_frames_left = std::max<uint32_t>(frames, 1);
+  g_frames_captured = 0;
+  g_running = true;
+  detail::g_enabled.store(true, std::memory_order_relaxed);
+  std::cout << "[Trace] capture started (" << g_frames_left << " frames)" << std::endl;
+  return true;
+}
+
+void endFrame() {
+  if (!enabled()) return;
+  std::lock_guard<std::mutex> lk(g_state_mu);
+  if (!g_running) return;
+  ++g_frames_captured;
+  if (--g_frames_left == 0) {
+    stopLocked();
+    std::cout << "[Trace] capture done (" << g_frames_captured << " frames, "
+              << std::min(g_event_count.load(), kMaxEvents) << " events)" << std::endl;
+  }
+}
+
+bool waitDone(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lk(g_state_mu);
+  if (g_done_cv.wait_for(lk, timeout, [] { return !g_running; })) return true;
+  stopLocked();
+  std::cerr << "[Trace] capture timed out after " << g_frames_captured << " frames" << std::endl;
+  return false;
+}
+
+void setThreadName(const char* name) {
+  ThreadBuffer& buf = threadBuffer();
+  std::lock_guard<std::mutex> lk(buf.mu);
+  buf.name = name;
+}
+
+void Scope::open(const char* name, const char* key, int64_t value, std::string_view detail) {
+  name_ = name;
+  key_ = key;
+  value_ = value;
+  const size_t n = std::min(detail.size(), kDetailLen);
+  if (n > 0) std::memcpy(detail_, detail.data(), n);
+  detail_[n] = '\0';
+  t0_ns_ = nowNs();
+}
+
+void Scope::close() {
+  const int64_t t1 = nowNs();
+  Event ev{std::exchange(name_, nullptr), key_, value_, t0_ns_, t1 - t0_ns_, {}};
+  if (g_event_count.fetch_add(1, std::memory_order_relaxed) >= kMaxEvents) {
+    g_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  std::memcpy(ev.detail, detail_, sizeof(ev.detail));
+  ThreadBuffer& buf = threadBuffer();
+  std::lock_guard<std::mutex> lk(buf.mu);
+  buf.events.push_back(ev);
+}
+
+Json::Value toJson() {
+  Json::Value out(Json::objectValue);
+  Json::Value events(Json::arrayValue);
+  uint32_t frames = 0;
+  bool running = false;
+  {
+    std::lock_guard<std::mutex> lk(g_state_mu);
+    frames = g_frames_captured;
+    running = g_running;
+  }
+  const int64_t origin = g_origin_ns.load();
+
+  std::lock_guard<std::mutex> rl(g_reg_mu);
+  for (const auto& b : g_buffers) {
+    std::lock_guard<std::mutex> bl(b->mu);
+    bool any = false;
+    for (const auto& e : b->events) {
+      if (e.ts_ns < origin) continue; // 開始前に開いたスコープ
+      Json::Value ev(Json::objectValue);
+      ev["name"] = e.name;
+      ev["ph"] = "X";
+      ev["pid"] = 1;
+      ev["tid"] = b->tid;
+      ev["ts"] = static_cast<double>(e.ts_ns - origin) / 1000.0;   // us
+      ev["dur"] = static_cast<double>(e.dur_ns) / 1000.0;
+      if (e.key || e.detail[0]) {
+        Json::Value args(Json::objectValue);
+        if (e.key) args[e.key] = static_cast<Json::Int64>(e.value);
+        if (e.detail[0]) args["detail"] = e.detail;
+        ev["args"] = args;
+      }
+      events.append(std::move(ev));
+      any = true;
+    }
+    if (any) {
+      Json::Value meta(Json::objectValue);
+      meta["name"] = "thread_name";
+      meta["ph"] = "M";
+      meta["pid"] = 1;
+      meta["tid"] = b->tid;
+      meta["args"]["name"] = b->name.empty() ? "thread-" + std::to_string(b->tid) : b->name;
+      events.append(std::move(meta));
+    }
+  }
+
+  out["traceEvents"] = events;
+  out["displayTimeUnit"] = "ms";
+  Json::Value other(Json::objectValue);
+  other["frames"] = frames;
+  other["running"] = running;
+  other["dropped_events"] = static_cast<Json::UInt64>(g_dropped.load());
+  out["otherData"] = other;
+  return out;
+}
+
+} // namespace trace
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <json/json.h>
+
+// On-demand scoped tracing of the frame pipeline, exported in Chrome / Perfetto trace format.
+// Idle cost of a Scope is one relaxed atomic load. start(frames) arms a capture for the next
+// `frames` fused frames (counted by endFrame() on the detection thread). Events go to a
+// per-thread buffer (uncontended lock) and are merged by toJson() once the capture is done.
+namespace trace {
+
+namespace detail {
+  extern std::atomic<bool> g_enabled;
+}
+
+inline bool enabled() { return detail::g_enabled.load(std::memory_order_relaxed); }
+
+// Arm a capture; false if one is already running
+bool start(uint32_t frames);
+// Count one fused frame; the capture stops after the requested number
+void endFrame();
+// Wait for the running capture to finish; stops it early on timeout. Returns true if it completed.
+bool waitDone(std::chrono::milliseconds timeout);
+// Chrome trace JSON ({"traceEvents": [...]}) of the last capture
+Json::Value toJson();
+// Label for the calling thread in captured traces
+void setThreadName(const char* name);
+
+// Records [construction, destruction) as one complete event while a capture is running.
+// `name` must be a string literal. next() closes the current span and opens a sibling.
+class Scope {
+public:
+  explicit Scope(const char* name) { if (enabled()) open(name, nullptr, 0, {}); }
+  // With one numeric argument (`key` must be a string literal)
+  Scope(const char* name, const char* key, int64_t value) { if (enabled()) open(name, key, value, {}); }
+  // With a short text detail (copied, truncated to 31 chars)
+  Scope(const char* name, std::string_view detail) { if (enabled()) open(name, nullptr, 0, detail); }
+  ~Scope() { if (name_) close(); }
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+  void next(const char* name) {
+    if (name_) close();
+    if (enabled()) open(name, nullptr, 0, {});
+  }
+  void end() {
+    if (name_) close();
+  }
+
+private:
+  static constexpr size_t kDetailLen = 31;
+
+  void open(const char* name, const char* key, int64_t value, std::string_view detail);
+  void close();
+
+  const char* name_{nullptr};
+  const char* key_{nullptr};
+  int64_t value_{0};
+  int64_t t0_ns_{0};
+  char detail_[kDetailLen + 1];
+};
+
+} // namespace trace
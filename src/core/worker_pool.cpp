@@ -0,0 +1,74 @@
+#include "worker_pool.h"
+#include "realtime.h"
+#include "trace.h"
+
+WorkerPool::WorkerPool(size_t threads) {
+  threads_.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    threads_.emplace_back([this] { workerLoop(); });
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    stop_ = true;
+  }
+  start_cv_.notify_all();
+  for (auto& th : threads_) {
+    if (th.joinable()) th.join();
+  }
+}
+
+void WorkerPool::runImpl(size_t count, TaskFn fn, void* ctx) {
+  if (count == 0) return;
+  if (threads_.empty() || count == 1) {
+    for (size_t i = 0; i < count; ++i) fn(ctx, i);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    fn_ = fn;
+    ctx_ = ctx;
+    stage_ = alloc_stats::stage();
+    count_ = count;
+    next_.store(0, std::memory_order_relaxed);
+    busy_ = threads_.size();
+    ++generation_;
+  }
+  start_cv_.notify_all();
+
+  drain(); // 呼び出し側スレッドも参加する
+
+  std::unique_lock<std::mutex> lk(mu_);
+  done_cv_.wait(lk, [this] { return busy_ == 0; });
+  fn_ = nullptr;
+  ctx_ = nullptr;
+}
+
+void WorkerPool::drain() {
+  for (size_t i = next_.fetch_add(1, std::memory_order_relaxed); i < count_;
+       i = next_.fetch_add(1, std::memory_order_relaxed)) {
+    fn_(ctx_, i);
+  }
+}
+
+void WorkerPool::workerLoop() {
+  realtime::applyThreadProfile(realtime::ThreadRole::Worker);
+  trace::setThreadName("worker");
+  uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lk(mu_);
+      start_cv_.wait(lk, [&] { return stop_ || generation_ != seen; });
+      if (stop_) return;
+      seen = generation_;
+      alloc_stats::setStage(stage_);
+    }
+    drain();
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      if (--busy_ == 0) done_cv_.notify_one();
+    }
+  }
+}
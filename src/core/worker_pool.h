@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "alloc_stats.h"
+
+// Small fixed-size pool for fork/join work inside one frame.
+// run() hands out task indices [0, count) to the workers and the calling thread
+// and returns once every task has finished. Tasks must not throw.
+// Results are deterministic as long as each task writes only its own output range.
+class WorkerPool {
+public:
+  explicit WorkerPool(size_t threads);
+  ~WorkerPool();
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  size_t size() const { return threads_.size(); }
+
+  template <typename Fn>
+  void run(size_t count, Fn&& fn) {
+    using F = std::remove_reference_t<Fn>;
+    runImpl(count, [](void* ctx, size_t i) { (*static_cast<F*>(ctx))(i); }, &fn);
+  }
+
+private:
+  using TaskFn = void (*)(void*, size_t);
+  void runImpl(size_t count, TaskFn fn, void* ctx);
+  void drain();
+  void workerLoop();
+
+  std::vector<std::thread> threads_;
+  std::mutex mu_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  TaskFn fn_{nullptr};
+  void* ctx_{nullptr};
+  alloc_stats::Stage stage_{alloc_stats::Stage::Other};   // caller's accounting stage for this generation
+  size_t count_{0};
+  std::atomic<size_t> next_{0};
+  size_t busy_{0};          // workers still inside the current generation
+  uint64_t generation_{0};
+  bool stop_{false};
+};
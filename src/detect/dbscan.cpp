@@ -1,11 +1,11 @@
 #include "dbscan.h"
+#include "core/trace.h"
 #include <algorithm>
+#include <bit>
 #ifdef _WIN32
 #define _USE_MATH_DEFINES
 #endif
 #include <cmath>
-#include <unordered_map>
-#include <queue>
 #include <limits>
 #include <iostream>
 #ifdef DBSCAN_PROFILE
@@ -20,6 +20,68 @@ void DBSCAN2D::setSensorModel(uint8_t sid, float delta_theta_deg, float sigma0,
     sensor_models_[sid] = {static_cast<float>(delta_theta_deg * M_PI / 180.0), sigma0, alpha};
 }
 
+SensorModel deriveSensorModel(const std::string& type, double angle_res_deg) {
+    SensorModel m = kDefaultSensorModel;
+    if (angle_res_deg > 0.0) {
+        m.delta_theta_rad = static_cast<float>(angle_res_deg * M_PI / 180.0);
+    }
+    // 距離ノイズはセンサー種別ごと（未知の種別は既定値）
+    if (type == "hokuyo_urg_eth" || type == "hokuyo_urg_eth_epoll") {
+        m.sigma0 = 0.02f;
+        m.alpha = 0.004f;
+    }
+    return m;
+}
+
+namespace {
+    // add(member, counts, seen) で 1 メンバ分をセンサー別カウンタに足す
+    template <class AddMember>
+    void buildSensorStats(ClusterSet& set, AddMember&& add) {
+        std::array<uint32_t, 256> counts{};
+        set.sensor_offsets.resize(set.clusters.size() + 1);
+        set.sensor_counts.clear();
+        for (size_t k = 0; k < set.clusters.size(); ++k) {
+            set.sensor_offsets[k] = static_cast<uint32_t>(set.sensor_counts.size());
+            uint64_t seen[4] = {0, 0, 0, 0};
+            for (uint32_t idx : set.members(k)) add(idx, counts, seen);
+            // 出現したセンサーだけを sid 昇順に書き出し、カウンタを戻す
+            for (int w = 0; w < 4; ++w) {
+                for (uint64_t bits = seen[w]; bits; bits &= bits - 1) {
+                    const uint8_t s = static_cast<uint8_t>(w * 64 + std::countr_zero(bits));
+                    set.sensor_counts.push_back({s, counts[s]});
+                    counts[s] = 0;
+                }
+            }
+            set.clusters[k].sensor_mask = seen[0];
+        }
+        set.sensor_offsets[set.clusters.size()] = static_cast<uint32_t>(set.sensor_counts.size());
+    }
+}
+
+void ClusterSet::updateSensorStats(std::span<const uint8_t> sid) {
+    buildSensorStats(*this, [&](uint32_t idx, std::array<uint32_t, 256>& counts, uint64_t (&seen)[4]) {
+        const uint8_t s = sid[idx];
+        if (counts[s]++ == 0) seen[s >> 6] |= uint64_t{1} << (s & 63);
+    });
+}
+
+void ClusterSet::updateSensorStats(std::span<const uint32_t> member_offsets,
+                                   std::span<const SensorPointCount> member_counts) {
+    buildSensorStats(*this, [&](uint32_t idx, std::array<uint32_t, 256>& counts, uint64_t (&seen)[4]) {
+        for (uint32_t j = member_offsets[idx]; j < member_offsets[idx + 1]; ++j) {
+            const auto& sc = member_counts[j];
+            if (counts[sc.sid] == 0) seen[sc.sid >> 6] |= uint64_t{1} << (sc.sid & 63);
+            counts[sc.sid] += sc.count;
+        }
+    });
+    // メンバ（voxel）数ではなく統合前の入力点数にする
+    for (size_t k = 0; k < clusters.size(); ++k) {
+        uint32_t n = 0;
+        for (const auto& sc : sensorCounts(k)) n += sc.count;
+        clusters[k].point_count = n;
+    }
+}
+
 void DBSCAN2D::setPerformanceParams(float h_min, float h_max, int R_max, int M_max) {
     h_min_ = h_min;
     h_max_ = h_max;
@@ -27,20 +89,17 @@ void DBSCAN2D::setPerformanceParams(float h_min, float h_max, int R_max, int M_m
     M_max_ = M_max;
 }
 
-// Hash function for grid cell coordinates
-struct CellHash {
-    std::size_t operator()(const std::pair<int, int>& cell) const {
-        return std::hash<int>()(cell.first) ^ (std::hash<int>()(cell.second) << 1);
-    }
-};
-
-std::vector<Cluster> DBSCAN2D::run(std::span<const float> xy, std::span<const uint8_t> sid, std::span<const float> dist, uint64_t t_ns, uint32_t seq) {
+void DBSCAN2D::run(std::span<const float> xy, std::span<const uint8_t> sid, std::span<const float> dist, uint64_t t_ns, uint32_t seq,
+                   ClusterSet& out, FrameSpatialIndex* index) {
 #ifdef DBSCAN_PROFILE
     auto start_time = std::chrono::high_resolution_clock::now();
 #endif
 
+    out.clear();
     const size_t N = xy.size() / 2;
-    if (N == 0 || sid.size() != N) return {};
+    if (N == 0 || sid.size() != N) return;
+    trace::Scope span("dbscan", "points", static_cast<int64_t>(N));
+    trace::Scope phase("dbscan.scales");
     
     const float eps_norm = eps_; // Treat eps_ as eps_norm for now
     const float eps_norm_sq = eps_norm * eps_norm;
@@ -49,16 +108,17 @@ std::vector<Cluster> DBSCAN2D::run(std::span<const float> xy, std::span<const ui
     const int M_dyn = std::max(M_max_, static_cast<int>(std::floor(0.1f * N)));
     
     // Step 1: Calculate local scales s_i and search radii eps_i
-    std::vector<float> scales(N);
-    std::vector<float> search_radii(N);
+    auto& scales = scales_;
+    auto& search_radii = search_radii_;
+    scales.resize(N);
+    search_radii.resize(N);
     
     for (size_t i = 0; i < N; ++i) {
         const float r = (i < dist.size()) ? dist[i] : std::hypot(xy[2*i], xy[2*i + 1]);
         const uint8_t sensor_id = sid[i];
         
-        // Get sensor model (use default if not found)
-        auto model_it = sensor_models_.find(sensor_id);
-        const auto& model = (model_it != sensor_models_.end()) ? model_it->second : sensor_models_[0];
+        // Dense lookup (unset sids hold the default model)
+        const auto& model = sensor_models_[sensor_id];
         
         // Calculate local scale: s_i^2 = σ_r(r)^2 + (k_effective * r * Δθ)^2
         // k_effective = (1/eps_norm) * k_scale for theoretical consistency
@@ -74,30 +134,32 @@ std::vector<Cluster> DBSCAN2D::run(std::span<const float> xy, std::span<const ui
     if (N < 2000) {
         h = 0.03f; // Small-N fallback
     } else {
-        std::vector<float> sorted_scales = scales;
-        std::nth_element(sorted_scales.begin(), sorted_scales.begin() + N/2, sorted_scales.end());
-        const float s_median = sorted_scales[N/2];
+        // Borrow search_radii as the selection buffer, then restore it from scales
+        search_radii.assign(scales.begin(), scales.end());
+        std::nth_element(search_radii.begin(), search_radii.begin() + N/2, search_radii.end());
+        const float s_median = search_radii[N/2];
+        for (size_t i = 0; i < N; ++i) search_radii[i] = eps_norm * scales[i];
         h = std::clamp(0.8f * s_median, h_min_, h_max_);
     }
     
-    // Step 3: Build spatial grid with better capacity estimation
-    std::unordered_map<std::pair<int, int>, std::vector<size_t>, CellHash> grid;
-    grid.reserve(std::max(static_cast<size_t>(N / 3), static_cast<size_t>(16))); // Better estimate
-    
-    for (size_t i = 0; i < N; ++i) {
-        const int ix = static_cast<int>(std::floor(xy[2*i] / h));
-        const int iy = static_cast<int>(std::floor(xy[2*i + 1] / h));
-        grid[{ix, iy}].push_back(i);
-    }
+    // Step 3: Spatial grid (shared frame index when available)
+    phase.next("dbscan.grid");
+    FrameSpatialIndex& grid = (index && index->size() == N && index->xy() == xy.data()) ? *index : own_index_;
+    if (&grid == &own_index_) own_index_.build(xy.data(), N, h);
+    const auto& level = grid.level(h);
+    const float cell = level.cell;
+    // R_max_ is defined in cells of size h; keep the same physical extent on a coarser level
+    const int R_cap = std::max(1, static_cast<int>(std::ceil(R_max_ * h / cell - 1e-4f)));
     
     // Step 4: DBSCAN algorithm with normalized distance
-    std::vector<int> cluster_id(N, -1); // -1 = unvisited, -2 = noise, >=0 = cluster
-    std::vector<bool> visited(N, false);
+    phase.next("dbscan.expand");
+    // Labels double as the visited flag: a point is labelled (noise or cluster) exactly when visited
+    auto& cluster_id = out.labels;
+    cluster_id.assign(N, -1); // -1 = unvisited, -2 = noise, >=0 = cluster
     int current_cluster = 0;
     
-    // Pre-allocate neighbor vector to avoid repeated allocations
-    std::vector<size_t> neighbors;
-    neighbors.reserve(std::min(static_cast<size_t>(M_dyn), N));
+    auto& neighbors = neighbors_;
+    auto& seed_set = seeds_;
     
     auto findNeighbors = [&](size_t point_idx) -> size_t {
         neighbors.clear();
@@ -108,58 +170,44 @@ std::vector<Cluster> DBSCAN2D::run(std::span<const float> xy, std::span<const ui
         const float scale_i_sq = scale_i * scale_i;
         
         // Calculate search radius in cells
-        const int R_i = std::min(R_max_, static_cast<int>(std::ceil(eps_i / h)));
-        const int ix = static_cast<int>(std::floor(px / h));
-        const int iy = static_cast<int>(std::floor(py / h));
+        const int R_i = std::min(R_cap, static_cast<int>(std::ceil(eps_i / cell)));
         
         int candidate_count = 0;
         
         // Add self to neighbors for inclusive minPts semantics
-        neighbors.push_back(point_idx);
+        neighbors.push_back(static_cast<uint32_t>(point_idx));
         
-        // Search neighboring cells
-        for (int dx = -R_i; dx <= R_i && candidate_count < M_dyn; ++dx) {
-            for (int dy = -R_i; dy <= R_i && candidate_count < M_dyn; ++dy) {
-                auto it = grid.find({ix + dx, iy + dy});
-                if (it == grid.end()) continue;
-                
-                for (size_t j : it->second) {
-                    if (j == point_idx) continue; // Skip self (already added)
-                    
-                    candidate_count++;
-                    if (candidate_count >= M_dyn) break;
-                    
-                    // Calculate normalized distance (optimized)
-                    const float qx = xy[2*j];
-                    const float qy = xy[2*j + 1];
-                    const float dx_norm = px - qx;
-                    const float dy_norm = py - qy;
-                    const float dist_sq = dx_norm * dx_norm + dy_norm * dy_norm;
-                    
-                    const float scale_j = scales[j];
-                    const float combined_scale_sq = scale_i_sq + scale_j * scale_j;
-                    const float d_norm_sq = dist_sq / combined_scale_sq;
-                    
-                    if (d_norm_sq <= eps_norm_sq) {
-                        neighbors.push_back(j);
-                        
-                        // Early exit optimization: stop once we have enough neighbors for core point
-                        if (static_cast<int>(neighbors.size()) >= minPts_) {
-                            // Continue scanning to collect all neighbors in this iteration
-                            // but we know this is a core point
-                        }
-                    }
-                }
+        // Search neighboring cells (dx-major, stops once M_dyn candidates were examined)
+        grid.forEachSquare(level, grid.pointCellX(level, point_idx), grid.pointCellY(level, point_idx), R_i,
+                           [&](uint32_t j) {
+            if (j == point_idx) return false; // Skip self (already added)
+            
+            candidate_count++;
+            if (candidate_count >= M_dyn) return true;
+            
+            // Calculate normalized distance (optimized)
+            const float qx = xy[2*j];
+            const float qy = xy[2*j + 1];
+            const float dx_norm = px - qx;
+            const float dy_norm = py - qy;
+            const float dist_sq = dx_norm * dx_norm + dy_norm * dy_norm;
+            
+            const float scale_j = scales[j];
+            const float combined_scale_sq = scale_i_sq + scale_j * scale_j;
+            const float d_norm_sq = dist_sq / combined_scale_sq;
+            
+            if (d_norm_sq <= eps_norm_sq) {
+                neighbors.push_back(j);
             }
-        }
+            return false;
+        });
         
         return neighbors.size();
     };
     
     // Main DBSCAN loop
     for (size_t i = 0; i < N; ++i) {
-        if (visited[i]) continue;
-        visited[i] = true;
+        if (cluster_id[i] != -1) continue; // already visited
         
         size_t neighbor_count = findNeighbors(i);
         
@@ -172,32 +220,30 @@ std::vector<Cluster> DBSCAN2D::run(std::span<const float> xy, std::span<const ui
         // Start new cluster
         cluster_id[i] = current_cluster;
         
-        // Expand cluster using queue (reuse neighbors vector, but skip self)
-        std::queue<size_t> seed_set;
-        for (size_t neighbor : neighbors) {
+        // Expand cluster using a FIFO over a reused buffer (reuse neighbors vector, but skip self)
+        seed_set.clear();
+        for (uint32_t neighbor : neighbors) {
             if (neighbor != i) { // Don't add self to expansion queue
-                seed_set.push(neighbor);
+                seed_set.push_back(neighbor);
             }
         }
         
-        while (!seed_set.empty()) {
-            size_t q = seed_set.front();
-            seed_set.pop();
+        for (size_t head = 0; head < seed_set.size(); ++head) {
+            const uint32_t q = seed_set[head];
             
-            if (!visited[q]) {
-                visited[q] = true;
+            if (cluster_id[q] == -1) {
+                // Mark visited before the query (findNeighbors does not read labels)
+                cluster_id[q] = current_cluster;
                 size_t q_neighbor_count = findNeighbors(q);
                 
                 if (static_cast<int>(q_neighbor_count) >= minPts_) {
-                    for (size_t qn : neighbors) {
+                    for (uint32_t qn : neighbors) {
                         if (qn != q) { // Don't add self to expansion queue
-                            seed_set.push(qn);
+                            seed_set.push_back(qn);
                         }
                     }
                 }
-            }
-            
-            if (cluster_id[q] < 0) { // If noise or unassigned
+            } else if (cluster_id[q] < 0) { // noise becomes a border point
                 cluster_id[q] = current_cluster;
             }
         }
@@ -205,23 +251,25 @@ std::vector<Cluster> DBSCAN2D::run(std::span<const float> xy, std::span<const ui
         current_cluster++;
     }
     
-    // Step 5: Generate cluster output
-    std::vector<Cluster> clusters;
-    if (current_cluster == 0) return clusters;
+    // Step 5: Generate cluster output (stats and CSR counts in one pass, then scatter)
+    phase.next("dbscan.output");
+    for (auto& label : cluster_id) {
+        if (label < 0) label = -1;
+    }
+    if (current_cluster == 0) return;
     
+    auto& clusters = out.clusters;
     clusters.resize(current_cluster);
-    
-    // Initialize clusters
     for (int c = 0; c < current_cluster; ++c) {
         clusters[c] = {
             static_cast<uint32_t>(c), 0, 0.0f, 0.0f,
             std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
             std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(),
-            {} // point_indices (empty vector)
+            0
         };
     }
     
-    // Accumulate cluster statistics and collect point indices
+    // Accumulate cluster statistics and member counts
     for (size_t i = 0; i < N; ++i) {
         const int cid = cluster_id[i];
         if (cid < 0) continue; // Skip noise points
@@ -229,10 +277,7 @@ std::vector<Cluster> DBSCAN2D::run(std::span<const float> xy, std::span<const ui
         auto& cluster = clusters[cid];
         const float x = xy[2*i];
         const float y = xy[2*i + 1];
-        const uint8_t sensor_id = sid[i];
-        
-        // Add point index to cluster
-        cluster.point_indices.push_back(i);
+        ++cluster.point_count;
         
         // Update bounding box
         cluster.minx = std::min(cluster.minx, x);
@@ -243,21 +288,30 @@ std::vector<Cluster> DBSCAN2D::run(std::span<const float> xy, std::span<const ui
         // Update centroid (accumulate for now)
         cluster.cx += x;
         cluster.cy += y;
-        
-        // Update sensor mask (guard against sid >= 8 for 8-bit mask)
-        if (sensor_id < 8) {
-            cluster.sensor_mask |= (1u << sensor_id);
-        }
     }
     
-    // Finalize centroids (convert sum to average)
-    for (auto& cluster : clusters) {
-        const size_t point_count = cluster.point_indices.size();
-        if (point_count > 0) {
-            cluster.cx /= static_cast<float>(point_count);
-            cluster.cy /= static_cast<float>(point_count);
+    // Finalize centroids (convert sum to average) and CSR offsets
+    out.offsets.resize(clusters.size() + 1);
+    uint32_t total = 0;
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        auto& cluster = clusters[c];
+        out.offsets[c] = total;
+        total += cluster.point_count;
+        if (cluster.point_count > 0) {
+            cluster.cx /= static_cast<float>(cluster.point_count);
+            cluster.cy /= static_cast<float>(cluster.point_count);
         }
     }
+    out.offsets[clusters.size()] = total;
+    
+    // Scatter members in ascending point order
+    out.indices.resize(total);
+    seed_set.assign(out.offsets.begin(), out.offsets.end() - 1); // fill cursor per cluster
+    for (size_t i = 0; i < N; ++i) {
+        const int cid = cluster_id[i];
+        if (cid >= 0) out.indices[seed_set[cid]++] = static_cast<uint32_t>(i);
+    }
+    out.updateSensorStats(sid);
 
 #ifdef DBSCAN_PROFILE
     auto end_time = std::chrono::high_resolution_clock::now();
@@ -265,6 +319,4 @@ std::vector<Cluster> DBSCAN2D::run(std::span<const float> xy, std::span<const ui
     std::cout << "[DBSCAN] N=" << N << " clusters=" << current_cluster
               << " time=" << duration.count() << "μs" << std::endl;
 #endif
-
-    return clusters;
 }
@@ -1,15 +1,60 @@
 #pragma once
 
+#include <array>
 #include <vector>
 #include <cstdint>
 #include <span>
-#include <unordered_map>
+#include <string>
+#include "detect/spatial_index.h"
 
 struct Cluster {
     uint32_t id;
-    uint8_t sensor_mask;
+    uint64_t sensor_mask; // bit s: sensor sid s contributed (sid < 64)
     float cx,cy,minx,miny,maxx,maxy;
-    std::vector<size_t> point_indices; // 元の点群インデックス
+    uint32_t point_count; // メンバ点数（メンバ自体は ClusterSet の CSR に持つ。voxel 有効時は統合前の入力点数）
+};
+
+struct SensorPointCount {
+    uint8_t sid;
+    uint32_t count;
+};
+
+// Frame-level clustering result: per-cluster stats plus one CSR membership table.
+// Buffers are reused across frames by the owner (no per-cluster vectors).
+struct ClusterSet {
+    std::vector<Cluster> clusters;
+    std::vector<int32_t> labels;    // per input point: position in `clusters`, -1 = noise / removed
+    std::vector<uint32_t> offsets;  // clusters.size() + 1 entries into `indices`
+    std::vector<uint32_t> indices;  // member point indices grouped by cluster (ascending within a cluster)
+    // Per-sensor point counts (CSR, ascending sid within a cluster)
+    std::vector<uint32_t> sensor_offsets;
+    std::vector<SensorPointCount> sensor_counts;
+
+    size_t size() const { return clusters.size(); }
+    bool empty() const { return clusters.empty(); }
+    std::span<const uint32_t> members(size_t k) const {
+        return {indices.data() + offsets[k], indices.data() + offsets[k + 1]};
+    }
+    std::span<const SensorPointCount> sensorCounts(size_t k) const {
+        return {sensor_counts.data() + sensor_offsets[k], sensor_counts.data() + sensor_offsets[k + 1]};
+    }
+    void clear() {
+        clusters.clear();
+        labels.clear();
+        offsets.assign(1, 0);
+        indices.clear();
+        sensor_offsets.assign(1, 0);
+        sensor_counts.clear();
+    }
+
+    // Recompute sensor_mask and per-sensor counts of every cluster from its members
+    // (one counter increment per member point)
+    void updateSensorStats(std::span<const uint8_t> sid);
+    // Same for members that stand for several input points (voxels): member i contributes the
+    // (sid, count) pairs member_counts[member_offsets[i] .. member_offsets[i + 1]), and
+    // point_count becomes the number of input points.
+    void updateSensorStats(std::span<const uint32_t> member_offsets,
+                           std::span<const SensorPointCount> member_counts);
 };
 
 struct SensorModel {
@@ -18,33 +63,54 @@ struct SensorModel {
   float alpha;           // Distance noise linear coefficient
 };
 
+// Δθ=0.25°, σ_r(r)=0.02+0.004·r
+inline constexpr SensorModel kDefaultSensorModel{0.0043633f, 0.02f, 0.004f};
+
+// Dense sid-indexed model table (sid is uint8_t); unset entries hold the default model
+struct SensorModelTable {
+  std::array<SensorModel, 256> models;
+  SensorModelTable() { models.fill(kDefaultSensorModel); }
+  const SensorModel& operator[](uint8_t sid) const { return models[sid]; }
+  SensorModel& operator[](uint8_t sid) { return models[sid]; }
+};
+
+// Model for a sensor of `type` scanning at `angle_res_deg` (RawScan::angle_res)
+SensorModel deriveSensorModel(const std::string& type, double angle_res_deg);
+
 class DBSCAN2D {
   float eps_; int minPts_;
   float k_scale_;        // Angular term scale coefficient (default 1.0)
-  std::unordered_map<uint8_t, SensorModel> sensor_models_;
+  SensorModelTable sensor_models_;
   
   // Performance parameters
   float h_min_, h_max_;  // Grid cell size limits
   int R_max_;            // Maximum search radius in cells
   int M_max_;            // Maximum candidate points per query
+
+  FrameSpatialIndex own_index_; // used when run() is not given a frame index
+
+  // Per-frame scratch reused across run() calls
+  std::vector<float> scales_, search_radii_;
+  std::vector<uint32_t> neighbors_, seeds_;
   
 public:
   // Constructor with default parameters aligned to plan
   DBSCAN2D(float eps, int minPts): eps_(eps), minPts_(minPts), k_scale_(1.0f),
-    h_min_(0.01f), h_max_(0.20f), R_max_(5), M_max_(600) {
-    // Default sensor model (Δθ=0.25°, σ_r(r)=0.02+0.004·r)
-    SensorModel default_model{0.0043633f, 0.02f, 0.004f};
-    sensor_models_[0] = default_model; // Default for sid=0
-  }
+    h_min_(0.01f), h_max_(0.20f), R_max_(5), M_max_(600) {}
   
   // Parameter setters
   void setParams(float eps, int minPts){ eps_=eps; minPts_=minPts; }
   void setAngularScale(float k_scale) { k_scale_ = k_scale; }
   void setSensorModel(uint8_t sid, float delta_theta_deg, float sigma0, float alpha);
+  void setSensorModels(const SensorModelTable& models) { sensor_models_ = models; }
   void setPerformanceParams(float h_min, float h_max, int R_max, int M_max);
   
   // Main clustering function
   // Note: minPts semantics are INCLUSIVE (neighbor count includes the query point itself)
   // k_scale: Angular term scale coefficient (1.0 = theoretical optimum, >1.0 = more tolerant, <1.0 = more strict)
-  std::vector<Cluster> run(std::span<const float> xy, std::span<const uint8_t> sid, std::span<const float> dist, uint64_t t_ns, uint32_t seq);
+  // index: optional frame-scoped spatial index over `xy` (shared with prefilter/postfilter).
+  //        The grid level is the smallest integer multiple of base_cell >= h; without it a private index is built at h.
+  // out: cluster stats and CSR membership; cluster k has id k and its members in ascending point order.
+  void run(std::span<const float> xy, std::span<const uint8_t> sid, std::span<const float> dist, uint64_t t_ns, uint32_t seq,
+           ClusterSet& out, FrameSpatialIndex* index = nullptr);
 };
\ No newline at end of file
@@ -1,104 +1,207 @@
 #include "postfilter.h"
+#include "core/alloc_stats.h"
+#include "core/trace.h"
 #include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <numeric>
-#include <unordered_map>
-#include <unordered_set>
+
+namespace {
+// Clusters up to this size use the direct pairwise scan
+constexpr size_t kDirectMembers = 48;
+} // namespace
 
 Postfilter::Postfilter(const PostfilterConfig& config) : config_(config) {}
 
-Postfilter::FilterResult Postfilter::apply(const std::vector<Cluster>& input_clusters,
+Postfilter::FilterResult Postfilter::apply(const ClusterSet& input_clusters,
                                           const std::vector<float>& xy,
-                                          const std::vector<uint8_t>& sid) const {
+                                          const std::vector<uint8_t>& sid,
+                                          FrameSpatialIndex* index) const {
+    FilterResult result;
+    result.clusters = input_clusters;
+    alloc_stats::noteCopy(input_clusters.clusters.size() * sizeof(Cluster) +
+                          (input_clusters.indices.size() + input_clusters.offsets.size()) * sizeof(uint32_t));
+    applyInPlace(result.clusters, xy, sid, index);
+    result.stats = stats_;
+    return result;
+}
+
+void Postfilter::applyInPlace(ClusterSet& clusters,
+                              const std::vector<float>& xy,
+                              const std::vector<uint8_t>& sid,
+                              FrameSpatialIndex* index) const {
     auto start_time = std::chrono::high_resolution_clock::now();
+    trace::Scope span("postfilter", "clusters", static_cast<int64_t>(clusters.size()));
     
     stats_.reset();
-    stats_.input_clusters = input_clusters.size();
+    stats_.input_clusters = clusters.size();
+    index_ = (index && index->size() == xy.size() / 2 && index->xy() == xy.data()) ? index : nullptr;
     
-    if (!config_.enabled || input_clusters.empty()) {
-        FilterResult result;
-        result.clusters = input_clusters;
-        result.stats = stats_;
-        stats_.output_clusters = input_clusters.size();
-        return result;
+    if (!config_.enabled || clusters.empty()) {
+        stats_.output_clusters = clusters.size();
+        return;
     }
 
-    // Build output
-    FilterResult result;
-    result.clusters = input_clusters;
-
     // Apply filters in sequence
     if (config_.isolation_removal.enabled) {
-        for(auto it = result.clusters.begin(); it != result.clusters.end();) {
-            if(!applyIsolationRemovalFilter(*it, xy, sid)) {
-                it = result.clusters.erase(it);
-            } else {
-                ++it;
+        // Compact surviving clusters and members to the front of the CSR in one sweep
+        // (writes never overtake reads: out <= offsets[c] and kept <= c)
+        auto& set = clusters;
+        const bool has_labels = set.labels.size() == xy.size() / 2;
+        uint32_t out = 0;
+        size_t kept = 0;
+        for (size_t c = 0; c < set.clusters.size(); ++c) {
+            const uint32_t begin = set.offsets[c];
+            const uint32_t end = set.offsets[c + 1];
+            const std::span<const uint32_t> members(set.indices.data() + begin, end - begin);
+            const bool keep = applyIsolationRemovalFilter(members, xy);
+            const uint32_t out_begin = out;
+            for (uint32_t k = begin; k < end; ++k) {
+                const uint32_t idx = set.indices[k];
+                if (keep && !isolated_[k - begin]) {
+                    set.indices[out++] = idx;
+                    if (has_labels) set.labels[idx] = static_cast<int32_t>(kept);
+                } else if (has_labels) {
+                    set.labels[idx] = -1;
+                }
             }
+            if (!keep) continue;
+            if (out - out_begin != end - begin) {
+                // rebuild cluster after removal
+                rebuildClusterFromPoints(set.clusters[c], xy,
+                                         std::span<const uint32_t>(set.indices.data() + out_begin, out - out_begin));
+            }
+            set.offsets[kept] = out_begin;
+            if (kept != c) set.clusters[kept] = set.clusters[c];
+            ++kept;
         }
+        const bool changed = kept != set.clusters.size() || out != set.indices.size();
+        set.clusters.resize(kept);
+        set.offsets.resize(kept + 1);
+        set.offsets[kept] = out;
+        set.indices.resize(out);
+        if (changed) set.updateSensorStats(sid);
     }
 
-    stats_.output_clusters = result.clusters.size();
+    stats_.output_clusters = clusters.size();
     
     auto end_time = std::chrono::high_resolution_clock::now();
     stats_.processing_time_us = std::chrono::duration<double, std::micro>(end_time - start_time).count();
-    
-    result.stats = stats_;
-    return result;
 }
 
-bool Postfilter::applyIsolationRemovalFilter(Cluster& cluster,
-                                             const std::vector<float>& xy,
-                                             const std::vector<uint8_t>& sid) const {
+bool Postfilter::applyIsolationRemovalFilter(std::span<const uint32_t> members,
+                                             const std::vector<float>& xy) const {
     const auto& cfg = config_.isolation_removal;
+    const float radius_sq = cfg.isolation_radius * cfg.isolation_radius;
+    const size_t m = members.size();
 
     // remove points that is isolated in the cluster
-    std::vector<size_t> isolated_points;
-    for (size_t i = 0; i < cluster.point_indices.size(); ++i) {
-        // Check isolation only among points in the same cluster
-        size_t point_idx = cluster.point_indices[i];
-        const float px = xy[2 * point_idx];
-        const float py = xy[2 * point_idx + 1];
-        const float radius_sq = cfg.isolation_radius * cfg.isolation_radius;
-        int neighbor_count = 0;
-        for (size_t j = 0; j < cluster.point_indices.size(); ++j) {
-            if (i == j) continue;
-            size_t other_idx = cluster.point_indices[j];
-            const float dx = xy[2 * other_idx] - px;
-            const float dy = xy[2 * other_idx + 1] - py;
-            const float dist_sq = dx * dx + dy * dy;
-            if (dist_sq < radius_sq) {
-                if(++neighbor_count >= cfg.required_neighbors) {
-                    break;
-                }
+    // (neighbors are counted only among points in the same cluster)
+    isolated_.assign(m, 0);
+    size_t isolated_count = 0;
+    if (m <= kDirectMembers) {
+        // Small clusters: the pairwise scan is cheaper than building a grid
+        for (size_t i = 0; i < m; ++i) {
+            const float px = xy[2 * members[i]];
+            const float py = xy[2 * members[i] + 1];
+            int neighbor_count = 0;
+            for (size_t j = 0; j < m; ++j) {
+                if (i == j) continue;
+                const float dx = xy[2 * members[j]] - px;
+                const float dy = xy[2 * members[j] + 1] - py;
+                if (dx * dx + dy * dy < radius_sq && ++neighbor_count >= cfg.required_neighbors) break;
+            }
+            if (neighbor_count < cfg.required_neighbors) {
+                isolated_[i] = 1;
+                ++isolated_count;
             }
         }
-        if (neighbor_count < cfg.required_neighbors) {
-            isolated_points.push_back(point_idx);
+    } else {
+        buildMemberGrid(members, xy);
+        const auto& g = grid_;
+        const int rings = static_cast<int>(std::ceil(cfg.isolation_radius * g.inv_cell));
+        for (size_t i = 0; i < m; ++i) {
+            const float px = xy[2 * members[i]];
+            const float py = xy[2 * members[i] + 1];
+            const int cx = static_cast<int>(g.cell_of[i] % g.nx);
+            const int cy = static_cast<int>(g.cell_of[i] / g.nx);
+            int neighbor_count = 0;
+            // 中心行から外側へ（近い候補ほど先に数えて早期打ち切り）
+            for (int d = 0; d <= 2 * rings && neighbor_count < cfg.required_neighbors; ++d) {
+                const int y = cy + ((d & 1) ? -(d + 1) / 2 : d / 2);
+                if (y < 0 || y >= g.ny) continue;
+                const size_t row = static_cast<size_t>(y) * g.nx;
+                const size_t x0 = row + std::max(0, cx - rings);
+                const size_t x1 = row + std::min(g.nx - 1, cx + rings);
+                // 行内の隣接セルは CSR 上で連続している
+                for (uint32_t k = g.cell_start[x0]; k < g.cell_start[x1 + 1]; ++k) {
+                    const uint32_t j = g.items[k];
+                    if (j == i) continue;
+                    const float dx = xy[2 * members[j]] - px;
+                    const float dy = xy[2 * members[j] + 1] - py;
+                    if (dx * dx + dy * dy < radius_sq && ++neighbor_count >= cfg.required_neighbors) break;
+                }
+            }
+            if (neighbor_count < cfg.required_neighbors) {
+                isolated_[i] = 1;
+                ++isolated_count;
+            }
         }
     }
-    if (isolated_points.empty()) {
+
+    if (isolated_count == 0) {
         return true; // No points removed, cluster remains valid
     }
-    if(cluster.point_indices.size() - isolated_points.size() < cfg.min_points_size) {
+    if (m - isolated_count < static_cast<size_t>(cfg.min_points_size)) {
         ++stats_.removed_by_isolation;
-        stats_.points_removed_total += cluster.point_indices.size();
+        stats_.points_removed_total += m;
         return false; // Not enough points remain, cluster is invalid
     }
-    stats_.points_removed_total += isolated_points.size();
-    // create new point_indices (use unordered_set for O(1) lookup)
-    std::unordered_set<size_t> isolated_set(isolated_points.begin(), isolated_points.end());
-    cluster.point_indices.erase(std::remove_if(cluster.point_indices.begin(),
-                                                cluster.point_indices.end(),
-                                                [&](size_t idx) {
-                                                    return isolated_set.count(idx) > 0;
-                                                }), cluster.point_indices.end());
-    // rebuild cluster after removal
-    rebuildClusterFromPoints(cluster, xy, sid, cluster.point_indices);
-
-    return true;
+    stats_.points_removed_total += isolated_count;
+    return true; // isolated members are compacted out by the caller
+}
+
+void Postfilter::buildMemberGrid(std::span<const uint32_t> members, const std::vector<float>& xy) const {
+    auto& g = grid_;
+    const size_t m = members.size();
+    float max_x = std::numeric_limits<float>::lowest();
+    float max_y = std::numeric_limits<float>::lowest();
+    g.min_x = std::numeric_limits<float>::max();
+    g.min_y = std::numeric_limits<float>::max();
+    for (uint32_t idx : members) {
+        g.min_x = std::min(g.min_x, xy[2 * idx]); max_x = std::max(max_x, xy[2 * idx]);
+        g.min_y = std::min(g.min_y, xy[2 * idx + 1]); max_y = std::max(max_y, xy[2 * idx + 1]);
+    }
+
+    // セル数はメンバ数に比例する上限に抑える（細長い壁クラスタなど）
+    const double w = static_cast<double>(max_x) - g.min_x;
+    const double h = static_cast<double>(max_y) - g.min_y;
+    const double cap = static_cast<double>(std::max<size_t>(64, 2 * m));
+    double c = std::max(static_cast<double>(config_.isolation_removal.isolation_radius), 1e-3);
+    const double cells = (std::floor(w / c) + 1.0) * (std::floor(h / c) + 1.0);
+    if (cells > cap) c *= std::sqrt(cells / cap) * 1.01;
+    g.inv_cell = static_cast<float>(1.0 / c);
+    g.nx = static_cast<int>(std::floor(w / c)) + 1;
+    g.ny = static_cast<int>(std::floor(h / c)) + 1;
+
+    // Counting sort of member positions into CSR
+    const size_t cells_total = static_cast<size_t>(g.nx) * g.ny;
+    g.cell_start.assign(cells_total + 1, 0);
+    g.cell_of.resize(m);
+    for (size_t i = 0; i < m; ++i) {
+        const int ix = std::min(g.nx - 1, static_cast<int>((xy[2 * members[i]] - g.min_x) * g.inv_cell));
+        const int iy = std::min(g.ny - 1, static_cast<int>((xy[2 * members[i] + 1] - g.min_y) * g.inv_cell));
+        g.cell_of[i] = static_cast<uint32_t>(iy) * g.nx + ix;
+        ++g.cell_start[g.cell_of[i] + 1];
+    }
+    for (size_t c2 = 0; c2 < cells_total; ++c2) g.cell_start[c2 + 1] += g.cell_start[c2];
+    g.items.resize(m);
+    for (size_t i = 0; i < m; ++i) g.items[g.cell_start[g.cell_of[i]]++] = static_cast<uint32_t>(i);
+    // 充填で進めた先頭位置を元に戻す
+    for (size_t c2 = cells_total; c2 > 0; --c2) g.cell_start[c2] = g.cell_start[c2 - 1];
+    g.cell_start[0] = 0;
 }
 
 std::vector<size_t> Postfilter::findNearbyPoints(const std::vector<float>& xy,
@@ -107,6 +210,19 @@ std::vector<size_t> Postfilter::findNearbyPoints(const std::vector<float>& xy,
     std::vector<size_t> nearby_points;
     const float radius_sq = radius * radius;
     
+    if (index_) {
+        const auto& lv = index_->level(radius);
+        index_->forEachRing(lv, index_->cellX(lv, center_x), index_->cellY(lv, center_y),
+                            FrameSpatialIndex::ringsFor(lv, radius), [&](uint32_t j) {
+            const float dx = xy[2 * j] - center_x;
+            const float dy = xy[2 * j + 1] - center_y;
+            if (dx * dx + dy * dy <= radius_sq) nearby_points.push_back(j);
+            return false;
+        });
+        std::sort(nearby_points.begin(), nearby_points.end());
+        return nearby_points;
+    }
+    
     for (size_t i = 0; i < xy.size() / 2; ++i) {
         const float dx = xy[2 * i] - center_x;
         const float dy = xy[2 * i + 1] - center_y;
@@ -122,20 +238,17 @@ std::vector<size_t> Postfilter::findNearbyPoints(const std::vector<float>& xy,
 
 void Postfilter::rebuildClusterFromPoints(Cluster& cluster,
                                          const std::vector<float>& xy,
-                                         const std::vector<uint8_t>& sid,
-                                         const std::vector<size_t>& point_indices) const {
-    // Recalculate cluster statistics
+                                         std::span<const uint32_t> point_indices) const {
+    // Recalculate cluster statistics (sensor stats: ClusterSet::updateSensorStats)
     float sum_x = 0.0f, sum_y = 0.0f;
     float min_x = std::numeric_limits<float>::max();
     float min_y = std::numeric_limits<float>::max();
     float max_x = std::numeric_limits<float>::lowest();
     float max_y = std::numeric_limits<float>::lowest();
-    uint8_t sensor_mask = 0;
     
-    for (size_t idx : point_indices) {
+    for (uint32_t idx : point_indices) {
         const float px = xy[2 * idx];
         const float py = xy[2 * idx + 1];
-        const uint8_t sensor_id = sid[idx];
         
         sum_x += px;
         sum_y += py;
@@ -143,10 +256,6 @@ void Postfilter::rebuildClusterFromPoints(Cluster& cluster,
         min_y = std::min(min_y, py);
         max_x = std::max(max_x, px);
         max_y = std::max(max_y, py);
-        
-        if (sensor_id < 8) {
-            sensor_mask |= (1u << sensor_id);
-        }
     }
     
     // Update cluster data
@@ -156,8 +265,7 @@ void Postfilter::rebuildClusterFromPoints(Cluster& cluster,
     cluster.miny = min_y;
     cluster.maxx = max_x;
     cluster.maxy = max_y;
-    cluster.point_indices = point_indices;
-    cluster.sensor_mask = sensor_mask;
+    cluster.point_count = static_cast<uint32_t>(point_indices.size());
 }
 
 void Postfilter::enableStrategy(const std::string& strategy_name, bool enabled) {
@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <string>
 #include <cmath>
+#include <span>
 #include "config/config.h"
 #include "detect/dbscan.h"
 
@@ -31,20 +32,33 @@ class Postfilter {
 private:
     PostfilterConfig config_;
     mutable PostfilterStats stats_;
+    mutable FrameSpatialIndex* index_{nullptr}; // frame index bound for the current apply()
+
+    // Dense CSR grid over one cluster's members (cell = isolation radius), reused across
+    // clusters so isolation removal is O(points) instead of O(points^2) per cluster
+    struct MemberGrid {
+        float min_x{0.0f}, min_y{0.0f}, inv_cell{0.0f};
+        int nx{0}, ny{0};
+        std::vector<uint32_t> cell_start;   // nx*ny + 1
+        std::vector<uint32_t> items;        // member positions grouped by cell
+        std::vector<uint32_t> cell_of;      // member position -> cell
+    };
+    mutable MemberGrid grid_;
+    mutable std::vector<uint8_t> isolated_; // per member position
     
     // Internal filtering methods
-    bool applyIsolationRemovalFilter(Cluster& cluster,
-                                     const std::vector<float>& xy,
-                                     const std::vector<uint8_t>& sid) const;
+    // Marks isolated members in isolated_; returns false if the whole cluster is rejected
+    bool applyIsolationRemovalFilter(std::span<const uint32_t> members,
+                                     const std::vector<float>& xy) const;
     
     // Helper methods
+    void buildMemberGrid(std::span<const uint32_t> members, const std::vector<float>& xy) const;
     std::vector<size_t> findNearbyPoints(const std::vector<float>& xy,
                                          float center_x, float center_y,
                                          float radius) const;
     void rebuildClusterFromPoints(Cluster& cluster,
                                   const std::vector<float>& xy,
-                                  const std::vector<uint8_t>& sid,
-                                  const std::vector<size_t>& point_indices) const;
+                                  std::span<const uint32_t> point_indices) const;
     
 public:
     explicit Postfilter(const PostfilterConfig& config = PostfilterConfig{});
@@ -53,13 +67,22 @@ public:
     // Input: clusters from DBSCAN, original point data
     // Output: filtered clusters
     struct FilterResult {
-        std::vector<Cluster> clusters;  // Filtered clusters
+        ClusterSet clusters;            // Filtered clusters
         PostfilterStats stats;          // Processing statistics
     };
     
-    FilterResult apply(const std::vector<Cluster>& input_clusters,
+    // index: optional frame-scoped spatial index over `xy` used for radius queries
+    FilterResult apply(const ClusterSet& input_clusters,
+                      const std::vector<float>& xy,
+                      const std::vector<uint8_t>& sid,
+                      FrameSpatialIndex* index = nullptr) const;
+
+    // Same as above, filtering `clusters` in place: rejected clusters and removed members are
+    // compacted out of the CSR and their labels reset to -1
+    void applyInPlace(ClusterSet& clusters,
                       const std::vector<float>& xy,
-                      const std::vector<uint8_t>& sid) const;
+                      const std::vector<uint8_t>& sid,
+                      FrameSpatialIndex* index = nullptr) const;
     
     // Configuration management
     void setConfig(const PostfilterConfig& config) { config_ = config; }
@@ -1,55 +1,83 @@
 #include "prefilter.h"
+#include "core/trace.h"
 #include <algorithm>
+#include <bit>
 #include <chrono>
 #ifdef _WIN32
 #define _USE_MATH_DEFINES
 #endif
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <numeric>
-#include <unordered_map>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
-Prefilter::Prefilter(const PrefilterConfig& config) : config_(config) {}
+namespace {
 
-// ── SpatialGrid ─────────────────────────────────────────────
-
-void Prefilter::SpatialGrid::build(const std::vector<FilterPoint>& points, float radius) {
-    cell_size = radius;
-    cells.clear();
-    cells.reserve(points.size() / 3 + 16);
-    for (size_t i = 0; i < points.size(); ++i) {
-        if (!points[i].valid) continue;
-        const int ix = static_cast<int>(std::floor(points[i].x / cell_size));
-        const int iy = static_cast<int>(std::floor(points[i].y / cell_size));
-        cells[cellKey(ix, iy)].push_back(i);
-    }
+using hr_clock = std::chrono::high_resolution_clock;
+
+inline double elapsedUs(hr_clock::time_point since) {
+    return std::chrono::duration<double, std::micro>(hr_clock::now() - since).count();
 }
 
-size_t Prefilter::SpatialGrid::countNeighbors(const std::vector<FilterPoint>& points,
-                                               size_t point_idx, float radius_sq) const {
-    const auto& pt = points[point_idx];
-    const int ix = static_cast<int>(std::floor(pt.x / cell_size));
-    const int iy = static_cast<int>(std::floor(pt.y / cell_size));
+constexpr float kMaxRings = 8.0f;
+
+} // namespace
+
+Prefilter::Prefilter(const PrefilterConfig& config) : config_(config) {}
+
+// ── Spatial index ───────────────────────────────────────────
+
+size_t Prefilter::countNeighbors(size_t i, float radius, size_t enough) const {
+    const float px = ws_.xy[2 * i];
+    const float py = ws_.xy[2 * i + 1];
+    const float radius_sq = radius * radius;
+    const auto& lv = *level_;
+
+    // 近いリングから走査し、必要数に達したら打ち切る（判定は count < k のみ）
     size_t count = 0;
-    for (int dx = -1; dx <= 1; ++dx) {
-        for (int dy = -1; dy <= 1; ++dy) {
-            auto it = cells.find(cellKey(ix + dx, iy + dy));
-            if (it == cells.end()) continue;
-            for (size_t j : it->second) {
-                if (!points[j].valid) continue;
-                const float ddx = points[j].x - pt.x;
-                const float ddy = points[j].y - pt.y;
-                if (ddx * ddx + ddy * ddy <= radius_sq) {
-                    ++count;
-                }
-            }
+    index_->forEachRing(lv, index_->pointCellX(lv, i), index_->pointCellY(lv, i),
+                        FrameSpatialIndex::ringsFor(lv, radius), [&](uint32_t j) {
+        if (!ws_.isValid(j)) return false;
+        const float ddx = ws_.xy[2 * j] - px;
+        const float ddy = ws_.xy[2 * j + 1] - py;
+        return ddx * ddx + ddy * ddy <= radius_sq && ++count >= enough;
+    });
+    return count; // includes self
+}
+
+void Prefilter::ensureLevel() const {
+    if (level_) return;
+
+    // 有効な半径のうち最小のものをセル幅にする（大きい半径はリング数で吸収）。
+    // ただし最大半径のリング数は kMaxRings までに抑える。
+    float cell = std::numeric_limits<float>::infinity();
+    float max_radius = 0.0f;
+    if (config_.neighborhood.enabled) {
+        float min_range = std::numeric_limits<float>::infinity();
+        float max_range = 0.0f;
+        for (size_t i = 0; i < ws_.n; ++i) {
+            if (!ws_.isValid(i)) continue;
+            min_range = std::min(min_range, ws_.range[i]);
+            max_range = std::max(max_range, ws_.range[i]);
+        }
+        if (std::isfinite(min_range)) {
+            cell = config_.neighborhood.r_base + config_.neighborhood.r_scale * min_range;
+            max_radius = config_.neighborhood.r_base + config_.neighborhood.r_scale * max_range;
         }
     }
-    return count; // includes self
+    if (config_.isolation_removal.enabled) {
+        cell = std::min(cell, config_.isolation_removal.isolation_radius);
+        max_radius = std::max(max_radius, config_.isolation_removal.isolation_radius);
+    }
+    if (!std::isfinite(cell) || cell <= 0.0f) cell = 0.1f;
+    cell = std::max(cell, max_radius / kMaxRings);
+
+    if (index_ == &own_index_) own_index_.build(ws_.xy, ws_.n, cell);
+    level_ = &index_->level(cell);
 }
 
 // ── apply ───────────────────────────────────────────────────
@@ -58,112 +86,157 @@ Prefilter::FilterResult Prefilter::apply(const std::vector<float>& xy_in,
                                         const std::vector<uint8_t>& sid_in,
                                         const std::vector<float>& dist_in,
                                         const std::vector<float>& intensities) const {
-    auto start_time = std::chrono::high_resolution_clock::now();
+    FilterResult result;
+    apply(xy_in, sid_in, dist_in, result, intensities);
+    return result;
+}
+
+void Prefilter::apply(const std::vector<float>& xy_in,
+                      const std::vector<uint8_t>& sid_in,
+                      const std::vector<float>& dist_in,
+                      FilterResult& out,
+                      const std::vector<float>& intensities,
+                      FrameSpatialIndex* index) const {
+    const auto start_time = hr_clock::now();
+    trace::Scope span("prefilter", "points", static_cast<int64_t>(xy_in.size() / 2));
 
     stats_.reset();
     stats_.input_points = xy_in.size() / 2;
 
     if (!config_.enabled || xy_in.empty() || xy_in.size() % 2 != 0 ||
         sid_in.size() != xy_in.size() / 2) {
-        FilterResult result;
-        result.xy = xy_in;
-        result.sid = sid_in;
-        result.dist = dist_in;
-        result.stats = stats_;
-        return result;
+        out.xy = xy_in;
+        out.sid = sid_in;
+        out.dist = dist_in;
+        out.stats = stats_;
+        if (index) index->rebind(out.xy.data());
+        return;
     }
 
+    // Bind the SoA views (no copy of the input arrays)
     const size_t num_points = xy_in.size() / 2;
-
-    // Check if angle is needed (only for spike/outlier removal)
-    const bool need_angle = config_.spike_removal.enabled || config_.outlier_removal.enabled;
-
-    // Convert input to internal format
-    std::vector<FilterPoint> points;
-    points.reserve(num_points);
-
-    for (size_t i = 0; i < num_points; ++i) {
-        FilterPoint pt;
-        pt.x = xy_in[2 * i];
-        pt.y = xy_in[2 * i + 1];
-        pt.sid = sid_in[i];
-        pt.range = (i < dist_in.size()) ? dist_in[i] : std::sqrt(pt.x * pt.x + pt.y * pt.y);
-        pt.angle = need_angle ? std::atan2(pt.y, pt.x) : 0.0f;
-        pt.intensity = (i < intensities.size()) ? intensities[i] : 0.0f;
-        pt.valid = true;
-        pt.original_index = i;
-        points.push_back(pt);
+    ws_.n = num_points;
+    ws_.xy = xy_in.data();
+    ws_.sid = sid_in.data();
+    if (dist_in.size() >= num_points) {
+        ws_.range = dist_in.data();
+    } else {
+        ws_.range_buf.resize(num_points);
+        for (size_t i = 0; i < num_points; ++i) {
+            ws_.range_buf[i] = (i < dist_in.size()) ? dist_in[i]
+                             : std::sqrt(xy_in[2 * i] * xy_in[2 * i] + xy_in[2 * i + 1] * xy_in[2 * i + 1]);
+        }
+        ws_.range = ws_.range_buf.data();
     }
-
-    // Apply filters in sequence
-    if (config_.neighborhood.enabled) {
-        applyNeighborhoodFilter(points);
+    ws_.intensity = intensities.data();
+    ws_.intensity_count = intensities.size();
+
+    ws_.valid.reset(num_points);
+    index_ = (index && index->size() == num_points) ? index : &own_index_;
+    level_ = nullptr;
+
+    // Apply filters in sequence (each only clears validity bits)
+    // Temporal persistence first: it records this frame's raw occupancy and is the cheapest test
+    if (config_.temporal_persistence.enabled) {
+        trace::Scope span("prefilter.temporal");
+        const auto t0 = hr_clock::now();
+        applyTemporalPersistenceFilter();
+        stats_.temporal_us = elapsedUs(t0);
+    } else {
+        temporal_.ran_last = false;
     }
 
-    if (config_.spike_removal.enabled) {
-        applySpikeRemovalFilter(points);
+    if (config_.neighborhood.enabled) {
+        trace::Scope span("prefilter.neighborhood");
+        const auto t0 = hr_clock::now();
+        applyNeighborhoodFilter();
+        stats_.neighborhood_us = elapsedUs(t0);
     }
 
-    if (config_.outlier_removal.enabled) {
-        applyOutlierRemovalFilter(points);
+    // spike/outlier/intensity run per sensor at ingest when scan_stage is set (ScanFilter)
+    const bool scan_strategies = !config_.scan_stage;
+
+    // spike/outlier share one per-sensor angle ordering
+    if (scan_strategies && (config_.spike_removal.enabled || config_.outlier_removal.enabled)) {
+        trace::Scope span("prefilter.angle_order");
+        const auto t0 = hr_clock::now();
+        buildAngleOrder();
+        if (config_.spike_removal.enabled) {
+            span.next("prefilter.spike");
+            applySpikeRemovalFilter();
+            stats_.spike_us = elapsedUs(t0);
+        }
+        if (config_.outlier_removal.enabled) {
+            span.next("prefilter.outlier");
+            const auto t1 = hr_clock::now();
+            if (config_.spike_removal.enabled) compactAngleOrder();
+            applyOutlierRemovalFilter();
+            stats_.outlier_us = elapsedUs(config_.spike_removal.enabled ? t1 : t0);
+        }
     }
 
-    if (config_.intensity_filter.enabled) {
-        applyIntensityFilter(points);
+    if (scan_strategies && config_.intensity_filter.enabled) {
+        trace::Scope span("prefilter.intensity");
+        const auto t0 = hr_clock::now();
+        applyIntensityFilter();
+        stats_.intensity_us = elapsedUs(t0);
     }
 
     if (config_.isolation_removal.enabled) {
-        applyIsolationRemovalFilter(points);
+        trace::Scope span("prefilter.isolation");
+        const auto t0 = hr_clock::now();
+        applyIsolationRemovalFilter();
+        stats_.isolation_us = elapsedUs(t0);
     }
 
-    // Build output
-    FilterResult result;
-    result.xy.reserve(points.size() * 2);
-    result.sid.reserve(points.size());
-    result.dist.reserve(points.size());
-
-    for (const auto& pt : points) {
-        if (pt.valid) {
-            result.xy.push_back(pt.x);
-            result.xy.push_back(pt.y);
-            result.sid.push_back(pt.sid);
-            result.dist.push_back(pt.range);
+    // Compact once
+    trace::Scope compact_span("prefilter.compact");
+    const size_t kept = ws_.valid.count();
+    const auto& words = ws_.valid.words();
+    out.xy.resize(kept * 2);
+    out.sid.resize(kept);
+    out.dist.resize(kept);
+    kept_.resize(kept);
+    size_t o = 0;
+    for (size_t w = 0; w < words.size(); ++w) {
+        uint64_t bits = words[w];
+        while (bits) {
+            const size_t i = w * 64 + static_cast<size_t>(std::countr_zero(bits));
+            bits &= bits - 1;
+            out.xy[2 * o] = ws_.xy[2 * i];
+            out.xy[2 * o + 1] = ws_.xy[2 * i + 1];
+            out.sid[o] = ws_.sid[i];
+            out.dist[o] = ws_.range[i];
+            kept_[o] = static_cast<uint32_t>(i);
+            ++o;
         }
     }
 
-    stats_.output_points = result.xy.size() / 2;
-
-    auto end_time = std::chrono::high_resolution_clock::now();
-    stats_.processing_time_us = std::chrono::duration<double, std::micro>(end_time - start_time).count();
+    // 共有索引は出力配列を指すように詰め直す（再構築しない）
+    if (index_ != &own_index_) index_->compact(kept_.data(), kept, out.xy.data());
 
-    result.stats = stats_;
-    return result;
+    stats_.output_points = kept;
+    stats_.processing_time_us = elapsedUs(start_time);
+    out.stats = stats_;
 }
 
 // ── Neighborhood filter (grid-based) ────────────────────────
 
-void Prefilter::applyNeighborhoodFilter(std::vector<FilterPoint>& points) const {
+void Prefilter::applyNeighborhoodFilter() const {
     const auto& cfg = config_.neighborhood;
+    ensureLevel();
 
-    // Use max possible radius for grid cell size
-    float max_range = 0.0f;
-    for (const auto& pt : points) {
-        if (pt.valid && pt.range > max_range) max_range = pt.range;
-    }
-    const float max_radius = cfg.r_base + cfg.r_scale * max_range;
-    grid_.build(points, max_radius);
-
+    const size_t enough = static_cast<size_t>(std::max(cfg.k, 1));
     size_t removed = 0;
-    for (size_t i = 0; i < points.size(); ++i) {
-        if (!points[i].valid) continue;
+    for (size_t i = 0; i < ws_.n; ++i) {
+        if (!ws_.isValid(i)) continue;
 
-        const float radius = cfg.r_base + cfg.r_scale * points[i].range;
-        const float radius_sq = radius * radius;
-        size_t neighbor_count = grid_.countNeighbors(points, i, radius_sq);
+        const float radius = cfg.r_base + cfg.r_scale * ws_.range[i];
+        const size_t neighbor_count = countNeighbors(i, radius, enough);
 
         // neighbor_count includes self
         if (static_cast<int>(neighbor_count) < cfg.k) {
-            points[i].valid = false;
+            ws_.invalidate(i);
             removed++;
         }
     }
@@ -171,106 +244,101 @@ void Prefilter::applyNeighborhoodFilter(std::vector<FilterPoint>& points) const
     stats_.removed_by_neighborhood = removed;
 }
 
-// ── Spike removal (using sorted indices) ────────────────────
-
-void Prefilter::applySpikeRemovalFilter(std::vector<FilterPoint>& points) const {
-    const auto& cfg = config_.spike_removal;
-    size_t removed = 0;
+// ── Per-sensor angle ordering ───────────────────────────────
 
-    // Group points by sensor ID
-    std::unordered_map<uint8_t, std::vector<size_t>> sensor_groups;
-    for (size_t i = 0; i < points.size(); ++i) {
-        if (points[i].valid) {
-            sensor_groups[points[i].sid].push_back(i);
+void Prefilter::buildAngleOrder() const {
+    // Counting sort by sensor ID, then sort each sensor's run by angle.
+    // atan2 is evaluated only for points that survived the earlier strategies.
+    auto& start = ws_.sensor_start;
+    start.assign(257, 0);
+    ws_.angle.resize(ws_.n);
+    size_t count = 0;
+    for (size_t i = 0; i < ws_.n; ++i) {
+        if (!ws_.isValid(i)) continue;
+        ++start[static_cast<size_t>(ws_.sid[i]) + 1];
+        ws_.angle[i] = std::atan2(ws_.xy[2 * i + 1], ws_.xy[2 * i]);
+        ++count;
+    }
+    for (size_t s = 0; s < 256; ++s) start[s + 1] += start[s];
+
+    ws_.order.resize(count);
+    std::vector<uint32_t>& order = ws_.order;
+    {
+        uint32_t cursor[256];
+        std::copy(start.begin(), start.begin() + 256, cursor);
+        for (size_t i = 0; i < ws_.n; ++i) {
+            if (ws_.isValid(i)) order[cursor[ws_.sid[i]]++] = static_cast<uint32_t>(i);
         }
     }
 
-    for (auto& [sid, indices] : sensor_groups) {
-        // Sort by angle
-        std::sort(indices.begin(), indices.end(), [&points](size_t a, size_t b) {
-            return points[a].angle < points[b].angle;
-        });
-
-        for (size_t j = 0; j < indices.size(); ++j) {
-            size_t idx = indices[j];
-            if (!points[idx].valid) continue;
-
-            float dr_dtheta = calculateAngularDerivative(points, indices, j);
+    const float* angle = ws_.angle.data();
+    for (size_t s = 0; s < 256; ++s) {
+        if (start[s + 1] - start[s] < 2) continue;
+        std::sort(order.begin() + start[s], order.begin() + start[s + 1],
+                  [angle](uint32_t a, uint32_t b) { return angle[a] < angle[b]; });
+    }
+}
 
-            if (std::abs(dr_dtheta) > cfg.dr_threshold) {
-                points[idx].valid = false;
-                removed++;
-            }
+void Prefilter::compactAngleOrder() const {
+    // Drop points invalidated since buildAngleOrder() while keeping the angle order
+    auto& start = ws_.sensor_start;
+    size_t w = 0;
+    size_t run_begin = 0;
+    for (size_t s = 0; s < 256; ++s) {
+        const size_t b = start[s], e = start[s + 1];
+        start[s] = static_cast<uint32_t>(run_begin);
+        for (size_t k = b; k < e; ++k) {
+            const uint32_t idx = ws_.order[k];
+            if (ws_.isValid(idx)) ws_.order[w++] = idx;
         }
+        run_begin = w;
     }
-
-    stats_.removed_by_spike = removed;
+    start[256] = static_cast<uint32_t>(w);
+    ws_.order.resize(w);
 }
 
-// ── Outlier removal (using sorted indices) ──────────────────
+// ── Spike removal (per-sensor angle order) ──────────────────
 
-void Prefilter::applyOutlierRemovalFilter(std::vector<FilterPoint>& points) const {
-    const auto& cfg = config_.outlier_removal;
+void Prefilter::applySpikeRemovalFilter() const {
     size_t removed = 0;
-
-    std::unordered_map<uint8_t, std::vector<size_t>> sensor_groups;
-    for (size_t i = 0; i < points.size(); ++i) {
-        if (points[i].valid) {
-            sensor_groups[points[i].sid].push_back(i);
-        }
+    for (size_t s = 0; s < 256; ++s) {
+        const size_t count = ws_.sensor_start[s + 1] - ws_.sensor_start[s];
+        if (count == 0) continue;
+        removed += scan_kernels::removeSpikes(ws_.order.data() + ws_.sensor_start[s], count,
+                                              ws_.angle.data(), ws_.range, ws_.valid,
+                                              config_.spike_removal.dr_threshold);
     }
+    stats_.removed_by_spike = removed;
+}
 
-    for (auto& [sid, indices] : sensor_groups) {
-        std::sort(indices.begin(), indices.end(), [&points](size_t a, size_t b) {
-            return points[a].angle < points[b].angle;
-        });
-
-        for (size_t j = 0; j < indices.size(); ++j) {
-            size_t idx = indices[j];
-            if (!points[idx].valid) continue;
-
-            float median_range = calculateMovingMedian(points, indices, j, cfg.median_window);
-            float deviation = std::abs(points[idx].range - median_range);
-
-            // Calculate local standard deviation within the window
-            int half_window = cfg.median_window / 2;
-            int start = std::max(0, static_cast<int>(j) - half_window);
-            int end = std::min(static_cast<int>(indices.size()) - 1, static_cast<int>(j) + half_window);
-
-            float local_std = 0.0f;
-            int count = 0;
-            for (int k = start; k <= end; ++k) {
-                if (points[indices[k]].valid) {
-                    float diff = points[indices[k]].range - median_range;
-                    local_std += diff * diff;
-                    count++;
-                }
-            }
+// ── Outlier removal (per-sensor angle order) ────────────────
 
-            if (count > 1) {
-                local_std = std::sqrt(local_std / (count - 1));
-                if (deviation > cfg.outlier_threshold * local_std) {
-                    points[idx].valid = false;
-                    removed++;
-                }
-            }
-        }
+void Prefilter::applyOutlierRemovalFilter() const {
+    size_t removed = 0;
+    for (size_t s = 0; s < 256; ++s) {
+        const size_t count = ws_.sensor_start[s + 1] - ws_.sensor_start[s];
+        if (count == 0) continue;
+        removed += scan_kernels::removeOutliers(ws_.order.data() + ws_.sensor_start[s], count,
+                                                ws_.range, ws_.valid,
+                                                config_.outlier_removal.median_window,
+                                                config_.outlier_removal.outlier_threshold,
+                                                ws_.window);
     }
-
     stats_.removed_by_outlier = removed;
 }
 
 // ── Intensity filter ────────────────────────────────────────
 
-void Prefilter::applyIntensityFilter(std::vector<FilterPoint>& points) const {
+void Prefilter::applyIntensityFilter() const {
     const auto& cfg = config_.intensity_filter;
     size_t removed = 0;
 
-    for (auto& pt : points) {
-        if (!pt.valid) continue;
+    for (size_t i = 0; i < ws_.n; ++i) {
+        if (!ws_.isValid(i)) continue;
 
-        if (pt.intensity < cfg.min_intensity) {
-            pt.valid = false;
+        const float intensity = (i < ws_.intensity_count) ? ws_.intensity[i] : 0.0f;
+        if (intensity < cfg.min_intensity) {
+            ws_.invalidate(i);
             removed++;
         }
     }
@@ -280,21 +348,19 @@ void Prefilter::applyIntensityFilter(std::vector<FilterPoint>& points) const {
 
 // ── Isolation removal (grid-based) ──────────────────────────
 
-void Prefilter::applyIsolationRemovalFilter(std::vector<FilterPoint>& points) const {
+void Prefilter::applyIsolationRemovalFilter() const {
     const auto& cfg = config_.isolation_removal;
+    ensureLevel();  // shared with the neighborhood filter when both are enabled
 
-    // Rebuild grid with isolation radius
-    grid_.build(points, cfg.isolation_radius);
-
+    const size_t enough = static_cast<size_t>(std::max(cfg.min_cluster_size, 1));
     size_t removed = 0;
-    for (size_t i = 0; i < points.size(); ++i) {
-        if (!points[i].valid) continue;
+    for (size_t i = 0; i < ws_.n; ++i) {
+        if (!ws_.isValid(i)) continue;
 
-        const float radius_sq = cfg.isolation_radius * cfg.isolation_radius;
-        size_t neighbor_count = grid_.countNeighbors(points, i, radius_sq);
+        const size_t neighbor_count = countNeighbors(i, cfg.isolation_radius, enough);
 
         if (static_cast<int>(neighbor_count) < cfg.min_cluster_size) {
-            points[i].valid = false;
+            ws_.invalidate(i);
             removed++;
         }
     }
@@ -302,81 +368,101 @@ void Prefilter::applyIsolationRemovalFilter(std::vector<FilterPoint>& points) co
     stats_.removed_by_isolation = removed;
 }
 
-// ── Angular derivative (O(1) using sorted indices) ──────────
-
-float Prefilter::calculateAngularDerivative(const std::vector<FilterPoint>& points,
-                                            const std::vector<size_t>& sorted_indices,
-                                            size_t j) const {
-    const auto& center_pt = points[sorted_indices[j]];
-
-    // Find prev valid
-    float prev_range = center_pt.range, prev_angle = center_pt.angle;
-    bool found_prev = false;
-    for (size_t k = j; k > 0; --k) {
-        if (points[sorted_indices[k - 1]].valid) {
-            prev_range = points[sorted_indices[k - 1]].range;
-            prev_angle = points[sorted_indices[k - 1]].angle;
-            found_prev = true;
-            break;
-        }
-    }
-
-    // Find next valid
-    float next_range = center_pt.range, next_angle = center_pt.angle;
-    bool found_next = false;
-    for (size_t k = j + 1; k < sorted_indices.size(); ++k) {
-        if (points[sorted_indices[k]].valid) {
-            next_range = points[sorted_indices[k]].range;
-            next_angle = points[sorted_indices[k]].angle;
-            found_next = true;
-            break;
-        }
-    }
-
-    if (found_prev && found_next) {
-        float dtheta = next_angle - prev_angle;
-        float dr = next_range - prev_range;
-        return (dtheta != 0.0f) ? dr / dtheta : 0.0f;
-    } else if (found_prev) {
-        float dtheta = center_pt.angle - prev_angle;
-        float dr = center_pt.range - prev_range;
-        return (dtheta != 0.0f) ? dr / dtheta : 0.0f;
-    } else if (found_next) {
-        float dtheta = next_angle - center_pt.angle;
-        float dr = next_range - center_pt.range;
-        return (dtheta != 0.0f) ? dr / dtheta : 0.0f;
+// ── Temporal persistence (multi-frame occupancy) ────────────
+
+void Prefilter::TemporalGrid::configure(float cell_size, float half_extent, int history_frames) {
+    const int k = std::clamp(history_frames, 1, 64);
+    // 毎フレーム呼ばれるので、設定が変わっていなければ何もしない（ログも出さない）
+    if (cell == cell_size && extent == half_extent && frames == k && !planes.empty()) return;
+
+    // 全プレーン合計のビット数を上限内に抑える（超える場合はセルを粗くする）
+    constexpr double kMaxBits = static_cast<double>(1u << 27); // 16 MiB
+    double c = std::max(static_cast<double>(cell_size), 0.01);
+    const double e = std::max(static_cast<double>(half_extent), 0.1);
+    double n = std::ceil(2.0 * e / c);
+    if (n * n * k > kMaxBits) {
+        c = 2.0 * e / std::floor(std::sqrt(kMaxBits / k));
+        n = std::ceil(2.0 * e / c);
+        std::cerr << "[Prefilter] temporal_persistence grid too large, cell size raised to " << c << " m" << std::endl;
     }
 
-    return 0.0f;
+    cell = cell_size;
+    extent = half_extent;
+    inv_cell = static_cast<float>(1.0 / c);
+    side = static_cast<int>(n);
+    frames = k;
+    words = (static_cast<size_t>(side) * side + 63) / 64;
+    planes.assign(words * frames, 0);
+    recorded = 0;
 }
 
-// ── Moving median (O(W) using sorted indices) ───────────────
-
-float Prefilter::calculateMovingMedian(const std::vector<FilterPoint>& points,
-                                       const std::vector<size_t>& sorted_indices,
-                                       size_t j, int window_size) const {
-    int half_window = window_size / 2;
-    int start = std::max(0, static_cast<int>(j) - half_window);
-    int end = std::min(static_cast<int>(sorted_indices.size()) - 1, static_cast<int>(j) + half_window);
-
-    std::vector<float> ranges;
-    ranges.reserve(end - start + 1);
-    for (int k = start; k <= end; ++k) {
-        if (points[sorted_indices[k]].valid) {
-            ranges.push_back(points[sorted_indices[k]].range);
+void Prefilter::applyTemporalPersistenceFilter() const {
+    const auto& cfg = config_.temporal_persistence;
+    auto& g = temporal_;
+    g.configure(cfg.cell_size, cfg.extent, cfg.history_frames);
+    if (!g.ran_last) {
+        // 履歴が途切れた（無効化されていた）場合はやり直す
+        std::fill(g.planes.begin(), g.planes.end(), 0);
+        g.recorded = 0;
+    }
+    g.ran_last = true;
+
+    // Record this frame's raw occupancy (all input points) into the oldest plane
+    const int plane = static_cast<int>(g.recorded % static_cast<uint64_t>(g.frames));
+    uint64_t* bits = g.planes.data() + plane * g.words;
+    std::fill(bits, bits + g.words, 0);
+    g.cell_of.resize(ws_.n);
+    for (size_t i = 0; i < ws_.n; ++i) {
+        const float gx = (ws_.xy[2 * i] + g.extent) * g.inv_cell;
+        const float gy = (ws_.xy[2 * i + 1] + g.extent) * g.inv_cell;
+        if (!(gx >= 0.0f && gy >= 0.0f && gx < g.side && gy < g.side)) {
+            g.cell_of[i] = TemporalGrid::kOutside;
+            continue;
         }
+        const uint32_t c = static_cast<uint32_t>(gy) * g.side + static_cast<uint32_t>(gx);
+        g.cell_of[i] = c;
+        bits[c >> 6] |= uint64_t{1} << (c & 63);
     }
+    ++g.recorded;
+
+    // 立ち上がり直後は記録済みフレーム数までしか要求しない
+    const int filled = static_cast<int>(std::min<uint64_t>(g.recorded, static_cast<uint64_t>(g.frames)));
+    const int required = std::min(cfg.min_hits, filled);
+    if (required <= 1) return; // the current frame always counts
+
+    const int side = g.side;
+    auto hitIn = [&](int p, uint32_t c) -> bool {
+        if (!cfg.dilate) return g.test(p, c);
+        const int cx = static_cast<int>(c % side);
+        const int cy = static_cast<int>(c / side);
+        for (int y = std::max(0, cy - 1); y <= std::min(side - 1, cy + 1); ++y) {
+            for (int x = std::max(0, cx - 1); x <= std::min(side - 1, cx + 1); ++x) {
+                if (g.test(p, static_cast<uint32_t>(y) * side + x)) return true;
+            }
+        }
+        return false;
+    };
 
-    if (ranges.empty()) return points[sorted_indices[j]].range;
-
-    size_t mid = ranges.size() / 2;
-    std::nth_element(ranges.begin(), ranges.begin() + mid, ranges.end());
-
-    if (ranges.size() % 2 == 0 && mid > 0) {
-        float lower = *std::max_element(ranges.begin(), ranges.begin() + mid);
-        return (lower + ranges[mid]) / 2.0f;
+    size_t removed = 0;
+    for (size_t i = 0; i < ws_.n; ++i) {
+        if (!ws_.isValid(i)) continue;
+        const uint32_t c = g.cell_of[i];
+        if (c == TemporalGrid::kOutside) continue; // off the grid: not judged
+
+        // current plane is a hit by construction; count the others until `required` is met
+        int hits = 1;
+        for (int k = 1; k < filled && hits < required; ++k) {
+            const int p = (plane + g.frames - k) % g.frames;
+            if (hitIn(p, c)) ++hits;
+            if (hits + (filled - 1 - k) < required) break; // cannot reach required any more
+        }
+        if (hits < required) {
+            ws_.invalidate(i);
+            removed++;
+        }
     }
-    return ranges[mid];
+
+    stats_.removed_by_temporal = removed;
 }
 
 // ── Strategy management ─────────────────────────────────────
@@ -392,6 +478,8 @@ void Prefilter::enableStrategy(const std::string& strategy_name, bool enabled) {
         config_.intensity_filter.enabled = enabled;
     } else if (strategy_name == "isolation_removal") {
         config_.isolation_removal.enabled = enabled;
+    } else if (strategy_name == "temporal_persistence") {
+        config_.temporal_persistence.enabled = enabled;
     }
 }
 
@@ -406,6 +494,8 @@ bool Prefilter::isStrategyEnabled(const std::string& strategy_name) const {
         return config_.intensity_filter.enabled;
     } else if (strategy_name == "isolation_removal") {
         return config_.isolation_removal.enabled;
+    } else if (strategy_name == "temporal_persistence") {
+        return config_.temporal_persistence.enabled;
     }
     return false;
 }
@@ -435,3 +525,9 @@ void Prefilter::setIsolationRemovalParams(int min_cluster_size, float isolation_
     config_.isolation_removal.min_cluster_size = min_cluster_size;
     config_.isolation_removal.isolation_radius = isolation_radius;
 }
+
+void Prefilter::setTemporalPersistenceParams(int history_frames, int min_hits, float cell_size) {
+    config_.temporal_persistence.history_frames = std::clamp(history_frames, 1, 64);
+    config_.temporal_persistence.min_hits = std::clamp(min_hits, 1, config_.temporal_persistence.history_frames);
+    config_.temporal_persistence.cell_size = cell_size;
+}
@@ -4,8 +4,9 @@
 #include <cstdint>
 #include <string>
 #include <cmath>
-#include <unordered_map>
 #include "config/config.h"
+#include "detect/scan_filter.h"
+#include "detect/spatial_index.h"
 
 // Use vector instead of span for broader C++ compatibility
 template<typename T>
@@ -20,63 +21,103 @@ struct PrefilterStats {
     size_t removed_by_outlier{0};
     size_t removed_by_intensity{0};
     size_t removed_by_isolation{0};
+    size_t removed_by_temporal{0};
     double processing_time_us{0.0};
+
+    // Per-strategy wall time [us]
+    double neighborhood_us{0.0};
+    double spike_us{0.0};
+    double outlier_us{0.0};
+    double intensity_us{0.0};
+    double isolation_us{0.0};
+    double temporal_us{0.0};
     
     void reset() {
         input_points = output_points = 0;
         removed_by_neighborhood = removed_by_spike = removed_by_outlier = 0;
-        removed_by_intensity = removed_by_isolation = 0;
+        removed_by_intensity = removed_by_isolation = removed_by_temporal = 0;
         processing_time_us = 0.0;
+        neighborhood_us = spike_us = outlier_us = intensity_us = isolation_us = temporal_us = 0.0;
     }
     
     size_t total_removed() const {
         return removed_by_neighborhood + removed_by_spike + removed_by_outlier + 
-               removed_by_intensity + removed_by_isolation;
+               removed_by_intensity + removed_by_isolation + removed_by_temporal;
     }
 };
 
-// Point data structure for internal processing
-struct FilterPoint {
-    float x, y;                  // World coordinates
-    uint8_t sid;                 // Sensor ID
-    float range;                 // Distance from sensor origin
-    float angle;                 // Angle from sensor
-    float intensity{0.0f};       // Intensity value (if available)
-    bool valid{true};            // Whether point passes all filters
-    size_t original_index;       // Index in original data
-};
-
 class Prefilter {
 private:
     PrefilterConfig config_;
     mutable PrefilterStats stats_;
-    
+
+    // Structure-of-arrays working set.
+    // 入力配列 (xy/sid/dist) はコピーせずに参照し、各戦略は有効ビットマスクを落とすだけ。
+    // 出力への詰め直しは最後に 1 回。スクラッチはフレーム間で再利用する。
+    struct Workspace {
+        const float* xy{nullptr};
+        const uint8_t* sid{nullptr};
+        const float* range{nullptr};        // dist_in, or range_buf when dist_in is short
+        const float* intensity{nullptr};
+        size_t intensity_count{0};
+        size_t n{0};
+
+        PointMask valid;
+        std::vector<float> range_buf;
+        std::vector<float> angle;           // atan2, filled only for points reaching spike/outlier
+        std::vector<uint32_t> order;        // per-sensor angle order, CSR by sensor_start
+        std::vector<uint32_t> sensor_start; // 257 entries
+        SlidingMedian window;               // outlier-removal window statistics
+
+        bool isValid(size_t i) const { return valid.test(i); }
+        void invalidate(size_t i) { valid.clear(i); }
+    };
+    mutable Workspace ws_;
+
     // Internal filtering methods
-    void applyNeighborhoodFilter(std::vector<FilterPoint>& points) const;
-    void applySpikeRemovalFilter(std::vector<FilterPoint>& points) const;
-    void applyOutlierRemovalFilter(std::vector<FilterPoint>& points) const;
-    void applyIntensityFilter(std::vector<FilterPoint>& points) const;
-    void applyIsolationRemovalFilter(std::vector<FilterPoint>& points) const;
-    
-    // Spatial grid for O(N) neighbor queries
-    struct SpatialGrid {
-        float cell_size;
-        std::unordered_map<int64_t, std::vector<size_t>> cells;
-
-        void build(const std::vector<FilterPoint>& points, float radius);
-        int64_t cellKey(int ix, int iy) const { return (static_cast<int64_t>(ix) << 32) | static_cast<uint32_t>(iy); }
-        size_t countNeighbors(const std::vector<FilterPoint>& points, size_t point_idx, float radius_sq) const;
+    void applyNeighborhoodFilter() const;
+    void applySpikeRemovalFilter() const;
+    void applyOutlierRemovalFilter() const;
+    void applyIntensityFilter() const;
+    void applyIsolationRemovalFilter() const;
+    void applyTemporalPersistenceFilter() const;
+
+    // Occupancy history for temporal persistence: K bit-planes over a fixed world grid,
+    // used as a ring (plane = frame % K). Each frame clears one plane and sets the bits of
+    // its input points, so the update is O(planes/64 + N) with fixed memory.
+    struct TemporalGrid {
+        float cell{0.0f}, inv_cell{0.0f}, extent{0.0f};
+        int side{0};                      // cells per axis
+        int frames{0};                    // K
+        size_t words{0};                  // uint64 words per plane
+        uint64_t recorded{0};             // frames recorded since the last reset
+        bool ran_last{false};             // history is continuous only if every frame was recorded
+        std::vector<uint64_t> planes;     // frames x words
+        std::vector<uint32_t> cell_of;    // per input point; kOutside when off the grid
+
+        static constexpr uint32_t kOutside = ~uint32_t{0};
+        void configure(float cell_size, float half_extent, int history_frames);
+        bool test(int plane, uint32_t cell_index) const {
+            return (planes[plane * words + (cell_index >> 6)] >> (cell_index & 63)) & 1u;
+        }
     };
-    mutable SpatialGrid grid_;
-
-    // Helper methods
-    float calculateAngularDerivative(const std::vector<FilterPoint>& points,
-                                     const std::vector<size_t>& sorted_indices,
-                                     size_t j) const;
-    float calculateMovingMedian(const std::vector<FilterPoint>& points,
-                                const std::vector<size_t>& sorted_indices,
-                                size_t j, int window_size) const;
-    
+    mutable TemporalGrid temporal_;
+
+    // Spatial index for neighborhood/isolation: the frame-scoped one passed to apply(),
+    // or own_index_ when called standalone. Invalidated points are skipped at query time,
+    // so later strategies see exactly the surviving points.
+    mutable FrameSpatialIndex own_index_;
+    mutable FrameSpatialIndex* index_{nullptr};
+    mutable const FrameSpatialIndex::Level* level_{nullptr};
+    mutable std::vector<uint32_t> kept_;
+    void ensureLevel() const;
+    // Valid points within radius (including self); stops counting once `enough` is reached
+    size_t countNeighbors(size_t i, float radius, size_t enough) const;
+
+    // Per-sensor angle ordering shared by spike/outlier removal
+    void buildAngleOrder() const;
+    void compactAngleOrder() const;
+
 public:
     explicit Prefilter(const PrefilterConfig& config = PrefilterConfig{});
     
@@ -94,9 +135,23 @@ public:
                       const std::vector<uint8_t>& sid_in,
                       const std::vector<float>& dist_in,
                       const std::vector<float>& intensities = {}) const;
+
+    // Same as above, writing into `out` so its buffers are reused across frames.
+    // `index` (optional) must be built over xy_in; it is queried instead of a private
+    // grid and is compacted to describe out.xy on return.
+    void apply(const std::vector<float>& xy_in,
+               const std::vector<uint8_t>& sid_in,
+               const std::vector<float>& dist_in,
+               FilterResult& out,
+               const std::vector<float>& intensities = {},
+               FrameSpatialIndex* index = nullptr) const;
     
     // Configuration management
-    void setConfig(const PrefilterConfig& config) { config_ = config; }
+    void setConfig(const PrefilterConfig& config) {
+        // 時間方向の履歴は途切れたら捨てる（無効化中のフレームは記録されない）
+        if (!config.enabled || !config.temporal_persistence.enabled) temporal_.ran_last = false;
+        config_ = config;
+    }
     const PrefilterConfig& getConfig() const { return config_; }
     
     // Statistics access
@@ -112,4 +167,5 @@ public:
     void setOutlierRemovalParams(int median_window, float outlier_threshold = 2.0f);
     void setIntensityFilterParams(float min_intensity, float min_reliability = 0.0f);
     void setIsolationRemovalParams(int min_cluster_size, float isolation_radius);
+    void setTemporalPersistenceParams(int history_frames, int min_hits, float cell_size = 0.1f);
 };
\ No newline at end of file
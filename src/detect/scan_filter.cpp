@@ -0,0 +1,309 @@
+#include "scan_filter.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numeric>
+
+// ── PointMask ───────────────────────────────────────────────
+
+void PointMask::reset(size_t n) {
+    n_ = n;
+    bits_.assign((n + 63) / 64, ~uint64_t{0});
+    if (n % 64 != 0) bits_.back() = (uint64_t{1} << (n % 64)) - 1;
+}
+
+size_t PointMask::count() const {
+    size_t c = 0;
+    for (uint64_t w : bits_) c += static_cast<size_t>(std::popcount(w));
+    return c;
+}
+
+// ── SlidingMedian ───────────────────────────────────────────
+
+void SlidingMedian::prepare(const uint32_t* order, size_t count, const float* range) {
+    n_ = count;
+    perm_.resize(count);
+    std::iota(perm_.begin(), perm_.end(), 0u);
+    std::sort(perm_.begin(), perm_.end(), [&](uint32_t a, uint32_t b) {
+        const float ra = range[order[a]], rb = range[order[b]];
+        return ra < rb || (ra == rb && a < b);
+    });
+
+    rank_.resize(count);
+    sorted_.resize(count);
+    for (size_t r = 0; r < count; ++r) {
+        rank_[perm_[r]] = static_cast<uint32_t>(r);
+        sorted_[r] = range[order[perm_[r]]];
+    }
+
+    tree_.assign(count + 1, 0);
+    top_bit_ = count ? std::bit_floor(count) : 0;
+    size_ = 0;
+    sum_ = sum_sq_ = 0.0;
+}
+
+void SlidingMedian::insert(size_t pos) {
+    for (size_t i = rank_[pos] + 1; i <= n_; i += i & (~i + 1)) ++tree_[i];
+    const double v = sorted_[rank_[pos]];
+    ++size_;
+    sum_ += v;
+    sum_sq_ += v * v;
+}
+
+void SlidingMedian::erase(size_t pos) {
+    for (size_t i = rank_[pos] + 1; i <= n_; i += i & (~i + 1)) --tree_[i];
+    const double v = sorted_[rank_[pos]];
+    --size_;
+    sum_ -= v;
+    sum_sq_ -= v * v;
+}
+
+uint32_t SlidingMedian::kth(size_t k) const {
+    // Fenwick descent: largest prefix whose count is <= k
+    size_t pos = 0;
+    for (size_t step = top_bit_; step; step >>= 1) {
+        if (pos + step <= n_ && tree_[pos + step] <= k) {
+            pos += step;
+            k -= tree_[pos];
+        }
+    }
+    return static_cast<uint32_t>(pos);
+}
+
+float SlidingMedian::median() const {
+    if (size_ == 0) return 0.0f;
+    const size_t mid = size_ / 2;
+    if (size_ % 2 == 0) {
+        return (sorted_[kth(mid - 1)] + sorted_[kth(mid)]) / 2.0f;
+    }
+    return sorted_[kth(mid)];
+}
+
+double SlidingMedian::sumSquaredDeviation(double about) const {
+    const double n = static_cast<double>(size_);
+    return sum_sq_ - 2.0 * about * sum_ + n * about * about;
+}
+
+// ── Kernels ─────────────────────────────────────────────────
+
+namespace scan_kernels {
+
+namespace {
+
+constexpr size_t kNoPrev = static_cast<size_t>(-1);
+
+// これ以下の窓では直接計算の方が速い（ランク付けのソートが割に合わない）
+constexpr int kDirectWindowMax = 15;
+
+float windowMedian(float* values, size_t n) {
+    const size_t mid = n / 2;
+    std::nth_element(values, values + mid, values + n);
+    if (n % 2 == 0 && mid > 0) {
+        const float lower = *std::max_element(values, values + mid);
+        return (lower + values[mid]) / 2.0f;
+    }
+    return values[mid];
+}
+
+// Small windows: gather into a fixed buffer (no allocation), median + std per point
+size_t removeOutliersDirect(const uint32_t* order, size_t count, const float* range,
+                            PointMask& valid, int median_window, float outlier_threshold) {
+    size_t removed = 0;
+    const int half_window = median_window / 2;
+    float values[kDirectWindowMax + 1];
+
+    for (size_t j = 0; j < count; ++j) {
+        const size_t idx = order[j];
+        if (!valid.test(idx)) continue;
+
+        const int start = std::max(0, static_cast<int>(j) - half_window);
+        const int end = std::min(static_cast<int>(count) - 1, static_cast<int>(j) + half_window);
+        size_t n = 0;
+        for (int k = start; k <= end; ++k) {
+            if (valid.test(order[k])) values[n++] = range[order[k]];
+        }
+
+        const float median_range = windowMedian(values, n);
+        const float deviation = std::abs(range[idx] - median_range);
+
+        if (n > 1) {
+            float local_std = 0.0f;
+            for (size_t k = 0; k < n; ++k) {
+                const float diff = values[k] - median_range;
+                local_std += diff * diff;
+            }
+            local_std = std::sqrt(local_std / static_cast<float>(n - 1));
+            if (deviation > outlier_threshold * local_std) {
+                valid.clear(idx);
+                removed++;
+            }
+        }
+    }
+    return removed;
+}
+
+float angularDerivative(const uint32_t* order, size_t count, const float* angle, const float* range,
+                        const PointMask& valid, size_t j, size_t prev) {
+    const size_t center = order[j];
+    const float center_range = range[center];
+    const float center_angle = angle[center];
+
+    // Prev valid (tracked by the caller)
+    float prev_range = center_range, prev_angle = center_angle;
+    const bool found_prev = (prev != kNoPrev);
+    if (found_prev) {
+        prev_range = range[order[prev]];
+        prev_angle = angle[order[prev]];
+    }
+
+    // Find next valid
+    float next_range = center_range, next_angle = center_angle;
+    bool found_next = false;
+    for (size_t k = j + 1; k < count; ++k) {
+        if (valid.test(order[k])) {
+            next_range = range[order[k]];
+            next_angle = angle[order[k]];
+            found_next = true;
+            break;
+        }
+    }
+
+    if (found_prev && found_next) {
+        float dtheta = next_angle - prev_angle;
+        float dr = next_range - prev_range;
+        return (dtheta != 0.0f) ? dr / dtheta : 0.0f;
+    } else if (found_prev) {
+        float dtheta = center_angle - prev_angle;
+        float dr = center_range - prev_range;
+        return (dtheta != 0.0f) ? dr / dtheta : 0.0f;
+    } else if (found_next) {
+        float dtheta = next_angle - center_angle;
+        float dr = next_range - center_range;
+        return (dtheta != 0.0f) ? dr / dtheta : 0.0f;
+    }
+
+    return 0.0f;
+}
+
+} // namespace
+
+size_t removeSpikes(const uint32_t* order, size_t count, const float* angle, const float* range,
+                    PointMask& valid, float dr_threshold) {
+    size_t removed = 0;
+
+    // Only order[j] can change at step j, so the previous valid point is
+    // simply the last one kept (no backward rescan over removed runs)
+    size_t prev = kNoPrev;
+    for (size_t j = 0; j < count; ++j) {
+        const size_t idx = order[j];
+        if (!valid.test(idx)) continue;
+
+        const float dr_dtheta = angularDerivative(order, count, angle, range, valid, j, prev);
+
+        if (std::abs(dr_dtheta) > dr_threshold) {
+            valid.clear(idx);
+            removed++;
+        } else {
+            prev = j;
+        }
+    }
+    return removed;
+}
+
+size_t removeOutliers(const uint32_t* order, size_t count, const float* range,
+                      PointMask& valid, int median_window, float outlier_threshold,
+                      SlidingMedian& window) {
+    if (median_window <= kDirectWindowMax) {
+        return removeOutliersDirect(order, count, range, valid, std::max(median_window, 1), outlier_threshold);
+    }
+
+    size_t removed = 0;
+    const size_t half_window = static_cast<size_t>(median_window / 2);
+
+    // Window = valid points at positions [j - half, j + half]. A position is in the
+    // window iff it is valid: points removed here are erased immediately, and points
+    // that were already invalid are never inserted.
+    window.prepare(order, count, range);
+    size_t lo = 0, hi = 0;
+    for (size_t j = 0; j < count; ++j) {
+        const size_t want_hi = std::min(count, j + half_window + 1);
+        for (; hi < want_hi; ++hi) {
+            if (valid.test(order[hi])) window.insert(hi);
+        }
+        const size_t want_lo = (j > half_window) ? j - half_window : 0;
+        for (; lo < want_lo; ++lo) {
+            if (valid.test(order[lo])) window.erase(lo);
+        }
+
+        const size_t idx = order[j];
+        if (!valid.test(idx)) continue;
+
+        const float median_range = window.median();
+        const float deviation = std::abs(range[idx] - median_range);
+
+        // Local standard deviation around the median
+        const size_t n = window.size();
+        if (n > 1) {
+            const double ss = std::max(0.0, window.sumSquaredDeviation(median_range));
+            const float local_std = static_cast<float>(std::sqrt(ss / static_cast<double>(n - 1)));
+            if (deviation > outlier_threshold * local_std) {
+                valid.clear(idx);
+                window.erase(j);
+                removed++;
+            }
+        }
+    }
+    return removed;
+}
+
+size_t compactOrder(uint32_t* order, size_t count, const PointMask& valid) {
+    size_t w = 0;
+    for (size_t k = 0; k < count; ++k) {
+        if (valid.test(order[k])) order[w++] = order[k];
+    }
+    return w;
+}
+
+} // namespace scan_kernels
+
+// ── ScanFilter ──────────────────────────────────────────────
+
+bool ScanFilter::active() const {
+    return config_.enabled && config_.scan_stage &&
+           (config_.spike_removal.enabled || config_.outlier_removal.enabled ||
+            config_.intensity_filter.enabled);
+}
+
+const PointMask& ScanFilter::apply(const float* angle, const float* range, const float* intensity, size_t n) {
+    stats_ = Stats{};
+    stats_.input_points = n;
+    valid_.reset(n);
+    if (n == 0) return valid_;
+
+    // Step order is already the angle order: the identity permutation
+    order_.resize(n);
+    std::iota(order_.begin(), order_.end(), 0u);
+    size_t count = n;
+
+    if (config_.spike_removal.enabled) {
+        stats_.removed_by_spike = scan_kernels::removeSpikes(order_.data(), count, angle, range, valid_,
+                                                             config_.spike_removal.dr_threshold);
+    }
+    if (config_.outlier_removal.enabled) {
+        if (stats_.removed_by_spike > 0) count = scan_kernels::compactOrder(order_.data(), count, valid_);
+        stats_.removed_by_outlier = scan_kernels::removeOutliers(order_.data(), count, range, valid_,
+                                                                 config_.outlier_removal.median_window,
+                                                                 config_.outlier_removal.outlier_threshold,
+                                                                 window_);
+    }
+    // 強度はセンサーが出力している場合のみ判定する
+    if (config_.intensity_filter.enabled && intensity) {
+        for (size_t i = 0; i < n; ++i) {
+            if (valid_.test(i) && intensity[i] < config_.intensity_filter.min_intensity) {
+                valid_.clear(i);
+                stats_.removed_by_intensity++;
+            }
+        }
+    }
+    return valid_;
+}
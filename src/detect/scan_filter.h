@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "config/config.h"
+
+// Point validity as a bitmask (1 = keep). Shared by Prefilter and ScanFilter.
+class PointMask {
+public:
+    void reset(size_t n);               // n points, all valid
+    size_t size() const { return n_; }
+    size_t count() const;               // number of valid points
+
+    bool test(size_t i) const { return (bits_[i >> 6] >> (i & 63)) & 1u; }
+    void clear(size_t i) { bits_[i >> 6] &= ~(uint64_t{1} << (i & 63)); }
+
+    const std::vector<uint64_t>& words() const { return bits_; }
+
+private:
+    std::vector<uint64_t> bits_;
+    size_t n_{0};
+};
+
+// Sliding-window order statistics over one scan-order run.
+// Fenwick tree on value ranks (one sort per run) plus running sums, so insert/erase/median
+// are O(log n) and the cost per point does not depend on the window size.
+// Buffers are reused across runs and frames.
+class SlidingMedian {
+public:
+    // Rank the values range[order[0..count)] (positions are indices into `order`)
+    void prepare(const uint32_t* order, size_t count, const float* range);
+
+    void insert(size_t pos);
+    void erase(size_t pos);
+    size_t size() const { return size_; }
+
+    // Median of the current window (mean of the two middle values when even)
+    float median() const;
+    // Σ (v - about)^2 over the current window
+    double sumSquaredDeviation(double about) const;
+
+private:
+    uint32_t kth(size_t k) const;        // rank of the k-th smallest (0-based)
+
+    std::vector<uint32_t> rank_;         // position -> rank
+    std::vector<float> sorted_;          // rank -> value
+    std::vector<uint32_t> tree_;         // Fenwick, 1-based
+    std::vector<uint32_t> perm_;         // sort scratch
+    size_t n_{0};
+    size_t top_bit_{0};
+    size_t size_{0};
+    double sum_{0.0};
+    double sum_sq_{0.0};
+};
+
+// Scan-order kernels for one sensor.
+// `order` lists point indices in increasing angle; `angle` [rad] and `range` [m]
+// are indexed by point. Both kernels only clear bits in `valid`.
+namespace scan_kernels {
+
+// |dR/dθ| spike removal (prefilter.spike_removal). Returns removed count.
+size_t removeSpikes(const uint32_t* order, size_t count, const float* angle, const float* range,
+                    PointMask& valid, float dr_threshold);
+
+// Moving-median outlier removal (prefilter.outlier_removal). Returns removed count.
+size_t removeOutliers(const uint32_t* order, size_t count, const float* range,
+                      PointMask& valid, int median_window, float outlier_threshold,
+                      SlidingMedian& window);
+
+// Drop entries whose point is no longer valid, keeping the order. Returns the new count.
+size_t compactOrder(uint32_t* order, size_t count, const PointMask& valid);
+
+} // namespace scan_kernels
+
+// Spike/outlier/intensity strategies on one sensor's native returns, in step order.
+// prefilter.scan_stage が有効なとき SensorManager が取り込み時にセンサーごとに適用する
+// （ワールド座標の atan2 + sort が不要で、回転した姿勢でも順序が正しい）。
+class ScanFilter {
+public:
+    struct Stats {
+        size_t input_points{0};
+        size_t removed_by_spike{0};
+        size_t removed_by_outlier{0};
+        size_t removed_by_intensity{0};
+    };
+
+    void setConfig(const PrefilterConfig& config) { config_ = config; }
+    bool active() const;
+
+    // angle [rad] / range [m] / intensity (nullptr if the sensor has none), all in step order.
+    // The returned mask stays valid until the next call.
+    const PointMask& apply(const float* angle, const float* range, const float* intensity, size_t n);
+
+    const Stats& lastStats() const { return stats_; }
+
+private:
+    PrefilterConfig config_;
+    PointMask valid_;
+    std::vector<uint32_t> order_;
+    SlidingMedian window_;
+    Stats stats_;
+};
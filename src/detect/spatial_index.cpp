@@ -0,0 +1,104 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+namespace {
+
+constexpr int kMaxFactor = 1 << 16;
+
+} // namespace
+
+void FrameSpatialIndex::build(const float* xy, size_t n, float base_cell) {
+    xy_ = xy;
+    n_ = n;
+    base_cell_ = std::max(base_cell, 1e-3f);
+
+    base_x_.resize(n);
+    base_y_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        base_x_[i] = floorCell(xy[2 * i]);
+        base_y_[i] = floorCell(xy[2 * i + 1]);
+    }
+    // レベルは要求されたときに作り直す（バッファは保持）
+    for (auto& lv : levels_) lv.factor = 0;
+}
+
+const FrameSpatialIndex::Level& FrameSpatialIndex::level(float min_cell) {
+    const int factor = std::clamp(static_cast<int>(std::ceil(min_cell / base_cell_ - 1e-4f)), 1, kMaxFactor);
+    Level* slot = &levels_.back();
+    for (auto& lv : levels_) {
+        if (lv.factor == factor) return lv;
+        if (lv.factor == 0) { slot = &lv; break; }
+    }
+    buildLevel(*slot, factor);
+    return *slot;
+}
+
+void FrameSpatialIndex::buildLevel(Level& lv, int factor) {
+    lv.factor = factor;
+    lv.cell = base_cell_ * static_cast<float>(factor);
+
+    // 占有セル数 <= n なので容量 2n 以上でロードファクタ 0.5 以下
+    const size_t capacity = std::bit_ceil(std::max<size_t>(64, 2 * n_));
+    lv.slot_mask = capacity - 1;
+    lv.hash_shift = 64 - std::countr_zero(capacity);
+    lv.keys.assign(capacity, kEmpty);
+    lv.slot_of.resize(n_);
+
+    lv.min_x = lv.min_y = std::numeric_limits<int>::max();
+    lv.max_x = lv.max_y = std::numeric_limits<int>::min();
+    for (size_t i = 0; i < n_; ++i) {
+        const int cx = floorDiv(base_x_[i], factor);
+        const int cy = floorDiv(base_y_[i], factor);
+        lv.min_x = std::min(lv.min_x, cx); lv.max_x = std::max(lv.max_x, cx);
+        lv.min_y = std::min(lv.min_y, cy); lv.max_y = std::max(lv.max_y, cy);
+
+        const uint64_t key = spatialCellKey(cx, cy);
+        uint64_t s = spatialSlot(key, lv.hash_shift);
+        while (lv.keys[s] != kEmpty && lv.keys[s] != key) s = (s + 1) & lv.slot_mask;
+        lv.keys[s] = key;
+        lv.slot_of[i] = static_cast<uint32_t>(s);
+    }
+    if (n_ == 0) { lv.min_x = lv.min_y = 0; lv.max_x = lv.max_y = -1; }
+    fillLevel(lv);
+}
+
+void FrameSpatialIndex::fillLevel(Level& lv) {
+    // Counting sort by slot into CSR (slot order == item order)
+    const size_t capacity = lv.keys.size();
+    lv.start.assign(capacity + 1, 0);
+    for (size_t i = 0; i < n_; ++i) ++lv.start[lv.slot_of[i] + 1];
+    for (size_t s = 0; s < capacity; ++s) lv.start[s + 1] += lv.start[s];
+    lv.items.resize(n_);
+    for (size_t i = 0; i < n_; ++i) lv.items[lv.start[lv.slot_of[i]]++] = static_cast<uint32_t>(i);
+    // 充填で進めた先頭位置を元に戻す
+    for (size_t s = capacity; s > 0; --s) lv.start[s] = lv.start[s - 1];
+    lv.start[0] = 0;
+}
+
+void FrameSpatialIndex::compact(const uint32_t* kept, size_t count, const float* xy) {
+    xy_ = xy;
+    if (count == n_) return; // nothing dropped (kept is ascending, so it is the identity)
+
+    for (size_t o = 0; o < count; ++o) {
+        const uint32_t i = kept[o];
+        base_x_[o] = base_x_[i];
+        base_y_[o] = base_y_[i];
+    }
+    // 構築済みレベルはセル表を保ったまま点リストだけ詰め直す
+    // （空になったセルは長さ 0 の範囲として残る）
+    for (auto& lv : levels_) {
+        if (lv.factor == 0) continue;
+        for (size_t o = 0; o < count; ++o) lv.slot_of[o] = lv.slot_of[kept[o]];
+    }
+    n_ = count;
+    base_x_.resize(count);
+    base_y_.resize(count);
+    for (auto& lv : levels_) {
+        if (lv.factor == 0) continue;
+        lv.slot_of.resize(count);
+        fillLevel(lv);
+    }
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Frame-scoped spatial index shared by prefilter, DBSCAN and postfilter.
+//
+// build() は 1 フレームに 1 回だけ点を基本セル（整数座標）に割り当てる。
+// 各ステージは level(min_cell) で自分に合ったセル幅（基本セルの整数倍）を要求でき、
+// レベルはキャッシュ済みの整数座標から導出される（浮動小数の再計算・bbox 再走査なし）。
+// compact() はフィルタで点が間引かれたときに索引を詰め直す（再構築しない）。
+//
+// 各レベルはオープンアドレス法のセル表 + CSR の点リストで、ハッシュ・ベクタ確保は
+// 行わない。バッファはフレーム間で再利用する。
+class FrameSpatialIndex {
+public:
+    struct Level {
+        int factor{0};                    // cell = base_cell * factor (0 = unused)
+        float cell{0.0f};
+        int min_x{0}, min_y{0}, max_x{-1}, max_y{-1}; // occupied cell bounds
+        uint64_t slot_mask{0};
+        int hash_shift{64};               // 64 - log2(slots): Fibonacci hashing takes the top bits
+        std::vector<uint64_t> keys;       // cell key per slot (kEmpty if unused)
+        std::vector<uint32_t> start;      // slot -> [start[s], start[s+1]) in items
+        std::vector<uint32_t> items;      // point indices grouped by cell
+        std::vector<uint32_t> slot_of;    // point -> slot
+
+        // Items of cell (cx, cy); returns false if the cell is empty
+        bool cellRange(int cx, int cy, uint32_t& begin, uint32_t& end) const;
+    };
+
+    // Index n points of `xy` ([x0,y0,x1,y1,...]) with the given base cell size [m]
+    void build(const float* xy, size_t n, float base_cell);
+
+    // Drop every point not listed in `kept` (ascending old indices) and renumber the
+    // survivors 0..count-1; `xy` is the compacted coordinate array.
+    void compact(const uint32_t* kept, size_t count, const float* xy);
+
+    // Same points, moved to another array (e.g. copied into a stage's output buffer)
+    void rebind(const float* xy) { xy_ = xy; }
+
+    // Level whose cell is the smallest integer multiple of base_cell >= min_cell
+    // (built lazily, cached for the frame; references stay valid until the next build())
+    const Level& level(float min_cell);
+
+    size_t size() const { return n_; }
+    float baseCell() const { return base_cell_; }
+    const float* xy() const { return xy_; }
+
+    // Cell coordinates of an arbitrary position at the given level
+    int cellX(const Level& lv, float x) const { return floorDiv(floorCell(x), lv.factor); }
+    int cellY(const Level& lv, float y) const { return floorDiv(floorCell(y), lv.factor); }
+    // Cell coordinates of indexed point i
+    int pointCellX(const Level& lv, size_t i) const { return floorDiv(base_x_[i], lv.factor); }
+    int pointCellY(const Level& lv, size_t i) const { return floorDiv(base_y_[i], lv.factor); }
+
+    // Visit candidates in rings of cells around (cx, cy), nearest ring first, up to `rings`.
+    // fn(j) returns true to stop. Returns true if stopped early.
+    template <typename Fn>
+    bool forEachRing(const Level& lv, int cx, int cy, int rings, Fn&& fn) const;
+
+    // Visit candidates in the (2R+1)^2 square of cells, dx-major (DBSCAN order).
+    template <typename Fn>
+    bool forEachSquare(const Level& lv, int cx, int cy, int R, Fn&& fn) const;
+
+    // Rings needed to cover `radius` at this level
+    static int ringsFor(const Level& lv, float radius) {
+        return static_cast<int>(std::ceil(radius / lv.cell));
+    }
+
+    static constexpr uint64_t kEmpty = ~uint64_t{0};
+
+private:
+    // floor(v / base_cell): division so a factor-1 level matches floor(x / h) exactly,
+    // truncate-and-adjust because std::floor is a libcall without SSE4.1
+    int floorCell(float v) const {
+        const float q = v / base_cell_;
+        if (!(q > -1.0e9f && q < 1.0e9f)) return q > 0.0f ? 1000000000 : -1000000000; // NaN -> low
+        const int t = static_cast<int>(q);
+        return t - (q < static_cast<float>(t));
+    }
+    static int floorDiv(int a, int m) { return a >= 0 ? a / m : -((-a + m - 1) / m); }
+    void buildLevel(Level& lv, int factor);
+    void fillLevel(Level& lv);
+
+    const float* xy_{nullptr};
+    size_t n_{0};
+    float base_cell_{0.01f};
+    std::vector<int32_t> base_x_, base_y_;
+    // Fixed storage so Level references stay valid for the frame. A frame uses a handful of
+    // cell sizes (prefilter, DBSCAN, postfilter); when all slots are taken the last one is reused.
+    static constexpr size_t kMaxLevels = 8;
+    std::array<Level, kMaxLevels> levels_;
+};
+
+// Cell key with the sign bits flipped so that (-1, -1) does not collide with kEmpty
+// (kEmpty would need cx == cy == INT_MAX, which floorCell never produces)
+inline uint64_t spatialCellKey(int cx, int cy) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(cx) ^ 0x80000000u) << 32) |
+           (static_cast<uint32_t>(cy) ^ 0x80000000u);
+}
+
+inline uint64_t spatialSlot(uint64_t key, int hash_shift) {
+    return (key * 0x9E3779B97F4A7C15ull) >> hash_shift;
+}
+
+inline bool FrameSpatialIndex::Level::cellRange(int cx, int cy, uint32_t& begin, uint32_t& end) const {
+    if (keys.empty() || cx < min_x || cx > max_x || cy < min_y || cy > max_y) return false;
+    const uint64_t key = spatialCellKey(cx, cy);
+    uint64_t s = spatialSlot(key, hash_shift);
+    while (true) {
+        const uint64_t k = keys[s];
+        if (k == key) {
+            begin = start[s];
+            end = start[s + 1];
+            return begin != end;
+        }
+        if (k == kEmpty) return false;
+        s = (s + 1) & slot_mask;
+    }
+}
+
+template <typename Fn>
+bool FrameSpatialIndex::forEachRing(const Level& lv, int cx, int cy, int rings, Fn&& fn) const {
+    auto visit = [&](int x, int y) -> bool {
+        uint32_t b, e;
+        if (!lv.cellRange(x, y, b, e)) return false;
+        for (uint32_t k = b; k < e; ++k) {
+            if (fn(lv.items[k])) return true;
+        }
+        return false;
+    };
+    for (int d = 0; d <= rings; ++d) {
+        // 占有範囲を完全に覆ったら以降のリングは空
+        if (cx - d < lv.min_x && cx + d > lv.max_x && cy - d < lv.min_y && cy + d > lv.max_y) {
+            if (d > 0) break;
+        }
+        if (d == 0) {
+            if (visit(cx, cy)) return true;
+            continue;
+        }
+        for (int x = cx - d; x <= cx + d; ++x) {
+            if (visit(x, cy - d) || visit(x, cy + d)) return true;
+        }
+        for (int y = cy - d + 1; y <= cy + d - 1; ++y) {
+            if (visit(cx - d, y) || visit(cx + d, y)) return true;
+        }
+    }
+    return false;
+}
+
+template <typename Fn>
+bool FrameSpatialIndex::forEachSquare(const Level& lv, int cx, int cy, int R, Fn&& fn) const {
+    for (int dx = -R; dx <= R; ++dx) {
+        for (int dy = -R; dy <= R; ++dy) {
+            uint32_t b, e;
+            if (!lv.cellRange(cx + dx, cy + dy, b, e)) continue;
+            for (uint32_t k = b; k < e; ++k) {
+                if (fn(lv.items[k])) return true;
+            }
+        }
+    }
+    return false;
+}
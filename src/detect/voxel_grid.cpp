@@ -0,0 +1,108 @@
+#include "voxel_grid.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include "detect/spatial_index.h"
+
+void VoxelDownsampler::apply(const std::vector<float>& xy,
+                             const std::vector<uint8_t>& sid,
+                             const std::vector<float>& dist,
+                             float resolution,
+                             VoxelFrame& out) {
+    const size_t n = std::min(xy.size() / 2, sid.size());
+    out.xy.clear();
+    out.sid.clear();
+    out.dist.clear();
+    out.count.clear();
+    out.sensor_offsets.assign(1, 0);
+    out.sensor_counts.clear();
+    sum_x_.clear();
+    sum_y_.clear();
+    if (n == 0) return;
+
+    const float inv = 1.0f / std::max(resolution, 1e-3f);
+    const size_t capacity = std::bit_ceil(std::max<size_t>(64, 2 * n));
+    const int hash_shift = 64 - std::countr_zero(capacity);
+    const uint64_t mask = capacity - 1;
+    keys_.assign(capacity, FrameSpatialIndex::kEmpty);
+    slot_voxel_.resize(capacity);
+    point_voxel_.resize(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        const float x = xy[2 * i];
+        const float y = xy[2 * i + 1];
+        const float r = (i < dist.size()) ? dist[i] : std::hypot(x, y);
+        const uint64_t key = spatialCellKey(static_cast<int>(std::floor(x * inv)),
+                                            static_cast<int>(std::floor(y * inv)));
+        uint64_t s = spatialSlot(key, hash_shift);
+        while (keys_[s] != FrameSpatialIndex::kEmpty && keys_[s] != key) s = (s + 1) & mask;
+
+        if (keys_[s] == FrameSpatialIndex::kEmpty) {
+            keys_[s] = key;
+            slot_voxel_[s] = static_cast<uint32_t>(out.sid.size());
+            point_voxel_[i] = slot_voxel_[s];
+            sum_x_.push_back(x);
+            sum_y_.push_back(y);
+            out.sid.push_back(sid[i]);
+            out.dist.push_back(r);
+            out.count.push_back(1);
+            continue;
+        }
+        const uint32_t v = slot_voxel_[s];
+        point_voxel_[i] = v;
+        sum_x_[v] += x;
+        sum_y_[v] += y;
+        ++out.count[v];
+        // 代表センサーは最も近い（測距精度の高い）点のもの
+        if (r < out.dist[v]) {
+            out.dist[v] = r;
+            out.sid[v] = sid[i];
+        }
+    }
+
+    const size_t m = out.sid.size();
+    out.xy.resize(2 * m);
+    for (size_t v = 0; v < m; ++v) {
+        const float c = static_cast<float>(out.count[v]);
+        out.xy[2 * v] = sum_x_[v] / c;
+        out.xy[2 * v + 1] = sum_y_[v] / c;
+    }
+
+    // voxel ごとのセンサー別点数: 入力点の sid を voxel 順に並べ替えて（counting sort）から数える
+    cursor_.resize(m);
+    uint32_t begin = 0;
+    for (size_t v = 0; v < m; ++v) {
+        cursor_[v] = begin;
+        begin += out.count[v];
+    }
+    member_sid_.resize(n);
+    for (size_t i = 0; i < n; ++i) member_sid_[cursor_[point_voxel_[i]]++] = sid[i];
+
+    std::array<uint32_t, 256> counts{};
+    out.sensor_offsets.resize(m + 1);
+    begin = 0;
+    for (size_t v = 0; v < m; ++v) {
+        out.sensor_offsets[v] = static_cast<uint32_t>(out.sensor_counts.size());
+        const uint32_t end = cursor_[v];
+        if (end - begin == 1) {
+            out.sensor_counts.push_back({member_sid_[begin], 1});
+        } else {
+            uint64_t seen[4] = {0, 0, 0, 0};
+            for (uint32_t j = begin; j < end; ++j) {
+                const uint8_t s = member_sid_[j];
+                if (counts[s]++ == 0) seen[s >> 6] |= uint64_t{1} << (s & 63);
+            }
+            for (int w = 0; w < 4; ++w) {
+                for (uint64_t bits = seen[w]; bits; bits &= bits - 1) {
+                    const uint8_t s = static_cast<uint8_t>(w * 64 + std::countr_zero(bits));
+                    out.sensor_counts.push_back({s, counts[s]});
+                    counts[s] = 0;
+                }
+            }
+        }
+        begin = end;
+    }
+    out.sensor_offsets[m] = static_cast<uint32_t>(out.sensor_counts.size());
+}
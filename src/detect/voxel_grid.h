@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "detect/dbscan.h"
+
+// Merged points of one frame (SoA). Buffers are reused across frames.
+struct VoxelFrame {
+    std::vector<float> xy;             // centroid [x0,y0,x1,y1,...]
+    std::vector<uint8_t> sid;          // sensor of the nearest (min-range) member
+    std::vector<float> dist;           // min range of the members [m]
+    std::vector<uint32_t> count;       // merged input points
+    // Merged input points per sensor (CSR, ascending sid within a voxel)
+    std::vector<uint32_t> sensor_offsets;
+    std::vector<SensorPointCount> sensor_counts;
+
+    size_t size() const { return sid.size(); }
+};
+
+// Voxel-grid downsampling: merges the points that fall into the same `resolution`
+// cell (near-duplicates where several sensors overlap). Open addressing over the
+// cell keys, no per-frame allocation once the buffers have grown; output keeps the
+// first-seen order of the voxels so results are deterministic.
+class VoxelDownsampler {
+public:
+    void apply(const std::vector<float>& xy,
+               const std::vector<uint8_t>& sid,
+               const std::vector<float>& dist,
+               float resolution,
+               VoxelFrame& out);
+
+private:
+    std::vector<uint64_t> keys_;
+    std::vector<uint32_t> slot_voxel_;
+    std::vector<float> sum_x_, sum_y_;
+    std::vector<uint32_t> point_voxel_;  // voxel of each input point
+    std::vector<uint32_t> cursor_;       // counting-sort cursor per voxel
+    std::vector<uint8_t> member_sid_;    // input sids grouped by voxel
+};
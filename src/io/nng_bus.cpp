@@ -98,7 +98,7 @@ void NngBus::stop() {
   enabled_ = false;
 }
 
-void NngBus::publishClusters(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items) {
+void NngBus::publishClusters(uint64_t t_ns, uint32_t seq, uint64_t params_version, const std::vector<Cluster>& items) {
   if (!enabled_ || !send_clusters_) return;
   
 #ifdef USE_NNG
@@ -106,14 +106,14 @@ void NngBus::publishClusters(uint64_t t_ns, uint32_t seq, const std::vector<Clus
   
   // Use the configured encoding
   if (encoding_ == "json") {
-    data = serializeToJson(t_ns, seq, items);
+    data = serializeToJson(t_ns, seq, params_version, items);
   } else {
     // Default to MessagePack, with JSON fallback on error
     try {
-      data = serializeToMessagePack(t_ns, seq, items);
+      data = serializeToMessagePack(t_ns, seq, params_version, items);
     } catch (const std::exception& e) {
       std::cerr << "[NngBus] MessagePack serialization failed, using JSON: " << e.what() << std::endl;
-      data = serializeToJson(t_ns, seq, items);
+      data = serializeToJson(t_ns, seq, params_version, items);
     }
   }
   
@@ -144,13 +144,13 @@ void NngBus::publishClusters(uint64_t t_ns, uint32_t seq, const std::vector<Clus
 #endif
 }
 
-std::string NngBus::serializeToMessagePack(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items) {
+std::string NngBus::serializeToMessagePack(uint64_t t_ns, uint32_t seq, uint64_t params_version, const std::vector<Cluster>& items) {
   // Simple MessagePack implementation for basic types
   // This is a minimal implementation - in production you'd use a proper MessagePack library
   std::ostringstream ss;
   
-  // MessagePack map with 5 elements: {v, seq, t_ns, items, raw}
-  ss << char(0x85); // fixmap with 5 elements
+  // MessagePack map with 6 elements: {v, seq, t_ns, pv, items, raw}
+  ss << char(0x86); // fixmap with 6 elements
   
   // "v": 1
   ss << char(0xa1) << 'v'; // fixstr with 1 char
@@ -171,6 +171,13 @@ std::string NngBus::serializeToMessagePack(uint64_t t_ns, uint32_t seq, const st
     ss << char((t_ns >> (i * 8)) & 0xff);
   }
   
+  // "pv": params_version (DetectionParams snapshot)
+  ss << char(0xa2) << "pv"; // fixstr with 2 chars
+  ss << char(0xcf); // uint64
+  for (int i = 7; i >= 0; i--) {
+    ss << char((params_version >> (i * 8)) & 0xff);
+  }
+  
   // "items": array of clusters
   ss << char(0xa5) << "items"; // fixstr with 5 chars
   if (items.size() < 16) {
@@ -182,8 +189,8 @@ std::string NngBus::serializeToMessagePack(uint64_t t_ns, uint32_t seq, const st
   }
   
   for (const auto& cluster : items) {
-    // Each cluster is a map with 9 elements: {id, cx, cy, minx, miny, maxx, maxy, n}
-    ss << char(0x88); // fixmap with 8 elements
+    // Each cluster is a map with 9 elements: {id, cx, cy, minx, miny, maxx, maxy, n, sensor_mask}
+    ss << char(0x89); // fixmap with 9 elements
     
     // "id": cluster.id
     ss << char(0xa2) << "id"; // fixstr with 2 chars
@@ -242,9 +249,9 @@ std::string NngBus::serializeToMessagePack(uint64_t t_ns, uint32_t seq, const st
       ss << char((u.i >> (i * 8)) & 0xff);
     }
     
-    // "n": cluster.point_indices.size()
+    // "n": cluster.point_count
     ss << char(0xa1) << 'n';
-    uint32_t n = static_cast<uint32_t>(cluster.point_indices.size());
+    uint32_t n = cluster.point_count;
     if (n < 128) {
       ss << char(n); // positive fixint
     } else if (n < 256) {
@@ -254,6 +261,13 @@ std::string NngBus::serializeToMessagePack(uint64_t t_ns, uint32_t seq, const st
       ss << char((n >> 8) & 0xff);
       ss << char(n & 0xff);
     }
+    
+    // "sensor_mask": bit s = sensor sid s
+    ss << char(0xab) << "sensor_mask"; // fixstr with 11 chars
+    ss << char(0xcf); // uint64
+    for (int i = 7; i >= 0; i--) {
+      ss << char((cluster.sensor_mask >> (i * 8)) & 0xff);
+    }
   }
   
   // "raw": false
@@ -263,11 +277,12 @@ std::string NngBus::serializeToMessagePack(uint64_t t_ns, uint32_t seq, const st
   return ss.str();
 }
 
-std::string NngBus::serializeToJson(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items) {
+std::string NngBus::serializeToJson(uint64_t t_ns, uint32_t seq, uint64_t params_version, const std::vector<Cluster>& items) {
   Json::Value root;
   root["v"] = 1;
   root["seq"] = seq;
   root["t_ns"] = Json::UInt64(t_ns);
+  root["pv"] = Json::UInt64(params_version);
   root["raw"] = false;
   
   Json::Value items_array(Json::arrayValue);
@@ -280,7 +295,9 @@ std::string NngBus::serializeToJson(uint64_t t_ns, uint32_t seq, const std::vect
     item["miny"] = cluster.miny;
     item["maxx"] = cluster.maxx;
     item["maxy"] = cluster.maxy;
-    item["n"] = static_cast<int>(cluster.point_indices.size());
+    item["n"] = static_cast<int>(cluster.point_count);
+    // Decimal string: a JSON number loses bits above 2^53 in JavaScript consumers
+    item["sensor_mask"] = std::to_string(cluster.sensor_mask);
     items_array.append(item);
   }
   root["items"] = items_array;
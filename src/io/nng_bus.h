@@ -29,15 +29,15 @@ public:
   void startPublisher(const std::string& url);
   void startPublisher(const SinkConfig& config);
   void updateConfig(const SinkConfig& config);
-  void publishClusters(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items);
+  void publishClusters(uint64_t t_ns, uint32_t seq, uint64_t params_version, const std::vector<Cluster>& items);
   void publishRaw(uint64_t t_ns, uint32_t seq, const std::vector<float>& xy, const std::vector<uint8_t>& sid);
   void stop();
   
   bool isEnabled() const { return enabled_; }
   
 private:
-  std::string serializeToMessagePack(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items);
-  std::string serializeToJson(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items);
+  std::string serializeToMessagePack(uint64_t t_ns, uint32_t seq, uint64_t params_version, const std::vector<Cluster>& items);
+  std::string serializeToJson(uint64_t t_ns, uint32_t seq, uint64_t params_version, const std::vector<Cluster>& items);
   std::string serializeRawToMessagePack(uint64_t t_ns, uint32_t seq, const std::vector<float>& xy, const std::vector<uint8_t>& sid);
   std::string serializeRawToJson(uint64_t t_ns, uint32_t seq, const std::vector<float>& xy, const std::vector<uint8_t>& sid);
 };
\ No newline at end of file
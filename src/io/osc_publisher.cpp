@@ -1,10 +1,10 @@
 #include "osc_publisher.h"
 #include <iostream>
-#include <sstream>
 #include <cstring>
 #include <vector>
 #include <cmath>
 #include <chrono>
+#include <algorithm>
 
 #ifdef USE_OSC
 #  ifdef _WIN32
@@ -16,6 +16,7 @@
      typedef intptr_t ssize_t;
 #  else
 #    include <unistd.h>
+#    include <cerrno>
 #    include <arpa/inet.h>
 #    include <netinet/in.h>
 #    include <sys/socket.h>
@@ -31,6 +32,54 @@
 //       raw OSC message bytes
 //   ]
 // We convert unix t_ns -> NTP (secs since 1900 + fractional 32-bit).
+//
+// Encoding is done directly into arena_ (one contiguous buffer per frame);
+// datagrams_ records the [offset, size] of every UDP payload so the whole
+// frame can be submitted with a single sendmmsg() batch.
+
+namespace {
+
+using clock_hr = std::chrono::steady_clock;
+
+constexpr size_t kBundleHeaderBytes = 16;   // "#bundle\0" + timetag
+constexpr size_t kArenaInitialBytes = 64 * 1024;
+constexpr size_t kDatagramInitialCount = 256;
+#if defined(USE_OSC) && defined(__linux__)
+constexpr unsigned kMaxMmsgBatch = 1024;    // UIO_MAXIOV
+#endif
+
+// Type tags
+constexpr char kClusterTypeTag[] = ",ihiffffffih"; // id, t_ns, seq, cx, cy, minx, miny, maxx, maxy, n, sensor_mask
+constexpr char kPointTypeTag[]   = ",hiffi";      // t_ns, seq, x, y, sid
+
+inline size_t oscStringSize(size_t len) {
+  // 終端 '\0' を含めて 4 バイト境界に揃える
+  return (len / 4 + 1) * 4;
+}
+
+inline size_t clusterMessageSize(const std::string& address) {
+  return oscStringSize(address.size()) + oscStringSize(sizeof(kClusterTypeTag) - 1) + 4 + 8 + 4 + 6 * 4 + 4 + 8;
+}
+
+inline size_t pointMessageSize(const std::string& address) {
+  return oscStringSize(address.size()) + oscStringSize(sizeof(kPointTypeTag) - 1) + 8 + 4 + 4 + 4 + 4;
+}
+
+// unix ns -> NTP 64-bit
+inline uint64_t unix_ns_to_ntp(uint64_t t_ns) {
+  const uint64_t NTP_EPOCH_OFFSET = 2208988800ULL; // seconds between 1900 and 1970
+  uint64_t secs = t_ns / 1000000000ULL;
+  uint64_t rem_ns = t_ns % 1000000000ULL;
+
+  uint64_t ntp_secs = secs + NTP_EPOCH_OFFSET;
+  // fractional = (rem_ns / 1e9) * 2^32
+  long double frac = (long double)rem_ns / 1000000000.0L;
+  uint64_t ntp_frac = (uint64_t)std::llround(frac * 4294967296.0L); // 2^32
+
+  return (ntp_secs << 32) | (ntp_frac & 0xffffffffULL);
+}
+
+} // namespace
 
 OscPublisher::OscPublisher() : enabled_(false) {
 #ifdef USE_OSC
@@ -83,6 +132,10 @@ void OscPublisher::start(const SinkConfig& config) {
   send_clusters_ = config.send_clusters;
   send_raw_ = config.send_raw;
 
+  // 送信バッファを先に確保しておく（以降のフレームでは容量を再利用）
+  arena_.reserve(kArenaInitialBytes);
+  datagrams_.reserve(kDatagramInitialCount);
+
 #ifdef USE_OSC
   socket_fd_ = socket(AF_INET, SOCK_DGRAM, 0);
   if (socket_fd_ == HOKUYO_OSC_INVALID_SOCKET) {
@@ -107,6 +160,12 @@ void OscPublisher::start(const SinkConfig& config) {
     return;
   }
 
+#if defined(__linux__)
+  mmsgs_.reserve(kDatagramInitialCount);
+  iovs_.reserve(kDatagramInitialCount);
+  use_sendmmsg_ = true;
+#endif
+
   enabled_ = true;
 #endif
 }
@@ -135,242 +194,257 @@ void OscPublisher::stop() {
   enabled_ = false;
 }
 
-// ---- NEW: Bundle encoder ----
-static inline void write_be32(std::ostringstream& ss, uint32_t v) {
-  ss << char((v >> 24) & 0xff) << char((v >> 16) & 0xff)
-     << char((v >> 8) & 0xff)  << char(v & 0xff);
+OscPublisherStats OscPublisher::getStats() const {
+  std::lock_guard<std::mutex> lk(stats_mu_);
+  return stats_;
 }
 
-static inline void write_be64(std::ostringstream& ss, uint64_t v) {
-  ss << char((v >> 56) & 0xff) << char((v >> 48) & 0xff)
-     << char((v >> 40) & 0xff) << char((v >> 32) & 0xff)
-     << char((v >> 24) & 0xff) << char((v >> 16) & 0xff)
-     << char((v >> 8) & 0xff)  << char(v & 0xff);
+// ---- Arena encoder ----
+
+void OscPublisher::resetArena() {
+  arena_.clear();
+  datagrams_.clear();
+  open_ = false;
 }
 
-// unix ns -> NTP 64-bit
-static inline uint64_t unix_ns_to_ntp(uint64_t t_ns) {
-  const uint64_t NTP_EPOCH_OFFSET = 2208988800ULL; // seconds between 1900 and 1970
-  uint64_t secs = t_ns / 1000000000ULL;
-  uint64_t rem_ns = t_ns % 1000000000ULL;
+void OscPublisher::beginDatagram() {
+  open_offset_ = arena_.size();
+  open_ = true;
+}
 
-  uint64_t ntp_secs = secs + NTP_EPOCH_OFFSET;
-  // fractional = (rem_ns / 1e9) * 2^32
-  long double frac = (long double)rem_ns / 1000000000.0L;
-  uint64_t ntp_frac = (uint64_t)std::llround(frac * 4294967296.0L); // 2^32
+void OscPublisher::endDatagram() {
+  if (!open_) return;
+  const size_t size = arena_.size() - open_offset_;
+  if (size > 0) datagrams_.push_back({open_offset_, size});
+  open_ = false;
+}
 
-  return (ntp_secs << 32) | (ntp_frac & 0xffffffffULL);
+void OscPublisher::beginBundle(uint64_t t_ns) {
+  beginDatagram();
+  putOscString("#bundle", 7); // "#bundle" + '\0' は 8B なので既に4揃え
+  putBe64(unix_ns_to_ntp(t_ns));
 }
 
-static inline void pad4(std::ostringstream& ss) {
-  while (ss.tellp() % 4 != 0) ss << '\0';
+size_t OscPublisher::beginBundleElement() {
+  // サイズは要素を書き終えてから埋める
+  const size_t size_pos = arena_.size();
+  putBe32(0);
+  return size_pos;
 }
 
-std::string OscPublisher::encodeOscMessage(const std::string& address, uint32_t id, uint64_t t_ns, uint32_t seq,
-                                           float cx, float cy, float minx, float miny, float maxx, float maxy, uint32_t n) {
-  std::ostringstream ss;
-
-  // Address
-  ss << address << '\0';
-  pad4(ss);
-
-  // Type tag string (i,t,i,f,f,f,f,f,f,i) => ",itiffffffi"
-  ss << ",ihiffffffi" << '\0';
-  pad4(ss);
-
-  // Writers
-  auto writeInt32 = [&](uint32_t val) { write_be32(ss, val); };
-  auto writeInt64 = [&](uint64_t val) { write_be64(ss, val); };
-  auto writeFloat32 = [&](float val) {
-    union { float f; uint32_t i; } u;
-    u.f = val;
-    write_be32(ss, u.i);
-  };
-
-  // Arguments: id, t_ns, seq, cx, cy, minx, miny, maxx, maxy, n
-  writeInt32(id);
-  writeInt64(t_ns);
-  writeInt32(seq);
-  writeFloat32(cx);
-  writeFloat32(cy);
-  writeFloat32(minx);
-  writeFloat32(miny);
-  writeFloat32(maxx);
-  writeFloat32(maxy);
-  writeInt32(n);
-
-  return ss.str();
+void OscPublisher::endBundleElement(size_t size_pos) {
+  const uint32_t v = static_cast<uint32_t>(arena_.size() - size_pos - 4);
+  char* p = arena_.data() + size_pos;
+  p[0] = char((v >> 24) & 0xff);
+  p[1] = char((v >> 16) & 0xff);
+  p[2] = char((v >> 8) & 0xff);
+  p[3] = char(v & 0xff);
 }
 
-std::string OscPublisher::encodeOscBundle(const std::vector<std::string>& messages, uint64_t t_ns) {
-  std::ostringstream ss;
+void OscPublisher::putBe32(uint32_t v) {
+  const char b[4] = {char((v >> 24) & 0xff), char((v >> 16) & 0xff),
+                     char((v >> 8) & 0xff),  char(v & 0xff)};
+  arena_.insert(arena_.end(), b, b + 4);
+}
 
-  // "#bundle" OSC-string
-  ss << "#bundle" << '\0';
-  pad4(ss); // (#bundle + \0 は 8B なので既に4揃え)
+void OscPublisher::putBe64(uint64_t v) {
+  putBe32(static_cast<uint32_t>(v >> 32));
+  putBe32(static_cast<uint32_t>(v & 0xffffffffULL));
+}
 
-  // NTP timetag
-  uint64_t ntp = unix_ns_to_ntp(t_ns);
-  write_be64(ss, ntp);
+void OscPublisher::putFloat32(float v) {
+  uint32_t u;
+  std::memcpy(&u, &v, sizeof(u));
+  putBe32(u);
+}
 
-  // Each element: size (int32 BE) + message bytes
-  for (const auto& msg : messages) {
-    write_be32(ss, static_cast<uint32_t>(msg.size()));
-    ss.write(msg.data(), static_cast<std::streamsize>(msg.size()));
-  }
+void OscPublisher::putOscString(const char* s, size_t len) {
+  arena_.insert(arena_.end(), s, s + len);
+  arena_.insert(arena_.end(), oscStringSize(len) - len, '\0');
+}
 
-  return ss.str();
+void OscPublisher::appendClusterMessage(const Cluster& c, uint64_t t_ns, uint32_t seq) {
+  putOscString(cluster_path_);
+  putOscString(kClusterTypeTag, sizeof(kClusterTypeTag) - 1);
+
+  // Arguments: id, t_ns, seq, cx, cy, minx, miny, maxx, maxy, n, sensor_mask
+  // (sensor_mask は末尾に追加したので、先頭 10 引数の位置は従来どおり)
+  putBe32(c.id);
+  putBe64(t_ns);
+  putBe32(seq);
+  putFloat32(c.cx);
+  putFloat32(c.cy);
+  putFloat32(c.minx);
+  putFloat32(c.miny);
+  putFloat32(c.maxx);
+  putFloat32(c.maxy);
+  putBe32(c.point_count);
+  putBe64(c.sensor_mask);
 }
 
-void OscPublisher::publishClusters(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items) {
-  if (!enabled_ || !send_clusters_) return;
+// Single point: timetag (int64), seq (int32), x (float), y (float), sid (int32)
+void OscPublisher::appendPointMessage(uint64_t t_ns, uint32_t seq, float x, float y, uint32_t sid) {
+  putOscString(raw_path_);
+  putOscString(kPointTypeTag, sizeof(kPointTypeTag) - 1);
+  putBe64(t_ns);
+  putBe32(seq);
+  putFloat32(x);
+  putFloat32(y);
+  putBe32(sid);
+}
 
-  // 1) まず全メッセージを生成
-  std::vector<std::string> msgs;
-  msgs.reserve(items.size());
-  for (const auto& c : items) {
-    msgs.emplace_back(encodeOscMessage(cluster_path_, c.id, t_ns, seq,
-                                       c.cx, c.cy,
-                                       c.minx, c.miny,
-                                       c.maxx, c.maxy,
-                                       static_cast<uint32_t>(c.point_indices.size())));
-  }
+// Encode `count` messages of fixed size into datagrams.
+// in_bundle: UDP MTU 対策で bundle_fragment_size_ を目安にチャンク分割
+// otherwise: 1 message = 1 datagram
+template <typename AppendFn>
+void OscPublisher::encodeFrame(size_t count, size_t message_size, uint64_t t_ns, AppendFn&& append) {
+  resetArena();
+  if (count == 0) return;
 
-  if(in_bundle_) {
-    // 2) UDP MTU 対策で適度にチャンク分割して Bundle 送信
-    //    だいたい 1200B を目安（ヘッダ 16B + 各要素の size(4B) を見込む）
+  if (in_bundle_) {
     const size_t SOFT_UDP_LIMIT = bundle_fragment_size_;
-    std::vector<std::string> chunk;
-    size_t current_bytes = 16; // "#bundle"+timetag = 8+8 = 16B
-
-    auto flush_chunk = [&]() {
-        if (chunk.empty()) return;
-        std::string bundle = encodeOscBundle(chunk, t_ns);
-        sendUdp(bundle);
-        chunk.clear();
-        current_bytes = 16;
-    };
-
-    for (const auto& m : msgs) {
-        size_t add_bytes = 4 + m.size(); // size field + message
-        if (!chunk.empty() && SOFT_UDP_LIMIT > 0 && (current_bytes + add_bytes) > SOFT_UDP_LIMIT) {
-            flush_chunk();
-        }
-        chunk.push_back(m);
-        current_bytes += add_bytes;
+    const size_t add_bytes = 4 + message_size; // size field + message
+    arena_.reserve(count * add_bytes + (count / 8 + 1) * kBundleHeaderBytes);
+
+    size_t current_bytes = 0;
+    size_t elements = 0;
+    for (size_t i = 0; i < count; ++i) {
+      if (elements == 0 || (SOFT_UDP_LIMIT > 0 && (current_bytes + add_bytes) > SOFT_UDP_LIMIT)) {
+        endDatagram();
+        beginBundle(t_ns);
+        current_bytes = kBundleHeaderBytes;
+        elements = 0;
+      }
+      const size_t size_pos = beginBundleElement();
+      append(i);
+      endBundleElement(size_pos);
+      current_bytes += add_bytes;
+      ++elements;
     }
-    flush_chunk();
-  }
-  else {
-    for (const auto& m : msgs) {
-      sendUdp(m);
+    endDatagram();
+  } else {
+    arena_.reserve(count * message_size);
+    for (size_t i = 0; i < count; ++i) {
+      beginDatagram();
+      append(i);
+      endDatagram();
     }
   }
 }
 
-void OscPublisher::sendUdp(const std::string& data) {
-#ifdef USE_OSC
-  if (socket_fd_ == HOKUYO_OSC_INVALID_SOCKET) return;
-
-  // Windows sendto は int 引数。size_t をそのまま渡すと警告/エラーの可能性があるため明示変換。
-  ssize_t sent = sendto(socket_fd_, data.c_str(), static_cast<int>(data.size()), 0,
-                        (struct sockaddr*)&addr_, sizeof(addr_));
-  if (sent < 0) {
-    std::cerr << "[OscPublisher] Failed to send UDP packet" << std::endl;
-  }
-#endif
-}
-
-// Encode an OSC message with a single string argument
-std::string OscPublisher::encodeOscStringMessage(const std::string& address, const std::string& s) {
-  std::ostringstream ss;
-  ss << address << '\0';
-  pad4(ss);
-
-  // Type tag string: ',s'
-  ss << ",s" << '\0';
-  pad4(ss);
-
-  // String argument
-  ss << s << '\0';
-  pad4(ss);
-
-  return ss.str();
-}
-
-// Encode an OSC message for a single point: timetag (int64), seq (int32), x (float), y (float), sid (int32)
-std::string OscPublisher::encodeOscPointMessage(const std::string& address, uint64_t t_ns, uint32_t seq, float x, float y, uint32_t sid) {
-  std::ostringstream ss;
-
-  // Address
-  ss << address << '\0';
-  pad4(ss);
-
-  // Type tag: int64 (h), int32 (i), float (f), float (f), int32 (i) => ",hiffi"
-  ss << ",hiffi" << '\0';
-  pad4(ss);
-
-  // write int64 t_ns
-  write_be64(ss, t_ns);
-
-  // write int32 seq
-  write_be32(ss, seq);
+void OscPublisher::publishClusters(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items) {
+  if (!enabled_ || !send_clusters_) return;
 
-  // write float x, y as big-endian 32-bit
-  auto writeFloat32 = [&](float val) {
-    union { float f; uint32_t i; } u;
-    u.f = val;
-    write_be32(ss, u.i);
-  };
-  writeFloat32(x);
-  writeFloat32(y);
+  const auto t0 = clock_hr::now();
+  encodeFrame(items.size(), clusterMessageSize(cluster_path_), t_ns,
+              [&](size_t i) { appendClusterMessage(items[i], t_ns, seq); });
+  const auto t1 = clock_hr::now();
 
-  // write sid
-  write_be32(ss, sid);
+  uint64_t syscalls = 0, errors = 0;
+  flushDatagrams(syscalls, errors);
+  const auto t2 = clock_hr::now();
 
-  return ss.str();
+  recordFrame(items.size(),
+              std::chrono::duration<double, std::micro>(t1 - t0).count(),
+              std::chrono::duration<double, std::micro>(t2 - t1).count(),
+              syscalls, errors);
 }
 
 void OscPublisher::publishRaw(uint64_t t_ns, uint32_t seq, const std::vector<float>& xy, const std::vector<uint8_t>& sid) {
   if (!enabled_ || !send_raw_) return;
 
-  // Build per-point OSC messages
-  std::vector<std::string> msgs;
-  size_t npoints = xy.size() / 2;
-  msgs.reserve(npoints);
-  for (size_t i = 0; i < npoints; ++i) {
-    float x = xy[i*2];
-    float y = xy[i*2 + 1];
-    uint32_t s = (i < sid.size()) ? static_cast<uint32_t>(sid[i]) : 0;
-    msgs.emplace_back(encodeOscPointMessage(raw_path_, t_ns, seq, x, y, s));
-  }
+  const size_t npoints = xy.size() / 2;
+  const auto t0 = clock_hr::now();
+  encodeFrame(npoints, pointMessageSize(raw_path_), t_ns, [&](size_t i) {
+    const uint32_t s = (i < sid.size()) ? static_cast<uint32_t>(sid[i]) : 0;
+    appendPointMessage(t_ns, seq, xy[i * 2], xy[i * 2 + 1], s);
+  });
+  const auto t1 = clock_hr::now();
+
+  uint64_t syscalls = 0, errors = 0;
+  flushDatagrams(syscalls, errors);
+  const auto t2 = clock_hr::now();
+
+  recordFrame(npoints,
+              std::chrono::duration<double, std::micro>(t1 - t0).count(),
+              std::chrono::duration<double, std::micro>(t2 - t1).count(),
+              syscalls, errors);
+}
 
-  if (in_bundle_) {
-    // Fragment messages into bundles if needed
-    const size_t SOFT_UDP_LIMIT = bundle_fragment_size_;
-    std::vector<std::string> chunk;
-    size_t current_bytes = 16; // "#bundle" + timetag
-
-    auto flush_chunk = [&]() {
-      if (chunk.empty()) return;
-      std::string bundle = encodeOscBundle(chunk, t_ns);
-      sendUdp(bundle);
-      chunk.clear();
-      current_bytes = 16;
-    };
-
-    for (const auto& m : msgs) {
-      size_t add_bytes = 4 + m.size();
-      if (!chunk.empty() && SOFT_UDP_LIMIT > 0 && (current_bytes + add_bytes) > SOFT_UDP_LIMIT) {
-        flush_chunk();
-      }
-      chunk.push_back(m);
-      current_bytes += add_bytes;
+void OscPublisher::flushDatagrams(uint64_t& syscalls, uint64_t& errors) {
+#ifdef USE_OSC
+  if (socket_fd_ == HOKUYO_OSC_INVALID_SOCKET || datagrams_.empty()) return;
+
+  const size_t n = datagrams_.size();
+  size_t next = 0;
+
+#if defined(__linux__)
+  if (use_sendmmsg_) {
+    iovs_.resize(n);
+    mmsgs_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      iovs_[i].iov_base = arena_.data() + datagrams_[i].offset;
+      iovs_[i].iov_len = datagrams_[i].size;
+      std::memset(&mmsgs_[i], 0, sizeof(mmsgs_[i]));
+      mmsgs_[i].msg_hdr.msg_name = &addr_;
+      mmsgs_[i].msg_hdr.msg_namelen = sizeof(addr_);
+      mmsgs_[i].msg_hdr.msg_iov = &iovs_[i];
+      mmsgs_[i].msg_hdr.msg_iovlen = 1;
     }
-    flush_chunk();
-  } else {
-    for (const auto& m : msgs) {
-      sendUdp(m);
+
+    while (next < n) {
+      const unsigned batch = static_cast<unsigned>(std::min<size_t>(n - next, kMaxMmsgBatch));
+      const int rv = sendmmsg(socket_fd_, &mmsgs_[next], batch, 0);
+      ++syscalls;
+      if (rv > 0) {
+        next += static_cast<size_t>(rv);
+        continue;
+      }
+      if (rv < 0 && errno == EINTR) continue;
+      if (rv < 0 && (errno == ENOSYS || errno == EOPNOTSUPP)) {
+        // カーネルが sendmmsg 非対応 → 以降は sendto ループへ
+        use_sendmmsg_ = false;
+        break;
+      }
+      // 先頭のデータグラムが拒否された（ENOBUFS / ECONNREFUSED 等）: 1件捨てて続行
+      ++errors;
+      ++next;
     }
   }
-}
\ No newline at end of file
+#endif
+
+  for (size_t i = next; i < n; ++i) {
+    // Windows sendto は int 引数。size_t をそのまま渡すと警告/エラーの可能性があるため明示変換。
+    ssize_t sent = sendto(socket_fd_, arena_.data() + datagrams_[i].offset,
+                          static_cast<int>(datagrams_[i].size), 0,
+                          (struct sockaddr*)&addr_, sizeof(addr_));
+    ++syscalls;
+    if (sent < 0) ++errors;
+  }
+
+  if (errors > 0) {
+    std::cerr << "[OscPublisher] Failed to send " << errors << " of " << n << " UDP packet(s)" << std::endl;
+  }
+#else
+  (void)syscalls;
+  (void)errors;
+#endif
+}
+
+void OscPublisher::recordFrame(size_t messages, double encode_us, double send_us, uint64_t syscalls, uint64_t errors) {
+  if (messages == 0) return;
+  size_t bytes = 0;
+  for (const auto& d : datagrams_) bytes += d.size;
+
+  std::lock_guard<std::mutex> lk(stats_mu_);
+  stats_.frames++;
+  stats_.messages += messages;
+  stats_.datagrams += datagrams_.size();
+  stats_.syscalls += syscalls;
+  stats_.bytes += bytes;
+  stats_.send_errors += errors;
+  stats_.last_encode_us = encode_us;
+  stats_.last_send_us = send_us;
+  stats_.total_encode_us += encode_us;
+  stats_.total_send_us += send_us;
+}
@@ -3,6 +3,7 @@
 #include <vector>
 #include <cstdint>
 #include <chrono>
+#include <mutex>
 #include "detect/dbscan.h"
 #include "config/config.h"
 
@@ -13,12 +14,27 @@
 #    define HOKUYO_OSC_INVALID_SOCKET INVALID_SOCKET
 #  else
 #    include <sys/socket.h>
+#    include <sys/uio.h>
 #    include <netinet/in.h>
 #    include <arpa/inet.h>
 #    define HOKUYO_OSC_INVALID_SOCKET (-1)
 #  endif
 #endif
 
+// Per-publisher counters (encode / send cost is measured per frame)
+struct OscPublisherStats {
+  uint64_t frames{0};          // publishClusters/publishRaw calls that produced output
+  uint64_t messages{0};        // OSC messages encoded
+  uint64_t datagrams{0};       // UDP datagrams submitted
+  uint64_t syscalls{0};        // sendmmsg/sendto calls issued
+  uint64_t bytes{0};           // payload bytes submitted
+  uint64_t send_errors{0};     // datagrams the kernel rejected
+  double last_encode_us{0.0};
+  double last_send_us{0.0};
+  double total_encode_us{0.0};
+  double total_send_us{0.0};
+};
+
 class OscPublisher {
   std::string host_;
   int port_;
@@ -29,6 +45,19 @@ class OscPublisher {
   uint64_t bundle_fragment_size_{0};
   bool send_clusters_{true};
   bool send_raw_{false};
+
+  // 1フレーム分のデータグラムを連続領域にエンコードする（容量はフレーム間で再利用）
+  struct Datagram {
+    size_t offset;
+    size_t size;
+  };
+  std::vector<char> arena_;
+  std::vector<Datagram> datagrams_;
+  size_t open_offset_{0};
+  bool open_{false};
+
+  mutable std::mutex stats_mu_;
+  OscPublisherStats stats_;
   
 #ifdef USE_OSC
 #  ifdef _WIN32
@@ -38,6 +67,12 @@ class OscPublisher {
   int socket_fd_{-1};
 #  endif
   struct sockaddr_in addr_;
+#  if defined(__linux__)
+  // sendmmsg 用の送信ベクタ（arena_ と同様に再利用）
+  std::vector<struct mmsghdr> mmsgs_;
+  std::vector<struct iovec> iovs_;
+  bool use_sendmmsg_{true};
+#  endif
 #endif
 
 public:
@@ -51,12 +86,28 @@ public:
   void stop();
   
   bool isEnabled() const { return enabled_; }
+  OscPublisherStats getStats() const;
   
 private:
-  std::string encodeOscBundle(const std::vector<std::string>& messages, uint64_t t_ns);
-  std::string encodeOscMessage(const std::string& address, uint32_t id, uint64_t t_ns, uint32_t seq, 
-                              float cx, float cy, float minx, float miny, float maxx, float maxy, uint32_t n);
-  std::string encodeOscStringMessage(const std::string& address, const std::string& s);
-  std::string encodeOscPointMessage(const std::string& address, uint64_t t_ns, uint32_t seq, float x, float y, uint32_t sid);
-  void sendUdp(const std::string& data);
-};
\ No newline at end of file
+  // Arena encoder
+  void resetArena();
+  void beginDatagram();
+  void endDatagram();
+  void beginBundle(uint64_t t_ns);
+  size_t beginBundleElement();
+  void endBundleElement(size_t size_pos);
+  void putBe32(uint32_t v);
+  void putBe64(uint64_t v);
+  void putFloat32(float v);
+  void putOscString(const char* s, size_t len);
+  void putOscString(const std::string& s) { putOscString(s.data(), s.size()); }
+
+  void appendClusterMessage(const Cluster& c, uint64_t t_ns, uint32_t seq);
+  void appendPointMessage(uint64_t t_ns, uint32_t seq, float x, float y, uint32_t sid);
+  template <typename AppendFn>
+  void encodeFrame(size_t count, size_t message_size, uint64_t t_ns, AppendFn&& append);
+
+  // Submit every encoded datagram (sendmmsg on Linux, sendto loop elsewhere)
+  void flushDatagrams(uint64_t& syscalls, uint64_t& errors);
+  void recordFrame(size_t messages, double encode_us, double send_us, uint64_t syscalls, uint64_t errors);
+};
@@ -1,8 +1,14 @@
 #include "publisher_manager.h"
 #include "nng_bus.h"
 #include "osc_publisher.h"
+#include "shm_ring.h"
+#include "core/alloc_stats.h"
+#include "core/realtime.h"
+#include "core/trace.h"
+#include <atomic>
 #include <iostream>
 #include <memory>
+#include <algorithm>
 
 // NngSinkPublisher implementation
 NngSinkPublisher::NngSinkPublisher() : enabled_(false) {
@@ -55,9 +61,9 @@ void NngSinkPublisher::updateConfig(const SinkConfig& config) {
     }
 }
 
-void NngSinkPublisher::publishClusters(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items) {
+void NngSinkPublisher::publishClusters(uint64_t t_ns, uint32_t seq, uint64_t params_version, const std::vector<Cluster>& items) {
     if (enabled_ && bus_) {
-        bus_->publishClusters(t_ns, seq, items);
+        bus_->publishClusters(t_ns, seq, params_version, items);
     }
 }
 
@@ -128,7 +134,8 @@ void OscSinkPublisher::updateConfig(const SinkConfig& config) {
     }
 }
 
-void OscSinkPublisher::publishClusters(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items) {
+void OscSinkPublisher::publishClusters(uint64_t t_ns, uint32_t seq, uint64_t /*params_version*/, const std::vector<Cluster>& items) {
+    // OSC の型タグは固定（既存レシーバ互換のため params_version は送らない）
     if (enabled_ && osc_) {
         osc_->publishClusters(t_ns, seq, items);
     }
@@ -151,6 +158,328 @@ bool OscSinkPublisher::isEnabled() const {
     return enabled_;
 }
 
+Json::Value OscSinkPublisher::getStats() const {
+    Json::Value out(Json::objectValue);
+    if (!osc_) return out;
+
+    const OscPublisherStats st = osc_->getStats();
+    out["frames"] = static_cast<Json::UInt64>(st.frames);
+    out["messages"] = static_cast<Json::UInt64>(st.messages);
+    out["datagrams"] = static_cast<Json::UInt64>(st.datagrams);
+    out["syscalls"] = static_cast<Json::UInt64>(st.syscalls);
+    out["bytes"] = static_cast<Json::UInt64>(st.bytes);
+    out["send_errors"] = static_cast<Json::UInt64>(st.send_errors);
+    out["last_encode_us"] = st.last_encode_us;
+    out["last_send_us"] = st.last_send_us;
+    out["avg_encode_us"] = st.frames ? st.total_encode_us / st.frames : 0.0;
+    out["avg_send_us"] = st.frames ? st.total_send_us / st.frames : 0.0;
+    out["datagrams_per_syscall"] = st.syscalls ? double(st.datagrams) / double(st.syscalls) : 0.0;
+    return out;
+}
+
+// ShmSinkPublisher implementation
+ShmSinkPublisher::ShmSinkPublisher() : enabled_(false) {
+    ring_ = std::make_unique<shm::ShmRingWriter>();
+}
+
+ShmSinkPublisher::~ShmSinkPublisher() {
+    stop();
+}
+
+bool ShmSinkPublisher::start(const SinkConfig& config) {
+    if (!config.isShm()) {
+        enabled_ = false;
+        return false;
+    }
+
+    rate_limit_ = config.rate_limit;
+    url_ = config.shm().url;
+    geometry_ = config.shm();
+    send_clusters_ = config.send_clusters;
+    send_raw_ = config.send_raw;
+
+    enabled_ = ring_->open(shm::shmObjectName(url_), geometry_.slots,
+                           geometry_.max_clusters, geometry_.max_points, geometry_.force);
+    scratch_.reserve(geometry_.max_clusters);
+
+    if (enabled_) {
+        std::cout << "[ShmSinkPublisher] Started on " << url_
+                  << " (slots: " << geometry_.slots
+                  << ", max_clusters: " << geometry_.max_clusters
+                  << ", max_points: " << geometry_.max_points
+                  << ", rate_limit: " << config.rate_limit << "Hz)" << std::endl;
+    } else {
+        std::cerr << "[ShmSinkPublisher] Failed to start on " << url_ << std::endl;
+    }
+
+    return enabled_;
+}
+
+void ShmSinkPublisher::updateConfig(const SinkConfig& config) {
+    if (!config.isShm()) return;
+
+    rate_limit_ = config.rate_limit;
+    send_clusters_ = config.send_clusters;
+    send_raw_ = config.send_raw;
+
+    // 名前・容量が変わった場合のみセグメントを作り直す
+    const auto& next = config.shm();
+    if (next.url != url_ || next.slots != geometry_.slots ||
+        next.max_clusters != geometry_.max_clusters || next.max_points != geometry_.max_points) {
+        stop();
+        start(config);
+        std::cout << "[ShmSinkPublisher] Recreated segment " << url_ << std::endl;
+    }
+}
+
+void ShmSinkPublisher::publishClusters(uint64_t t_ns, uint32_t seq, uint64_t params_version, const std::vector<Cluster>& items) {
+    if (!enabled_ || !send_clusters_ || !ring_) return;
+
+    const size_t n = std::min<size_t>(items.size(), geometry_.max_clusters);
+    scratch_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        const auto& c = items[i];
+        auto& o = scratch_[i];
+        o.id = c.id;
+        o.point_count = c.point_count;
+        o.sensor_mask = c.sensor_mask;
+        o.cx = c.cx; o.cy = c.cy;
+        o.minx = c.minx; o.miny = c.miny;
+        o.maxx = c.maxx; o.maxy = c.maxy;
+    }
+    ring_->writeClusters(t_ns, seq, params_version, scratch_.data(), n,
+                         items.size() > n ? shm::kFlagTruncated : 0u);
+}
+
+void ShmSinkPublisher::publishRaw(uint64_t t_ns, uint32_t seq, const std::vector<float>& xy, const std::vector<uint8_t>& sid) {
+    if (!enabled_ || !send_raw_ || !ring_) return;
+
+    const size_t n = std::min(xy.size() / 2, sid.size());
+    ring_->writeRaw(t_ns, seq, xy.data(), sid.data(), n);
+}
+
+void ShmSinkPublisher::stop() {
+    if (ring_) {
+        ring_->close();
+    }
+    enabled_ = false;
+}
+
+bool ShmSinkPublisher::isEnabled() const {
+    return enabled_;
+}
+
+Json::Value ShmSinkPublisher::getStats() const {
+    Json::Value out(Json::objectValue);
+    if (!ring_) return out;
+    out["cluster_frames"] = static_cast<Json::UInt64>(ring_->clusterFrames());
+    out["raw_frames"] = static_cast<Json::UInt64>(ring_->rawFrames());
+    out["truncated_frames"] = static_cast<Json::UInt64>(ring_->truncatedFrames());
+    out["segment"] = shm::shmObjectName(url_);
+    return out;
+}
+
+// SinkWorker implementation
+SinkWorker::SinkWorker(std::unique_ptr<ISinkPublisher> publisher, const SinkConfig& config)
+    : publisher_(std::move(publisher)),
+      queue_depth_(static_cast<size_t>(std::max(1, config.queue_depth))) {
+    cacheConfig(config);
+}
+
+SinkWorker::~SinkWorker() {
+    stop();
+}
+
+void SinkWorker::cacheConfig(const SinkConfig& config) {
+    send_raw_.store(config.send_raw, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lk(queue_mutex_);
+        queue_depth_ = static_cast<size_t>(std::max(1, config.queue_depth));
+        while (queue_.size() > queue_depth_) {
+            queue_.pop_front();
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool SinkWorker::start(const SinkConfig& config) {
+    bool ok = false;
+    {
+        std::lock_guard<std::mutex> lk(publisher_mutex_);
+        ok = publisher_ && publisher_->start(config);
+        rate_limit_.store(publisher_ ? publisher_->getRateLimit() : 0, std::memory_order_relaxed);
+    }
+    enabled_.store(ok, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lk(queue_mutex_);
+        stop_ = false;
+    }
+    if (!thread_.joinable()) {
+        thread_ = std::thread([this] { run(); });
+    }
+    return ok;
+}
+
+bool SinkWorker::update(const SinkConfig& config) {
+    cacheConfig(config);
+
+    // 送信中のフレームが終わるまで待ってから差し替える
+    std::lock_guard<std::mutex> lk(publisher_mutex_);
+    if (!publisher_) return false;
+
+    // タイプが変わった場合は再作成が必要
+    bool type_changed = (config.isNng() && publisher_->getType() != "nng") ||
+                        (config.isOsc() && publisher_->getType() != "osc") ||
+                        (config.isShm() && publisher_->getType() != "shm");
+
+    bool ok;
+    if (type_changed) {
+        publisher_->stop();
+        if (config.isNng()) {
+            publisher_ = std::make_unique<NngSinkPublisher>();
+        } else if (config.isShm()) {
+            publisher_ = std::make_unique<ShmSinkPublisher>();
+        } else {
+            publisher_ = std::make_unique<OscSinkPublisher>();
+        }
+        ok = publisher_->start(config);
+    } else {
+        publisher_->updateConfig(config);
+        ok = publisher_->isEnabled();
+    }
+
+    rate_limit_.store(publisher_->getRateLimit(), std::memory_order_relaxed);
+    enabled_.store(ok, std::memory_order_relaxed);
+    return ok;
+}
+
+void SinkWorker::stop() {
+    {
+        std::lock_guard<std::mutex> lk(queue_mutex_);
+        stop_ = true;
+        queue_.clear();
+    }
+    queue_cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    std::lock_guard<std::mutex> lk(publisher_mutex_);
+    if (publisher_) {
+        publisher_->stop();
+    }
+    enabled_.store(false, std::memory_order_relaxed);
+}
+
+bool SinkWorker::admit() {
+    if (!enabled_.load(std::memory_order_relaxed)) return false;
+
+    const int rate = rate_limit_.load(std::memory_order_relaxed);
+    if (rate <= 0) return true;
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_enqueue_).count();
+    auto min_interval = 1000 / rate;
+    if (elapsed >= min_interval) {
+        last_enqueue_ = now;
+        return true;
+    }
+    return false;
+}
+
+void SinkWorker::enqueue(std::shared_ptr<const FrameSnapshot> frame) {
+    {
+        std::lock_guard<std::mutex> lk(queue_mutex_);
+        if (stop_) return;
+        // latest-wins: 溢れたら最も古いフレームを捨てる
+        while (queue_.size() >= queue_depth_) {
+            queue_.pop_front();
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+        queue_.push_back(std::move(frame));
+    }
+    enqueued_.fetch_add(1, std::memory_order_relaxed);
+    queue_cv_.notify_one();
+}
+
+void SinkWorker::run() {
+    // REST から追加された sink は Crow スレッド（io のピン留め）から生成されるので、既定に戻す
+    realtime::applyThreadProfile(realtime::ThreadRole::Background);
+    alloc_stats::setStage(alloc_stats::Stage::Sinks);
+    trace::setThreadName("sink");
+    for (;;) {
+        std::shared_ptr<const FrameSnapshot> frame;
+        {
+            std::unique_lock<std::mutex> lk(queue_mutex_);
+            queue_cv_.wait(lk, [this] { return stop_ || !queue_.empty(); });
+            if (stop_) break;
+            frame = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        std::lock_guard<std::mutex> lk(publisher_mutex_);
+        if (!publisher_ || !publisher_->isEnabled()) continue;
+
+        trace::Scope span("sink.send", trace::enabled() ? publisher_->getUrl() : std::string());
+        const auto t0 = std::chrono::steady_clock::now();
+        try {
+            publisher_->publishClusters(frame->t_ns, frame->seq, frame->params_version, frame->clusters);
+            if (frame->has_raw) publisher_->publishRaw(frame->t_ns, frame->seq, frame->xy, frame->sid);
+            sent_.fetch_add(1, std::memory_order_relaxed);
+        } catch (const std::exception& e) {
+            errors_.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "[SinkWorker] Error publishing to "
+                      << publisher_->getType() << " sink "
+                      << publisher_->getUrl() << ": " << e.what() << std::endl;
+        }
+        const uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - t0).count());
+        last_send_ns_.store(ns, std::memory_order_relaxed);
+        total_send_ns_.fetch_add(ns, std::memory_order_relaxed);
+        if (ns > max_send_ns_.load(std::memory_order_relaxed)) {
+            max_send_ns_.store(ns, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::string SinkWorker::getType() const {
+    std::lock_guard<std::mutex> lk(publisher_mutex_);
+    return publisher_ ? publisher_->getType() : "";
+}
+
+std::string SinkWorker::getUrl() const {
+    std::lock_guard<std::mutex> lk(publisher_mutex_);
+    return publisher_ ? publisher_->getUrl() : "";
+}
+
+Json::Value SinkWorker::getStats() const {
+    Json::Value out;
+    {
+        std::lock_guard<std::mutex> lk(publisher_mutex_);
+        out["type"] = publisher_ ? publisher_->getType() : "";
+        out["url"] = publisher_ ? publisher_->getUrl() : "";
+        out["stats"] = publisher_ ? publisher_->getStats() : Json::Value(Json::objectValue);
+    }
+    out["enabled"] = isEnabled();
+
+    Json::Value q;
+    {
+        std::lock_guard<std::mutex> lk(queue_mutex_);
+        q["depth"] = static_cast<Json::UInt64>(queue_.size());
+        q["capacity"] = static_cast<Json::UInt64>(queue_depth_);
+    }
+    const uint64_t sent = sent_.load(std::memory_order_relaxed);
+    q["enqueued"] = static_cast<Json::UInt64>(enqueued_.load(std::memory_order_relaxed));
+    q["dropped"] = static_cast<Json::UInt64>(dropped_.load(std::memory_order_relaxed));
+    q["sent"] = static_cast<Json::UInt64>(sent);
+    q["errors"] = static_cast<Json::UInt64>(errors_.load(std::memory_order_relaxed));
+    q["last_send_us"] = last_send_ns_.load(std::memory_order_relaxed) / 1000.0;
+    q["max_send_us"] = max_send_ns_.load(std::memory_order_relaxed) / 1000.0;
+    q["avg_send_us"] = sent ? (total_send_ns_.load(std::memory_order_relaxed) / 1000.0) / sent : 0.0;
+    out["queue"] = q;
+    return out;
+}
+
 // PublisherManager implementation
 PublisherManager::PublisherManager() {
     publishers_ = std::make_shared<PublisherArray>();
@@ -160,19 +489,29 @@ PublisherManager::~PublisherManager() {
     stopAll();
 }
 
+std::unique_ptr<ISinkPublisher> PublisherManager::createPublisher(const SinkConfig& config) {
+    if (config.isNng()) return std::make_unique<NngSinkPublisher>();
+    if (config.isOsc()) return std::make_unique<OscSinkPublisher>();
+    if (config.isShm()) return std::make_unique<ShmSinkPublisher>();
+    return nullptr;
+}
+
 bool PublisherManager::configure(const std::vector<SinkConfig>& sinks) {
     std::cout << "[PublisherManager] Configuring " << sinks.size() << " sink(s)..." << std::endl;
 
     // 古いpublisherを先に停止してソケット/ポートを解放する。
     // 新しいpublisherを起動する前に解放しないと、同一ポート(NNG等)への
     // 二重bindになり、Windowsでは "Address in use" → アクセス違反でクラッシュする。
+    // (worker スレッドもここで join される)
+    std::shared_ptr<PublisherArray> old_publishers;
     {
         std::lock_guard<std::mutex> lock(publishers_mutex_);
-        if (publishers_) {
-            for (auto& pub : *publishers_) {
-                if (pub) {
-                    pub->stop();
-                }
+        old_publishers = publishers_;
+    }
+    if (old_publishers) {
+        for (auto& worker : *old_publishers) {
+            if (worker) {
+                worker->stop();
             }
         }
     }
@@ -186,25 +525,21 @@ bool PublisherManager::configure(const std::vector<SinkConfig>& sinks) {
 
     // Create and start publishers for each sink
     for (const auto& sink : sinks) {
-        std::unique_ptr<ISinkPublisher> publisher;
-
-        if (sink.isNng()) {
-            publisher = std::make_unique<NngSinkPublisher>();
-        } else if (sink.isOsc()) {
-            publisher = std::make_unique<OscSinkPublisher>();
-        } else {
+        std::unique_ptr<ISinkPublisher> publisher = createPublisher(sink);
+        if (!publisher) {
             std::cerr << "[PublisherManager] Unknown sink type in configuration" << std::endl;
             failure_count++;
             continue;
         }
 
-        if (publisher->start(sink)) {
+        auto worker = std::make_unique<SinkWorker>(std::move(publisher), sink);
+        if (worker->start(sink)) {
             success_count++;
         } else {
             failure_count++;
         }
 
-        new_publishers->push_back(std::move(publisher));
+        new_publishers->push_back(std::move(worker));
     }
 
     // 旧publisherは上で既に停止済み。新しいものへスワップする
@@ -223,71 +558,98 @@ bool PublisherManager::configure(const std::vector<SinkConfig>& sinks) {
 }
 
 bool PublisherManager::updateSink(size_t index, const SinkConfig& config) {
-    std::lock_guard<std::mutex> lock(publishers_mutex_);
-    if (!publishers_ || index >= publishers_->size()) {
+    std::shared_ptr<PublisherArray> current_publishers;
+    {
+        std::lock_guard<std::mutex> lock(publishers_mutex_);
+        current_publishers = publishers_;
+    }
+    if (!current_publishers || index >= current_publishers->size()) {
         std::cerr << "[PublisherManager] updateSink: invalid index " << index << std::endl;
         return false;
     }
 
-    auto& publisher = (*publishers_)[index];
-    if (!publisher) return false;
+    auto& worker = (*current_publishers)[index];
+    if (!worker) return false;
 
-    // タイプが変わった場合は再作成が必要
-    bool type_changed = (config.isNng() && publisher->getType() != "nng") ||
-                        (config.isOsc() && publisher->getType() != "osc");
+    return worker->update(config);
+}
 
-    if (type_changed) {
-        publisher->stop();
-        if (config.isNng()) {
-            publisher = std::make_unique<NngSinkPublisher>();
-        } else {
-            publisher = std::make_unique<OscSinkPublisher>();
+std::shared_ptr<FrameSnapshot> PublisherManager::acquireSnapshot() const {
+    // 同時に保持され得るのは各 worker のキュー分だけなので、プールは小さく抑える
+    constexpr size_t kMaxPooled = 16;
+    for (auto& snap : snapshot_pool_) {
+        if (snap.use_count() == 1) {
+            // Pairs with the release in the workers' last shared_ptr drop
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return snap;
         }
-        return publisher->start(config);
     }
-
-    publisher->updateConfig(config);
-    return publisher->isEnabled();
+    auto snap = std::make_shared<FrameSnapshot>();
+    if (snapshot_pool_.size() < kMaxPooled) snapshot_pool_.push_back(snap);
+    return snap;
 }
 
-void PublisherManager::publish(uint64_t t_ns, uint32_t seq,
+void PublisherManager::publish(uint64_t t_ns, uint32_t seq, uint64_t params_version,
                                const std::vector<Cluster>& clusters,
-                               const std::vector<float>& xy, const std::vector<uint8_t>& sid) const {
+                               const std::vector<float>& xy, const std::vector<uint8_t>& sid,
+                               bool include_raw) const {
     std::shared_ptr<PublisherArray> current_publishers;
     {
         std::lock_guard<std::mutex> lock(publishers_mutex_);
         current_publishers = publishers_;
     }
 
-    if (!current_publishers) return;
+    if (!current_publishers || current_publishers->empty()) return;
 
-    for (auto& publisher : *current_publishers) {
-        if (!publisher || !publisher->isEnabled()) continue;
-        if (!publisher->shouldPublish()) continue;
+    // rate limit を通過した worker だけに配る（スナップショットは1回だけ作る）
+    auto& admitted = admitted_;
+    admitted.clear();
+    bool wants_raw = false;
+    for (auto& worker : *current_publishers) {
+        if (!worker || !worker->admit()) continue;
+        admitted.push_back(worker.get());
+        wants_raw = wants_raw || worker->wantsRaw();
+    }
+    if (admitted.empty()) return;
+
+    auto frame = acquireSnapshot();
+    frame->t_ns = t_ns;
+    frame->seq = seq;
+    frame->params_version = params_version;
+    frame->clusters.assign(clusters.begin(), clusters.end());
+    frame->has_raw = include_raw;
+    alloc_stats::noteCopy(clusters.size() * sizeof(Cluster));
+    if (wants_raw && include_raw) {
+        frame->xy.assign(xy.begin(), xy.end());
+        frame->sid.assign(sid.begin(), sid.end());
+        alloc_stats::noteCopy(xy.size() * sizeof(float) + sid.size());
+    } else {
+        frame->xy.clear();
+        frame->sid.clear();
+    }
+    std::shared_ptr<const FrameSnapshot> shared = std::move(frame);
 
-        try {
-            publisher->publishClusters(t_ns, seq, clusters);
-            publisher->publishRaw(t_ns, seq, xy, sid);
-        } catch (const std::exception& e) {
-            std::cerr << "[PublisherManager] Error publishing to "
-                      << publisher->getType() << " sink "
-                      << publisher->getUrl() << ": " << e.what() << std::endl;
-        }
+    for (auto* worker : admitted) {
+        worker->enqueue(shared);
     }
 }
 
 void PublisherManager::stopAll() {
-    std::lock_guard<std::mutex> lock(publishers_mutex_);
-    if (publishers_) {
-        for (auto& publisher : *publishers_) {
-            if (publisher) {
-                publisher->stop();
+    std::shared_ptr<PublisherArray> old_publishers;
+    {
+        std::lock_guard<std::mutex> lock(publishers_mutex_);
+        old_publishers = publishers_;
+        // Replace with empty array
+        publishers_ = std::make_shared<PublisherArray>();
+    }
+    if (old_publishers) {
+        for (auto& worker : *old_publishers) {
+            if (worker) {
+                worker->stop();
             }
         }
     }
 
-    // Replace with empty array
-    publishers_ = std::make_shared<PublisherArray>();
     std::cout << "[PublisherManager] All publishers stopped" << std::endl;
 }
 
@@ -308,10 +670,27 @@ size_t PublisherManager::getEnabledPublisherCount() const {
     }
 
     size_t enabled_count = 0;
-    for (const auto& publisher : *current_publishers) {
-        if (publisher && publisher->isEnabled()) {
+    for (const auto& worker : *current_publishers) {
+        if (worker && worker->isEnabled()) {
             enabled_count++;
         }
     }
     return enabled_count;
 }
+
+Json::Value PublisherManager::getStatsAsJson() const {
+    std::shared_ptr<PublisherArray> current_publishers;
+    {
+        std::lock_guard<std::mutex> lock(publishers_mutex_);
+        current_publishers = publishers_;
+    }
+
+    Json::Value out(Json::arrayValue);
+    if (!current_publishers) return out;
+
+    for (const auto& worker : *current_publishers) {
+        if (!worker) continue;
+        out.append(worker->getStats());
+    }
+    return out;
+}
@@ -4,6 +4,11 @@
 #include <memory>
 #include <mutex>
 #include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <json/json.h>
 #include "detect/dbscan.h"
 #include "config/config.h"
 
@@ -11,35 +16,28 @@
 class ISinkPublisher {
 protected:
     int rate_limit_{0};
-    std::chrono::steady_clock::time_point last_publish_;
 
 public:
     virtual ~ISinkPublisher() = default;
     virtual bool start(const SinkConfig& config) = 0;
     virtual void updateConfig(const SinkConfig& config) = 0;
-    virtual void publishClusters(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items) = 0;
+    // params_version: DetectionParams snapshot the clusters were computed with
+    virtual void publishClusters(uint64_t t_ns, uint32_t seq, uint64_t params_version, const std::vector<Cluster>& items) = 0;
     virtual void publishRaw(uint64_t t_ns, uint32_t seq, const std::vector<float>& xy, const std::vector<uint8_t>& sid) = 0;
     virtual void stop() = 0;
     virtual bool isEnabled() const = 0;
     virtual std::string getType() const = 0;
     virtual std::string getUrl() const = 0;
+    // Transport counters for /api/v1/metrics (empty object when the sink has none)
+    virtual Json::Value getStats() const { return Json::Value(Json::objectValue); }
 
-    bool shouldPublish() {
-        if (rate_limit_ <= 0) return true;
-        auto now = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_publish_).count();
-        auto min_interval = 1000 / rate_limit_;
-        if (elapsed >= min_interval) {
-            last_publish_ = now;
-            return true;
-        }
-        return false;
-    }
+    int getRateLimit() const { return rate_limit_; }
 };
 
 // Forward declarations
 class NngBus;
 class OscPublisher;
+namespace shm { class ShmRingWriter; struct ShmCluster; }
 
 // NNG sink publisher implementation
 class NngSinkPublisher : public ISinkPublisher {
@@ -54,7 +52,7 @@ public:
 
     bool start(const SinkConfig& config) override;
     void updateConfig(const SinkConfig& config) override;
-    void publishClusters(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items) override;
+    void publishClusters(uint64_t t_ns, uint32_t seq, uint64_t params_version, const std::vector<Cluster>& items) override;
     void publishRaw(uint64_t t_ns, uint32_t seq, const std::vector<float>& xy, const std::vector<uint8_t>& sid) override;
     void stop() override;
     bool isEnabled() const override;
@@ -75,21 +73,118 @@ public:
 
     bool start(const SinkConfig& config) override;
     void updateConfig(const SinkConfig& config) override;
-    void publishClusters(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items) override;
+    void publishClusters(uint64_t t_ns, uint32_t seq, uint64_t params_version, const std::vector<Cluster>& items) override;
     void publishRaw(uint64_t t_ns, uint32_t seq, const std::vector<float>& xy, const std::vector<uint8_t>& sid) override;
     void stop() override;
     bool isEnabled() const override;
     std::string getType() const override { return "osc"; }
     std::string getUrl() const override { return url_; }
+    Json::Value getStats() const override;
+};
+
+// Shared-memory ring sink (same-host consumers, see io/shm_ring.h)
+class ShmSinkPublisher : public ISinkPublisher {
+private:
+    std::unique_ptr<shm::ShmRingWriter> ring_;
+    std::vector<shm::ShmCluster> scratch_;   // Cluster -> ShmCluster 変換用（容量は再利用）
+    std::string url_;
+    ShmConfig geometry_;
+    bool send_clusters_{true};
+    bool send_raw_{false};
+    bool enabled_;
+
+public:
+    ShmSinkPublisher();
+    ~ShmSinkPublisher() override;
+
+    bool start(const SinkConfig& config) override;
+    void updateConfig(const SinkConfig& config) override;
+    void publishClusters(uint64_t t_ns, uint32_t seq, uint64_t params_version, const std::vector<Cluster>& items) override;
+    void publishRaw(uint64_t t_ns, uint32_t seq, const std::vector<float>& xy, const std::vector<uint8_t>& sid) override;
+    void stop() override;
+    bool isEnabled() const override;
+    std::string getType() const override { return "shm"; }
+    std::string getUrl() const override { return url_; }
+    Json::Value getStats() const override;
+};
+
+// Immutable frame shared by every sink worker (built once per published frame)
+struct FrameSnapshot {
+    uint64_t t_ns{0};
+    uint32_t seq{0};
+    uint64_t params_version{0};
+    std::vector<Cluster> clusters;
+    std::vector<float> xy;       // empty when no admitted sink sends raw
+    std::vector<uint8_t> sid;
+    bool has_raw{false};         // false: raw withheld this frame (sinks send clusters only)
+};
+
+// Per-sink worker: owns one publisher and drains a bounded latest-wins queue
+// on its own thread, so encode/send never runs on the detection thread.
+class SinkWorker {
+private:
+    std::unique_ptr<ISinkPublisher> publisher_;
+    mutable std::mutex publisher_mutex_;  // publish と updateSink の排他
+
+    mutable std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    std::deque<std::shared_ptr<const FrameSnapshot>> queue_;
+    size_t queue_depth_;
+    bool stop_{false};
+    std::thread thread_;
+
+    // Detection thread only (rate limit at enqueue)
+    std::atomic<int> rate_limit_{0};
+    std::atomic<bool> send_raw_{false};
+    std::atomic<bool> enabled_{false};
+    std::chrono::steady_clock::time_point last_enqueue_{};
+
+    // Metrics
+    std::atomic<uint64_t> enqueued_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> sent_{0};
+    std::atomic<uint64_t> errors_{0};
+    std::atomic<uint64_t> total_send_ns_{0};
+    std::atomic<uint64_t> last_send_ns_{0};
+    std::atomic<uint64_t> max_send_ns_{0};
+
+    void run();
+    void cacheConfig(const SinkConfig& config);
+
+public:
+    SinkWorker(std::unique_ptr<ISinkPublisher> publisher, const SinkConfig& config);
+    ~SinkWorker();
+
+    bool start(const SinkConfig& config);
+    bool update(const SinkConfig& config);
+    void stop();
+
+    // Detection thread: rate-limit check (no locks besides the short queue lock)
+    bool admit();
+    bool wantsRaw() const { return send_raw_.load(std::memory_order_relaxed); }
+    void enqueue(std::shared_ptr<const FrameSnapshot> frame);
+
+    bool isEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+    std::string getType() const;
+    std::string getUrl() const;
+    Json::Value getStats() const;
 };
 
 // Publisher manager for handling multiple sinks
 class PublisherManager {
 private:
-    using PublisherArray = std::vector<std::unique_ptr<ISinkPublisher>>;
+    using PublisherArray = std::vector<std::unique_ptr<SinkWorker>>;
     mutable std::mutex publishers_mutex_;
     std::shared_ptr<PublisherArray> publishers_;
 
+    // Detection thread only: snapshots are recycled once no worker holds them,
+    // so their buffers keep their capacity across frames
+    mutable std::vector<std::shared_ptr<FrameSnapshot>> snapshot_pool_;
+    mutable std::vector<SinkWorker*> admitted_;
+    std::shared_ptr<FrameSnapshot> acquireSnapshot() const;
+
+    static std::unique_ptr<ISinkPublisher> createPublisher(const SinkConfig& config);
+
 public:
     PublisherManager();
     ~PublisherManager();
@@ -100,10 +195,13 @@ public:
     // Update a single sink in-place without destroying other publishers
     bool updateSink(size_t index, const SinkConfig& config);
 
-    // Publish clusters and raw in a single pass (rate limit checked once per sink)
-    void publish(uint64_t t_ns, uint32_t seq,
+    // Hand a frame to every sink worker (rate limit checked once per sink).
+    // Clusters are copied into a pooled shared snapshot; raw points are
+    // copied only when an admitted sink sends raw and `include_raw` is set.
+    void publish(uint64_t t_ns, uint32_t seq, uint64_t params_version,
                  const std::vector<Cluster>& clusters,
-                 const std::vector<float>& xy, const std::vector<uint8_t>& sid) const;
+                 const std::vector<float>& xy, const std::vector<uint8_t>& sid,
+                 bool include_raw = true) const;
 
     // Stop all publishers
     void stopAll();
@@ -111,4 +209,7 @@ public:
     // Get current publisher count for logging/monitoring
     size_t getPublisherCount() const;
     size_t getEnabledPublisherCount() const;
+
+    // Per-sink transport metrics: [{type, url, enabled, queue, stats}]
+    Json::Value getStatsAsJson() const;
 };
@@ -6,6 +6,10 @@
 
 #include "rest_handlers.h"
 #include <json/json.h>
+#include "core/realtime.h"
+#include "core/alloc_stats.h"
+#include "core/trace.h"
+#include "core/shadow_pipeline.h"
 #include <fstream>
 #include <iostream>
 #include <filesystem>
@@ -67,6 +71,23 @@ void RestApi::registerRoutes(crow::SimpleApp& app) {
     return putDbscan(req);
   });
   
+  // Shadow pipeline endpoints
+  CROW_ROUTE(app, "/api/v1/shadow").methods("GET"_method)([this]() {
+    return getShadow();
+  });
+  
+  CROW_ROUTE(app, "/api/v1/shadow").methods("PUT"_method)([this](const crow::request& req) {
+    return putShadow(req);
+  });
+  
+  CROW_ROUTE(app, "/api/v1/shadow").methods("DELETE"_method)([this](const crow::request& req) {
+    return deleteShadow(req);
+  });
+  
+  CROW_ROUTE(app, "/api/v1/shadow/promote").methods("POST"_method)([this](const crow::request& req) {
+    return postShadowPromote(req);
+  });
+  
   // Sinks endpoints
   CROW_ROUTE(app, "/api/v1/sinks").methods("GET"_method)([this]() {
     return getSinks();
@@ -117,6 +138,16 @@ void RestApi::registerRoutes(crow::SimpleApp& app) {
   CROW_ROUTE(app, "/api/v1/health").methods("GET"_method)([this]() {
     return getHealth();
   });
+
+  // Metrics endpoint
+  CROW_ROUTE(app, "/api/v1/metrics").methods("GET"_method)([this]() {
+    return getMetrics();
+  });
+
+  // Pipeline trace capture (blocks until the requested frames were traced)
+  CROW_ROUTE(app, "/api/v1/debug/trace").methods("POST"_method)([this](const crow::request& req) {
+    return postDebugTrace(req);
+  });
 }
 
 bool RestApi::authorize(const crow::request& req) const {
@@ -269,10 +300,10 @@ crow::response RestApi::postSensor(const crow::request& req) {
     }
     
     std::string type = sensorData["type"].asString();
-    if (type != "hokuyo_urg_eth" && type != "unknown") {
+    if (type != "hokuyo_urg_eth" && type != "hokuyo_urg_eth_epoll" && type != "unknown") {
       Json::Value error;
       error["error"] = "invalid_type";
-      error["message"] = "Sensor type must be 'hokuyo_urg_eth' or 'unknown'";
+      error["message"] = "Sensor type must be 'hokuyo_urg_eth', 'hokuyo_urg_eth_epoll' or 'unknown'";
       crow::response resp(400, error.toStyledString());
       resp.add_header("Content-Type", "application/json");
       return resp;
@@ -575,16 +606,97 @@ crow::response RestApi::putPostfilter(const crow::request& req) {
   }
 }
 
+Json::Value RestApi::dbscanToJson(const DbscanConfig& cfg) {
+  Json::Value result;
+  result["eps_norm"] = cfg.eps_norm;
+  result["minPts"] = cfg.minPts;
+  result["k_scale"] = cfg.k_scale;
+  result["h_min"] = cfg.h_min;
+  result["h_max"] = cfg.h_max;
+  result["R_max"] = cfg.R_max;
+  result["M_max"] = cfg.M_max;
+  return result;
+}
+
+std::string RestApi::applyDbscanJson(const Json::Value& in, DbscanConfig& cfg, bool& updated) {
+  updated = false;
+  // Validate and update eps_norm
+  if (in.isMember("eps_norm")) {
+    float eps_norm = in["eps_norm"].asFloat();
+    if (eps_norm < 0.1f || eps_norm > 10.0f) {
+      return "eps_norm must be between 0.1 and 10.0";
+    }
+    cfg.eps_norm = eps_norm;
+    updated = true;
+  }
+
+  // Validate and update minPts
+  if (in.isMember("minPts")) {
+    int minPts = in["minPts"].asInt();
+    if (minPts < 1 || minPts > 100) {
+      return "minPts must be between 1 and 100";
+    }
+    cfg.minPts = minPts;
+    updated = true;
+  }
+
+  // Validate and update k_scale
+  if (in.isMember("k_scale")) {
+    float k_scale = in["k_scale"].asFloat();
+    if (k_scale < 0.1f || k_scale > 10.0f) {
+      return "k_scale must be between 0.1 and 10.0";
+    }
+    cfg.k_scale = k_scale;
+    updated = true;
+  }
+
+  // Validate and update h_min
+  if (in.isMember("h_min")) {
+    float h_min = in["h_min"].asFloat();
+    if (h_min < 0.001f || h_min > cfg.h_max) {
+      return "h_min must be between 0.001 and h_max";
+    }
+    cfg.h_min = h_min;
+    updated = true;
+  }
+
+  // Validate and update h_max
+  if (in.isMember("h_max")) {
+    float h_max = in["h_max"].asFloat();
+    if (h_max < cfg.h_min || h_max > 1.0f) {
+      return "h_max must be between h_min and 1.0";
+    }
+    cfg.h_max = h_max;
+    updated = true;
+  }
+
+  // Validate and update R_max
+  if (in.isMember("R_max")) {
+    int R_max = in["R_max"].asInt();
+    if (R_max < 1 || R_max > 50) {
+      return "R_max must be between 1 and 50";
+    }
+    cfg.R_max = R_max;
+    updated = true;
+  }
+
+  // Validate and update M_max
+  if (in.isMember("M_max")) {
+    int M_max = in["M_max"].asInt();
+    if (M_max < 10 || M_max > 5000) {
+      return "M_max must be between 10 and 5000";
+    }
+    cfg.M_max = M_max;
+    updated = true;
+  }
+
+  return {};
+}
+
 crow::response RestApi::getDbscan() {
   try {
-    Json::Value result;
-    result["eps_norm"] = config_.dbscan.eps_norm;
-    result["minPts"] = config_.dbscan.minPts;
-    result["k_scale"] = config_.dbscan.k_scale;
-    result["h_min"] = config_.dbscan.h_min;
-    result["h_max"] = config_.dbscan.h_max;
-    result["R_max"] = config_.dbscan.R_max;
-    result["M_max"] = config_.dbscan.M_max;
+    Json::Value result = dbscanToJson(config_.dbscan);
+    result["params_version"] = static_cast<Json::UInt64>(params_.version());
     
     crow::response resp(200, result.toStyledString());
     resp.add_header("Content-Type", "application/json");
@@ -619,132 +731,232 @@ crow::response RestApi::putDbscan(const crow::request& req) {
       return resp;
     }
     
+    // Validate on a copy: a rejected field leaves the live config untouched
+    DbscanConfig dbscan_cfg = config_.dbscan;
     bool updated = false;
-    
-    // Validate and update eps_norm
-    if (config.isMember("eps_norm")) {
-      float eps_norm = config["eps_norm"].asFloat();
-      if (eps_norm < 0.1f || eps_norm > 10.0f) {
-        Json::Value error;
-        error["error"] = "config_invalid";
-        error["message"] = "eps_norm must be between 0.1 and 10.0";
-        crow::response resp(400, error.toStyledString());
-        resp.add_header("Content-Type", "application/json");
-        return resp;
-      }
-      config_.dbscan.eps_norm = eps_norm;
-      updated = true;
+    const std::string invalid = applyDbscanJson(config, dbscan_cfg, updated);
+    if (!invalid.empty()) {
+      Json::Value error;
+      error["error"] = "config_invalid";
+      error["message"] = invalid;
+      crow::response resp(400, error.toStyledString());
+      resp.add_header("Content-Type", "application/json");
+      return resp;
     }
     
-    // Validate and update minPts
-    if (config.isMember("minPts")) {
-      int minPts = config["minPts"].asInt();
-      if (minPts < 1 || minPts > 100) {
-        Json::Value error;
-        error["error"] = "config_invalid";
-        error["message"] = "minPts must be between 1 and 100";
-        crow::response resp(400, error.toStyledString());
-        resp.add_header("Content-Type", "application/json");
-        return resp;
+    if (updated) {
+      config_.dbscan = dbscan_cfg;
+      params_.update([&](DetectionParams& p) { p.dbscan = dbscan_cfg; });
+      
+      if (ws_) {
+        ws_->broadcastSnapshot();
       }
-      config_.dbscan.minPts = minPts;
-      updated = true;
     }
     
-    // Validate and update k_scale
-    if (config.isMember("k_scale")) {
-      float k_scale = config["k_scale"].asFloat();
-      if (k_scale < 0.1f || k_scale > 10.0f) {
-        Json::Value error;
-        error["error"] = "config_invalid";
-        error["message"] = "k_scale must be between 0.1 and 10.0";
-        crow::response resp(400, error.toStyledString());
-        resp.add_header("Content-Type", "application/json");
-        return resp;
-      }
-      config_.dbscan.k_scale = k_scale;
-      updated = true;
+    Json::Value result = dbscanToJson(config_.dbscan);
+    result["params_version"] = static_cast<Json::UInt64>(params_.version());
+    
+    crow::response resp(200, result.toStyledString());
+    resp.add_header("Content-Type", "application/json");
+    return resp;
+  } catch (const std::exception& e) {
+    Json::Value error;
+    error["error"] = "internal_error";
+    error["message"] = e.what();
+    crow::response resp(500, error.toStyledString());
+    resp.add_header("Content-Type", "application/json");
+    return resp;
+  }
+}
+
+// Shadow pipeline endpoints
+namespace {
+  crow::response shadowUnavailable() {
+    Json::Value error;
+    error["error"] = "unavailable";
+    error["message"] = "Shadow pipeline is not available";
+    crow::response resp(503, error.toStyledString());
+    resp.add_header("Content-Type", "application/json");
+    return resp;
+  }
+
+  // scan_stage が有効な間、spike/outlier/intensity はセンサー取り込み時にライブの設定で適用済みで、
+  // shadow はそれを評価できない。候補がそこ（または scan_stage 自体）を変えていれば理由を返す
+  std::string scanStageUnevaluated(const PrefilterConfig& live, const PrefilterConfig& cand) {
+    if (cand.scan_stage != live.scan_stage) {
+      return "prefilter.scan_stage differs from the live setting and cannot be evaluated in the shadow pipeline";
+    }
+    if (!live.scan_stage) return {};
+    const auto& ls = live.spike_removal;
+    const auto& cs = cand.spike_removal;
+    const auto& lo = live.outlier_removal;
+    const auto& co = cand.outlier_removal;
+    const auto& li = live.intensity_filter;
+    const auto& ci = cand.intensity_filter;
+    if (ls.enabled != cs.enabled || ls.dr_threshold != cs.dr_threshold || ls.window_size != cs.window_size ||
+        lo.enabled != co.enabled || lo.median_window != co.median_window ||
+        lo.outlier_threshold != co.outlier_threshold || lo.use_robust_regression != co.use_robust_regression ||
+        li.enabled != ci.enabled || li.min_intensity != ci.min_intensity || li.min_reliability != ci.min_reliability) {
+      return "spike_removal / outlier_removal / intensity_filter run at scan stage (prefilter.scan_stage) "
+             "and are not evaluated by the shadow pipeline; change them directly or turn scan_stage off first";
+    }
+    return {};
+  }
+}
+
+crow::response RestApi::getShadow() {
+  if (!shadow_) {
+    return shadowUnavailable();
+  }
+  
+  try {
+    Json::Value result = shadow_->toJson();
+    if (auto cand = shadow_->candidate()) {
+      result["candidate"]["dbscan"] = dbscanToJson(cand->dbscan);
+      result["candidate"]["prefilter"] = filters_.prefilterConfigAsJson(cand->prefilter);
+      // ライブの scan_stage が後から変わると候補の一部が評価されていない（promote は拒否される）
+      const std::string unevaluated = scanStageUnevaluated(filters_.prefilterConfig(), cand->prefilter);
+      result["candidate"]["scan_stage_evaluated"] = unevaluated.empty();
+      if (!unevaluated.empty()) result["candidate"]["warning"] = unevaluated;
+    } else {
+      result["candidate"] = Json::nullValue;
     }
     
-    // Validate and update h_min
-    if (config.isMember("h_min")) {
-      float h_min = config["h_min"].asFloat();
-      if (h_min < 0.001f || h_min > config_.dbscan.h_max) {
-        Json::Value error;
-        error["error"] = "config_invalid";
-        error["message"] = "h_min must be between 0.001 and h_max";
-        crow::response resp(400, error.toStyledString());
-        resp.add_header("Content-Type", "application/json");
-        return resp;
-      }
-      config_.dbscan.h_min = h_min;
-      updated = true;
+    crow::response resp(200, result.toStyledString());
+    resp.add_header("Content-Type", "application/json");
+    return resp;
+  } catch (const std::exception& e) {
+    Json::Value error;
+    error["error"] = "internal_error";
+    error["message"] = e.what();
+    crow::response resp(500, error.toStyledString());
+    resp.add_header("Content-Type", "application/json");
+    return resp;
+  }
+}
+
+crow::response RestApi::putShadow(const crow::request& req) {
+  if (!authorize(req)) {
+    return sendUnauthorized();
+  }
+  if (!shadow_) {
+    return shadowUnavailable();
+  }
+  
+  try {
+    Json::CharReaderBuilder builder;
+    Json::Value config;
+    std::string errs;
+    std::istringstream stream(req.body);
+    
+    if (!Json::parseFromStream(builder, stream, &config, &errs) || !config.isObject()) {
+      Json::Value error;
+      error["error"] = "invalid_json";
+      error["message"] = "Invalid JSON in request body";
+      crow::response resp(400, error.toStyledString());
+      resp.add_header("Content-Type", "application/json");
+      return resp;
     }
     
-    // Validate and update h_max
-    if (config.isMember("h_max")) {
-      float h_max = config["h_max"].asFloat();
-      if (h_max < config_.dbscan.h_min || h_max > 1.0f) {
-        Json::Value error;
-        error["error"] = "config_invalid";
-        error["message"] = "h_max must be between h_min and 1.0";
-        crow::response resp(400, error.toStyledString());
-        resp.add_header("Content-Type", "application/json");
-        return resp;
-      }
-      config_.dbscan.h_max = h_max;
-      updated = true;
+    // The candidate starts from the live configuration: "dbscan" overrides single fields
+    // (same validation as PUT /api/v1/dbscan), "prefilter" replaces the whole prefilter
+    ShadowPipeline::Candidate cand;
+    cand.dbscan = config_.dbscan;
+    bool updated = false;
+    const std::string invalid = applyDbscanJson(config.get("dbscan", Json::objectValue), cand.dbscan, updated);
+    if (!invalid.empty()) {
+      Json::Value error;
+      error["error"] = "config_invalid";
+      error["message"] = invalid;
+      crow::response resp(400, error.toStyledString());
+      resp.add_header("Content-Type", "application/json");
+      return resp;
+    }
+    cand.prefilter = config.isMember("prefilter") ? filters_.parsePrefilterConfig(config["prefilter"])
+                                                  : filters_.prefilterConfig();
+    const std::string unevaluated = scanStageUnevaluated(filters_.prefilterConfig(), cand.prefilter);
+    if (!unevaluated.empty()) {
+      Json::Value error;
+      error["error"] = "config_invalid";
+      error["message"] = unevaluated;
+      crow::response resp(400, error.toStyledString());
+      resp.add_header("Content-Type", "application/json");
+      return resp;
     }
     
-    // Validate and update R_max
-    if (config.isMember("R_max")) {
-      int R_max = config["R_max"].asInt();
-      if (R_max < 1 || R_max > 50) {
-        Json::Value error;
-        error["error"] = "config_invalid";
-        error["message"] = "R_max must be between 1 and 50";
-        crow::response resp(400, error.toStyledString());
-        resp.add_header("Content-Type", "application/json");
-        return resp;
-      }
-      config_.dbscan.R_max = R_max;
-      updated = true;
+    shadow_->start(cand);
+    return getShadow();
+  } catch (const std::exception& e) {
+    Json::Value error;
+    error["error"] = "internal_error";
+    error["message"] = e.what();
+    crow::response resp(500, error.toStyledString());
+    resp.add_header("Content-Type", "application/json");
+    return resp;
+  }
+}
+
+crow::response RestApi::deleteShadow(const crow::request& req) {
+  if (!authorize(req)) {
+    return sendUnauthorized();
+  }
+  if (!shadow_) {
+    return shadowUnavailable();
+  }
+  
+  shadow_->stop();
+  return getShadow();
+}
+
+crow::response RestApi::postShadowPromote(const crow::request& req) {
+  if (!authorize(req)) {
+    return sendUnauthorized();
+  }
+  if (!shadow_) {
+    return shadowUnavailable();
+  }
+  
+  try {
+    const auto cand = shadow_->candidate();
+    if (!cand) {
+      Json::Value error;
+      error["error"] = "no_candidate";
+      error["message"] = "No shadow candidate is running";
+      crow::response resp(409, error.toStyledString());
+      resp.add_header("Content-Type", "application/json");
+      return resp;
+    }
+    const std::string unevaluated = scanStageUnevaluated(filters_.prefilterConfig(), cand->prefilter);
+    if (!unevaluated.empty()) {
+      Json::Value error;
+      error["error"] = "scan_stage_not_evaluated";
+      error["message"] = unevaluated;
+      crow::response resp(409, error.toStyledString());
+      resp.add_header("Content-Type", "application/json");
+      return resp;
     }
     
-    // Validate and update M_max
-    if (config.isMember("M_max")) {
-      int M_max = config["M_max"].asInt();
-      if (M_max < 10 || M_max > 5000) {
-        Json::Value error;
-        error["error"] = "config_invalid";
-        error["message"] = "M_max must be between 10 and 5000";
-        crow::response resp(400, error.toStyledString());
-        resp.add_header("Content-Type", "application/json");
-        return resp;
-      }
-      config_.dbscan.M_max = M_max;
-      updated = true;
+    // DBSCAN and prefilter switch in the same params version
+    if (!filters_.applyDetectionConfig(cand->prefilter, cand->dbscan)) {
+      Json::Value error;
+      error["error"] = "config_invalid";
+      error["message"] = "Failed to apply the shadow candidate";
+      crow::response resp(500, error.toStyledString());
+      resp.add_header("Content-Type", "application/json");
+      return resp;
     }
+    config_.dbscan = cand->dbscan;
+    shadow_->stop();
+    std::cout << "[RestApi] Shadow candidate promoted" << std::endl;
     
-    if (updated) {
-      dbscan_.setParams(config_.dbscan.eps_norm, config_.dbscan.minPts);
-      dbscan_.setAngularScale(config_.dbscan.k_scale);
-      dbscan_.setPerformanceParams(config_.dbscan.h_min, config_.dbscan.h_max,
-                                   config_.dbscan.R_max, config_.dbscan.M_max);
-      
-      if (ws_) {
-        ws_->broadcastSnapshot();
-      }
+    if (ws_) {
+      ws_->broadcastSnapshot();
     }
     
     Json::Value result;
-    result["eps_norm"] = config_.dbscan.eps_norm;
-    result["minPts"] = config_.dbscan.minPts;
-    result["k_scale"] = config_.dbscan.k_scale;
-    result["h_min"] = config_.dbscan.h_min;
-    result["h_max"] = config_.dbscan.h_max;
-    result["R_max"] = config_.dbscan.R_max;
-    result["M_max"] = config_.dbscan.M_max;
+    result["dbscan"] = dbscanToJson(config_.dbscan);
+    result["prefilter"] = filters_.getPrefilterConfigAsJson();
+    result["params_version"] = static_cast<Json::UInt64>(params_.version());
     
     crow::response resp(200, result.toStyledString());
     resp.add_header("Content-Type", "application/json");
@@ -772,6 +984,7 @@ crow::response RestApi::getSinks() {
       sinkJson["cluster_topic"] = sink.cluster_topic;
       sinkJson["raw_topic"] = sink.raw_topic;
       sinkJson["rate_limit"] = sink.rate_limit;
+      sinkJson["queue_depth"] = sink.queue_depth;
       sinkJson["send_clusters"] = sink.send_clusters;
       sinkJson["send_raw"] = sink.send_raw;
 
@@ -784,6 +997,13 @@ crow::response RestApi::getSinks() {
         sinkJson["type"] = "nng";
         sinkJson["url"] = sink.nng().url;
         sinkJson["encoding"] = sink.nng().encoding;
+      } else if (sink.isShm()) {
+        sinkJson["type"] = "shm";
+        sinkJson["url"] = sink.shm().url;
+        sinkJson["slots"] = sink.shm().slots;
+        sinkJson["max_clusters"] = sink.shm().max_clusters;
+        sinkJson["max_points"] = sink.shm().max_points;
+        sinkJson["force"] = sink.shm().force;
       }
       
       result.append(sinkJson);
@@ -844,10 +1064,10 @@ crow::response RestApi::postSink(const crow::request& req) {
     std::string type = sinkData["type"].asString();
     std::string url = sinkData["url"].asString();
     
-    if (type != "nng" && type != "osc") {
+    if (type != "nng" && type != "osc" && type != "shm") {
       Json::Value error;
       error["error"] = "invalid_type";
-      error["message"] = "Sink type must be 'nng' or 'osc'";
+      error["message"] = "Sink type must be 'nng', 'osc' or 'shm'";
       crow::response resp(400, error.toStyledString());
       resp.add_header("Content-Type", "application/json");
       return resp;
@@ -872,11 +1092,21 @@ crow::response RestApi::postSink(const crow::request& req) {
       return resp;
     }
     
+    if (type == "shm" && (url.find("shm://") != 0 || url.size() <= 6)) {
+      Json::Value error;
+      error["error"] = "invalid_url";
+      error["message"] = "SHM sink URL must be 'shm://<name>'";
+      crow::response resp(400, error.toStyledString());
+      resp.add_header("Content-Type", "application/json");
+      return resp;
+    }
+    
     // Create new sink configuration
     SinkConfig newSink;
     newSink.cluster_topic = sinkData.get("cluster_topic", "/hokuyohub/cluster").asString();
     newSink.raw_topic = sinkData.get("raw_topic", "/hokuyohub/raw").asString();
     newSink.rate_limit = sinkData.get("rate_limit", 0).asInt();
+    newSink.queue_depth = std::max(1, sinkData.get("queue_depth", newSink.queue_depth).asInt());
     newSink.send_clusters = sinkData.get("send_clusters", true).asBool();
     newSink.send_raw = sinkData.get("send_raw", false).asBool();
     
@@ -901,6 +1131,14 @@ crow::response RestApi::postSink(const crow::request& req) {
       }
       
       newSink.cfg = nng;
+    } else if (type == "shm") {
+      ShmConfig shm;
+      shm.url = url;
+      shm.slots = std::max(2u, sinkData.get("slots", shm.slots).asUInt());
+      shm.max_clusters = std::max(1u, sinkData.get("max_clusters", shm.max_clusters).asUInt());
+      shm.max_points = std::max(1u, sinkData.get("max_points", shm.max_points).asUInt());
+      shm.force = sinkData.get("force", shm.force).asBool();
+      newSink.cfg = shm;
     }
     
     // Add to configuration
@@ -922,6 +1160,7 @@ crow::response RestApi::postSink(const crow::request& req) {
     result["cluster_topic"] = newSink.cluster_topic;
     result["raw_topic"] = newSink.raw_topic;
     result["rate_limit"] = newSink.rate_limit;
+    result["queue_depth"] = newSink.queue_depth;
     result["message"] = "Sink added successfully";
     
     crow::response resp(201, result.toStyledString());
@@ -984,6 +1223,11 @@ crow::response RestApi::patchSink(int index, const crow::request& req) {
       updated = true;
     }
 
+    if (patch.isMember("queue_depth") && patch["queue_depth"].isInt()) {
+      sink.queue_depth = std::max(1, patch["queue_depth"].asInt());
+      updated = true;
+    }
+
     if (patch.isMember("send_clusters") && patch["send_clusters"].isBool()) {
       sink.send_clusters = patch["send_clusters"].asBool();
       updated = true;
@@ -1020,6 +1264,17 @@ crow::response RestApi::patchSink(int index, const crow::request& req) {
         }
         sink.nng().url = url;
         updated = true;
+      } else if (sink.isShm()) {
+        if (url.find("shm://") != 0 || url.size() <= 6) {
+          Json::Value error;
+          error["error"] = "invalid_url";
+          error["message"] = "SHM sink URL must be 'shm://<name>'";
+          crow::response resp(400, error.toStyledString());
+          resp.add_header("Content-Type", "application/json");
+          return resp;
+        }
+        sink.shm().url = url;
+        updated = true;
       }
     }
     
@@ -1047,6 +1302,23 @@ crow::response RestApi::patchSink(int index, const crow::request& req) {
         sink.nng().encoding = encoding;
         updated = true;
       }
+    } else if (sink.isShm()) {
+      if (patch.isMember("slots") && patch["slots"].isUInt()) {
+        sink.shm().slots = std::max(2u, patch["slots"].asUInt());
+        updated = true;
+      }
+      if (patch.isMember("max_clusters") && patch["max_clusters"].isUInt()) {
+        sink.shm().max_clusters = std::max(1u, patch["max_clusters"].asUInt());
+        updated = true;
+      }
+      if (patch.isMember("max_points") && patch["max_points"].isUInt()) {
+        sink.shm().max_points = std::max(1u, patch["max_points"].asUInt());
+        updated = true;
+      }
+      if (patch.isMember("force") && patch["force"].isBool()) {
+        sink.shm().force = patch["force"].asBool();
+        updated = true;
+      }
     }
     
     if (updated) {
@@ -1065,6 +1337,7 @@ crow::response RestApi::patchSink(int index, const crow::request& req) {
     result["cluster_topic"] = sink.cluster_topic;
     result["raw_topic"] = sink.raw_topic;
     result["rate_limit"] = sink.rate_limit;
+    result["queue_depth"] = sink.queue_depth;
     
     if (sink.isOsc()) {
       result["type"] = "osc";
@@ -1075,6 +1348,13 @@ crow::response RestApi::patchSink(int index, const crow::request& req) {
       result["type"] = "nng";
       result["url"] = sink.nng().url;
       result["encoding"] = sink.nng().encoding;
+    } else if (sink.isShm()) {
+      result["type"] = "shm";
+      result["url"] = sink.shm().url;
+      result["slots"] = sink.shm().slots;
+      result["max_clusters"] = sink.shm().max_clusters;
+      result["max_points"] = sink.shm().max_points;
+      result["force"] = sink.shm().force;
     }
     
     result["message"] = "Sink updated successfully";
@@ -1276,12 +1556,7 @@ crow::response RestApi::postConfigsLoad(const crow::request& req) {
       
       // Apply the configuration to runtime systems
       sensors_.reloadFromAppConfig();
-      filters_.recreatePrefilter();
-      filters_.recreatePostfilter();
-      dbscan_.setParams(config_.dbscan.eps_norm, config_.dbscan.minPts);
-      dbscan_.setAngularScale(config_.dbscan.k_scale);
-      dbscan_.setPerformanceParams(config_.dbscan.h_min, config_.dbscan.h_max,
-                                   config_.dbscan.R_max, config_.dbscan.M_max);
+      params_.publishFrom(config_);
       applySinksRuntime();
       
       // Notify WebSocket clients of configuration change
@@ -1375,12 +1650,7 @@ crow::response RestApi::postConfigsImport(const crow::request& req) {
       
       // Apply the configuration to runtime systems
       sensors_.reloadFromAppConfig();
-      filters_.updatePrefilterConfig(Json::Value()); // Reload from config
-      filters_.updatePostfilterConfig(Json::Value()); // Reload from config
-      dbscan_.setParams(config_.dbscan.eps_norm, config_.dbscan.minPts);
-      dbscan_.setAngularScale(config_.dbscan.k_scale);
-      dbscan_.setPerformanceParams(config_.dbscan.h_min, config_.dbscan.h_max,
-                                   config_.dbscan.R_max, config_.dbscan.M_max);
+      params_.publishFrom(config_);
       applySinksRuntime();
       
       // Notify WebSocket clients of configuration change
@@ -1572,9 +1842,12 @@ crow::response RestApi::getHealth() {
     result["api_endpoints"].append("/api/v1/sensors");
     result["api_endpoints"].append("/api/v1/filters");
     result["api_endpoints"].append("/api/v1/dbscan");
+    result["api_endpoints"].append("/api/v1/shadow");
     result["api_endpoints"].append("/api/v1/sinks");
     result["api_endpoints"].append("/api/v1/configs");
     result["api_endpoints"].append("/api/v1/health");
+    result["api_endpoints"].append("/api/v1/metrics");
+    result["api_endpoints"].append("/api/v1/debug/trace");
     
     crow::response resp(200, result.toStyledString());
     resp.add_header("Content-Type", "application/json");
@@ -1587,4 +1860,99 @@ crow::response RestApi::getHealth() {
     resp.add_header("Content-Type", "application/json");
     return resp;
   }
-}
\ No newline at end of file
+}
+
+// Runtime metrics endpoint
+crow::response RestApi::getMetrics() {
+  try {
+    Json::Value result;
+    result["timestamp"] = static_cast<Json::Int64>(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
+    result["sinks"] = publisher_manager_.getStatsAsJson();
+
+    // Real-time profile and fusion tick jitter
+    const auto rt = realtime::status();
+    const auto jitter = realtime::fusionTickJitter().total();
+    Json::Value realtime(Json::objectValue);
+    realtime["enabled"] = rt.enabled;
+    realtime["memory_locked"] = rt.memory_locked;
+    realtime["threads_applied"] = rt.threads_applied;
+    realtime["threads_degraded"] = rt.threads_degraded;
+    Json::Value tick(Json::objectValue);
+    tick["ticks"] = static_cast<Json::UInt64>(jitter.ticks);
+    tick["missed"] = static_cast<Json::UInt64>(jitter.missed);
+    tick["mean_us"] = jitter.mean_us;
+    tick["p99_us"] = jitter.p99_us;
+    tick["max_us"] = jitter.max_us;
+    realtime["tick_jitter"] = tick;
+    result["realtime"] = realtime;
+    if (frame_budget_) result["frame_budget"] = frame_budget_->toJson();
+    result["alloc_stats"] = alloc_stats::toJson();
+
+    crow::response resp(200, result.toStyledString());
+    resp.add_header("Content-Type", "application/json");
+    return resp;
+  } catch (const std::exception& e) {
+    Json::Value error;
+    error["error"] = "internal_error";
+    error["message"] = e.what();
+    crow::response resp(500, error.toStyledString());
+    resp.add_header("Content-Type", "application/json");
+    return resp;
+  }
+}
+
+// Pipeline trace endpoint
+crow::response RestApi::postDebugTrace(const crow::request& req) {
+  if (!authorize(req)) {
+    return sendUnauthorized();
+  }
+
+  constexpr int kDefaultFrames = 300;
+  constexpr int kMaxFrames = 3000;
+  try {
+    int frames = kDefaultFrames;
+    if (const char* p = req.url_params.get("frames")) {
+      try {
+        frames = std::stoi(p);
+      } catch (const std::exception&) {
+        frames = -1;
+      }
+      if (frames < 1 || frames > kMaxFrames) {
+        Json::Value error;
+        error["error"] = "invalid_parameter";
+        error["message"] = "frames must be between 1 and " + std::to_string(kMaxFrames);
+        crow::response resp(400, error.toStyledString());
+        resp.add_header("Content-Type", "application/json");
+        return resp;
+      }
+    }
+
+    if (!trace::start(static_cast<uint32_t>(frames))) {
+      Json::Value error;
+      error["error"] = "busy";
+      error["message"] = "A trace capture is already running";
+      crow::response resp(409, error.toStyledString());
+      resp.add_header("Content-Type", "application/json");
+      return resp;
+    }
+
+    // 30fps 想定で余裕を持たせる（フレームが来ない場合はそこまでの分を返す）
+    const bool complete = trace::waitDone(std::chrono::milliseconds(frames * 100 + 5000));
+    Json::Value result = trace::toJson();
+    result["otherData"]["complete"] = complete;
+
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    crow::response resp(200, Json::writeString(writer, result));
+    resp.add_header("Content-Type", "application/json");
+    resp.add_header("Content-Disposition", "attachment; filename=\"hokuyohub-trace.json\"");
+    return resp;
+  } catch (const std::exception& e) {
+    Json::Value error;
+    error["error"] = "internal_error";
+    error["message"] = e.what();
+    crow::response resp(500, error.toStyledString());
+    resp.add_header("Content-Type", "application/json");
+    return resp;
+  }
+}
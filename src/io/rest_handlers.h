@@ -2,24 +2,30 @@
 #include <crow.h>
 #include "core/sensor_manager.h"
 #include "core/filter_manager.h"
-#include "detect/dbscan.h"
+#include "core/detection_params.h"
 #include "io/publisher_manager.h"
 #include "config/config.h"
 #include "ws_handlers.h"
+#include "core/frame_budget.h"
 #include <memory>
+#include <string>
+
+class ShadowPipeline;
 
 class RestApi {
    SensorManager& sensors_;
    FilterManager& filters_;
-   DBSCAN2D& dbscan_;
+   DetectionParamsStore& params_;
    PublisherManager& publisher_manager_;
    std::shared_ptr<LiveWs> ws_;
    AppConfig& config_;
    std::string token_;
+   const FrameBudget* frame_budget_{nullptr};
+   ShadowPipeline* shadow_{nullptr};
 
   public:
-    RestApi(SensorManager& s, FilterManager& f, DBSCAN2D& d, PublisherManager& pm, std::shared_ptr<LiveWs> w, AppConfig& cfg)
-     : sensors_(s), filters_(f), dbscan_(d), publisher_manager_(pm), ws_(std::move(w)), config_(cfg), token_(cfg.security.api_token) {}
+    RestApi(SensorManager& s, FilterManager& f, DetectionParamsStore& d, PublisherManager& pm, std::shared_ptr<LiveWs> w, AppConfig& cfg)
+     : sensors_(s), filters_(f), params_(d), publisher_manager_(pm), ws_(std::move(w)), config_(cfg), token_(cfg.security.api_token) {}
 
     // Register all routes with the Crow app
     void registerRoutes(crow::SimpleApp& app);
@@ -27,6 +33,12 @@ class RestApi {
   // Sink runtime management (public for main.cpp access)
   void applySinksRuntime();
 
+  // Frame budget state reported under /api/v1/metrics (detection thread owns it)
+  void setFrameBudget(const FrameBudget* budget) { frame_budget_ = budget; }
+
+  // Shadow pipeline controlled under /api/v1/shadow
+  void setShadowPipeline(ShadowPipeline* shadow) { shadow_ = shadow; }
+
 private:
   bool authorize(const crow::request& req) const;
   crow::response sendUnauthorized() const;
@@ -46,6 +58,15 @@ private:
   // DBSCAN
   crow::response getDbscan();
   crow::response putDbscan(const crow::request& req);
+  static Json::Value dbscanToJson(const DbscanConfig& cfg);
+  // Validate the given fields onto cfg; returns the error message (empty when valid)
+  static std::string applyDbscanJson(const Json::Value& in, DbscanConfig& cfg, bool& updated);
+
+  // Shadow pipeline (A/B testing of DBSCAN / prefilter candidates)
+  crow::response getShadow();
+  crow::response putShadow(const crow::request& req);
+  crow::response deleteShadow(const crow::request& req);
+  crow::response postShadowPromote(const crow::request& req);
   
   // Sensors (new endpoints)
   crow::response postSensor(const crow::request& req);
@@ -69,4 +90,10 @@ private:
   
   // Health check
   crow::response getHealth();
+
+  // Runtime metrics
+  crow::response getMetrics();
+
+  // On-demand pipeline trace (Chrome trace JSON)
+  crow::response postDebugTrace(const crow::request& req);
 };
\ No newline at end of file
@@ -0,0 +1,347 @@
+#include "shm_ring.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#if !defined(_WIN32)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace shm {
+
+namespace {
+
+constexpr size_t kAlign = 64;
+
+inline size_t alignUp(size_t v) { return (v + kAlign - 1) & ~(kAlign - 1); }
+
+inline size_t clusterSlotStride(uint32_t capacity) {
+  return alignUp(sizeof(ShmSlotHeader) + size_t(capacity) * sizeof(ShmCluster));
+}
+
+inline size_t rawSlotStride(uint32_t capacity) {
+  return alignUp(sizeof(ShmSlotHeader) + size_t(capacity) * (2 * sizeof(float) + sizeof(uint8_t)));
+}
+
+inline ShmSlotHeader* slotAt(void* base, const ShmChannelHeader& ch, uint64_t frame) {
+  const uint64_t idx = frame % ch.slot_count;
+  return reinterpret_cast<ShmSlotHeader*>(static_cast<char*>(base) + ch.slots_offset + idx * ch.slot_stride);
+}
+
+inline const ShmSlotHeader* slotAt(const void* base, const ShmChannelHeader& ch, uint64_t frame) {
+  const uint64_t idx = frame % ch.slot_count;
+  return reinterpret_cast<const ShmSlotHeader*>(static_cast<const char*>(base) + ch.slots_offset + idx * ch.slot_stride);
+}
+
+inline char* payloadOf(ShmSlotHeader* s) { return reinterpret_cast<char*>(s) + sizeof(ShmSlotHeader); }
+inline const char* payloadOf(const ShmSlotHeader* s) { return reinterpret_cast<const char*>(s) + sizeof(ShmSlotHeader); }
+
+// seqlock: slot を書き込み中(奇数)にする
+inline uint64_t beginWrite(ShmSlotHeader* s) {
+  const uint64_t g = s->generation.load(std::memory_order_relaxed);
+  s->generation.store(g + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  return g + 2;
+}
+
+inline void endWrite(ShmSlotHeader* s, uint64_t next_gen) {
+  s->generation.store(next_gen, std::memory_order_release);
+}
+
+// head の slot を参照する（書き込み中・上書き済みなら false）
+template <typename Fn>
+bool peekLatest(const void* base, const ShmChannelHeader& ch, uint64_t after_frame, Fn&& fill) {
+  const uint64_t head = ch.head.load(std::memory_order_acquire);
+  if (head == 0 || head <= after_frame) return false;
+
+  const ShmSlotHeader* s = slotAt(base, ch, head);
+  const uint64_t g = s->generation.load(std::memory_order_acquire);
+  if (g & 1ULL) return false;          // 書き込み中
+  if (s->frame != head) return false;  // 既に次の周回で上書きされた
+  fill(s, g);
+  return true;
+}
+
+} // namespace
+
+std::string shmObjectName(const std::string& url) {
+  std::string name = url;
+  if (name.rfind("shm://", 0) == 0) name = name.substr(6);
+  while (!name.empty() && name.front() == '/') name.erase(name.begin());
+  // POSIX shm 名にはスラッシュを含められない
+  std::replace(name.begin(), name.end(), '/', '_');
+  return "/" + name;
+}
+
+// ---- Writer ----
+
+ShmRingWriter::~ShmRingWriter() {
+  close();
+}
+
+bool ShmRingWriter::open(const std::string& name, uint32_t slots, uint32_t max_clusters, uint32_t max_points,
+                         bool force) {
+  close();
+#if defined(_WIN32)
+  (void)name; (void)slots; (void)max_clusters; (void)max_points; (void)force;
+  std::cerr << "[ShmRingWriter] Shared-memory sink is not supported on Windows" << std::endl;
+  return false;
+#else
+  if (name.size() < 2 || slots == 0) {
+    std::cerr << "[ShmRingWriter] Invalid segment parameters for '" << name << "'" << std::endl;
+    return false;
+  }
+
+  const size_t header_bytes = alignUp(sizeof(ShmSegmentHeader));
+  const size_t cstride = clusterSlotStride(max_clusters);
+  const size_t rstride = rawSlotStride(max_points);
+  const size_t total = header_bytes + cstride * slots + rstride * slots;
+
+  // 既存のセグメントは勝手に消さない（別の書き手が使用中なら、その読み手ごと孤立させてしまう）。
+  // クラッシュ等で残った古いセグメントは force 指定時のみ unlink して作り直す。
+  if (force) ::shm_unlink(name.c_str());
+  int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    if (errno == EEXIST) {
+      std::cerr << "[ShmRingWriter] Segment '" << name << "' already exists (another writer, or left over from a crash)."
+                << " Remove /dev/shm" << name << " or set force: true on the sink to take it over" << std::endl;
+    } else {
+      std::cerr << "[ShmRingWriter] shm_open failed for '" << name << "': " << std::strerror(errno) << std::endl;
+    }
+    return false;
+  }
+  if (::ftruncate(fd, static_cast<off_t>(total)) != 0) {
+    std::cerr << "[ShmRingWriter] ftruncate failed for '" << name << "': " << std::strerror(errno) << std::endl;
+    ::close(fd);
+    ::shm_unlink(name.c_str());
+    return false;
+  }
+  void* p = ::mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    std::cerr << "[ShmRingWriter] mmap failed for '" << name << "': " << std::strerror(errno) << std::endl;
+    ::shm_unlink(name.c_str());
+    return false;
+  }
+
+  // ftruncate 直後はゼロ埋め済み。ヘッダと各 slot の atomic を構築する
+  auto* hdr = new (p) ShmSegmentHeader{};
+  hdr->segment_bytes = total;
+
+  auto initChannel = [&](ShmChannelHeader& ch, uint32_t capacity, size_t stride, size_t offset) {
+    ch.head.store(0, std::memory_order_relaxed);
+    ch.slot_count = slots;
+    ch.capacity = capacity;
+    ch.slot_stride = stride;
+    ch.slots_offset = offset;
+    for (uint32_t i = 0; i < slots; ++i) {
+      new (static_cast<char*>(p) + offset + i * stride) ShmSlotHeader{};
+    }
+  };
+  initChannel(hdr->clusters, max_clusters, cstride, header_bytes);
+  initChannel(hdr->raw, max_points, rstride, header_bytes + cstride * slots);
+
+  hdr->writer_alive.store(1, std::memory_order_relaxed);
+  hdr->version = kVersion;
+  std::atomic_thread_fence(std::memory_order_release);
+  hdr->magic = kMagic; // magic は最後に書く（読み手はこれで初期化完了を判定）
+
+  // 常駐させてホットパスでのページフォルトを避ける
+  for (size_t off = 0; off < total; off += 4096) {
+    static_cast<volatile char*>(p)[off] = static_cast<volatile char*>(p)[off];
+  }
+
+  name_ = name;
+  base_ = p;
+  bytes_ = total;
+  cluster_frame_ = 0;
+  raw_frame_ = 0;
+  truncated_ = 0;
+  return true;
+#endif
+}
+
+void ShmRingWriter::close() {
+#if !defined(_WIN32)
+  if (base_) {
+    auto* hdr = static_cast<ShmSegmentHeader*>(base_);
+    hdr->writer_alive.store(0, std::memory_order_release);
+    ::munmap(base_, bytes_);
+    ::shm_unlink(name_.c_str());
+  }
+#endif
+  base_ = nullptr;
+  bytes_ = 0;
+}
+
+void ShmRingWriter::writeClusters(uint64_t t_ns, uint32_t seq, uint64_t params_version,
+                                  const ShmCluster* items, size_t count, uint32_t flags) {
+  if (!base_) return;
+  auto* hdr = static_cast<ShmSegmentHeader*>(base_);
+  ShmChannelHeader& ch = hdr->clusters;
+
+  const uint64_t frame = ++cluster_frame_;
+  ShmSlotHeader* s = slotAt(base_, ch, frame);
+  const size_t n = std::min<size_t>(count, ch.capacity);
+
+  const uint64_t next_gen = beginWrite(s);
+  s->frame = frame;
+  s->t_ns = t_ns;
+  s->seq = seq;
+  s->count = static_cast<uint32_t>(n);
+  s->flags = flags | ((n < count) ? kFlagTruncated : 0);
+  s->params_version = params_version;
+  if (n) std::memcpy(payloadOf(s), items, n * sizeof(ShmCluster));
+  endWrite(s, next_gen);
+  ch.head.store(frame, std::memory_order_release);
+
+  if (s->flags & kFlagTruncated) truncated_++;
+}
+
+void ShmRingWriter::writeRaw(uint64_t t_ns, uint32_t seq, const float* xy, const uint8_t* sid, size_t count) {
+  if (!base_) return;
+  auto* hdr = static_cast<ShmSegmentHeader*>(base_);
+  ShmChannelHeader& ch = hdr->raw;
+
+  const uint64_t frame = ++raw_frame_;
+  ShmSlotHeader* s = slotAt(base_, ch, frame);
+  const size_t n = std::min<size_t>(count, ch.capacity);
+
+  const uint64_t next_gen = beginWrite(s);
+  s->frame = frame;
+  s->t_ns = t_ns;
+  s->seq = seq;
+  s->count = static_cast<uint32_t>(n);
+  s->flags = (n < count) ? kFlagTruncated : 0;
+  s->params_version = 0;
+  char* payload = payloadOf(s);
+  if (n) {
+    // SoA: xy[2*capacity] の後ろに sid[capacity]（読み手は capacity からオフセットを計算）
+    std::memcpy(payload, xy, n * 2 * sizeof(float));
+    std::memcpy(payload + size_t(ch.capacity) * 2 * sizeof(float), sid, n);
+  }
+  endWrite(s, next_gen);
+  ch.head.store(frame, std::memory_order_release);
+
+  if (n < count) truncated_++;
+}
+
+// ---- Reader ----
+
+ShmRingReader::~ShmRingReader() {
+  close();
+}
+
+bool ShmRingReader::open(const std::string& name) {
+  close();
+#if defined(_WIN32)
+  (void)name;
+  return false;
+#else
+  int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) return false;
+
+  struct stat st{};
+  if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ShmSegmentHeader)) {
+    ::close(fd);
+    return false;
+  }
+  const size_t total = static_cast<size_t>(st.st_size);
+  void* p = ::mmap(nullptr, total, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) return false;
+
+  const auto* hdr = static_cast<const ShmSegmentHeader*>(p);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (hdr->magic != kMagic || hdr->version != kVersion || hdr->segment_bytes != total) {
+    ::munmap(p, total);
+    return false;
+  }
+
+  base_ = p;
+  bytes_ = total;
+  return true;
+#endif
+}
+
+void ShmRingReader::close() {
+#if !defined(_WIN32)
+  if (base_) ::munmap(const_cast<void*>(base_), bytes_);
+#endif
+  base_ = nullptr;
+  bytes_ = 0;
+}
+
+bool ShmRingReader::writerAlive() const {
+  if (!base_) return false;
+  return static_cast<const ShmSegmentHeader*>(base_)->writer_alive.load(std::memory_order_acquire) != 0;
+}
+
+uint64_t ShmRingReader::latestClusterFrame() const {
+  if (!base_) return 0;
+  return static_cast<const ShmSegmentHeader*>(base_)->clusters.head.load(std::memory_order_acquire);
+}
+
+uint64_t ShmRingReader::latestRawFrame() const {
+  if (!base_) return 0;
+  return static_cast<const ShmSegmentHeader*>(base_)->raw.head.load(std::memory_order_acquire);
+}
+
+bool ShmRingReader::peekClusters(ShmClusterView& out, uint64_t after_frame) const {
+  if (!base_) return false;
+  const auto* hdr = static_cast<const ShmSegmentHeader*>(base_);
+  return peekLatest(base_, hdr->clusters, after_frame, [&](const ShmSlotHeader* s, uint64_t g) {
+    out.frame = s->frame;
+    out.t_ns = s->t_ns;
+    out.seq = s->seq;
+    out.count = std::min(s->count, hdr->clusters.capacity);
+    out.flags = s->flags;
+    out.params_version = s->params_version;
+    out.items = reinterpret_cast<const ShmCluster*>(payloadOf(s));
+    out.generation_ = &s->generation;
+    out.expected_ = g;
+  });
+}
+
+bool ShmRingReader::peekRaw(ShmRawView& out, uint64_t after_frame) const {
+  if (!base_) return false;
+  const auto* hdr = static_cast<const ShmSegmentHeader*>(base_);
+  return peekLatest(base_, hdr->raw, after_frame, [&](const ShmSlotHeader* s, uint64_t g) {
+    const char* payload = payloadOf(s);
+    out.frame = s->frame;
+    out.t_ns = s->t_ns;
+    out.seq = s->seq;
+    out.count = std::min(s->count, hdr->raw.capacity);
+    out.flags = s->flags;
+    out.xy = reinterpret_cast<const float*>(payload);
+    out.sid = reinterpret_cast<const uint8_t*>(payload + size_t(hdr->raw.capacity) * 2 * sizeof(float));
+    out.generation_ = &s->generation;
+    out.expected_ = g;
+  });
+}
+
+bool ShmRingReader::readClusters(std::vector<ShmCluster>& out, ShmClusterView& meta, uint64_t after_frame, int max_retries) const {
+  for (int attempt = 0; attempt < max_retries; ++attempt) {
+    if (!peekClusters(meta, after_frame)) return false;
+    out.assign(meta.items, meta.items + meta.count);
+    if (meta.stillValid()) return true;
+  }
+  return false;
+}
+
+bool ShmRingReader::readRaw(std::vector<float>& xy, std::vector<uint8_t>& sid, ShmRawView& meta, uint64_t after_frame, int max_retries) const {
+  for (int attempt = 0; attempt < max_retries; ++attempt) {
+    if (!peekRaw(meta, after_frame)) return false;
+    xy.assign(meta.xy, meta.xy + size_t(meta.count) * 2);
+    sid.assign(meta.sid, meta.sid + meta.count);
+    if (meta.stillValid()) return true;
+  }
+  return false;
+}
+
+} // namespace shm
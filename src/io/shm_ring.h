@@ -0,0 +1,172 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ===== Shared-memory frame ring =====
+// 同一ホスト上のコンシューマ向けに、最新フレームを POSIX 共有メモリへ書き出す。
+// ヘッダ単体で読み手側からも利用できる（hokuyo_shm ライブラリ）。
+//
+// Segment layout (offsets from the mapping base, all 64-byte aligned):
+//   ShmSegmentHeader
+//   cluster slots: slot_count x [ShmSlotHeader + ShmCluster[capacity]]
+//   raw slots:     slot_count x [ShmSlotHeader + float xy[2*capacity] + uint8 sid[capacity]]
+//
+// Seqlock protocol per slot:
+//   writer: generation -> odd, write header+payload, generation -> even, head -> frame
+//   reader: g1 = generation (acquire), skip if odd; read; g2 = generation; valid iff g1 == g2
+// Writers never block and readers never take locks or issue syscalls.
+
+namespace shm {
+
+constexpr uint32_t kMagic   = 0x484b5348; // "HKSH"
+constexpr uint32_t kVersion = 1;
+
+constexpr uint32_t kFlagTruncated = 1u << 0; // payload exceeded slot capacity
+
+struct ShmCluster {
+  uint32_t id;
+  uint32_t point_count;
+  uint64_t sensor_mask;
+  float cx, cy;
+  float minx, miny, maxx, maxy;
+};
+static_assert(sizeof(ShmCluster) == 40, "ShmCluster layout is part of the wire format");
+
+struct alignas(64) ShmSlotHeader {
+  std::atomic<uint64_t> generation; // odd while the writer owns the slot
+  uint64_t frame;                   // monotonic frame number (1-based)
+  uint64_t t_ns;
+  uint32_t seq;
+  uint32_t count;                   // clusters or points in this slot
+  uint32_t flags;
+  uint32_t reserved;
+  uint64_t params_version;          // DetectionParams version (cluster channel; 0 for raw)
+};
+
+struct alignas(64) ShmChannelHeader {
+  std::atomic<uint64_t> head;       // last completed frame number (0 = none yet)
+  uint32_t slot_count;
+  uint32_t capacity;                // max clusters / points per slot
+  uint64_t slot_stride;             // bytes between consecutive slots
+  uint64_t slots_offset;            // offset of slot 0 from the segment base
+};
+
+struct alignas(64) ShmSegmentHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t segment_bytes;
+  std::atomic<uint32_t> writer_alive; // 1 while a publisher has the segment open
+  ShmChannelHeader clusters;
+  ShmChannelHeader raw;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory seqlock requires lock-free 64-bit atomics");
+
+// Zero-copy views into the mapping. Pointers are valid until the slot is
+// rewritten; call stillValid() after consuming the payload.
+struct ShmClusterView {
+  uint64_t frame{0};
+  uint64_t t_ns{0};
+  uint32_t seq{0};
+  uint32_t count{0};
+  uint32_t flags{0};
+  uint64_t params_version{0};
+  const ShmCluster* items{nullptr};
+
+  const std::atomic<uint64_t>* generation_{nullptr};
+  uint64_t expected_{0};
+  bool stillValid() const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return generation_ && generation_->load(std::memory_order_relaxed) == expected_;
+  }
+};
+
+struct ShmRawView {
+  uint64_t frame{0};
+  uint64_t t_ns{0};
+  uint32_t seq{0};
+  uint32_t count{0};
+  uint32_t flags{0};
+  const float* xy{nullptr};     // 2*count
+  const uint8_t* sid{nullptr};  // count
+
+  const std::atomic<uint64_t>* generation_{nullptr};
+  uint64_t expected_{0};
+  bool stillValid() const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return generation_ && generation_->load(std::memory_order_relaxed) == expected_;
+  }
+};
+
+// Map a "shm://name" URL (or bare name) to a POSIX shm object name ("/name").
+std::string shmObjectName(const std::string& url);
+
+class ShmRingWriter {
+public:
+  ShmRingWriter() = default;
+  ~ShmRingWriter();
+  ShmRingWriter(const ShmRingWriter&) = delete;
+  ShmRingWriter& operator=(const ShmRingWriter&) = delete;
+
+  // Create the segment. Fails if the name already exists unless `force` is set, in which case the
+  // existing segment is unlinked first (readers still attached to it keep the orphaned mapping).
+  // close() unlinks the segment this writer created. Returns false on failure.
+  bool open(const std::string& name, uint32_t slots, uint32_t max_clusters, uint32_t max_points,
+            bool force = false);
+  void close();
+  bool isOpen() const { return base_ != nullptr; }
+
+  // Hot path: memcpy into the next slot, no allocation and no syscalls.
+  // `flags` is OR'ed into the slot flags (kFlagTruncated is also set when count exceeds capacity).
+  void writeClusters(uint64_t t_ns, uint32_t seq, uint64_t params_version,
+                     const ShmCluster* items, size_t count, uint32_t flags = 0);
+  void writeRaw(uint64_t t_ns, uint32_t seq, const float* xy, const uint8_t* sid, size_t count);
+
+  uint64_t clusterFrames() const { return cluster_frame_; }
+  uint64_t rawFrames() const { return raw_frame_; }
+  uint64_t truncatedFrames() const { return truncated_; }
+
+private:
+  std::string name_;
+  void* base_{nullptr};
+  size_t bytes_{0};
+  uint64_t cluster_frame_{0};
+  uint64_t raw_frame_{0};
+  uint64_t truncated_{0};
+};
+
+class ShmRingReader {
+public:
+  ShmRingReader() = default;
+  ~ShmRingReader();
+  ShmRingReader(const ShmRingReader&) = delete;
+  ShmRingReader& operator=(const ShmRingReader&) = delete;
+
+  // Attach read-only to an existing segment. Returns false if absent or incompatible.
+  bool open(const std::string& name);
+  void close();
+  bool isOpen() const { return base_ != nullptr; }
+  bool writerAlive() const;
+
+  // Latest completed frame number (0 if nothing published yet)
+  uint64_t latestClusterFrame() const;
+  uint64_t latestRawFrame() const;
+
+  // Zero-copy access to the newest frame newer than `after_frame`.
+  // Returns false if there is none or the slot is being rewritten.
+  bool peekClusters(ShmClusterView& out, uint64_t after_frame = 0) const;
+  bool peekRaw(ShmRawView& out, uint64_t after_frame = 0) const;
+
+  // Copying variants: retry until a consistent snapshot is obtained.
+  bool readClusters(std::vector<ShmCluster>& out, ShmClusterView& meta, uint64_t after_frame = 0, int max_retries = 8) const;
+  bool readRaw(std::vector<float>& xy, std::vector<uint8_t>& sid, ShmRawView& meta, uint64_t after_frame = 0, int max_retries = 8) const;
+
+private:
+  const void* base_{nullptr};
+  size_t bytes_{0};
+};
+
+} // namespace shm
@@ -7,13 +7,38 @@
 #include "ws_handlers.h"
 #include <crow.h>
 #include <json/json.h>
+#include <charconv>
+#include <string>
 #include "core/sensor_manager.h"  // ★ SensorManager へ橋渡し
 #include "core/filter_manager.h"  // ★ FilterManager へ橋渡し
 #include "config/config.h"        // ★ AppConfig へ橋渡し
+#include "core/alloc_stats.h"
+#include "core/trace.h"
 
 std::mutex LiveWs::mtx_;
 std::unordered_set<crow::websocket::connection*> LiveWs::conns_;
 
+namespace {
+// Frame messages are formatted straight into a reused buffer instead of building a
+// Json::Value tree per point (shortest round-trip representation for floats)
+template <typename T>
+void appendNumber(std::string& out, T v) {
+  char buf[32];
+  auto res = std::to_chars(buf, buf + sizeof(buf), v);
+  out.append(buf, res.ptr);
+}
+
+void appendFrameHeader(std::string& out, const char* type, uint64_t t_ns, uint32_t seq) {
+  out.clear();
+  out += "{\"type\":\"";
+  out += type;
+  out += "\",\"t\":";
+  appendNumber(out, t_ns);
+  out += ",\"seq\":";
+  appendNumber(out, seq);
+}
+} // namespace
+
 void LiveWs::registerWebSocketRoutes(crow::SimpleApp& app) {
   // Register WebSocket route for /ws/live
   CROW_WEBSOCKET_ROUTE(app, "/ws/live")
@@ -127,65 +152,81 @@ void LiveWs::handleNewMessage(crow::websocket::connection& conn, const std::stri
 
 void LiveWs::broadcast(std::string_view msg){
   std::lock_guard<std::mutex> lk(mtx_);
+  trace::Scope span("ws.broadcast", "clients", static_cast<int64_t>(conns_.size()));
   for(const auto& c : conns_){
-    if(c) c->send_text(std::string{msg});
+    if(c){
+      c->send_text(std::string{msg});
+      alloc_stats::noteCopy(msg.size());
+    }
   }
 }
 
-void LiveWs::pushClustersLite(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items){
-  Json::Value j; j["type"]="clusters-lite"; j["t"] = Json::UInt64(t_ns); j["seq"] = Json::UInt(seq);
-  j["items"] = Json::arrayValue;
-  for(const auto& c: items){
-      Json::Value o; o["id"]=Json::UInt(c.id); o["cx"]=c.cx; o["cy"]=c.cy;
-      o["minx"]=c.minx; o["miny"]=c.miny; o["maxx"]=c.maxx; o["maxy"]=c.maxy; o["count"]=(int)c.point_indices.size(); o["sensor_mask"]=c.sensor_mask;
-      j["items"].append(o);
+bool LiveWs::hasConnections(){
+  std::lock_guard<std::mutex> lk(mtx_);
+  return !conns_.empty();
+}
+
+void LiveWs::pushClustersLite(uint64_t t_ns, uint32_t seq, uint64_t params_version, const ClusterSet& items){
+  if(!hasConnections()) return; // 誰も見ていなければ整形しない
+  auto& out = frame_json_;
+  appendFrameHeader(out, "clusters-lite", t_ns, seq);
+  out += ",\"params_version\":"; appendNumber(out, params_version);
+  out += ",\"items\":[";
+  for(size_t k = 0; k < items.size(); ++k){
+    const auto& c = items.clusters[k];
+    if(k) out += ',';
+    out += "{\"id\":"; appendNumber(out, c.id);
+    out += ",\"cx\":"; appendNumber(out, c.cx);
+    out += ",\"cy\":"; appendNumber(out, c.cy);
+    out += ",\"minx\":"; appendNumber(out, c.minx);
+    out += ",\"miny\":"; appendNumber(out, c.miny);
+    out += ",\"maxx\":"; appendNumber(out, c.maxx);
+    out += ",\"maxy\":"; appendNumber(out, c.maxy);
+    out += ",\"count\":"; appendNumber(out, c.point_count);
+    // 64 ビットは JS の Number で欠けるため 10 進文字列で送る（BigInt で復元）
+    out += ",\"sensor_mask\":\""; appendNumber(out, c.sensor_mask); out += '"';
+    // {"<sid>": 点数, ...}
+    out += ",\"sensor_counts\":{";
+    bool first = true;
+    for(const auto& sc : items.sensorCounts(k)){
+      if(!first) out += ',';
+      first = false;
+      out += '"'; appendNumber(out, static_cast<unsigned>(sc.sid)); out += "\":";
+      appendNumber(out, sc.count);
+    }
+    out += "}}";
   }
+  out += "]}";
   // 全接続にブロードキャスト
-  LiveWs::broadcast(j.toStyledString());
+  LiveWs::broadcast(out);
 }
 
-void LiveWs::pushRawLite(uint64_t t_ns, uint32_t seq, const std::vector<float>& xy, const std::vector<uint8_t>& sid){
-  Json::Value j;
-  j["type"] = "raw-lite";
-  j["t"] = Json::UInt64(t_ns);
-  j["seq"] = Json::UInt(seq);
-  
-  // Convert xy vector to JSON array
-  j["xy"] = Json::arrayValue;
-  for(const auto& val : xy){
-    j["xy"].append(val);
-  }
-  
-  // Convert sid vector to JSON array
-  j["sid"] = Json::arrayValue;
-  for(const auto& val : sid){
-    j["sid"].append(Json::UInt(val));
-  }
-  
+void LiveWs::pushPointsLite(const char* type, uint64_t t_ns, uint32_t seq,
+                            const std::vector<float>& xy, const std::vector<uint8_t>& sid){
+  if(!hasConnections()) return;
+  auto& out = frame_json_;
+  appendFrameHeader(out, type, t_ns, seq);
+  out += ",\"xy\":[";
+  for(size_t i = 0; i < xy.size(); ++i){
+    if(i) out += ',';
+    appendNumber(out, xy[i]);
+  }
+  out += "],\"sid\":[";
+  for(size_t i = 0; i < sid.size(); ++i){
+    if(i) out += ',';
+    appendNumber(out, static_cast<unsigned>(sid[i]));
+  }
+  out += "]}";
   // Broadcast to all connections
-  LiveWs::broadcast(j.toStyledString());
+  LiveWs::broadcast(out);
+}
+
+void LiveWs::pushRawLite(uint64_t t_ns, uint32_t seq, const std::vector<float>& xy, const std::vector<uint8_t>& sid){
+  pushPointsLite("raw-lite", t_ns, seq, xy, sid);
 }
 
 void LiveWs::pushFilteredLite(uint64_t t_ns, uint32_t seq, const std::vector<float>& xy, const std::vector<uint8_t>& sid){
-  Json::Value j;
-  j["type"] = "filtered-lite";
-  j["t"] = Json::UInt64(t_ns);
-  j["seq"] = Json::UInt(seq);
-  
-  // Convert xy vector to JSON array
-  j["xy"] = Json::arrayValue;
-  for(const auto& val : xy){
-    j["xy"].append(val);
-  }
-  
-  // Convert sid vector to JSON array
-  j["sid"] = Json::arrayValue;
-  for(const auto& val : sid){
-    j["sid"].append(Json::UInt(val));
-  }
-  
-  // Broadcast to all connections
-  LiveWs::broadcast(j.toStyledString());
+  pushPointsLite("filtered-lite", t_ns, seq, xy, sid);
 }
 
 Json::Value LiveWs::buildSnapshot() const
@@ -257,9 +298,19 @@ Json::Value LiveWs::buildSnapshot() const
         sink_obj["in_bundle"] = cfg.in_bundle;
         sink_obj["bundle_fragment_size"] = cfg.bundle_fragment_size;
       }
+      else if (sink.isShm()) {
+        const auto& cfg = sink.shm();
+        sink_obj["type"] = "shm";
+        sink_obj["url"] = cfg.url;
+        sink_obj["slots"] = cfg.slots;
+        sink_obj["max_clusters"] = cfg.max_clusters;
+        sink_obj["max_points"] = cfg.max_points;
+        sink_obj["force"] = cfg.force;
+      }
       sink_obj["cluster_topic"] = sink.cluster_topic;
       sink_obj["raw_topic"] = sink.raw_topic;
       sink_obj["rate_limit"] = sink.rate_limit;
+      sink_obj["queue_depth"] = sink.queue_depth;
       sink_obj["send_clusters"] = sink.send_clusters;
       sink_obj["send_raw"] = sink.send_raw;
 
@@ -394,6 +445,11 @@ void LiveWs::handleWorldUpdate(crow::websocket::connection& conn, const Json::Va
       }
     }
     
+    // Rebuild the compiled ROI raster and hand it to the detection thread
+    if (params_) {
+      res["params_version"] = Json::UInt64(params_->publishWorldMask(appConfig_->world_mask));
+    }
+    
     res["message"] = "World mask updated successfully";
     std::cout << "[WorldUpdate] World mask updated successfully. Include regions: " 
               << appConfig_->world_mask.include.size() 
@@ -614,15 +670,15 @@ void LiveWs::handleDbscanUpdate(crow::websocket::connection& conn, const Json::V
     }
     
     if (updated) {
-      // Apply the updated configuration to the DBSCAN instance
-      if (dbscan_) {
-        dbscan_->setParams(appConfig_->dbscan.eps_norm, appConfig_->dbscan.minPts);
-        dbscan_->setAngularScale(appConfig_->dbscan.k_scale);
-        dbscan_->setPerformanceParams(appConfig_->dbscan.h_min, appConfig_->dbscan.h_max,
-                                     appConfig_->dbscan.R_max, appConfig_->dbscan.M_max);
+      // Publish a new parameter snapshot (picked up by the detection thread on the next frame)
+      uint64_t version = 0;
+      if (params_) {
+        const DbscanConfig dbscan_cfg = appConfig_->dbscan;
+        version = params_->update([&](DetectionParams& p) { p.dbscan = dbscan_cfg; });
         
         std::cout << "[DBSCAN] Configuration updated via WebSocket: eps_norm=" << appConfig_->dbscan.eps_norm
-                  << " minPts=" << appConfig_->dbscan.minPts << " k_scale=" << appConfig_->dbscan.k_scale << std::endl;
+                  << " minPts=" << appConfig_->dbscan.minPts << " k_scale=" << appConfig_->dbscan.k_scale
+                  << " (params v" << version << ")" << std::endl;
       }
       
       res["message"] = "DBSCAN configuration updated successfully";
@@ -637,6 +693,7 @@ void LiveWs::handleDbscanUpdate(crow::websocket::connection& conn, const Json::V
       broadcast_msg["config"]["h_max"] = appConfig_->dbscan.h_max;
       broadcast_msg["config"]["R_max"] = appConfig_->dbscan.R_max;
       broadcast_msg["config"]["M_max"] = appConfig_->dbscan.M_max;
+      broadcast_msg["params_version"] = Json::UInt64(version);
       
       broadcast(broadcast_msg.toStyledString());
     } else {
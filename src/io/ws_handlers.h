@@ -6,6 +6,7 @@
 #include <mutex>
 #include <unordered_set>
 #include "detect/dbscan.h"
+#include "core/detection_params.h"
 
 class PublisherManager;
 class SensorManager; // 追加: 前方宣言
@@ -17,14 +18,14 @@ class LiveWs {
    SensorManager* sensorManager_{nullptr};
    FilterManager* filterManager_{nullptr};
    AppConfig* appConfig_{nullptr};
-   DBSCAN2D* dbscan_{nullptr};
+   DetectionParamsStore* params_{nullptr};
  public:
    explicit LiveWs(PublisherManager& pm) : publisher_manager_(pm) {}
 
    void setSensorManager(SensorManager* sm) { sensorManager_ = sm; }
    void setFilterManager(FilterManager* fm) { filterManager_ = fm; }
    void setAppConfig(AppConfig* cfg) { appConfig_ = cfg; }
-   void setDbscan(DBSCAN2D* dbscan) { dbscan_ = dbscan; }
+   void setDetectionParams(DetectionParamsStore* params) { params_ = params; }
 
    // Register WebSocket routes with the Crow app
    void registerWebSocketRoutes(crow::SimpleApp& app);
@@ -36,7 +37,8 @@ class LiveWs {
 
    // 全接続へ通知
    static void broadcast(std::string_view msg);
-   void pushClustersLite(uint64_t t_ns, uint32_t seq, const std::vector<Cluster>& items);
+   static bool hasConnections();
+   void pushClustersLite(uint64_t t_ns, uint32_t seq, uint64_t params_version, const ClusterSet& items);
    void pushRawLite(uint64_t t_ns, uint32_t seq, const std::vector<float>& xy, const std::vector<uint8_t>& sid);
    void pushFilteredLite(uint64_t t_ns, uint32_t seq, const std::vector<float>& xy, const std::vector<uint8_t>& sid);
 
@@ -66,6 +68,11 @@ class LiveWs {
    void handleSinkDelete(crow::websocket::connection& conn, const Json::Value& j);
 
  private:
+   // フレーム送信用の JSON 文字列バッファ（検出スレッド専用、容量を再利用）
+   std::string frame_json_;
+   void pushPointsLite(const char* type, uint64_t t_ns, uint32_t seq,
+                       const std::vector<float>& xy, const std::vector<uint8_t>& sid);
+
    static std::mutex mtx_;
    static std::unordered_set<crow::websocket::connection*> conns_;
 };
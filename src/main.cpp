@@ -7,9 +7,15 @@
 #include "io/publisher_manager.h"
 #include "core/sensor_manager.h"
 #include "detect/dbscan.h"
-#include "detect/prefilter.h"
-#include "detect/postfilter.h"
+#include "detect/voxel_grid.h"
 #include "core/filter_manager.h"
+#include "core/detection_params.h"
+#include "core/detection_pipeline.h"
+#include "core/shadow_pipeline.h"
+#include "core/realtime.h"
+#include "core/frame_budget.h"
+#include "core/alloc_stats.h"
+#include "core/trace.h"
 
 #include <signal.h>
 #include <atomic>
@@ -56,6 +62,9 @@ int main(int argc, char** argv) {
 
   AppConfig appcfg = load_app_config(cfgPath);
 
+  // Real-time profile (memory locking now; each thread applies its own pinning/priority)
+  realtime::configure(appcfg.realtime);
+
   // Initialize publisher manager (will be configured via RestApi)
   PublisherManager publisher_manager;
   
@@ -63,17 +72,29 @@ int main(int argc, char** argv) {
   SensorManager sensors(appcfg);
   sensors.configure(appcfg.sensors);
   
-  // Initialize DBSCAN with new structured config (fallback to legacy for compatibility)
-  const auto& dcfg = appcfg.dbscan;
-  float eps_to_use = (dcfg.eps_norm != 2.5f) ? dcfg.eps_norm : dcfg.eps; // Use eps_norm if set, else eps
-  DBSCAN2D dbscan(eps_to_use, dcfg.minPts);
-  
-  // Configure additional parameters
-  dbscan.setAngularScale(dcfg.k_scale);
-  dbscan.setPerformanceParams(dcfg.h_min, dcfg.h_max, dcfg.R_max, dcfg.M_max);
+  // Detection parameters are published as immutable snapshots (WS/REST write, pipeline reads)
+  DetectionParamsStore detectionParams(appcfg);
+  sensors.setDetectionParams(&detectionParams);  // world_mask.apply_at_ingest
+
+  // Detection-thread-owned pipeline; reconfigured from the snapshot when its version changes
+  DetectionPipeline pipeline(*detectionParams.load());
+  // Raw points for sinks and UI at a coarser voxel resolution (voxel.publish_resolution)
+  VoxelDownsampler publish_downsampler;
+  VoxelFrame publish_frame;
+  // Per-frame budget: stage timing and ordered degradation under overload
+  FrameBudget frame_budget;
+  frame_budget.configure(appcfg.frame_budget);
+  // Candidate DBSCAN / prefilter parameters evaluated on copies of the live frames
+  ShadowPipeline shadow;
+  shadow.setReporter([](const Json::Value& stats) {
+    Json::Value msg;
+    msg["type"] = "shadow.stats";
+    msg["stats"] = stats;
+    LiveWs::broadcast(msg.toStyledString());
+  });
 
   // Initialize filter manager with configuration
-  FilterManager filterManager(appcfg.prefilter, appcfg.postfilter);
+  FilterManager filterManager(appcfg.prefilter, appcfg.postfilter, detectionParams);
 
   // Initialize CrowCpp application with explicit cleanup
   std::cout << "[Crow] Creating new Crow application instance..." << std::endl;
@@ -83,12 +104,14 @@ int main(int argc, char** argv) {
   std::cout << "[Crow] Initializing fresh Crow state..." << std::endl;
   
   auto ws = std::make_shared<LiveWs>(publisher_manager);
-  auto rest = std::make_shared<RestApi>(sensors, filterManager, dbscan, publisher_manager, ws, appcfg);
+  auto rest = std::make_shared<RestApi>(sensors, filterManager, detectionParams, publisher_manager, ws, appcfg);
 
   ws->setSensorManager(&sensors);
   ws->setFilterManager(&filterManager);
   ws->setAppConfig(&appcfg);
-  ws->setDbscan(&dbscan);
+  ws->setDetectionParams(&detectionParams);
+  rest->setFrameBudget(&frame_budget);
+  rest->setShadowPipeline(&shadow);
   
   // Register routes with CrowCpp app
   rest->registerRoutes(app);
@@ -191,78 +214,61 @@ int main(int argc, char** argv) {
   // センサー開始（スタブ：タイマーでダミーデータを流す）
   std::cout << "[App] CRITICAL: Starting sensors with callback registration..." << std::endl;
   sensors.start([&](const ScanFrame& f){
-    // Push raw points to WebUI (unfiltered)
-    ws->pushRawLite(f.t_ns, f.seq, f.xy, f.sid);
-
-    // Apply prefilter through FilterManager
-    // Use pointers to avoid copies — point at original data by default
-    const std::vector<float>* p_xy = &f.xy;
-    const std::vector<uint8_t>* p_sid = &f.sid;
-    const std::vector<float>* p_dist = &f.dist;
-
-    Prefilter::FilterResult filter_result;
-    if (filterManager.isPrefilterEnabled()) {
-      try {
-        filter_result = filterManager.applyPrefilter(f.xy, f.sid, f.dist);
-        p_xy = &filter_result.xy;
-        p_sid = &filter_result.sid;
-        p_dist = &filter_result.dist;
-      } catch (const std::exception& e) {
-        std::cerr << "[Prefilter] Error in frame seq=" << f.seq << ": " << e.what() << std::endl;
-      }
-    }
-    
-    // Apply ROI world_mask filtering after prefilter and before DBSCAN
-    std::vector<float> roi_xy;
-    std::vector<uint8_t> roi_sid;
-    std::vector<float> roi_dist;
-    if (!appcfg.world_mask.empty()) {
-      roi_xy.reserve(p_xy->size());
-      roi_sid.reserve(p_sid->size());
-      roi_dist.reserve(p_dist->size());
+    // Frame budget: choose this frame's degradation level from the incoming point count
+    frame_budget.beginFrame(f.sid.size());
+    const bool skip_ui_points = frame_budget.active(FrameBudget::Degradation::UiPoints);
+    const bool cheap_prefilter = frame_budget.active(FrameBudget::Degradation::Prefilter);
+    // Allocation accounting (instrumentation build): charge work below to its stage
+    alloc_stats::ScopedStage alloc_scope(alloc_stats::Stage::Publish);
+    // On-demand trace capture (/api/v1/debug/trace)
+    trace::Scope frame_span("frame", "seq", f.seq);
 
-      for (size_t i = 0; i < p_xy->size(); i += 2) {
-        if (i + 1 < p_xy->size()) {
-          core::Point2D point((*p_xy)[i], (*p_xy)[i + 1]);
-          if (appcfg.world_mask.allows(point)) {
-            roi_xy.push_back((*p_xy)[i]);
-            roi_xy.push_back((*p_xy)[i + 1]);
-            roi_sid.push_back((*p_sid)[i / 2]);
-            roi_dist.push_back((*p_dist)[i / 2]);
-          }
-        }
-      }
+    // Use the snapshot the frame was ingested with (ROI / scan-stage prefilter already
+    // applied under it); fall back to the latest one. No locks on this thread.
+    const auto params = f.params ? f.params : detectionParams.load();
 
-      p_xy = &roi_xy;
-      p_sid = &roi_sid;
-      p_dist = &roi_dist;
+    // Raw points for WebUI / sinks, optionally at a coarser voxel resolution
+    const std::vector<float>* pub_xy = &f.xy;
+    const std::vector<uint8_t>* pub_sid = &f.sid;
+    if (params->voxel.publish_resolution > 0.0f) {
+      publish_downsampler.apply(f.xy, f.sid, f.dist, params->voxel.publish_resolution, publish_frame);
+      pub_xy = &publish_frame.xy;
+      pub_sid = &publish_frame.sid;
     }
+    frame_budget.mark(FrameBudget::Stage::Publish);
 
-    // Push filtered points to WebUI
-    ws->pushFilteredLite(f.t_ns, f.seq, *p_xy, *p_sid);
+    // Push raw points to WebUI (unfiltered)
+    alloc_stats::setStage(alloc_stats::Stage::Ui);
+    if (!skip_ui_points) ws->pushRawLite(f.t_ns, f.seq, *pub_xy, *pub_sid);
+    frame_budget.mark(FrameBudget::Stage::Ui);
 
-    // DBSCAN clustering on filtered frame
-    std::vector<Cluster> raw_clusters;
-    try {
-      raw_clusters = dbscan.run(*p_xy, *p_sid, *p_dist, f.t_ns, f.seq);
-    } catch (const std::exception& e) {
-      std::cerr << "[DBSCAN] Error in frame seq=" << f.seq << ": " << e.what() << std::endl;
-    }
+    // Prefilter -> ROI -> voxel -> DBSCAN -> postfilter (stage marks go to the frame budget)
+    DetectionPipeline::Options opt;
+    opt.cheap_prefilter = cheap_prefilter;
+    opt.force_voxel = frame_budget.active(FrameBudget::Degradation::Voxel) ? frame_budget.config().voxel_resolution : 0.0f;
+    opt.budget = &frame_budget;
+    opt.alloc_stages = true;
+    pipeline.run(f, *params, opt);
+    const std::vector<Cluster>& final_clusters = pipeline.clusters().clusters;
 
-    // Apply postfilter to clusters through FilterManager
-    std::vector<Cluster> final_clusters = std::move(raw_clusters);
-    if (filterManager.isPostfilterEnabled()) {
-      try {
-        auto postfilter_result = filterManager.applyPostfilter(final_clusters, *p_xy, *p_sid);
-        final_clusters = std::move(postfilter_result.clusters);
-      } catch (const std::exception& e) {
-        std::cerr << "[Postfilter] Error in frame seq=" << f.seq << ": " << e.what() << std::endl;
-        // Continue with unfiltered clusters
-      }
-    }
-    
-    ws->pushClustersLite(f.t_ns, f.seq, final_clusters);
-    publisher_manager.publish(f.t_ns, f.seq, final_clusters, f.xy, f.sid);
+    // Push filtered points and clusters to WebUI
+    alloc_stats::setStage(alloc_stats::Stage::Ui);
+    if (!skip_ui_points) ws->pushFilteredLite(f.t_ns, f.seq, pipeline.xy(), pipeline.sid());
+    ws->pushClustersLite(f.t_ns, f.seq, params->version, pipeline.clusters());
+    frame_budget.mark(FrameBudget::Stage::Ui);
+    alloc_stats::setStage(alloc_stats::Stage::Publish);
+    // Sink workers encode/send asynchronously from a pooled snapshot
+    // ("raw_sink_rate" degradation: raw points only every N-th frame)
+    const bool raw_to_sinks = !frame_budget.active(FrameBudget::Degradation::RawSinkRate) ||
+                              f.seq % static_cast<uint32_t>(frame_budget.config().raw_sink_divisor) == 0;
+    publisher_manager.publish(f.t_ns, f.seq, params->version, final_clusters, *pub_xy, *pub_sid, raw_to_sinks);
+    frame_budget.mark(FrameBudget::Stage::Publish);
+    // Shadow candidate: copy into its mailbox (skipped while it is still busy)
+    if (shadow.active()) shadow.submit(f, params, pipeline, opt);
+    frame_budget.endFrame();
+    alloc_stats::endFrame();
+    frame_span.end();
+    trace::endFrame();
   });
 
   // Start the CrowCpp application with signal checking
@@ -288,6 +294,9 @@ int main(int argc, char** argv) {
     std::cout << "[DEBUG-CRITICAL] FORCED re-configuration - host='" << saved_host << "' port=" << saved_port << std::endl;
   }
   
+  // Crow's I/O threads inherit CPU affinity and scheduling policy from the thread that starts them
+  realtime::applyThreadProfile(realtime::ThreadRole::Io);
+
   // Use concurrent mode to allow signal checking
   app.multithreaded();
   std::cout << "[DEBUG-CRITICAL] About to start async server..." << std::endl;
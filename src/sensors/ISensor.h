@@ -14,13 +14,21 @@ struct RawScan {
     std::string sensor_id{""};
 };
 
+// ドライバが報告する接続状態
+enum class SensorLinkState : uint8_t { Connecting, Streaming, Failed };
+
 class ISensor {
 public:
     using Callback = std::function<void(const RawScan&)>;
+    using StateCallback = std::function<void(SensorLinkState)>;
     virtual ~ISensor() = default;
     virtual bool start(const SensorConfig& cfg) = 0;
     virtual void stop() = 0;
     virtual void subscribe(Callback cb) = 0;
     virtual bool applySkipStep(int) { return false; }
     virtual bool applyMode(const std::string&) { return false; }
+    // start() が接続を待たずに戻るドライバは true を返し、接続状態の変化を
+    // StateCallback で通知する（停止中に設定される）。既定では start() の成功 = 受信中
+    virtual bool reportsLinkState() const { return false; }
+    virtual void setStateCallback(StateCallback) {}
 };
\ No newline at end of file
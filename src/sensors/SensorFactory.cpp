@@ -1,10 +1,19 @@
 #include "SensorFactory.h"
 #include "sensors/hokuyo/HokuyoSensorUrg.h"
+#ifdef HOKUYO_SCIP_REACTOR
+#include "sensors/hokuyo/HokuyoSensorScip.h"
+#endif
 
 std::unique_ptr<ISensor> create_sensor(const SensorConfig& cfg) {
     if (cfg.type == "hokuyo_urg_eth") {
         return std::make_unique<HokuyoSensorUrg>();
     }
+#ifdef HOKUYO_SCIP_REACTOR
+    // 全センサーで epoll スレッド 1 本を共有する SCIP ドライバ
+    if (cfg.type == "hokuyo_urg_eth_epoll") {
+        return std::make_unique<HokuyoSensorScip>();
+    }
+#endif
     // 他のタイプはここに追加
     return nullptr;
 }
\ No newline at end of file
@@ -0,0 +1,454 @@
+#include "HokuyoSensorScip.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    using clock_mono = ScipReactor::clock;
+
+    constexpr int kConnectTimeoutMs   = 2000;
+    constexpr int kHandshakeTimeoutMs = 2000;
+    constexpr int kBackoffMinMs       = 200;
+    constexpr int kBackoffMaxMs       = 5000;
+    constexpr int kMaxSkipScans       = 9;     // HokuyoSensorUrg と同じ上限
+    constexpr size_t kReadChunk       = 4096;
+
+    // SCIP の 6bit エンコーディング（各文字 - 0x30）
+    inline uint32_t decode3(const char* p) {
+        return (static_cast<uint32_t>(p[0] - 0x30) << 12) |
+               (static_cast<uint32_t>(p[1] - 0x30) << 6) |
+                static_cast<uint32_t>(p[2] - 0x30);
+    }
+
+    inline uint16_t clamp16(uint32_t v) {
+        return static_cast<uint16_t>(std::min<uint32_t>(v, 65535u));
+    }
+
+    int jitterMs(int base_ms) {
+        // 複数センサーの再接続が同じ瞬間に揃わないよう ±20% 揺らす
+        thread_local std::minstd_rand rng{std::random_device{}()};
+        std::uniform_int_distribution<int> d(-base_ms / 5, base_ms / 5);
+        return base_ms + d(rng);
+    }
+}
+
+HokuyoSensorScip::~HokuyoSensorScip() {
+    stop();
+}
+
+bool HokuyoSensorScip::start(const SensorConfig& cfg) {
+    if (running_) return true;
+    cfg_ = cfg;
+    scan_.sensor_id = cfg_.id;
+    // 名前解決は呼び出し側（ライフサイクルスレッド）で一度だけ行う。
+    // getaddrinfo は DNS 待ちでブロックし得るので、共有のリアクタスレッドでは呼ばない
+    if (!resolve()) return false;
+    reactor_ = &ScipReactor::instance();
+    running_ = true;
+    if (!reactor_->add(this)) {
+        running_ = false;
+        return false;
+    }
+    return true;
+}
+
+bool HokuyoSensorScip::resolve() {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    const std::string port = std::to_string(cfg_.port);
+    const int rc = ::getaddrinfo(cfg_.host.c_str(), port.c_str(), &hints, &res);
+    if (rc != 0 || !res) {
+        std::cerr << "[HokuyoSensorScip] " << cfg_.id << ": cannot resolve " << cfg_.host << ": "
+                  << (rc != 0 ? ::gai_strerror(rc) : "no address") << std::endl;
+        if (res) ::freeaddrinfo(res);
+        return false;
+    }
+    std::memcpy(&addr_, res->ai_addr, res->ai_addrlen);
+    addr_len_ = static_cast<socklen_t>(res->ai_addrlen);
+    ::freeaddrinfo(res);
+    return true;
+}
+
+void HokuyoSensorScip::stop() {
+    if (!running_.exchange(false)) return;
+    // リアクタが onDetach を呼び終えるまで待つ（以降コールバックは来ない）
+    reactor_->remove(this);
+}
+
+void HokuyoSensorScip::subscribe(Callback cb) {
+    std::lock_guard<std::mutex> lk(cb_mu_);
+    cb_ = std::move(cb);
+}
+
+void HokuyoSensorScip::setStateCallback(StateCallback cb) {
+    std::lock_guard<std::mutex> lk(cb_mu_);
+    state_cb_ = std::move(cb);
+}
+
+// ---- reactor thread ----
+
+void HokuyoSensorScip::report(SensorLinkState s) {
+    if (reported_ == static_cast<int>(s)) return;
+    reported_ = static_cast<int>(s);
+    std::lock_guard<std::mutex> lk(cb_mu_);
+    if (state_cb_) state_cb_(s);
+}
+
+void HokuyoSensorScip::onAttach(ScipReactor&) {
+    backoff_ms_ = 0;
+    fail_count_ = 0;
+    reported_ = -1;
+    connectNow();
+}
+
+void HokuyoSensorScip::onDetach() {
+    closeSocket();
+    state_ = State::Idle;
+    deadline_ = clock_mono::time_point::max();
+    std::cout << "[HokuyoSensorScip] " << cfg_.id << ": stopped" << std::endl;
+}
+
+void HokuyoSensorScip::connectNow() {
+    closeSocket();
+    std::cout << "[HokuyoSensorScip] " << cfg_.id << ": connecting " << cfg_.host << ":" << cfg_.port << std::endl;
+    report(SensorLinkState::Connecting);
+
+    // アドレスは start() で解決済み（再接続でも同じアドレスを使う。変えるには再起動/再設定）
+    fd_ = ::socket(addr_.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+        fail("socket failed");
+        return;
+    }
+    int one = 1;
+    ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    const int rc = ::connect(fd_, reinterpret_cast<const sockaddr*>(&addr_), addr_len_);
+    if (rc < 0 && errno != EINPROGRESS) {
+        fail("connect failed");
+        return;
+    }
+    if (!reactor_->watch(this, fd_, EPOLLOUT)) {
+        fail("watch failed");
+        return;
+    }
+    state_ = State::Connecting;
+    deadline_ = clock_mono::now() + std::chrono::milliseconds(kConnectTimeoutMs);
+}
+
+void HokuyoSensorScip::closeSocket() {
+    if (fd_ >= 0) {
+        if (state_ == State::Handshake || state_ == State::Streaming) {
+            // best-effort: 計測を止めてから切断
+            ::send(fd_, "QT\n", 3, MSG_DONTWAIT | MSG_NOSIGNAL);
+        }
+        reactor_->unwatch(fd_);
+        ::close(fd_);
+        fd_ = -1;
+    }
+    rx_.clear();
+    tx_.clear();
+    want_out_ = false;
+    block_ = Block::None;
+    block_line_ = 0;
+}
+
+void HokuyoSensorScip::fail(const char* what) {
+    closeSocket();
+    state_ = State::Idle;
+    report(SensorLinkState::Failed);
+    backoff_ms_ = backoff_ms_ == 0 ? kBackoffMinMs : std::min(backoff_ms_ * 2, kBackoffMaxMs);
+    const int delay = jitterMs(backoff_ms_);
+    std::cerr << "[HokuyoSensorScip] " << cfg_.id << ": " << what
+              << " - reconnecting in " << delay << "ms" << std::endl;
+    deadline_ = clock_mono::now() + std::chrono::milliseconds(delay);
+}
+
+void HokuyoSensorScip::onTimer(clock_mono::time_point) {
+    switch (state_) {
+        case State::Idle:       connectNow(); break;
+        case State::Connecting: fail("connect timeout"); break;
+        case State::Handshake:  fail("handshake timeout"); break;
+        case State::Streaming:  fail("no data"); break;
+    }
+}
+
+void HokuyoSensorScip::onEvents(uint32_t events) {
+    if (state_ == State::Connecting) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        ::getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+            fail("connect failed");
+            return;
+        }
+        std::cout << "[HokuyoSensorScip] " << cfg_.id << ": connected" << std::endl;
+        reactor_->modify(this, fd_, EPOLLIN);
+        state_ = State::Handshake;
+        deadline_ = clock_mono::now() + std::chrono::milliseconds(kHandshakeTimeoutMs);
+        // 前回の計測が残っていても QT で止めてから仕様を取得する
+        if (!sendCommand("QT\nPP\n")) fail("send failed");
+        return;
+    }
+
+    if (events & EPOLLOUT) {
+        if (!flushTx()) { fail("send failed"); return; }
+    }
+    if (events & EPOLLIN) {
+        if (!readAvailable()) { fail("connection closed"); return; }
+        processLines();
+        return;
+    }
+    if (events & (EPOLLERR | EPOLLHUP)) fail("socket error");
+}
+
+bool HokuyoSensorScip::sendCommand(const std::string& cmd) {
+    tx_ += cmd;
+    return flushTx();
+}
+
+bool HokuyoSensorScip::flushTx() {
+    while (!tx_.empty()) {
+        const ssize_t n = ::send(fd_, tx_.data(), tx_.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) {
+            tx_.erase(0, static_cast<size_t>(n));
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!want_out_) {
+                reactor_->modify(this, fd_, EPOLLIN | EPOLLOUT);
+                want_out_ = true;
+            }
+            return true;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        return false;
+    }
+    if (want_out_) {
+        reactor_->modify(this, fd_, EPOLLIN);
+        want_out_ = false;
+    }
+    return true;
+}
+
+bool HokuyoSensorScip::readAvailable() {
+    for (;;) {
+        const size_t old = rx_.size();
+        rx_.resize(old + kReadChunk);
+        const ssize_t n = ::recv(fd_, rx_.data() + old, kReadChunk, MSG_DONTWAIT);
+        if (n > 0) {
+            rx_.resize(old + static_cast<size_t>(n));
+            if (static_cast<size_t>(n) < kReadChunk) return true;
+            continue;
+        }
+        rx_.resize(old);
+        if (n == 0) return false;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+        if (errno == EINTR) continue;
+        return false;
+    }
+}
+
+void HokuyoSensorScip::processLines() {
+    size_t pos = 0;
+    while (fd_ >= 0) {
+        const size_t nl = rx_.find('\n', pos);
+        if (nl == std::string::npos) break;
+        std::string_view line(rx_.data() + pos, nl - pos);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        pos = nl + 1;
+        if (line.empty()) finishBlock();
+        else handleLine(line);
+    }
+    // fail() で rx_ がクリアされた場合は何もしない
+    if (fd_ >= 0 && pos > 0) rx_.erase(0, pos);
+}
+
+bool HokuyoSensorScip::checksumOk(std::string_view line) const {
+    if (cfg_.ignore_checksum_error) return true;
+    if (line.size() < 2) return false;
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < line.size(); ++i) sum += static_cast<unsigned char>(line[i]);
+    return static_cast<char>((sum & 0x3F) + 0x30) == line.back();
+}
+
+void HokuyoSensorScip::handleLine(std::string_view line) {
+    const int idx = block_line_++;
+    if (idx == 0) {
+        // エコーバック行でブロック種別を決める
+        block_bad_ = false;
+        if (line.starts_with("QT")) block_ = Block::Quit;
+        else if (line.starts_with("PP")) block_ = Block::Params;
+        else if (line.starts_with("MD") || line.starts_with("ME")) {
+            block_ = Block::Scan;
+            block_ts_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock_mono::now().time_since_epoch()).count();
+            data_.clear();
+        }
+        else block_ = Block::Other;
+        return;
+    }
+    if (idx == 1) {
+        if (line.size() < 2) { block_bad_ = true; return; }
+        status_[0] = line[0];
+        status_[1] = line[1];
+        if (line.size() >= 3 && !checksumOk(line)) block_bad_ = true;
+        return;
+    }
+
+    switch (block_) {
+        case Block::Params:
+            parseParameter(line);
+            break;
+        case Block::Scan:
+            // idx 2 はタイムスタンプ、以降がデータ行（末尾 1 文字はチェックサム）
+            if (!checksumOk(line)) { block_bad_ = true; break; }
+            if (idx >= 3) data_.append(line.data(), line.size() - 1);
+            break;
+        default:
+            break;
+    }
+}
+
+void HokuyoSensorScip::parseParameter(std::string_view line) {
+    // "KEY:value;checksum"
+    const size_t colon = line.find(':');
+    const size_t semi = line.rfind(';');
+    if (colon == std::string_view::npos || semi == std::string_view::npos || semi <= colon) return;
+    const std::string_view key = line.substr(0, colon);
+    const std::string_view val = line.substr(colon + 1, semi - colon - 1);
+    int v = 0;
+    if (std::from_chars(val.data(), val.data() + val.size(), v).ec != std::errc{}) return;
+    if (key == "AMIN") amin_ = v;
+    else if (key == "AMAX") amax_ = v;
+    else if (key == "ARES") ares_ = v;
+    else if (key == "AFRT") afrt_ = v;
+    else if (key == "SCAN") scan_rpm_ = v;
+}
+
+void HokuyoSensorScip::finishBlock() {
+    const Block kind = block_;
+    const int lines = block_line_;
+    block_ = Block::None;
+    block_line_ = 0;
+    if (lines == 0) return;
+
+    switch (kind) {
+        case Block::Params:
+            if (block_bad_ || status_[0] != '0' || status_[1] != '0' || ares_ <= 0 || amax_ <= amin_) {
+                fail("PP failed");
+                return;
+            }
+            startMeasurement();
+            break;
+
+        case Block::Scan:
+            if (status_[0] == '0' && status_[1] == '0') {
+                // 計測開始の応答。最初のスキャンを待つ
+                state_ = State::Streaming;
+                deadline_ = clock_mono::now() + std::chrono::milliseconds(rx_timeout_ms_);
+                break;
+            }
+            if (status_[0] != '9' || status_[1] != '9') {
+                fail("measurement error status");
+                return;
+            }
+            // QT 前の計測の残りは読み捨てる
+            if (state_ != State::Streaming) break;
+            if (block_bad_ || !decodeScan()) {
+                // 3) 受信失敗のリトライと再接続（HokuyoSensorUrg と同じ 3 回）
+                if (++fail_count_ >= 3) fail("checksum/decode failed 3 times");
+                return;
+            }
+            fail_count_ = 0;
+            backoff_ms_ = 0;
+            state_ = State::Streaming;
+            report(SensorLinkState::Streaming);
+            deadline_ = clock_mono::now() + std::chrono::milliseconds(rx_timeout_ms_);
+            {
+                std::lock_guard<std::mutex> lk(cb_mu_);
+                if (cb_) cb_(scan_);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void HokuyoSensorScip::startMeasurement() {
+    // 1) 角度マスクを step に変換（urg_deg2step と同じ丸め・クランプ）
+    auto deg2step = [&](double deg) {
+        int step = static_cast<int>(std::floor(deg * ares_ / 360.0 + 0.5)) + afrt_;
+        return std::clamp(step, amin_, amax_);
+    };
+    int first = deg2step(cfg_.mask.angle.min_deg);
+    int last  = deg2step(cfg_.mask.angle.max_deg);
+    if (first > last) std::swap(first, last);
+    const int cluster = std::clamp(cfg_.skip_step, 1, 99);
+
+    const double msec = scan_rpm_ > 0 ? 60000.0 / scan_rpm_ : 25.0;
+    int skip_scan = static_cast<int>(cfg_.interval / msec);
+    if (skip_scan < 0 || skip_scan > kMaxSkipScans) {
+        std::cerr << "[HokuyoSensorScip] invalid interval: " << cfg_.interval << std::endl
+                  << "    must be between 0 and " << (int)(kMaxSkipScans * msec) << "[ms] for this sensor" << std::endl;
+    }
+    skip_scan = std::clamp(skip_scan, 0, kMaxSkipScans);
+    // 想定周期の 4 倍（最低 1 秒）受信が途切れたら再接続
+    rx_timeout_ms_ = std::max(1000, static_cast<int>(4 * (skip_scan + 1) * msec));
+
+    first_step_ = first;
+    last_step_ = last;
+    cluster_ = cluster;
+    intensity_ = (cfg_.mode == "ME");
+
+    scan_.start_angle = (first - afrt_) * 360.0 / ares_;
+    scan_.angle_res = cluster * 360.0 / ares_;
+    const size_t expected = static_cast<size_t>((last - first) / cluster + 1);
+    scan_.ranges_mm.reserve(expected);
+    if (intensity_) scan_.intensities.reserve(expected);
+    data_.reserve(expected * (intensity_ ? 6 : 3));
+
+    // "MD"/"ME" + start(4) end(4) cluster(2) skip(1) scans(2: 00 = 無限)
+    char cmd[32];
+    std::snprintf(cmd, sizeof(cmd), "%s%04d%04d%02d%01d%02d\n",
+                  intensity_ ? "ME" : "MD", first, last, cluster, skip_scan, 0);
+    if (!sendCommand(cmd)) {
+        fail("send failed");
+        return;
+    }
+    deadline_ = clock_mono::now() + std::chrono::milliseconds(kHandshakeTimeoutMs);
+}
+
+bool HokuyoSensorScip::decodeScan() {
+    const size_t stride = intensity_ ? 6 : 3;
+    const size_t expected = static_cast<size_t>((last_step_ - first_step_) / cluster_ + 1);
+    if (data_.size() != expected * stride) return false;
+
+    scan_.monotonic_ts_ns = block_ts_ns_;
+    scan_.ranges_mm.resize(expected);
+    if (intensity_) scan_.intensities.resize(expected);
+    else scan_.intensities.clear();
+
+    const char* p = data_.data();
+    for (size_t i = 0; i < expected; ++i, p += stride) {
+        scan_.ranges_mm[i] = clamp16(decode3(p));
+        if (intensity_) scan_.intensities[i] = clamp16(decode3(p + 3));
+    }
+    return true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "sensors/ISensor.h"
+#include "ScipReactor.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+
+// SCIP 2.0 を直接話す URG ドライバ（type: "hokuyo_urg_eth_epoll", Linux のみ）。
+// 受信は共有の ScipReactor（epoll スレッド 1 本）で行い、センサーごとの
+// スレッドやブロッキング I/O を持たない。start() は名前解決と登録だけして戻り、
+// 接続・再接続はリアクタ上でバックオフ付きに行う。
+// コールバックはリアクタスレッドから呼ばれるため、重い処理をしないこと。
+class HokuyoSensorScip final : public ISensor, private ScipReactor::Client {
+public:
+    HokuyoSensorScip() = default;
+    ~HokuyoSensorScip() override;
+
+    bool start(const SensorConfig& cfg) override;
+    void stop() override;
+    void subscribe(Callback cb) override;
+    bool reportsLinkState() const override { return true; }
+    void setStateCallback(StateCallback cb) override;
+
+private:
+    enum class State { Idle, Connecting, Handshake, Streaming };
+    enum class Block { None, Quit, Params, Scan, Other };
+
+    // ScipReactor::Client (reactor thread)
+    void onAttach(ScipReactor& reactor) override;
+    void onEvents(uint32_t events) override;
+    void onTimer(ScipReactor::clock::time_point now) override;
+    ScipReactor::clock::time_point deadline() const override { return deadline_; }
+    void onDetach() override;
+
+    bool resolve();
+    void connectNow();
+    void fail(const char* what);
+    void report(SensorLinkState s);
+    void closeSocket();
+    bool sendCommand(const std::string& cmd);
+    bool flushTx();
+    bool readAvailable();
+    void processLines();
+    void handleLine(std::string_view line);
+    void finishBlock();
+    void parseParameter(std::string_view line);
+    void startMeasurement();
+    bool decodeScan();
+    bool checksumOk(std::string_view line) const;
+
+    SensorConfig cfg_{};
+    std::atomic<bool> running_{false};
+    ScipReactor* reactor_{nullptr};
+    sockaddr_storage addr_{};         // start() で解決したセンサーのアドレス
+    socklen_t addr_len_{0};
+
+    std::mutex cb_mu_;
+    Callback cb_{};
+    StateCallback state_cb_{};
+
+    // ---- reactor thread only ----
+    State state_{State::Idle};
+    int reported_{-1};                // 最後に通知した SensorLinkState（-1 = 未通知）
+    int fd_{-1};
+    ScipReactor::clock::time_point deadline_{ScipReactor::clock::time_point::max()};
+    int backoff_ms_{0};
+    int fail_count_{0};
+    int rx_timeout_ms_{1000};
+    bool want_out_{false};
+
+    std::string rx_;                  // 未処理の受信バイト
+    std::string tx_;                  // 未送信のコマンド
+    std::string data_;                // スキャンのエンコード済みデータ（チェックサム除去後）
+
+    // 空行で終わる 1 応答ブロックの解析状態（行単位で逐次処理）
+    Block block_{Block::None};
+    int block_line_{0};
+    char status_[2]{};
+    bool block_bad_{false};
+    uint64_t block_ts_ns_{0};
+
+    // PP で得たセンサー仕様
+    int amin_{0}, amax_{0}, ares_{1440}, afrt_{0}, scan_rpm_{2400};
+    int first_step_{0}, last_step_{0}, cluster_{1};
+    bool intensity_{false};
+
+    RawScan scan_;                    // 接続ごとに使い回す
+};
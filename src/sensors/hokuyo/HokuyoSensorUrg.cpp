@@ -1,4 +1,5 @@
 #include "HokuyoSensorUrg.h"
+#include "core/realtime.h"
 #include <chrono>
 #include <vector>
 #include <algorithm>
@@ -98,6 +99,7 @@ urg_measurement_type_t HokuyoSensorUrg::toUrgMode(const std::string& mode) {
 }
 
 void HokuyoSensorUrg::rxLoop(urg_measurement_type_t mtype) {
+    realtime::applyThreadProfile(realtime::ThreadRole::SensorRx);
     auto start_measurement = [&]() {
         double msec = urg_scan_usec(&urg_) / 1000.0;
         int skip_scan = cfg_.interval/msec;
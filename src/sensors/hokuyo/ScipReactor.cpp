@@ -0,0 +1,178 @@
+#include "ScipReactor.h"
+#include "core/realtime.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+ScipReactor& ScipReactor::instance() {
+    static ScipReactor reactor;
+    return reactor;
+}
+
+ScipReactor::~ScipReactor() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    if (th_.joinable()) {
+        wake();
+        th_.join();
+    }
+    if (wakefd_ >= 0) ::close(wakefd_);
+    if (epfd_ >= 0) ::close(epfd_);
+}
+
+bool ScipReactor::ensureStarted() {
+    // mu_ held by the caller
+    if (th_.joinable()) return true;
+    epfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epfd_ < 0) {
+        std::cerr << "[ScipReactor] epoll_create1 failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    wakefd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakefd_ < 0) {
+        std::cerr << "[ScipReactor] eventfd failed: " << std::strerror(errno) << std::endl;
+        ::close(epfd_);
+        epfd_ = -1;
+        return false;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr; // nullptr = wake fd
+    ::epoll_ctl(epfd_, EPOLL_CTL_ADD, wakefd_, &ev);
+    th_ = std::thread([this] { loop(); });
+    std::cout << "[ScipReactor] started" << std::endl;
+    return true;
+}
+
+void ScipReactor::wake() {
+    const uint64_t one = 1;
+    [[maybe_unused]] ssize_t n = ::write(wakefd_, &one, sizeof(one));
+}
+
+bool ScipReactor::add(Client* client) {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (!ensureStarted()) return false;
+        commands_.push_back({client, true});
+        ++submitted_;
+    }
+    wake();
+    return true;
+}
+
+void ScipReactor::remove(Client* client) {
+    std::unique_lock<std::mutex> lk(mu_);
+    if (!th_.joinable()) return;
+    commands_.push_back({client, false});
+    const uint64_t ticket = ++submitted_;
+    lk.unlock();
+    wake();
+    lk.lock();
+    cv_.wait(lk, [&] { return applied_ >= ticket || stop_; });
+}
+
+bool ScipReactor::watch(Client* client, int fd, uint32_t events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.ptr = client;
+    if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        std::cerr << "[ScipReactor] epoll_ctl(ADD) failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ScipReactor::modify(Client* client, int fd, uint32_t events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.ptr = client;
+    ::epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void ScipReactor::unwatch(int fd) {
+    if (fd >= 0) ::epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void ScipReactor::drainCommands() {
+    std::deque<Command> pending;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        pending.swap(commands_);
+    }
+    for (const auto& cmd : pending) {
+        if (cmd.add) {
+            clients_.push_back(cmd.client);
+            cmd.client->onAttach(*this);
+        } else {
+            auto it = std::find(clients_.begin(), clients_.end(), cmd.client);
+            if (it != clients_.end()) {
+                clients_.erase(it);
+                cmd.client->onDetach();
+            }
+        }
+    }
+    if (!pending.empty()) {
+        std::lock_guard<std::mutex> lk(mu_);
+        applied_ += pending.size();
+        cv_.notify_all();
+    }
+}
+
+void ScipReactor::loop() {
+    realtime::applyThreadProfile(realtime::ThreadRole::SensorRx);
+    constexpr int kMaxEvents = 64;
+    epoll_event events[kMaxEvents];
+
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            if (stop_) break;
+        }
+        drainCommands();
+
+        // 次のタイマ期限まで待つ（接続タイムアウト・再接続・受信監視）
+        auto next = clock::time_point::max();
+        for (auto* c : clients_) next = std::min(next, c->deadline());
+        int timeout_ms = -1;
+        if (next != clock::time_point::max()) {
+            const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - clock::now()).count();
+            timeout_ms = static_cast<int>(std::clamp<long long>(wait + 1, 0, 1000));
+        }
+
+        const int n = ::epoll_wait(epfd_, events, kMaxEvents, timeout_ms);
+        if (n < 0 && errno != EINTR) {
+            std::cerr << "[ScipReactor] epoll_wait failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            auto* c = static_cast<Client*>(events[i].data.ptr);
+            if (!c) {
+                uint64_t v;
+                while (::read(wakefd_, &v, sizeof(v)) > 0) {}
+                continue;
+            }
+            // 同じバッチ内で remove 済みのクライアントは無視
+            if (std::find(clients_.begin(), clients_.end(), c) == clients_.end()) continue;
+            c->onEvents(events[i].events);
+        }
+
+        const auto now = clock::now();
+        for (auto* c : clients_) {
+            if (c->deadline() <= now) c->onTimer(now);
+        }
+    }
+
+    for (auto* c : clients_) c->onDetach();
+    clients_.clear();
+    std::lock_guard<std::mutex> lk(mu_);
+    applied_ = submitted_;
+    cv_.notify_all();
+}
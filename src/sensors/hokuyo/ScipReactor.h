@@ -0,0 +1,66 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 全 SCIP 接続を 1 本の epoll スレッドで回すリアクタ（Linux のみ）。
+// センサーごとにスレッドを持たず、ソケットはすべて non-blocking で扱う。
+// クライアントのコールバックはすべてリアクタスレッド上で呼ばれる。
+class ScipReactor {
+public:
+    using clock = std::chrono::steady_clock;
+
+    class Client {
+    public:
+        virtual ~Client() = default;
+        // Reactor thread only
+        virtual void onAttach(ScipReactor& reactor) = 0;   // registered: start connecting
+        virtual void onEvents(uint32_t events) = 0;        // epoll events for the watched fd
+        virtual void onTimer(clock::time_point now) = 0;   // deadline() has passed
+        virtual clock::time_point deadline() const = 0;    // time_point::max() = none
+        virtual void onDetach() = 0;                       // unregistered: close the socket
+    };
+
+    static ScipReactor& instance();
+    ~ScipReactor();
+    ScipReactor(const ScipReactor&) = delete;
+    ScipReactor& operator=(const ScipReactor&) = delete;
+
+    // Thread-safe. add() starts the reactor thread on first use.
+    bool add(Client* client);
+    // Blocks until the reactor has detached the client (no callbacks afterwards).
+    void remove(Client* client);
+
+    // Reactor thread only: fd interest of a client
+    bool watch(Client* client, int fd, uint32_t events);
+    void modify(Client* client, int fd, uint32_t events);
+    void unwatch(int fd);
+
+private:
+    ScipReactor() = default;
+    bool ensureStarted();
+    void wake();
+    void loop();
+    void drainCommands();
+
+    struct Command {
+        Client* client;
+        bool add;
+    };
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<Command> commands_;
+    uint64_t applied_{0};      // commands processed by the reactor thread
+    uint64_t submitted_{0};
+    bool stop_{false};
+
+    int epfd_{-1};
+    int wakefd_{-1};
+    std::thread th_;
+    std::vector<Client*> clients_;   // reactor thread only
+};
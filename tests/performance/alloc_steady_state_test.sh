@@ -0,0 +1,166 @@
+#!/bin/bash
+# 定常状態のフレームがヒープ確保をしないことの検証（Linux のみ）
+#
+# -DHOKUYO_ALLOC_STATS=ON でビルドした hokuyo_hub を疑似 URG（fake_scip_sensor.py）につなぎ、
+# ウォームアップ後の N フレームで ingest / prefilter / voxel / dbscan / postfilter / publish の
+# 各ステージの確保回数が 0 であることを /api/v1/metrics の alloc_stats で確認する。
+# ui（Crow の send_text が接続ごとにペイロードを値で受け取ってキューする）と sinks（別スレッド）は対象外。
+#
+#   tests/performance/alloc_steady_state_test.sh [frames]
+#   HOKUYO_HUB_BIN=/path/to/hokuyo_hub で既存の計測ビルドを使う（ビルドを省略）
+
+set -u
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_ROOT="$(cd "$SCRIPT_DIR/../.." && pwd)"
+FRAMES="${1:-300}"
+WARMUP_FRAMES=150
+STAGES="ingest prefilter voxel dbscan postfilter publish"
+BUILD_DIR="${BUILD_DIR:-$PROJECT_ROOT/build/alloc-stats}"
+WORK_DIR="$(mktemp -d /tmp/hokuyo_hub_alloc_test.XXXXXX)"
+TEST_LOG="$WORK_DIR/test.log"
+
+echo "=== HokuyoHub Steady-State Allocation Test ===" | tee "$TEST_LOG"
+echo "Timestamp: $(date)" | tee -a "$TEST_LOG"
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "SKIP: needs the epoll SCIP driver (hokuyo_urg_eth_epoll, Linux only)" | tee -a "$TEST_LOG"
+    exit 0
+fi
+
+PIDS=()
+cleanup() {
+    for pid in "${PIDS[@]}"; do kill "$pid" 2>/dev/null; done
+    wait 2>/dev/null
+}
+trap cleanup EXIT
+
+fail() {
+    echo "✗ FAIL: $1" | tee -a "$TEST_LOG"
+    echo "Log: $TEST_LOG"
+    exit 1
+}
+
+# 計測ビルド
+HUB_BIN="${HOKUYO_HUB_BIN:-}"
+if [ -z "$HUB_BIN" ]; then
+    echo "Building hokuyo_hub with HOKUYO_ALLOC_STATS=ON in $BUILD_DIR ..." | tee -a "$TEST_LOG"
+    cmake -S "$PROJECT_ROOT" -B "$BUILD_DIR" -DCMAKE_BUILD_TYPE=Release -DHOKUYO_ALLOC_STATS=ON >> "$TEST_LOG" 2>&1 \
+        || fail "cmake configure"
+    cmake --build "$BUILD_DIR" --target hokuyo_hub -j"$(nproc)" >> "$TEST_LOG" 2>&1 || fail "build"
+    HUB_BIN="$BUILD_DIR/hokuyo_hub"
+fi
+[ -x "$HUB_BIN" ] || fail "hokuyo_hub binary not found: $HUB_BIN"
+
+free_port() {
+    python3 -c 'import socket; s=socket.socket(); s.bind(("127.0.0.1", 0)); print(s.getsockname()[1]); s.close()'
+}
+SENSOR_PORT=$(free_port)
+HTTP_PORT=$(free_port)
+NNG_PORT=$(free_port)
+
+# 疑似センサー（4 パターンのスキャンを 40Hz で繰り返す）
+python3 "$SCRIPT_DIR/fake_scip_sensor.py" --port "$SENSOR_PORT" --rate 40 --patterns 4 >> "$TEST_LOG" 2>&1 &
+PIDS+=($!)
+
+# voxel と raw 送信を有効にして全ステージを通す
+cat > "$WORK_DIR/alloc_test.yaml" <<EOF
+sensors:
+  - id: fake1
+    type: hokuyo_urg_eth_epoll
+    name: fake-urg
+    endpoint: 127.0.0.1:$SENSOR_PORT
+    enabled: true
+    mode: MD
+    interval: 0
+    skip_step: 1
+    ignore_checkSumError: 0
+    pose: { tx: 0, ty: 0, theta: 0 }
+    mask:
+      angle: { min: -135, max: 135 }
+      range: { near: 0.05, far: 15 }
+dbscan:
+  eps_norm: 5
+  minPts: 5
+prefilter:
+  enabled: true
+postfilter:
+  enabled: true
+voxel:
+  enabled: true
+  resolution: 0.02
+ui:
+  listen: 127.0.0.1:$HTTP_PORT
+sinks:
+  - type: nng
+    url: tcp://127.0.0.1:$NNG_PORT
+    encoding: msgpack
+    cluster_topic: /hokuyohub/cluster
+    raw_topic: /hokuyohub/raw
+    rate_limit: 0
+    send_clusters: true
+    send_raw: true
+EOF
+
+"$HUB_BIN" --config "$WORK_DIR/alloc_test.yaml" >> "$TEST_LOG" 2>&1 &
+PIDS+=($!)
+
+METRICS_URL="http://127.0.0.1:$HTTP_PORT/api/v1/metrics"
+SENSORS_URL="http://127.0.0.1:$HTTP_PORT/api/v1/sensors"
+
+# センサーが running になるまで待つ
+echo "Waiting for the fake sensor to stream..." | tee -a "$TEST_LOG"
+for _ in $(seq 1 60); do
+    if curl -s "$SENSORS_URL" | grep -q '"state" *: *"running"'; then break; fi
+    sleep 0.5
+done
+curl -s "$SENSORS_URL" | grep -q '"state" *: *"running"' || fail "sensor did not reach the running state"
+
+frames_now() {
+    curl -s "$METRICS_URL" | python3 -c 'import json,sys; print(int(json.load(sys.stdin)["alloc_stats"].get("frames", 0)))' 2>/dev/null || echo 0
+}
+
+wait_frames() {
+    local target=$1
+    for _ in $(seq 1 $(( target / 10 + 60 ))); do
+        [ "$(frames_now)" -ge "$target" ] && return 0
+        sleep 0.5
+    done
+    return 1
+}
+
+# ウォームアップ（容量が定常サイズまで育つのを待つ）
+wait_frames "$WARMUP_FRAMES" || fail "no frames processed during warm-up"
+curl -s "$METRICS_URL" > "$WORK_DIR/before.json" || fail "metrics request failed"
+BEFORE=$(python3 -c 'import json,sys; print(int(json.load(open(sys.argv[1]))["alloc_stats"]["frames"]))' "$WORK_DIR/before.json")
+echo "Warm-up done at frame $BEFORE, measuring $FRAMES frames..." | tee -a "$TEST_LOG"
+
+wait_frames $(( BEFORE + FRAMES )) || fail "fewer than $FRAMES frames after warm-up"
+curl -s "$METRICS_URL" > "$WORK_DIR/after.json" || fail "metrics request failed"
+
+# stages.<name>.allocs は最初の endFrame 以降のフレーム平均なので、平均 x フレーム数の差で区間の合計を出す
+python3 - "$WORK_DIR/before.json" "$WORK_DIR/after.json" $STAGES <<'PY' 2>&1 | tee -a "$TEST_LOG"
+import json, sys
+before = json.load(open(sys.argv[1]))["alloc_stats"]
+after = json.load(open(sys.argv[2]))["alloc_stats"]
+if not after.get("enabled"):
+    print("alloc_stats disabled: hokuyo_hub was not built with -DHOKUYO_ALLOC_STATS=ON")
+    sys.exit(1)
+frames = after["frames"] - before["frames"]
+failed = False
+for stage in sys.argv[3:]:
+    total = lambda s: s["stages"][stage]["allocs"] * s["frames"]
+    allocs = round(total(after) - total(before))
+    per_frame = allocs / frames if frames else 0.0
+    mark = "✓" if allocs == 0 else "✗"
+    print(f"{mark} {stage:<11} allocs={allocs} over {frames} frames ({per_frame:.3f}/frame)")
+    failed |= allocs != 0
+sys.exit(1 if failed else 0)
+PY
+RESULT=${PIPESTATUS[0]}
+
+if [ "$RESULT" -ne 0 ]; then
+    fail "steady-state frames allocated (see above)"
+fi
+echo "✓ PASS: no allocations in $STAGES" | tee -a "$TEST_LOG"
+echo "Log: $TEST_LOG"
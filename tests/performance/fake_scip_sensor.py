@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+# SCIP 2.0 を話す疑似 URG（hokuyo_urg_eth_epoll ドライバ用）
+# 同じ数パターンのスキャンを繰り返し送る（点数・クラスタ数が定常になるので確保回数の検証に使える）
+#
+#   fake_scip_sensor.py --port 10940 [--rate 40] [--patterns 4]
+
+import argparse
+import math
+import socket
+import socketserver
+import threading
+import time
+
+AMIN, AMAX, ARES, AFRT, SCAN_RPM = 0, 1080, 1440, 540, 2400
+
+
+def checksum(data: bytes) -> bytes:
+    return bytes([(sum(data) & 0x3F) + 0x30])
+
+
+def encode3(v: int) -> bytes:
+    return bytes([((v >> 12) & 0x3F) + 0x30, ((v >> 6) & 0x3F) + 0x30, (v & 0x3F) + 0x30])
+
+
+def line(data: bytes) -> bytes:
+    return data + checksum(data) + b"\n"
+
+
+def make_scan(pattern: int, first: int, last: int, cluster: int) -> list:
+    # 5 m の壁 + パターンごとに位置の違う人物（円柱）数体
+    people = [(1.5 + 0.4 * k + 0.1 * pattern, -60 + 35 * k + 5 * pattern) for k in range(5)]
+    ranges = []
+    for step in range(first, last + 1, cluster):
+        deg = (step - AFRT) * 360.0 / ARES
+        r = 5.0
+        for dist, center_deg in people:
+            if abs(deg - center_deg) < math.degrees(0.2 / dist):
+                r = min(r, dist)
+        ranges.append(int(r * 1000))
+    return ranges
+
+
+def scan_block(echo: bytes, ranges: list, ts_ms: int) -> bytes:
+    data = b"".join(encode3(v) for v in ranges)
+    out = echo + b"\n" + line(b"99")
+    ts = bytes([((ts_ms >> s) & 0x3F) + 0x30 for s in (18, 12, 6, 0)])
+    out += line(ts)
+    for i in range(0, len(data), 64):
+        out += line(data[i:i + 64])
+    return out + b"\n"
+
+
+class Handler(socketserver.BaseRequestHandler):
+    def handle(self):
+        sock = self.request
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        stop = threading.Event()
+        streamer = None
+        buf = b""
+        try:
+            while True:
+                chunk = sock.recv(4096)
+                if not chunk:
+                    break
+                buf += chunk
+                while b"\n" in buf:
+                    cmd, buf = buf.split(b"\n", 1)
+                    cmd = cmd.rstrip(b"\r")
+                    if cmd.startswith(b"QT"):
+                        stop.set()
+                        if streamer:
+                            streamer.join()
+                        sock.sendall(cmd + b"\n" + line(b"00") + b"\n")
+                    elif cmd.startswith(b"PP"):
+                        params = [b"MODL:FAKE-URG", b"DMIN:20", b"DMAX:30000", b"ARES:%d" % ARES,
+                                  b"AMIN:%d" % AMIN, b"AMAX:%d" % AMAX, b"AFRT:%d" % AFRT, b"SCAN:%d" % SCAN_RPM]
+                        sock.sendall(cmd + b"\n" + line(b"00") + b"".join(line(p + b";") for p in params) + b"\n")
+                    elif cmd.startswith(b"MD") and len(cmd) >= 15:
+                        first, last, cluster = int(cmd[2:6]), int(cmd[6:10]), max(1, int(cmd[10:12]))
+                        sock.sendall(cmd + b"\n" + line(b"00") + b"\n")
+                        stop = threading.Event()
+                        streamer = threading.Thread(target=self.stream, daemon=True,
+                                                    args=(sock, cmd, first, last, cluster, stop))
+                        streamer.start()
+                    else:
+                        sock.sendall(cmd + b"\n" + line(b"0E") + b"\n")
+        except OSError:
+            pass
+        finally:
+            stop.set()
+
+    def stream(self, sock, echo, first, last, cluster, stop):
+        scans = [make_scan(p, first, last, cluster) for p in range(self.server.patterns)]
+        period = 1.0 / self.server.rate
+        t0 = time.monotonic()
+        n = 0
+        while not stop.is_set():
+            ts_ms = int((time.monotonic() - t0) * 1000)
+            try:
+                sock.sendall(scan_block(echo, scans[n % len(scans)], ts_ms))
+            except OSError:
+                return
+            n += 1
+            time.sleep(max(0.0, t0 + n * period - time.monotonic()))
+
+
+class Server(socketserver.ThreadingTCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Fake SCIP 2.0 sensor replaying fixed scans")
+    ap.add_argument("--host", default="127.0.0.1")
+    ap.add_argument("--port", type=int, default=10940)
+    ap.add_argument("--rate", type=float, default=40.0, help="scans per second")
+    ap.add_argument("--patterns", type=int, default=4, help="number of distinct scans to cycle through")
+    args = ap.parse_args()
+    with Server((args.host, args.port), Handler) as srv:
+        srv.rate = args.rate
+        srv.patterns = max(1, args.patterns)
+        print(f"[fake_scip_sensor] listening on {args.host}:{args.port}", flush=True)
+        srv.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,131 @@
+// voxel 有効時のクラスタ点数・センサー別点数・sensor_mask の整合性テスト
+//
+// 複数センサーが重なる人物（点の塊）を、voxel 無効 / voxel 有効 / frame budget の
+// voxel 縮退（force_voxel）の 3 通りで検出し、次を確認する。
+//   - sensor_mask のビット集合 == sensor_counts の sid 集合
+//   - sensor_counts の合計 == point_count
+//   - voxel の有無で point_count と sensor_counts が変わらない（統合前の入力点で数える）
+// tests/unit/voxel_sensor_counts_test.sh からビルド・実行する。
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+#include "core/detection_pipeline.h"
+
+namespace {
+  int g_failures = 0;
+
+  void check(bool ok, const char* what, int cluster) {
+    if (!ok) {
+      std::printf("✗ %s (cluster %d)\n", what, cluster);
+      ++g_failures;
+    }
+  }
+
+  struct Summary {
+    float cx, cy;
+    uint32_t n;
+    uint64_t mask;
+    std::map<int, uint32_t> counts;
+  };
+
+  std::vector<Summary> summarize(const char* label, const ClusterSet& set) {
+    std::vector<Summary> out;
+    for (size_t k = 0; k < set.size(); ++k) {
+      const auto& c = set.clusters[k];
+      Summary s{c.cx, c.cy, c.point_count, c.sensor_mask, {}};
+      uint64_t mask = 0;
+      uint32_t total = 0;
+      for (const auto& sc : set.sensorCounts(k)) {
+        s.counts[sc.sid] = sc.count;
+        if (sc.sid < 64) mask |= uint64_t{1} << sc.sid;
+        total += sc.count;
+      }
+      check(mask == c.sensor_mask, "sensor_mask != sids of sensor_counts", static_cast<int>(k));
+      check(total == c.point_count, "sum of sensor_counts != point_count", static_cast<int>(k));
+      std::printf("  %-8s cluster %zu: n=%u mask=%llu sensors=%zu\n", label, k, c.point_count,
+                  static_cast<unsigned long long>(c.sensor_mask), s.counts.size());
+      out.push_back(std::move(s));
+    }
+    return out;
+  }
+
+  // 重心が最も近いクラスタ同士で点数・センサー別点数を比べる
+  void compare(const std::vector<Summary>& ref, const std::vector<Summary>& got) {
+    check(ref.size() == got.size(), "cluster count differs", -1);
+    for (size_t i = 0; i < ref.size(); ++i) {
+      const Summary* best = nullptr;
+      float best_d = 1e9f;
+      for (const auto& g : got) {
+        const float d = std::hypot(g.cx - ref[i].cx, g.cy - ref[i].cy);
+        if (d < best_d) { best_d = d; best = &g; }
+      }
+      check(best && best_d < 0.2f, "no matching cluster", static_cast<int>(i));
+      if (!best) continue;
+      check(best->n == ref[i].n, "point_count differs from the run without voxel", static_cast<int>(i));
+      check(best->mask == ref[i].mask, "sensor_mask differs from the run without voxel", static_cast<int>(i));
+      check(best->counts == ref[i].counts, "sensor_counts differ from the run without voxel", static_cast<int>(i));
+    }
+  }
+}
+
+int main() {
+  AppConfig cfg;
+  DetectionParams p;
+  p.dbscan = cfg.dbscan;
+  p.prefilter = cfg.prefilter;
+  p.prefilter.enabled = false;   // 点を落とさない（点数をそのまま比べる）
+  p.postfilter = cfg.postfilter;
+  p.voxel = cfg.voxel;
+  p.voxel.enabled = false;
+  p.world_mask = std::make_shared<const core::CompiledWorldMask>(cfg.world_mask, cfg.world_mask.resolution);
+  p.version = 1;
+
+  // 3 m 間隔の人物 4 体。それぞれ 1〜3 台のセンサーが同じ場所を見ている
+  ScanFrame f{};
+  f.t_ns = 1;
+  f.seq = 1;
+  std::mt19937 rng(7);
+  std::normal_distribution<float> noise(0.0f, 0.03f);
+  const std::vector<std::vector<uint8_t>> blob_sensors = {{0}, {0, 1}, {0, 1, 2}, {3, 40}};
+  for (size_t b = 0; b < blob_sensors.size(); ++b) {
+    for (int i = 0; i < 120; ++i) {
+      const float x = 3.0f * static_cast<float>(b) + noise(rng);
+      const float y = 2.0f + noise(rng);
+      f.xy.push_back(x);
+      f.xy.push_back(y);
+      f.sid.push_back(blob_sensors[b][i % blob_sensors[b].size()]);
+      f.dist.push_back(std::hypot(x, y));
+    }
+  }
+
+  DetectionPipeline plain(p);
+  plain.run(f, p, {});
+  const auto ref = summarize("raw", plain.clusters());
+  check(ref.size() == blob_sensors.size(), "expected one cluster per blob", -1);
+
+  DetectionParams pv = p;
+  pv.voxel.enabled = true;
+  pv.voxel.resolution = 0.05f;
+  pv.version = 2;
+  DetectionPipeline voxel(pv);
+  voxel.run(f, pv, {});
+  check(voxel.clusters().indices.size() < f.sid.size(), "voxel stage did not merge any points", -1);
+  compare(ref, summarize("voxel", voxel.clusters()));
+
+  DetectionPipeline degraded(p);
+  DetectionPipeline::Options opt;
+  opt.force_voxel = 0.05f;
+  degraded.run(f, p, opt);
+  compare(ref, summarize("degraded", degraded.clusters()));
+
+  if (g_failures > 0) {
+    std::printf("✗ FAIL: %d check(s) failed\n", g_failures);
+    return 1;
+  }
+  std::printf("✓ PASS: voxel cluster counts match the raw points\n");
+  return 0;
+}
@@ -0,0 +1,44 @@
+#!/bin/bash
+# voxel 有効時のクラスタ点数・センサー別点数・sensor_mask の整合性テスト
+#
+# 検出パイプライン（src/core/detection_pipeline.cpp と src/detect/*）を直接リンクした
+# 小さなテストをビルドして実行する（Crow / urg_c / NNG は不要）。
+#
+#   tests/unit/voxel_sensor_counts_test.sh
+#   CXX=clang++ で別のコンパイラを使う
+
+set -u
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_ROOT="$(cd "$SCRIPT_DIR/../.." && pwd)"
+CXX="${CXX:-c++}"
+WORK_DIR="$(mktemp -d /tmp/hokuyo_hub_voxel_test.XXXXXX)"
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+echo "=== HokuyoHub Voxel Sensor Counts Test ==="
+
+DEPS_FLAGS="$(pkg-config --cflags --libs jsoncpp yaml-cpp 2>/dev/null || echo "-ljsoncpp -lyaml-cpp")"
+SRC="$PROJECT_ROOT/src"
+SOURCES=(
+    "$SCRIPT_DIR/voxel_sensor_counts_test.cpp"
+    "$SRC/core/detection_pipeline.cpp"
+    "$SRC/core/detection_params.cpp"
+    "$SRC/core/alloc_stats.cpp"
+    "$SRC/core/frame_budget.cpp"
+    "$SRC/core/mask.cpp"
+    "$SRC/core/realtime.cpp"
+    "$SRC/core/trace.cpp"
+    "$SRC/core/worker_pool.cpp"
+    "$SRC/config/config.cpp"
+    "$SRC"/detect/*.cpp
+)
+
+# shellcheck disable=SC2086
+if ! "$CXX" -std=c++20 -O2 -I"$SRC" "${SOURCES[@]}" -o "$WORK_DIR/voxel_sensor_counts_test" $DEPS_FLAGS -pthread \
+        > "$WORK_DIR/build.log" 2>&1; then
+    cat "$WORK_DIR/build.log"
+    echo "✗ FAIL: build"
+    exit 1
+fi
+
+"$WORK_DIR/voxel_sensor_counts_test"
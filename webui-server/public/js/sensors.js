@@ -298,6 +298,7 @@ function showAddSensorModal() {
             <label>Sensor Type:</label>
             <select id="sensor-type-select">
               <option value="${SensorTypes.HOKUYO_URG_ETH}">Hokuyo URG Ethernet</option>
+              <option value="${SensorTypes.HOKUYO_URG_ETH_EPOLL}">Hokuyo URG Ethernet (epoll, Linux)</option>
               <option value="${SensorTypes.UNKNOWN}">Unknown</option>
             </select>
           </div>
@@ -359,6 +359,7 @@ function showAddSinkModal() {
             <select id="sink-type-select">
               <option value="${SinkTypes.NNG}">NNG</option>
               <option value="${SinkTypes.OSC}">OSC</option>
+              <option value="${SinkTypes.SHM}">Shared Memory</option>
             </select>
           </div>
           <div class="modal__row">
@@ -436,6 +437,10 @@ function showAddSinkModal() {
       encodingRow.style.display = 'none';
       bundleRow.style.display = 'flex';
       fragmentRow.style.display = 'flex';
+    } else {
+      encodingRow.style.display = 'none';
+      bundleRow.style.display = 'none';
+      fragmentRow.style.display = 'none';
     }
   };
   
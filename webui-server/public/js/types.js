@@ -42,6 +42,7 @@ export const MessageTypes = {
  */
 export const SensorTypes = {
   HOKUYO_URG_ETH: 'hokuyo_urg_eth',
+  HOKUYO_URG_ETH_EPOLL: 'hokuyo_urg_eth_epoll',
   UNKNOWN: 'unknown'
 };
 
@@ -58,7 +59,8 @@ export const SensorModes = {
  */
 export const SinkTypes = {
   NNG: 'nng',
-  OSC: 'osc'
+  OSC: 'osc',
+  SHM: 'shm'
 };
 
 /**
@@ -410,6 +412,8 @@ export function createDefaultSink(type = SinkTypes.NNG) {
   } else if (type === SinkTypes.OSC) {
     base.in_bundle = false;
     base.bundle_fragment_size = 1024;
+  } else if (type === SinkTypes.SHM) {
+    base.url = 'shm://hokuyohub';
   }
   
   return base;